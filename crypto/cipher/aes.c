@@ -1510,12 +1510,13 @@ srtp_err_status_t srtp_aes_expand_decryption_key (const uint8_t *key,
 {
     int i;
     srtp_err_status_t status;
-    int num_rounds = expanded_key->num_rounds;
+    int num_rounds;
 
     status = srtp_aes_expand_encryption_key(key, key_len, expanded_key);
     if (status) {
         return status;
     }
+    num_rounds = expanded_key->num_rounds;
 
     /* invert the order of the round keys */
     for (i = 0; i < num_rounds / 2; i++) {
@@ -2091,9 +2092,357 @@ static inline void aes_inv_final_round (v128_t *state, const v128_t *round_key)
 #endif  /* CPU type */
 
 
+
+/*
+ * constant-time software fallback
+ *
+ * the table-driven implementation above indexes its tables with
+ * secret data, which leaks key material through the data cache on
+ * platforms without hardware AES.  the bitsliced implementation below
+ * computes the S-box algebraically (inversion in GF(2^8) as x^254,
+ * then the affine transform) using only word-wide logic, with no
+ * secret-dependent loads or branches, and processes four blocks in
+ * parallel - a natural fit for the counter mode bulk path, which
+ * always has parallel counter blocks in hand
+ *
+ * representation: q[0..7] hold the 64 bytes of four 16-byte blocks,
+ * one bit plane per word; bit (16k + b) of q[i] is bit i of byte b of
+ * block k
+ */
+
+/* transpose an 8x8 bit matrix held in x (byte m = row m) */
+static inline uint64_t bs_transpose8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+static inline uint64_t bs_le64(const uint8_t *p)
+{
+    uint64_t x;
+    memcpy(&x, p, 8);
+#ifdef WORDS_BIGENDIAN
+    x = __builtin_bswap64(x);
+#endif
+    return x;
+}
+
+
+static void bs_load(uint64_t q[8], const uint8_t in[64])
+{
+    int g, i;
+
+    for (i = 0; i < 8; i++) {
+        q[i] = 0;
+    }
+    for (g = 0; g < 8; g++) {
+        uint64_t x = bs_transpose8(bs_le64(in + 8 * g));
+        for (i = 0; i < 8; i++) {
+            q[i] |= ((x >> (8 * i)) & 0xFF) << (8 * g);
+        }
+    }
+}
+
+static void bs_store(uint8_t out[64], const uint64_t q[8])
+{
+    int g, i;
+
+    for (g = 0; g < 8; g++) {
+        uint64_t x = 0;
+        for (i = 0; i < 8; i++) {
+            x |= ((q[i] >> (8 * g)) & 0xFF) << (8 * i);
+        }
+        x = bs_transpose8(x);
+#ifdef WORDS_BIGENDIAN
+        x = __builtin_bswap64(x);
+#endif
+        memcpy(out + 8 * g, &x, 8);
+    }
+}
+
+/* GF(2^8) multiply, 64 bytes at a time */
+static void bs_gf_mul(uint64_t r[8], const uint64_t a[8], const uint64_t b[8])
+{
+    uint64_t c[15];
+    int i, j, k;
+
+    for (k = 0; k < 15; k++) {
+        c[k] = 0;
+    }
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 8; j++) {
+            c[i + j] ^= a[i] & b[j];
+        }
+    }
+    /* reduce mod x^8 + x^4 + x^3 + x + 1 */
+    for (k = 14; k >= 8; k--) {
+        c[k - 4] ^= c[k];
+        c[k - 5] ^= c[k];
+        c[k - 7] ^= c[k];
+        c[k - 8] ^= c[k];
+    }
+    for (i = 0; i < 8; i++) {
+        r[i] = c[i];
+    }
+}
+
+/* GF(2^8) squaring (linear, so just a fixed xor network) */
+static void bs_gf_sq(uint64_t r[8], const uint64_t a[8])
+{
+    uint64_t b0 = a[0] ^ a[4] ^ a[6];
+    uint64_t b1 = a[4] ^ a[6] ^ a[7];
+    uint64_t b2 = a[1] ^ a[5];
+    uint64_t b3 = a[4] ^ a[5] ^ a[6] ^ a[7];
+    uint64_t b4 = a[2] ^ a[4] ^ a[7];
+    uint64_t b5 = a[5] ^ a[6];
+    uint64_t b6 = a[3] ^ a[5];
+    uint64_t b7 = a[6] ^ a[7];
+
+    r[0] = b0; r[1] = b1; r[2] = b2; r[3] = b3;
+    r[4] = b4; r[5] = b5; r[6] = b6; r[7] = b7;
+}
+
+/* S-box: inversion (x^254) followed by the affine transform */
+static void bs_sub_bytes(uint64_t q[8])
+{
+    uint64_t x2[8], x3[8], x12[8], t[8], s[8];
+    int i;
+
+    bs_gf_sq(x2, q);             /* x^2   */
+    bs_gf_mul(x3, x2, q);        /* x^3   */
+    bs_gf_sq(t, x3);             /* x^6   */
+    bs_gf_sq(x12, t);            /* x^12  */
+    bs_gf_mul(s, x12, x3);       /* x^15  */
+    bs_gf_sq(t, s);              /* x^30  */
+    bs_gf_sq(s, t);              /* x^60  */
+    bs_gf_sq(t, s);              /* x^120 */
+    bs_gf_sq(s, t);              /* x^240 */
+    bs_gf_mul(t, s, x12);        /* x^252 */
+    bs_gf_mul(s, t, x2);         /* x^254 = x^-1 */
+
+    /* affine transform, constant 0x63 */
+    for (i = 0; i < 8; i++) {
+        q[i] = s[i] ^ s[(i + 4) & 7] ^ s[(i + 5) & 7] ^
+               s[(i + 6) & 7] ^ s[(i + 7) & 7];
+    }
+    q[0] = ~q[0];
+    q[1] = ~q[1];
+    q[5] = ~q[5];
+    q[6] = ~q[6];
+}
+
+/* ShiftRows: a fixed permutation of byte positions inside each block */
+static void bs_shift_rows(uint64_t q[8])
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        uint64_t x = q[i];
+        q[i] = (x & 0x1111111111111111ULL) |
+               (((x >> 4) & 0x0222022202220222ULL) |
+                ((x << 12) & 0x2000200020002000ULL)) |
+               (((x >> 8) & 0x0044004400440044ULL) |
+                ((x << 8) & 0x4400440044004400ULL)) |
+               (((x >> 12) & 0x0008000800080008ULL) |
+                ((x << 4) & 0x8880888088808880ULL));
+    }
+}
+
+/* rotate rows within each column: row r takes row (r+1) mod 4 */
+static inline uint64_t bs_rot_row(uint64_t x)
+{
+    return ((x >> 1) & 0x7777777777777777ULL) |
+           ((x << 3) & 0x8888888888888888ULL);
+}
+
+static void bs_mix_columns(uint64_t q[8])
+{
+    uint64_t r1[8], r2[8], r3[8], t[8], x[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        r1[i] = bs_rot_row(q[i]);
+        r2[i] = bs_rot_row(r1[i]);
+        r3[i] = bs_rot_row(r2[i]);
+        t[i] = q[i] ^ r1[i];
+    }
+    /* xtime(t) */
+    x[0] = t[7];
+    x[1] = t[0] ^ t[7];
+    x[2] = t[1];
+    x[3] = t[2] ^ t[7];
+    x[4] = t[3] ^ t[7];
+    x[5] = t[4];
+    x[6] = t[5];
+    x[7] = t[6];
+    for (i = 0; i < 8; i++) {
+        q[i] = x[i] ^ r1[i] ^ r2[i] ^ r3[i];
+    }
+}
+
+/* bitslice one round key, replicated across the four blocks */
+static void bs_load_round_key(uint64_t k[8], const v128_t *rk)
+{
+    uint64_t lo = bs_transpose8(bs_le64(rk->v8));
+    uint64_t hi = bs_transpose8(bs_le64(rk->v8 + 8));
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        uint64_t p = ((lo >> (8 * i)) & 0xFF) | (((hi >> (8 * i)) & 0xFF) << 8);
+        p |= p << 16;
+        p |= p << 32;
+        k[i] = p;
+    }
+}
+
+void srtp_aes_encrypt_ct4(v128_t blocks[4], const srtp_aes_expanded_key_t *exp_key)
+{
+    uint64_t q[8], k[8];
+    int i, r;
+
+    bs_load(q, (const uint8_t *)blocks);
+
+    bs_load_round_key(k, &exp_key->round[0]);
+    for (i = 0; i < 8; i++) {
+        q[i] ^= k[i];
+    }
+
+    for (r = 1; r < exp_key->num_rounds; r++) {
+        bs_sub_bytes(q);
+        bs_shift_rows(q);
+        bs_mix_columns(q);
+        bs_load_round_key(k, &exp_key->round[r]);
+        for (i = 0; i < 8; i++) {
+            q[i] ^= k[i];
+        }
+    }
+    bs_sub_bytes(q);
+    bs_shift_rows(q);
+    bs_load_round_key(k, &exp_key->round[r]);
+    for (i = 0; i < 8; i++) {
+        q[i] ^= k[i];
+    }
+
+    bs_store((uint8_t *)blocks, q);
+}
+
+
+/*
+ * hardware-accelerated AES block encryption
+ *
+ * when the compiler and CPU support it, the block encryption below is
+ * dispatched to the AES instructions (AES-NI on x86, the ARMv8 crypto
+ * extensions on aarch64) instead of the T-table code; the round keys
+ * produced by the key expansion above are stored in standard byte
+ * order, so they can be loaded directly by the hardware instructions
+ *
+ * on x86 the CPU capability is detected at runtime (and cached), so a
+ * single binary runs on CPUs both with and without AES-NI; on aarch64
+ * the crypto extensions are a compile-time target feature
+ */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define AES_HAVE_NI 1
+
+#include <wmmintrin.h>
+
+static int aes_ni_available (void)
+{
+    static int available = -1;
+
+    if (available < 0) {
+        available = __builtin_cpu_supports("aes");
+    }
+    return available;
+}
+
+__attribute__((target("aes,sse2")))
+static void aes_encrypt_ni (v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
+{
+    __m128i state = _mm_loadu_si128((const __m128i *)plaintext->v8);
+    int i;
+
+    state = _mm_xor_si128(state, _mm_loadu_si128((const __m128i *)exp_key->round[0].v8));
+    for (i = 1; i < exp_key->num_rounds; i++) {
+        state = _mm_aesenc_si128(state, _mm_loadu_si128((const __m128i *)exp_key->round[i].v8));
+    }
+    state = _mm_aesenclast_si128(state, _mm_loadu_si128((const __m128i *)exp_key->round[i].v8));
+    _mm_storeu_si128((__m128i *)plaintext->v8, state);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define AES_HAVE_CE 1
+
+#include <arm_neon.h>
+
+static void aes_encrypt_ce (v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
+{
+    uint8x16_t state = vld1q_u8(plaintext->v8);
+    int i;
+
+    for (i = 0; i < exp_key->num_rounds - 1; i++) {
+        state = vaesmcq_u8(vaeseq_u8(state, vld1q_u8(exp_key->round[i].v8)));
+    }
+    state = vaeseq_u8(state, vld1q_u8(exp_key->round[i].v8));
+    state = veorq_u8(state, vld1q_u8(exp_key->round[i + 1].v8));
+    vst1q_u8(plaintext->v8, state);
+}
+
+#endif  /* AES hardware support */
+
+
+int srtp_aes_hardware_accelerated (void)
+{
+#ifdef AES_HAVE_NI
+    return aes_ni_available();
+#elif defined(AES_HAVE_CE)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 void srtp_aes_encrypt (v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
 {
 
+#ifdef AES_HAVE_NI
+    if (aes_ni_available()) {
+        aes_encrypt_ni(plaintext, exp_key);
+        return;
+    }
+#endif
+#ifdef AES_HAVE_CE
+    aes_encrypt_ce(plaintext, exp_key);
+    return;
+#endif
+
+#ifndef SRTP_AES_TTABLE
+    /*
+     * constant-time software path: run the block through the
+     * bitsliced core, with the other three lanes carrying copies.
+     * define SRTP_AES_TTABLE to get the (cache-timing leaky, but
+     * faster) table-driven rounds back
+     */
+    {
+        v128_t blocks[4];
+
+        v128_copy(&blocks[0], plaintext);
+        v128_copy(&blocks[1], plaintext);
+        v128_copy(&blocks[2], plaintext);
+        v128_copy(&blocks[3], plaintext);
+        srtp_aes_encrypt_ct4(blocks, exp_key);
+        v128_copy(plaintext, &blocks[0]);
+        return;
+    }
+#endif
+
     /* add in the subkey */
     v128_xor_eq(plaintext, &exp_key->round[0]);
 
@@ -0,0 +1,991 @@
+/*
+ * aes_gcm.c
+ *
+ * AES Galois Counter Mode, native implementation
+ *
+ * David A. McGrew
+ * Cisco Systems, Inc.
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2013-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * this file provides AES-GCM for builds without OpenSSL, so that
+ * single-pass AEAD is available everywhere: the CTR keystream comes
+ * from the aes.c core (which already dispatches to AES-NI or the
+ * ARMv8 crypto extensions when present), and GHASH is computed with
+ * the PCLMULQDQ carry-less multiply on x86 CPUs that have it, falling
+ * back to a 4-bit table multiply elsewhere
+ *
+ * the cipher is one-shot per packet, matching how the SRTP layer
+ * drives it: set_iv, then one or more set_aad calls (SRTCP supplies
+ * the header and the trailing index separately), then a single
+ * encrypt (or decrypt) call covering the whole payload
+ */
+
+#ifdef HAVE_CONFIG_H
+    #include <config.h>
+#endif
+
+#include "aes_gcm.h"
+#include "alloc.h"
+#include "err.h"                /* for srtp_debug */
+#include "crypto_types.h"
+
+#ifndef NO_64BIT_MATH
+
+srtp_debug_module_t srtp_mod_aes_gcm = {
+    0,               /* debugging is off by default */
+    "aes gcm"        /* printable module name       */
+};
+
+extern const srtp_cipher_type_t srtp_aes_gcm_128;
+extern const srtp_cipher_type_t srtp_aes_gcm_256;
+
+/*
+ * For now we only support 8 and 16 octet tags.  The spec allows for
+ * optional 12 byte tag, which may be supported in the future.
+ */
+#define GCM_AUTH_TAG_LEN    16
+#define GCM_AUTH_TAG_LEN_8  8
+
+#define GCM_IV_LEN          12
+
+/*
+ * GHASH
+ *
+ * GHASH is a polynomial hash over GF(2^128), with the field
+ * represented using the "reflected" bit order fixed by the GCM spec.
+ * the portable path below uses Shoup's 4-bit table method: the key
+ * schedule holds the sixteen low multiples of the hash subkey H, and
+ * each input byte costs two table lookups and two 4-bit reduction
+ * steps.  state and table entries are kept as pairs of 64-bit words
+ * holding the big-endian halves of the 128-bit field elements.
+ */
+
+/* reduction table for the 4-bit shifts: i * (x^4 mod p), as the top
+   16 bits of the 128-bit result */
+static const uint16_t srtp_ghash_last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static uint64_t srtp_ghash_load64 (const uint8_t *p)
+{
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+           ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+           ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+           ((uint64_t)p[6] <<  8) | ((uint64_t)p[7]);
+}
+
+static void srtp_ghash_store64 (uint8_t *p, uint64_t v)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+/*
+ * expands the hash subkey H (the AES encryption of the zero block)
+ * into the table of its sixteen low multiples
+ */
+static void srtp_ghash_key_init (srtp_ghash_key_t *k, const uint8_t h[16])
+{
+    uint64_t vh = srtp_ghash_load64(h);
+    uint64_t vl = srtp_ghash_load64(h + 8);
+    int i, j;
+
+    k->hh[0] = 0;
+    k->hl[0] = 0;
+    k->hh[8] = vh;
+    k->hl[8] = vl;
+
+    /* entries 4, 2, 1 are H multiplied by x, x^2, x^3 */
+    for (i = 4; i > 0; i >>= 1) {
+        uint32_t t = (uint32_t)(vl & 1) * 0xe1000000u;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ ((uint64_t)t << 32);
+        k->hh[i] = vh;
+        k->hl[i] = vl;
+    }
+
+    /* the rest are sums of the powers computed above */
+    for (i = 2; i < 16; i <<= 1) {
+        for (j = 1; j < i; j++) {
+            k->hh[i + j] = k->hh[i] ^ k->hh[j];
+            k->hl[i + j] = k->hl[i] ^ k->hl[j];
+        }
+    }
+}
+
+/*
+ * multiplies the state (zh, zl) by H, using the table; this is the
+ * inner loop of the portable GHASH
+ */
+static void srtp_ghash_mult (const srtp_ghash_key_t *k,
+                             uint64_t *zh_ptr, uint64_t *zl_ptr)
+{
+    uint64_t zh = *zh_ptr, zl = *zl_ptr;
+    uint8_t x[16];
+    uint8_t lo, hi, rem;
+    int i;
+
+    srtp_ghash_store64(x, zh);
+    srtp_ghash_store64(x + 8, zl);
+
+    lo = x[15] & 0xf;
+    zh = k->hh[lo];
+    zl = k->hl[lo];
+
+    for (i = 15; i >= 0; i--) {
+        lo = x[i] & 0xf;
+        hi = (x[i] >> 4) & 0xf;
+
+        if (i != 15) {
+            rem = (uint8_t)(zl & 0xf);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ ((uint64_t)srtp_ghash_last4[rem] << 48);
+            zh ^= k->hh[lo];
+            zl ^= k->hl[lo];
+        }
+
+        rem = (uint8_t)(zl & 0xf);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ ((uint64_t)srtp_ghash_last4[rem] << 48);
+        zh ^= k->hh[hi];
+        zl ^= k->hl[hi];
+    }
+
+    *zh_ptr = zh;
+    *zl_ptr = zl;
+}
+
+/*
+ * x86 fast path: GHASH via the PCLMULQDQ carry-less multiply,
+ * following the standard construction - multiply the 128-bit
+ * operands into a 256-bit product, shift left one bit to account for
+ * the reflected bit order, then fold the high half back with two
+ * shifts-and-xors modulo x^128 + x^7 + x^2 + x + 1.  detected at run
+ * time, like the AES-NI path in aes.c, so a single binary runs on
+ * CPUs with and without the instruction
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define GHASH_HAVE_CLMUL 1
+
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+static int srtp_ghash_clmul_available (void)
+{
+    static int available = -1;
+
+    if (available < 0) {
+        available = __builtin_cpu_supports("pclmul") &&
+                    __builtin_cpu_supports("ssse3");
+    }
+    return available;
+}
+
+__attribute__((target("pclmul,ssse3")))
+static void srtp_ghash_mult_clmul (const uint8_t h[16],
+                                   uint64_t *zh_ptr, uint64_t *zl_ptr)
+{
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                       8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i a, b, t1, t2, t3, t4, t5, t6, t7, t8;
+
+    a = _mm_set_epi64x((long long)*zh_ptr, (long long)*zl_ptr);
+    b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)h), bswap);
+
+    /* 128x128 -> 256 bit carry-less multiply (karatsuba-free form) */
+    t1 = _mm_clmulepi64_si128(a, b, 0x00);
+    t2 = _mm_clmulepi64_si128(a, b, 0x10);
+    t3 = _mm_clmulepi64_si128(a, b, 0x01);
+    t4 = _mm_clmulepi64_si128(a, b, 0x11);
+    t2 = _mm_xor_si128(t2, t3);
+    t3 = _mm_slli_si128(t2, 8);
+    t2 = _mm_srli_si128(t2, 8);
+    t1 = _mm_xor_si128(t1, t3);
+    t4 = _mm_xor_si128(t4, t2);
+
+    /* shift the 256-bit product left by one bit */
+    t5 = _mm_srli_epi32(t1, 31);
+    t6 = _mm_srli_epi32(t4, 31);
+    t1 = _mm_slli_epi32(t1, 1);
+    t4 = _mm_slli_epi32(t4, 1);
+    t7 = _mm_srli_si128(t5, 12);
+    t6 = _mm_slli_si128(t6, 4);
+    t5 = _mm_slli_si128(t5, 4);
+    t1 = _mm_or_si128(t1, t5);
+    t4 = _mm_or_si128(t4, t6);
+    t4 = _mm_or_si128(t4, t7);
+
+    /* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+    t5 = _mm_slli_epi32(t1, 31);
+    t6 = _mm_slli_epi32(t1, 30);
+    t7 = _mm_slli_epi32(t1, 25);
+    t5 = _mm_xor_si128(t5, t6);
+    t5 = _mm_xor_si128(t5, t7);
+    t6 = _mm_srli_si128(t5, 4);
+    t5 = _mm_slli_si128(t5, 12);
+    t1 = _mm_xor_si128(t1, t5);
+    t8 = _mm_srli_epi32(t1, 1);
+    t2 = _mm_srli_epi32(t1, 2);
+    t3 = _mm_srli_epi32(t1, 7);
+    t8 = _mm_xor_si128(t8, t2);
+    t8 = _mm_xor_si128(t8, t3);
+    t8 = _mm_xor_si128(t8, t6);
+    t1 = _mm_xor_si128(t1, t8);
+    t4 = _mm_xor_si128(t4, t1);
+
+    *zl_ptr = (uint64_t)_mm_cvtsi128_si64(t4);
+    *zh_ptr = (uint64_t)_mm_cvtsi128_si64(_mm_srli_si128(t4, 8));
+}
+#endif /* GHASH_HAVE_CLMUL */
+
+/* folds one full 16-octet block into the GHASH state */
+static void srtp_ghash_block (srtp_aes_gcm_ctx_t *c, const uint8_t *block)
+{
+    c->ghash_h ^= srtp_ghash_load64(block);
+    c->ghash_l ^= srtp_ghash_load64(block + 8);
+#ifdef GHASH_HAVE_CLMUL
+    if (srtp_ghash_clmul_available()) {
+        srtp_ghash_mult_clmul(c->h, &c->ghash_h, &c->ghash_l);
+    } else {
+        srtp_ghash_mult(&c->hash_key, &c->ghash_h, &c->ghash_l);
+    }
+#else
+    srtp_ghash_mult(&c->hash_key, &c->ghash_h, &c->ghash_l);
+#endif
+}
+
+/*
+ * folds len octets at data into the GHASH state, zero-padding the
+ * final partial block as the spec requires between the AAD, the
+ * ciphertext, and the length block
+ */
+static void srtp_ghash_update (srtp_aes_gcm_ctx_t *c,
+                               const uint8_t *data, unsigned int len)
+{
+    uint8_t block[16];
+
+    while (len >= 16) {
+        srtp_ghash_block(c, data);
+        data += 16;
+        len -= 16;
+    }
+    if (len > 0) {
+        memset(block, 0, 16);
+        memcpy(block, data, len);
+        srtp_ghash_block(c, block);
+    }
+}
+
+/*
+ * closes out the AAD phase: any AAD octets short of a block are
+ * zero-padded and hashed, so the ciphertext starts on a block
+ * boundary as the spec requires
+ */
+static void srtp_ghash_flush_aad (srtp_aes_gcm_ctx_t *c)
+{
+    if (c->aad_part_len > 0) {
+        memset(c->aad_part + c->aad_part_len, 0, 16 - c->aad_part_len);
+        srtp_ghash_block(c, c->aad_part);
+        c->aad_part_len = 0;
+    }
+}
+
+/*
+ * CTR mode for the payload: GCM increments only the low 32 bits of
+ * the counter block, big-endian
+ */
+static void srtp_aes_gcm_inc32 (v128_t *counter)
+{
+    int i;
+
+    for (i = 15; i >= 12; i--) {
+        if (++counter->v8[i] != 0) {
+            break;
+        }
+    }
+}
+
+static void srtp_aes_gcm_ctr_transform (srtp_aes_gcm_ctx_t *c,
+                                        uint8_t *buf, unsigned int len)
+{
+    v128_t blocks[4];
+    unsigned int i;
+
+    /* four blocks at a time: the hardware AES pipelines the four
+       independent counters, and the bitsliced software core runs at
+       full width */
+    while (len >= 64) {
+        for (i = 0; i < 4; i++) {
+            v128_copy(&blocks[i], &c->counter);
+            srtp_aes_gcm_inc32(&c->counter);
+        }
+        if (srtp_aes_hardware_accelerated()) {
+            srtp_aes_encrypt(&blocks[0], &c->expanded_key);
+            srtp_aes_encrypt(&blocks[1], &c->expanded_key);
+            srtp_aes_encrypt(&blocks[2], &c->expanded_key);
+            srtp_aes_encrypt(&blocks[3], &c->expanded_key);
+        } else {
+            srtp_aes_encrypt_ct4(blocks, &c->expanded_key);
+        }
+        for (i = 0; i < 64; i++) {
+            buf[i] ^= blocks[i >> 4].v8[i & 15];
+        }
+        buf += 64;
+        len -= 64;
+    }
+
+    while (len > 0) {
+        unsigned int n = (len < 16) ? len : 16;
+
+        v128_copy(&blocks[0], &c->counter);
+        srtp_aes_gcm_inc32(&c->counter);
+        srtp_aes_encrypt(&blocks[0], &c->expanded_key);
+        for (i = 0; i < n; i++) {
+            buf[i] ^= blocks[0].v8[i];
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/*
+ * finishes GHASH with the length block and xors in E(K, J0),
+ * producing the full 16-octet tag
+ */
+static void srtp_aes_gcm_compute_tag (srtp_aes_gcm_ctx_t *c, uint8_t tag[16])
+{
+    uint8_t len_block[16];
+    v128_t ekj0;
+    int i;
+
+    srtp_ghash_flush_aad(c);
+
+    srtp_ghash_store64(len_block, c->aad_octets * 8);
+    srtp_ghash_store64(len_block + 8, c->text_octets * 8);
+    srtp_ghash_update(c, len_block, 16);
+
+    v128_copy(&ekj0, &c->j0);
+    srtp_aes_encrypt(&ekj0, &c->expanded_key);
+
+    srtp_ghash_store64(tag, c->ghash_h);
+    srtp_ghash_store64(tag + 8, c->ghash_l);
+    for (i = 0; i < 16; i++) {
+        tag[i] ^= ekj0.v8[i];
+    }
+}
+
+/*
+ * This function allocates a new instance of this crypto engine.
+ * The key_len parameter should be one of 28 or 44 for
+ * AES-128-GCM or AES-256-GCM respectively.  Note that the
+ * key length includes the 14 byte salt value that is used when
+ * initializing the KDF.
+ */
+static srtp_err_status_t srtp_aes_gcm_place (srtp_cipher_t *c, void *state, int key_len, int tlen)
+{
+    srtp_aes_gcm_ctx_t *gcm = (srtp_aes_gcm_ctx_t *)state;
+
+    debug_print(srtp_mod_aes_gcm, "placing cipher with key length %d", key_len);
+
+    /*
+     * Verify the key_len is valid for one of: AES-128/256
+     */
+    if (key_len != SRTP_AES_GCM_128_KEY_LEN_WSALT &&
+        key_len != SRTP_AES_GCM_256_KEY_LEN_WSALT) {
+        return (srtp_err_status_bad_param);
+    }
+
+    if (tlen != GCM_AUTH_TAG_LEN &&
+        tlen != GCM_AUTH_TAG_LEN_8) {
+        return (srtp_err_status_bad_param);
+    }
+
+    memset(c, 0x0, sizeof(srtp_cipher_t));
+    memset(gcm, 0x0, sizeof(srtp_aes_gcm_ctx_t));
+
+    /* set pointers */
+    c->state = gcm;
+
+    /* setup cipher attributes */
+    switch (key_len) {
+    case SRTP_AES_GCM_128_KEY_LEN_WSALT:
+        c->type = &srtp_aes_gcm_128;
+        c->algorithm = SRTP_AES_GCM_128;
+        gcm->key_size = SRTP_AES_128_KEY_LEN;
+        gcm->tag_len = tlen;
+        break;
+    case SRTP_AES_GCM_256_KEY_LEN_WSALT:
+        c->type = &srtp_aes_gcm_256;
+        c->algorithm = SRTP_AES_GCM_256;
+        gcm->key_size = SRTP_AES_256_KEY_LEN;
+        gcm->tag_len = tlen;
+        break;
+    }
+
+    /* set key size        */
+    c->key_len = key_len;
+
+    return (srtp_err_status_ok);
+}
+
+static srtp_err_status_t srtp_aes_gcm_alloc (srtp_cipher_t **c, int key_len, int tlen)
+{
+    srtp_aes_gcm_ctx_t *gcm;
+    srtp_err_status_t status;
+
+    debug_print(srtp_mod_aes_gcm, "allocating cipher with key length %d", key_len);
+    debug_print(srtp_mod_aes_gcm, "allocating cipher with tag length %d", tlen);
+
+    /* allocate memory a cipher of type aes_gcm */
+    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
+    if (*c == NULL) {
+        return (srtp_err_status_alloc_fail);
+    }
+
+    gcm = (srtp_aes_gcm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_gcm_ctx_t));
+    if (gcm == NULL) {
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return (srtp_err_status_alloc_fail);
+    }
+
+    status = srtp_aes_gcm_place(*c, gcm, key_len, tlen);
+    if (status) {
+        srtp_crypto_free(gcm);
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return status;
+    }
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function deallocates a GCM session
+ */
+static srtp_err_status_t srtp_aes_gcm_dealloc (srtp_cipher_t *c)
+{
+    srtp_aes_gcm_ctx_t *ctx;
+
+    ctx = (srtp_aes_gcm_ctx_t *)c->state;
+    if (ctx) {
+        /* zeroize the key material */
+        octet_string_set_to_zero(ctx, sizeof(srtp_aes_gcm_ctx_t));
+        srtp_crypto_free(ctx);
+    }
+
+    /* free memory */
+    srtp_crypto_free(c);
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_gcm_context_init(...) initializes the aes_gcm_context
+ * using the value in key[]: the AES key schedule is expanded and the
+ * GHASH subkey H = E(K, 0^128) is derived and tabulated
+ */
+static srtp_err_status_t srtp_aes_gcm_context_init (void *cv, const uint8_t *key)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    srtp_err_status_t status;
+    v128_t h;
+
+    c->dir = srtp_direction_any;
+
+    debug_print(srtp_mod_aes_gcm, "key:  %s",
+                srtp_octet_string_hex_string(key, c->key_size));
+
+    switch (c->key_size) {
+    case SRTP_AES_256_KEY_LEN:
+    case SRTP_AES_128_KEY_LEN:
+        break;
+    default:
+        return (srtp_err_status_bad_param);
+    }
+
+    status = srtp_aes_expand_encryption_key(key, c->key_size,
+                                            &c->expanded_key);
+    if (status) {
+        return (status);
+    }
+
+    /* the hash subkey is the encryption of the zero block */
+    v128_set_to_zero(&h);
+    srtp_aes_encrypt(&h, &c->expanded_key);
+    memcpy(c->h, h.v8, 16);
+    srtp_ghash_key_init(&c->hash_key, c->h);
+    octet_string_set_to_zero(&h, sizeof(h));
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * aes_gcm_set_iv(c, iv) establishes the 12-octet IV for one packet
+ * and resets the GHASH and counter state
+ */
+static srtp_err_status_t srtp_aes_gcm_set_iv (void *cv, uint8_t *iv, srtp_cipher_direction_t direction)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    if (direction != srtp_direction_encrypt && direction != srtp_direction_decrypt) {
+        return (srtp_err_status_bad_param);
+    }
+    c->dir = direction;
+
+    debug_print(srtp_mod_aes_gcm, "setting iv: %s", v128_hex_string((v128_t *)iv));
+
+    /* J0 = IV || 0^31 || 1, since the IV is always 96 bits */
+    memcpy(c->j0.v8, iv, GCM_IV_LEN);
+    c->j0.v8[12] = 0;
+    c->j0.v8[13] = 0;
+    c->j0.v8[14] = 0;
+    c->j0.v8[15] = 1;
+
+    /* the payload counter starts one past J0 */
+    v128_copy(&c->counter, &c->j0);
+    srtp_aes_gcm_inc32(&c->counter);
+
+    c->ghash_h = 0;
+    c->ghash_l = 0;
+    c->aad_octets = 0;
+    c->aad_part_len = 0;
+    c->text_octets = 0;
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function processes the AAD
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	aad	Additional data to process for AEAD cipher suites
+ *	aad_len	length of aad buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_set_aad (void *cv, const uint8_t *aad, uint32_t aad_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    debug_print(srtp_mod_aes_gcm, "setting AAD: %s",
+                srtp_octet_string_hex_string(aad, aad_len));
+
+    /*
+     * the AAD can arrive in several calls (SRTCP passes the header
+     * and the trailing index separately), so octets short of a block
+     * are carried in aad_part until more AAD arrives or the text
+     * phase begins; only then is the padding applied
+     */
+    c->aad_octets += aad_len;
+    if (c->aad_part_len > 0) {
+        unsigned int n = 16 - c->aad_part_len;
+
+        if (n > aad_len) {
+            n = aad_len;
+        }
+        memcpy(c->aad_part + c->aad_part_len, aad, n);
+        c->aad_part_len += n;
+        aad += n;
+        aad_len -= n;
+        if (c->aad_part_len == 16) {
+            srtp_ghash_block(c, c->aad_part);
+            c->aad_part_len = 0;
+        }
+    }
+    while (aad_len >= 16) {
+        srtp_ghash_block(c, aad);
+        aad += 16;
+        aad_len -= 16;
+    }
+    if (aad_len > 0) {
+        memcpy(c->aad_part, aad, aad_len);
+        c->aad_part_len = aad_len;
+    }
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function encrypts a buffer using AES GCM mode
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to encrypt
+ *	enc_len	length of encrypt buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_encrypt (void *cv, unsigned char *buf, unsigned int *enc_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+
+    if (c->dir != srtp_direction_encrypt && c->dir != srtp_direction_decrypt) {
+        return (srtp_err_status_bad_param);
+    }
+
+    srtp_ghash_flush_aad(c);
+
+    /* encrypt, then fold the ciphertext into the hash */
+    srtp_aes_gcm_ctr_transform(c, buf, *enc_len);
+    srtp_ghash_update(c, buf, *enc_len);
+    c->text_octets += *enc_len;
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function calculates and returns the GCM tag for a given context.
+ * This should be called after encrypting the data.  The *len value
+ * is increased by the tag size.  The caller must ensure that *buf has
+ * enough room to accept the appended tag.
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to encrypt
+ *	len	length of encrypt buffer
+ */
+static srtp_err_status_t srtp_aes_gcm_get_tag (void *cv, uint8_t *buf, uint32_t *len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    uint8_t tag[16];
+
+    srtp_aes_gcm_compute_tag(c, tag);
+    memcpy(buf, tag, c->tag_len);
+    *len = c->tag_len;
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function decrypts a buffer using AES GCM mode
+ *
+ * Parameters:
+ *	c	Crypto context
+ *	buf	data to decrypt; the tag occupies its final octets
+ *	enc_len	length of encrypt buffer, including the tag
+ */
+static srtp_err_status_t srtp_aes_gcm_decrypt (void *cv, unsigned char *buf, unsigned int *enc_len)
+{
+    srtp_aes_gcm_ctx_t *c = (srtp_aes_gcm_ctx_t *)cv;
+    uint8_t tag[16];
+    unsigned int payload_len;
+
+    if (c->dir != srtp_direction_encrypt && c->dir != srtp_direction_decrypt) {
+        return (srtp_err_status_bad_param);
+    }
+    if (*enc_len < (unsigned int)c->tag_len) {
+        return (srtp_err_status_bad_param);
+    }
+    payload_len = *enc_len - c->tag_len;
+
+    srtp_ghash_flush_aad(c);
+
+    /* hash the ciphertext, then decrypt it in place */
+    srtp_ghash_update(c, buf, payload_len);
+    c->text_octets += payload_len;
+    srtp_aes_gcm_ctr_transform(c, buf, payload_len);
+
+    /*
+     * check the tag; on a mismatch, zeroize the decrypted payload so
+     * that unauthenticated plaintext is never handed back
+     */
+    srtp_aes_gcm_compute_tag(c, tag);
+    if (octet_string_is_eq(tag, buf + payload_len, c->tag_len)) {
+        octet_string_set_to_zero(buf, payload_len);
+        return (srtp_err_status_auth_fail);
+    }
+
+    /*
+     * Reduce the buffer size by the tag length since the tag
+     * is not part of the original payload
+     */
+    *enc_len -= c->tag_len;
+
+    return (srtp_err_status_ok);
+}
+
+/*
+ * This function runs one complete AEAD operation - IV setup, AAD,
+ * payload transform and tag - in a single call.  The phases are the
+ * same static functions the discrete entry points use; fusing them
+ * here lets the compiler keep the context hot across the phases and
+ * costs the caller one indirect call instead of four
+ *
+ * Parameters:
+ *	c	  Crypto context
+ *	iv	  12-octet IV for this packet
+ *	direction encrypt or decrypt
+ *	aad	  additional authenticated data
+ *	aad_len	  length of aad buffer
+ *	buf	  data to transform in place
+ *	len	  on entry the plaintext length (encrypt) or the
+ *		  ciphertext-plus-tag length (decrypt); updated to the
+ *		  output length, with the tag appended on encrypt
+ */
+static srtp_err_status_t srtp_aes_gcm_aead (void *cv, uint8_t *iv, srtp_cipher_direction_t direction, const uint8_t *aad, uint32_t aad_len, unsigned char *buf, unsigned int *len)
+{
+    srtp_err_status_t status;
+
+    status = srtp_aes_gcm_set_iv(cv, iv, direction);
+    if (status) {
+        return (status);
+    }
+    status = srtp_aes_gcm_set_aad(cv, aad, aad_len);
+    if (status) {
+        return (status);
+    }
+    if (direction == srtp_direction_encrypt) {
+        uint32_t tag_len;
+
+        status = srtp_aes_gcm_encrypt(cv, buf, len);
+        if (status) {
+            return (status);
+        }
+        status = srtp_aes_gcm_get_tag(cv, buf + *len, &tag_len);
+        if (status) {
+            return (status);
+        }
+        *len += tag_len;
+        return (srtp_err_status_ok);
+    }
+    return srtp_aes_gcm_decrypt(cv, buf, len);
+}
+
+/*
+ * Name of this crypto engine
+ */
+static const char srtp_aes_gcm_128_description[] = "AES-128 GCM";
+static const char srtp_aes_gcm_256_description[] = "AES-256 GCM";
+
+/*
+ * KAT values for AES self-test.  These
+ * values we're derived from independent test code
+ * using OpenSSL.
+ */
+static const uint8_t srtp_aes_gcm_test_case_0_key[SRTP_AES_GCM_128_KEY_LEN_WSALT] = {
+    0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
+    0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0a, 0x0b, 0x0c,
+};
+
+static uint8_t srtp_aes_gcm_test_case_0_iv[12] = {
+    0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad,
+    0xde, 0xca, 0xf8, 0x88
+};
+
+static const uint8_t srtp_aes_gcm_test_case_0_plaintext[60] =  {
+    0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5,
+    0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+    0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda,
+    0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+    0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53,
+    0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+    0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57,
+    0xba, 0x63, 0x7b, 0x39
+};
+
+static const uint8_t srtp_aes_gcm_test_case_0_aad[20] = {
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xab, 0xad, 0xda, 0xd2
+};
+
+static const uint8_t srtp_aes_gcm_test_case_0_ciphertext[76] = {
+    0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24,
+    0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+    0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0,
+    0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+    0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c,
+    0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+    0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97,
+    0x3d, 0x58, 0xe0, 0x91,
+    /* the last 16 bytes are the tag */
+    0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb,
+    0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47,
+};
+
+static const srtp_cipher_test_case_t srtp_aes_gcm_test_case_0a = {
+    SRTP_AES_GCM_128_KEY_LEN_WSALT,      /* octets in key            */
+    srtp_aes_gcm_test_case_0_key,        /* key                      */
+    srtp_aes_gcm_test_case_0_iv,         /* packet index             */
+    60,                                  /* octets in plaintext      */
+    srtp_aes_gcm_test_case_0_plaintext,  /* plaintext                */
+    68,                                  /* octets in ciphertext     */
+    srtp_aes_gcm_test_case_0_ciphertext, /* ciphertext  + tag        */
+    20,                                  /* octets in AAD            */
+    srtp_aes_gcm_test_case_0_aad,        /* AAD                      */
+    GCM_AUTH_TAG_LEN_8,
+    NULL                                 /* pointer to next testcase */
+};
+
+static const srtp_cipher_test_case_t srtp_aes_gcm_test_case_0 = {
+    SRTP_AES_GCM_128_KEY_LEN_WSALT,      /* octets in key            */
+    srtp_aes_gcm_test_case_0_key,        /* key                      */
+    srtp_aes_gcm_test_case_0_iv,         /* packet index             */
+    60,                                  /* octets in plaintext      */
+    srtp_aes_gcm_test_case_0_plaintext,  /* plaintext                */
+    76,                                  /* octets in ciphertext     */
+    srtp_aes_gcm_test_case_0_ciphertext, /* ciphertext  + tag        */
+    20,                                  /* octets in AAD            */
+    srtp_aes_gcm_test_case_0_aad,        /* AAD                      */
+    GCM_AUTH_TAG_LEN,
+    &srtp_aes_gcm_test_case_0a           /* pointer to next testcase */
+};
+
+static const uint8_t srtp_aes_gcm_test_case_1_key[SRTP_AES_GCM_256_KEY_LEN_WSALT] = {
+    0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c,
+    0xa5, 0x59, 0x09, 0xc5, 0x54, 0x66, 0x93, 0x1c,
+    0xaf, 0xf5, 0x26, 0x9a, 0x21, 0xd5, 0x14, 0xb2,
+    0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08,
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0a, 0x0b, 0x0c,
+
+};
+
+static uint8_t srtp_aes_gcm_test_case_1_iv[12] = {
+    0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad,
+    0xde, 0xca, 0xf8, 0x88
+};
+
+static const uint8_t srtp_aes_gcm_test_case_1_plaintext[60] =  {
+    0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5,
+    0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+    0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda,
+    0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+    0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53,
+    0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+    0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57,
+    0xba, 0x63, 0x7b, 0x39
+};
+
+static const uint8_t srtp_aes_gcm_test_case_1_aad[20] = {
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+    0xab, 0xad, 0xda, 0xd2
+};
+
+static const uint8_t srtp_aes_gcm_test_case_1_ciphertext[76] = {
+    0x0b, 0x11, 0xcf, 0xaf, 0x68, 0x4d, 0xae, 0x46,
+    0xc7, 0x90, 0xb8, 0x8e, 0xb7, 0x6a, 0x76, 0x2a,
+    0x94, 0x82, 0xca, 0xab, 0x3e, 0x39, 0xd7, 0x86,
+    0x1b, 0xc7, 0x93, 0xed, 0x75, 0x7f, 0x23, 0x5a,
+    0xda, 0xfd, 0xd3, 0xe2, 0x0e, 0x80, 0x87, 0xa9,
+    0x6d, 0xd7, 0xe2, 0x6a, 0x7d, 0x5f, 0xb4, 0x80,
+    0xef, 0xef, 0xc5, 0x29, 0x12, 0xd1, 0xaa, 0x10,
+    0x09, 0xc9, 0x86, 0xc1,
+    /* the last 16 bytes are the tag */
+    0x45, 0xbc, 0x03, 0xe6, 0xe1, 0xac, 0x0a, 0x9f,
+    0x81, 0xcb, 0x8e, 0x5b, 0x46, 0x65, 0x63, 0x1d,
+};
+
+static const srtp_cipher_test_case_t srtp_aes_gcm_test_case_1a = {
+    SRTP_AES_GCM_256_KEY_LEN_WSALT,      /* octets in key            */
+    srtp_aes_gcm_test_case_1_key,        /* key                      */
+    srtp_aes_gcm_test_case_1_iv,         /* packet index             */
+    60,                                  /* octets in plaintext      */
+    srtp_aes_gcm_test_case_1_plaintext,  /* plaintext                */
+    68,                                  /* octets in ciphertext     */
+    srtp_aes_gcm_test_case_1_ciphertext, /* ciphertext  + tag        */
+    20,                                  /* octets in AAD            */
+    srtp_aes_gcm_test_case_1_aad,        /* AAD                      */
+    GCM_AUTH_TAG_LEN_8,
+    NULL                                 /* pointer to next testcase */
+};
+
+static const srtp_cipher_test_case_t srtp_aes_gcm_test_case_1 = {
+    SRTP_AES_GCM_256_KEY_LEN_WSALT,      /* octets in key            */
+    srtp_aes_gcm_test_case_1_key,        /* key                      */
+    srtp_aes_gcm_test_case_1_iv,         /* packet index             */
+    60,                                  /* octets in plaintext      */
+    srtp_aes_gcm_test_case_1_plaintext,  /* plaintext                */
+    76,                                  /* octets in ciphertext     */
+    srtp_aes_gcm_test_case_1_ciphertext, /* ciphertext  + tag        */
+    20,                                  /* octets in AAD            */
+    srtp_aes_gcm_test_case_1_aad,        /* AAD                      */
+    GCM_AUTH_TAG_LEN,
+    &srtp_aes_gcm_test_case_1a           /* pointer to next testcase */
+};
+
+/*
+ * This is the vector function table for this crypto engine.
+ */
+const srtp_cipher_type_t srtp_aes_gcm_128 = {
+    srtp_aes_gcm_alloc,
+    srtp_aes_gcm_dealloc,
+    srtp_aes_gcm_context_init,
+    srtp_aes_gcm_set_aad,
+    srtp_aes_gcm_encrypt,
+    srtp_aes_gcm_decrypt,
+    srtp_aes_gcm_set_iv,
+    srtp_aes_gcm_get_tag,
+    srtp_aes_gcm_128_description,
+    &srtp_aes_gcm_test_case_0,
+    SRTP_AES_GCM_128,
+    srtp_aes_gcm_place,
+    sizeof(srtp_aes_gcm_ctx_t),
+    srtp_aes_gcm_aead
+};
+
+/*
+ * This is the vector function table for this crypto engine.
+ */
+const srtp_cipher_type_t srtp_aes_gcm_256 = {
+    srtp_aes_gcm_alloc,
+    srtp_aes_gcm_dealloc,
+    srtp_aes_gcm_context_init,
+    srtp_aes_gcm_set_aad,
+    srtp_aes_gcm_encrypt,
+    srtp_aes_gcm_decrypt,
+    srtp_aes_gcm_set_iv,
+    srtp_aes_gcm_get_tag,
+    srtp_aes_gcm_256_description,
+    &srtp_aes_gcm_test_case_1,
+    SRTP_AES_GCM_256,
+    srtp_aes_gcm_place,
+    sizeof(srtp_aes_gcm_ctx_t),
+    srtp_aes_gcm_aead
+};
+
+#endif /* !NO_64BIT_MATH */
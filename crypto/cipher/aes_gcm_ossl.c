@@ -75,6 +75,40 @@ extern const srtp_cipher_type_t srtp_aes_gcm_256_openssl;
 #define GCM_AUTH_TAG_LEN    16
 #define GCM_AUTH_TAG_LEN_8  8
 
+/*
+ * Under OpenSSL 3, the convenience ciphers returned by
+ * EVP_aes_*_gcm() cause an implicit provider fetch (with the
+ * associated locking) whenever they are handed to
+ * EVP_CipherInit_ex().  Fetch each algorithm once and hand the
+ * cached handle to every context instead; the first use happens
+ * inside the cipher self-tests run from srtp_init(), before any
+ * packet traffic, and the handles live for the life of the process.
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static EVP_CIPHER *srtp_evp_fetched_aes_128_gcm = NULL;
+static EVP_CIPHER *srtp_evp_fetched_aes_256_gcm = NULL;
+
+static const EVP_CIPHER *srtp_evp_aes_gcm (int key_size)
+{
+    if (key_size == SRTP_AES_256_KEY_LEN) {
+        if (srtp_evp_fetched_aes_256_gcm == NULL) {
+            srtp_evp_fetched_aes_256_gcm =
+                EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+        }
+        return srtp_evp_fetched_aes_256_gcm;
+    }
+    if (srtp_evp_fetched_aes_128_gcm == NULL) {
+        srtp_evp_fetched_aes_128_gcm =
+            EVP_CIPHER_fetch(NULL, "AES-128-GCM", NULL);
+    }
+    return srtp_evp_fetched_aes_128_gcm;
+}
+#else
+#define srtp_evp_aes_gcm(key_size)                    \
+    ((key_size) == SRTP_AES_256_KEY_LEN ? EVP_aes_256_gcm() \
+                                        : EVP_aes_128_gcm())
+#endif
+
 
 /*
  * This function allocates a new instance of this crypto engine.
@@ -190,10 +224,8 @@ static srtp_err_status_t srtp_aes_gcm_openssl_context_init (void* cv, const uint
 
     switch (c->key_size) {
     case SRTP_AES_256_KEY_LEN:
-        evp = EVP_aes_256_gcm();
-        break;
     case SRTP_AES_128_KEY_LEN:
-        evp = EVP_aes_128_gcm();
+        evp = srtp_evp_aes_gcm(c->key_size);
         break;
     default:
         return (srtp_err_status_bad_param);
@@ -204,6 +236,14 @@ static srtp_err_status_t srtp_aes_gcm_openssl_context_init (void* cv, const uint
         return (srtp_err_status_init_fail);
     }
 
+    /*
+     * the IV length never changes, so set it here, once per key,
+     * rather than on every packet
+     */
+    if (!EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_SET_IVLEN, 12, 0)) {
+        return (srtp_err_status_init_fail);
+    }
+
     return (srtp_err_status_ok);
 }
 
@@ -223,19 +263,13 @@ static srtp_err_status_t srtp_aes_gcm_openssl_set_iv (void *cv, uint8_t *iv, srt
 
     debug_print(srtp_mod_aes_gcm, "setting iv: %s", v128_hex_string((v128_t*)iv));
 
+    /*
+     * re-key-free re-init: passing a NULL cipher keeps the cached key
+     * schedule and the IV length set at context_init time, so the only
+     * per-packet work is the direction flip and the IV load
+     */
     if (!EVP_CipherInit_ex(c->ctx, NULL, NULL, NULL,
-                           NULL, (c->dir == srtp_direction_encrypt ? 1 : 0))) {
-        return (srtp_err_status_init_fail);
-    }
-
-    /* set IV len  and the IV value, the followiong 3 calls are required */
-    if (!EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_SET_IVLEN, 12, 0)) {
-        return (srtp_err_status_init_fail);
-    }
-    if (!EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_SET_IV_FIXED, -1, (void*)iv)) {
-        return (srtp_err_status_init_fail);
-    }
-    if (!EVP_CIPHER_CTX_ctrl(c->ctx, EVP_CTRL_GCM_IV_GEN, 0, (void*)iv)) {
+                           iv, (c->dir == srtp_direction_encrypt ? 1 : 0))) {
         return (srtp_err_status_init_fail);
     }
 
@@ -372,7 +406,51 @@ static srtp_err_status_t srtp_aes_gcm_openssl_decrypt (void *cv, unsigned char *
     return (srtp_err_status_ok);
 }
 
+/*
+ * This function runs one complete AEAD operation - IV setup, AAD,
+ * payload transform and tag - in a single call, so that a short
+ * packet costs one crossing of the cipher interface instead of the
+ * four discrete set_iv/set_aad/encrypt/get_tag calls
+ *
+ * Parameters:
+ *	c	  Crypto context
+ *	iv	  12-octet IV for this packet
+ *	direction encrypt or decrypt
+ *	aad	  additional authenticated data
+ *	aad_len	  length of aad buffer
+ *	buf	  data to transform in place
+ *	len	  on entry the plaintext length (encrypt) or the
+ *		  ciphertext-plus-tag length (decrypt); updated to the
+ *		  output length, with the tag appended on encrypt
+ */
+static srtp_err_status_t srtp_aes_gcm_openssl_aead (void *cv, uint8_t *iv, srtp_cipher_direction_t direction, const uint8_t *aad, uint32_t aad_len, unsigned char *buf, unsigned int *len)
+{
+    srtp_err_status_t status;
 
+    status = srtp_aes_gcm_openssl_set_iv(cv, iv, direction);
+    if (status) {
+        return (status);
+    }
+    status = srtp_aes_gcm_openssl_set_aad(cv, aad, aad_len);
+    if (status) {
+        return (status);
+    }
+    if (direction == srtp_direction_encrypt) {
+        uint32_t tag_len;
+
+        status = srtp_aes_gcm_openssl_encrypt(cv, buf, len);
+        if (status) {
+            return (status);
+        }
+        status = srtp_aes_gcm_openssl_get_tag(cv, buf + *len, &tag_len);
+        if (status) {
+            return (status);
+        }
+        *len += tag_len;
+        return (srtp_err_status_ok);
+    }
+    return srtp_aes_gcm_openssl_decrypt(cv, buf, len);
+}
 
 /*
  * Name of this crypto engine
@@ -545,7 +623,10 @@ const srtp_cipher_type_t srtp_aes_gcm_128_openssl = {
     srtp_aes_gcm_openssl_get_tag,
     srtp_aes_gcm_128_openssl_description,
     &srtp_aes_gcm_test_case_0,
-    SRTP_AES_GCM_128
+    SRTP_AES_GCM_128,
+    NULL,                        /* place: EVP contexts cannot be placed */
+    0,
+    srtp_aes_gcm_openssl_aead
 };
 
 /*
@@ -562,6 +643,9 @@ const srtp_cipher_type_t srtp_aes_gcm_256_openssl = {
     srtp_aes_gcm_openssl_get_tag,
     srtp_aes_gcm_256_openssl_description,
     &srtp_aes_gcm_test_case_1,
-    SRTP_AES_GCM_256
+    SRTP_AES_GCM_256,
+    NULL,                        /* place: EVP contexts cannot be placed */
+    0,
+    srtp_aes_gcm_openssl_aead
 };
 
@@ -94,12 +94,12 @@ extern const srtp_cipher_type_t srtp_aes_icm_256;
  *
  */
 
-static srtp_err_status_t srtp_aes_icm_alloc (srtp_cipher_t **c, int key_len, int tlen)
+static srtp_err_status_t srtp_aes_icm_place (srtp_cipher_t *c, void *state, int key_len, int tlen)
 {
-    srtp_aes_icm_ctx_t *icm;
+    srtp_aes_icm_ctx_t *icm = (srtp_aes_icm_ctx_t *)state;
 
     debug_print(srtp_mod_aes_icm,
-                "allocating cipher with key length %d", key_len);
+                "placing cipher with key length %d", key_len);
 
     /*
      * The check for key_len = 30/46 does not apply. Our usage
@@ -111,37 +111,58 @@ static srtp_err_status_t srtp_aes_icm_alloc (srtp_cipher_t **c, int key_len, int
         return srtp_err_status_bad_param;
     }
 
-    /* allocate memory a cipher of type aes_icm */
-    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
-    if (*c == NULL) {
-        return srtp_err_status_alloc_fail;
-    }
-    memset(*c, 0x0, sizeof(srtp_cipher_t));
-
-    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_icm_ctx_t));
-    if (icm == NULL) {
-	srtp_crypto_free(*c);
-        return srtp_err_status_alloc_fail;
-    }
+    memset(c, 0x0, sizeof(srtp_cipher_t));
     memset(icm, 0x0, sizeof(srtp_aes_icm_ctx_t));
 
     /* set pointers */
-    (*c)->state = icm;
+    c->state = icm;
 
     switch (key_len) {
     case SRTP_AES_ICM_256_KEY_LEN_WSALT:
-        (*c)->algorithm = SRTP_AES_ICM_256;
-        (*c)->type = &srtp_aes_icm_256;
+        c->algorithm = SRTP_AES_ICM_256;
+        c->type = &srtp_aes_icm_256;
         break;
     default:
-        (*c)->algorithm = SRTP_AES_ICM_128;
-        (*c)->type = &srtp_aes_icm_128;
+        c->algorithm = SRTP_AES_ICM_128;
+        c->type = &srtp_aes_icm_128;
         break;
     }
 
     /* set key size        */
     icm->key_size = key_len;
-    (*c)->key_len = key_len;
+    c->key_len = key_len;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_aes_icm_alloc (srtp_cipher_t **c, int key_len, int tlen)
+{
+    srtp_aes_icm_ctx_t *icm;
+    srtp_err_status_t status;
+
+    debug_print(srtp_mod_aes_icm,
+                "allocating cipher with key length %d", key_len);
+
+    /* allocate memory a cipher of type aes_icm */
+    *c = (srtp_cipher_t *)srtp_crypto_alloc(sizeof(srtp_cipher_t));
+    if (*c == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_icm_ctx_t));
+    if (icm == NULL) {
+	srtp_crypto_free(*c);
+        *c = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    status = srtp_aes_icm_place(*c, icm, key_len, tlen);
+    if (status) {
+        srtp_crypto_free(icm);
+        srtp_crypto_free(*c);
+        *c = NULL;
+        return status;
+    }
 
     return srtp_err_status_ok;
 }
@@ -178,9 +199,9 @@ static srtp_err_status_t srtp_aes_icm_dealloc (srtp_cipher_t *c)
  * randomizes the starting point in the keystream
  */
 
-static srtp_err_status_t srtp_aes_icm_context_init (void *cv, const uint8_t *key)
+static srtp_err_status_t srtp_aes_icm_context_setup (srtp_aes_icm_ctx_t *c, const uint8_t *key,
+                                                     const srtp_aes_expanded_key_t *schedule)
 {
-    srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
     srtp_err_status_t status;
     int base_key_len, copy_len;
 
@@ -211,12 +232,16 @@ static srtp_err_status_t srtp_aes_icm_context_init (void *cv, const uint8_t *key
     debug_print(srtp_mod_aes_icm,
                 "offset: %s", v128_hex_string(&c->offset));
 
-    /* expand key */
-    status = srtp_aes_expand_encryption_key(key, base_key_len, &c->expanded_key);
-    if (status) {
-        v128_set_to_zero(&c->counter);
-        v128_set_to_zero(&c->offset);
-        return status;
+    /* expand key, unless the caller supplied an expanded schedule */
+    if (schedule != NULL) {
+        memcpy(&c->expanded_key, schedule, sizeof(c->expanded_key));
+    } else {
+        status = srtp_aes_expand_encryption_key(key, base_key_len, &c->expanded_key);
+        if (status) {
+            v128_set_to_zero(&c->counter);
+            v128_set_to_zero(&c->offset);
+            return status;
+        }
     }
 
     /* indicate that the keystream_buffer is empty */
@@ -225,12 +250,26 @@ static srtp_err_status_t srtp_aes_icm_context_init (void *cv, const uint8_t *key
     return srtp_err_status_ok;
 }
 
+static srtp_err_status_t srtp_aes_icm_context_init (void *cv, const uint8_t *key)
+{
+    return srtp_aes_icm_context_setup((srtp_aes_icm_ctx_t *)cv, key, NULL);
+}
+
+srtp_err_status_t srtp_aes_icm_context_init_from_schedule (void *cv, const uint8_t *key,
+                                                           const srtp_aes_expanded_key_t *schedule)
+{
+    if (schedule == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    return srtp_aes_icm_context_setup((srtp_aes_icm_ctx_t *)cv, key, schedule);
+}
+
 /*
  * aes_icm_set_iv(c, iv) sets the counter value to the exor of iv with
  * the offset
  */
 
-static srtp_err_status_t srtp_aes_icm_set_iv (void *cv, uint8_t *iv, srtp_cipher_direction_t direction)
+srtp_err_status_t srtp_aes_icm_set_iv (void *cv, uint8_t *iv, srtp_cipher_direction_t direction)
 {
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t *)cv;
     v128_t nonce;
@@ -291,13 +330,12 @@ static void srtp_aes_icm_advance (srtp_aes_icm_ctx_t *c)
  *  - fill buffer then add in remaining (< 16) bytes of keystream
  */
 
-static srtp_err_status_t srtp_aes_icm_encrypt (void *cv,
+srtp_err_status_t srtp_aes_icm_encrypt (void *cv,
                                                unsigned char *buf, unsigned int *enc_len)
 {
     srtp_aes_icm_ctx_t *c = (srtp_aes_icm_ctx_t*)cv;
     unsigned int bytes_to_encr = *enc_len;
     unsigned int i;
-    uint32_t *b;
 
     /* check that there's enough segment left*/
     if ((bytes_to_encr + htons(c->counter.v16[7])) > 0xffff) {
@@ -309,10 +347,9 @@ static srtp_err_status_t srtp_aes_icm_encrypt (void *cv,
     if (bytes_to_encr <= (unsigned int)c->bytes_in_buffer) {
 
         /* deal with odd case of small bytes_to_encr */
-        for (i = (sizeof(v128_t) - c->bytes_in_buffer);
-             i < (sizeof(v128_t) - c->bytes_in_buffer + bytes_to_encr); i++) {
-            *buf++ ^= c->keystream_buffer.v8[i];
-        }
+        srtp_octet_string_xor(buf,
+                              &c->keystream_buffer.v8[sizeof(v128_t) - c->bytes_in_buffer],
+                              bytes_to_encr);
 
         c->bytes_in_buffer -= bytes_to_encr;
 
@@ -322,60 +359,61 @@ static srtp_err_status_t srtp_aes_icm_encrypt (void *cv,
     } else {
 
         /* encrypt bytes until the remaining data is 16-byte aligned */
-        for (i = (sizeof(v128_t) - c->bytes_in_buffer); i < sizeof(v128_t); i++) {
-            *buf++ ^= c->keystream_buffer.v8[i];
-        }
+        srtp_octet_string_xor(buf,
+                              &c->keystream_buffer.v8[sizeof(v128_t) - c->bytes_in_buffer],
+                              c->bytes_in_buffer);
+        buf += c->bytes_in_buffer;
 
         bytes_to_encr -= c->bytes_in_buffer;
         c->bytes_in_buffer = 0;
 
     }
 
+    /*
+     * process four blocks of keystream per iteration; the counter
+     * blocks are independent, so the four AES computations can
+     * overlap in the pipeline (and in the AES units, when block
+     * encryption is hardware-accelerated)
+     */
+    while (bytes_to_encr >= 4 * sizeof(v128_t)) {
+        v128_t keystream[4];
+        int j;
+
+        for (j = 0; j < 4; j++) {
+            v128_copy(&keystream[j], &c->counter);
+
+            /* clock counter forward */
+            if (!++(c->counter.v8[15])) {
+                ++(c->counter.v8[14]);
+            }
+        }
+        if (srtp_aes_hardware_accelerated()) {
+            srtp_aes_encrypt(&keystream[0], &c->expanded_key);
+            srtp_aes_encrypt(&keystream[1], &c->expanded_key);
+            srtp_aes_encrypt(&keystream[2], &c->expanded_key);
+            srtp_aes_encrypt(&keystream[3], &c->expanded_key);
+        } else {
+            /* constant-time bitsliced core, four blocks in parallel */
+            srtp_aes_encrypt_ct4(keystream, &c->expanded_key);
+        }
+
+        /* add keystream into the data buffer */
+        srtp_octet_string_xor(buf, (const uint8_t*)keystream,
+                              4 * sizeof(v128_t));
+        buf += 4 * sizeof(v128_t);
+
+        bytes_to_encr -= 4 * sizeof(v128_t);
+    }
+
     /* now loop over entire 16-byte blocks of keystream */
     for (i = 0; i < (bytes_to_encr / sizeof(v128_t)); i++) {
 
         /* fill buffer with new keystream */
         srtp_aes_icm_advance(c);
 
-        /*
-         * add keystream into the data buffer (this would be a lot faster
-         * if we could assume 32-bit alignment!)
-         */
-
-#if ALIGN_32
-        b = (uint32_t*)buf;
-        *b++ ^= c->keystream_buffer.v32[0];
-        *b++ ^= c->keystream_buffer.v32[1];
-        *b++ ^= c->keystream_buffer.v32[2];
-        *b++ ^= c->keystream_buffer.v32[3];
-        buf = (uint8_t*)b;
-#else
-        if ((((unsigned long)buf) & 0x03) != 0) {
-            *buf++ ^= c->keystream_buffer.v8[0];
-            *buf++ ^= c->keystream_buffer.v8[1];
-            *buf++ ^= c->keystream_buffer.v8[2];
-            *buf++ ^= c->keystream_buffer.v8[3];
-            *buf++ ^= c->keystream_buffer.v8[4];
-            *buf++ ^= c->keystream_buffer.v8[5];
-            *buf++ ^= c->keystream_buffer.v8[6];
-            *buf++ ^= c->keystream_buffer.v8[7];
-            *buf++ ^= c->keystream_buffer.v8[8];
-            *buf++ ^= c->keystream_buffer.v8[9];
-            *buf++ ^= c->keystream_buffer.v8[10];
-            *buf++ ^= c->keystream_buffer.v8[11];
-            *buf++ ^= c->keystream_buffer.v8[12];
-            *buf++ ^= c->keystream_buffer.v8[13];
-            *buf++ ^= c->keystream_buffer.v8[14];
-            *buf++ ^= c->keystream_buffer.v8[15];
-        } else {
-            b = (uint32_t*)buf;
-            *b++ ^= c->keystream_buffer.v32[0];
-            *b++ ^= c->keystream_buffer.v32[1];
-            *b++ ^= c->keystream_buffer.v32[2];
-            *b++ ^= c->keystream_buffer.v32[3];
-            buf = (uint8_t*)b;
-        }
-#endif  /* #if ALIGN_32 */
+        /* add keystream into the data buffer */
+        srtp_octet_string_xor(buf, c->keystream_buffer.v8, sizeof(v128_t));
+        buf += sizeof(v128_t);
 
     }
 
@@ -385,9 +423,9 @@ static srtp_err_status_t srtp_aes_icm_encrypt (void *cv,
         /* fill buffer with new keystream */
         srtp_aes_icm_advance(c);
 
-        for (i = 0; i < (bytes_to_encr & 0xf); i++) {
-            *buf++ ^= c->keystream_buffer.v8[i];
-        }
+        i = bytes_to_encr & 0xf;
+        srtp_octet_string_xor(buf, c->keystream_buffer.v8, i);
+        buf += i;
 
         /* reset the keystream buffer size to right value */
         c->bytes_in_buffer = sizeof(v128_t) - i;
@@ -503,7 +541,9 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     0,                          /* get_tag */
     srtp_aes_icm_128_description,
     &srtp_aes_icm_128_test_case_0,
-    SRTP_AES_ICM_128
+    SRTP_AES_ICM_128,
+    srtp_aes_icm_place,
+    sizeof(srtp_aes_icm_ctx_t)
 };
 
 const srtp_cipher_type_t srtp_aes_icm_256 = {
@@ -517,5 +557,7 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     0,                          /* get_tag */
     srtp_aes_icm_256_description,
     &srtp_aes_icm_256_test_case_0,
-    SRTP_AES_ICM_256
+    SRTP_AES_ICM_256,
+    srtp_aes_icm_place,
+    sizeof(srtp_aes_icm_ctx_t)
 };
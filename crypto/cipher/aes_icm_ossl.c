@@ -67,6 +67,34 @@ extern const srtp_cipher_type_t srtp_aes_icm_128;
 extern const srtp_cipher_type_t srtp_aes_icm_192;
 extern const srtp_cipher_type_t srtp_aes_icm_256;
 
+/*
+ * with OpenSSL 3 the EVP_aes_*_ctr() convenience handles imply a
+ * provider fetch on every key init; cache explicitly fetched
+ * algorithms for the life of the process instead
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static EVP_CIPHER *srtp_evp_fetched_aes_ctr[3] = { NULL, NULL, NULL };
+
+static const EVP_CIPHER *srtp_evp_aes_ctr (int key_size)
+{
+    static const char *name[3] = {
+        "AES-128-CTR", "AES-192-CTR", "AES-256-CTR"
+    };
+    int i = (key_size == SRTP_AES_256_KEY_LEN) ? 2 :
+            (key_size == SRTP_AES_192_KEY_LEN) ? 1 : 0;
+
+    if (srtp_evp_fetched_aes_ctr[i] == NULL) {
+        srtp_evp_fetched_aes_ctr[i] = EVP_CIPHER_fetch(NULL, name[i], NULL);
+    }
+    return srtp_evp_fetched_aes_ctr[i];
+}
+#else
+#define srtp_evp_aes_ctr(key_size)                          \
+    ((key_size) == SRTP_AES_256_KEY_LEN ? EVP_aes_256_ctr() \
+     : (key_size) == SRTP_AES_192_KEY_LEN ? EVP_aes_192_ctr() \
+                                          : EVP_aes_128_ctr())
+#endif
+
 /*
  * integer counter mode works as follows:
  *
@@ -235,13 +263,9 @@ static srtp_err_status_t srtp_aes_icm_openssl_context_init (void* cv, const uint
 
     switch (c->key_size) {
     case SRTP_AES_256_KEY_LEN:
-        evp = EVP_aes_256_ctr();
-        break;
     case SRTP_AES_192_KEY_LEN:
-        evp = EVP_aes_192_ctr();
-        break;
     case SRTP_AES_128_KEY_LEN:
-        evp = EVP_aes_128_ctr();
+        evp = srtp_evp_aes_ctr(c->key_size);
         break;
     default:
         return srtp_err_status_bad_param;
@@ -471,7 +495,9 @@ const srtp_cipher_type_t srtp_aes_icm_128 = {
     0,                           /* get_tag */
     srtp_aes_icm_128_openssl_description,
     &srtp_aes_icm_128_test_case_0,
-    SRTP_AES_ICM_128
+    SRTP_AES_ICM_128,
+    NULL,                        /* place: EVP contexts cannot be placed */
+    0
 };
 
 /*
@@ -489,7 +515,9 @@ const srtp_cipher_type_t srtp_aes_icm_192 = {
     0,                           /* get_tag */
     srtp_aes_icm_192_openssl_description,
     &srtp_aes_icm_192_test_case_0,
-    SRTP_AES_ICM_192
+    SRTP_AES_ICM_192,
+    NULL,                        /* place: EVP contexts cannot be placed */
+    0
 };
 
 /*
@@ -507,6 +535,8 @@ const srtp_cipher_type_t srtp_aes_icm_256 = {
     0,                           /* get_tag */
     srtp_aes_icm_256_openssl_description,
     &srtp_aes_icm_256_test_case_0,
-    SRTP_AES_ICM_256
+    SRTP_AES_ICM_256,
+    NULL,                        /* place: EVP contexts cannot be placed */
+    0
 };
 
@@ -74,6 +74,64 @@ srtp_err_status_t srtp_cipher_dealloc (srtp_cipher_t *c)
     return (((c)->type)->dealloc(c));
 }
 
+srtp_err_status_t srtp_cipher_type_place (const srtp_cipher_type_t *ct, srtp_cipher_t *c, void *state, size_t state_octets, int key_len, int tlen)
+{
+    if (!ct || !c || !ct->place) {
+	return (srtp_err_status_bad_param);
+    }
+    if (state_octets < ct->state_octets) {
+	return (srtp_err_status_bad_param);
+    }
+    return ((ct)->place((c), (state), (key_len), (tlen)));
+}
+
+srtp_err_status_t srtp_cipher_clear_placed (srtp_cipher_t *c)
+{
+    if (!c || !c->type) {
+	return (srtp_err_status_bad_param);
+    }
+
+    /* zeroize the key material, but free nothing - the storage is the
+     * caller's (typically its stack frame) */
+    if (c->type->state_octets > 0 && c->state != NULL) {
+        octet_string_set_to_zero(c->state, c->type->state_octets);
+    }
+    octet_string_set_to_zero(c, sizeof(srtp_cipher_t));
+
+    return (srtp_err_status_ok);
+}
+
+srtp_err_status_t srtp_cipher_clone (const srtp_cipher_t *c, srtp_cipher_t **c_out)
+{
+    srtp_err_status_t status;
+
+    if (!c || !c->type || !c_out) {
+	return (srtp_err_status_bad_param);
+    }
+
+    /* only types with flat, placeable state can be duplicated by copy */
+    if (!c->type->place) {
+	return (srtp_err_status_bad_param);
+    }
+
+    /*
+     * the tag length passed to alloc() only has to satisfy the type's
+     * validation; the authoritative value lives in the state, which is
+     * copied below
+     */
+    status = srtp_cipher_type_alloc(c->type, c_out, c->key_len, 16);
+    if (status) {
+	return status;
+    }
+
+    (*c_out)->algorithm = c->algorithm;
+    if (c->type->state_octets > 0 && c->state != NULL) {
+        memcpy((*c_out)->state, c->state, c->type->state_octets);
+    }
+
+    return (srtp_err_status_ok);
+}
+
 srtp_err_status_t srtp_cipher_init (srtp_cipher_t *c, const uint8_t *key)
 {
     if (!c || !c->type || !c->state) {
@@ -144,6 +202,51 @@ srtp_err_status_t srtp_cipher_set_aad (srtp_cipher_t *c, const uint8_t *aad, uin
     return (((c)->type)->set_aad(((c)->state), aad, aad_len));
 }
 
+srtp_err_status_t srtp_cipher_aead (srtp_cipher_t *c, uint8_t *iv, int direction, const uint8_t *aad, uint32_t aad_len, uint8_t *buffer, unsigned int *octets_in_buffer)
+{
+    srtp_err_status_t status;
+    uint32_t tag_len;
+
+    if (!c || !c->type || !c->state) {
+	return (srtp_err_status_bad_param);
+    }
+
+    /* use the backend's fused entry when it provides one */
+    if (((c)->type)->aead) {
+	return (((c)->type)->aead(((c)->state), iv, direction, aad, aad_len,
+				  buffer, octets_in_buffer));
+    }
+
+    /* otherwise compose the operation from the discrete calls */
+    if (!((c)->type)->set_aad || !((c)->type)->get_tag) {
+	return (srtp_err_status_no_such_op);
+    }
+    status = (((c)->type)->set_iv(((c)->state), iv, direction));
+    if (status) {
+	return status;
+    }
+    status = (((c)->type)->set_aad(((c)->state), aad, aad_len));
+    if (status) {
+	return status;
+    }
+    if (direction == srtp_direction_encrypt) {
+	status = (((c)->type)->encrypt(((c)->state), buffer, octets_in_buffer));
+	if (status) {
+	    return status;
+	}
+	status = (((c)->type)->get_tag(((c)->state),
+				       buffer + *octets_in_buffer, &tag_len));
+	if (status) {
+	    return status;
+	}
+	*octets_in_buffer += tag_len;
+	return (srtp_err_status_ok);
+    }
+
+    /* the tag rides at the end of the buffer and is checked by decrypt */
+    return (((c)->type)->decrypt(((c)->state), buffer, octets_in_buffer));
+}
+
 /* some bookkeeping functions */
 
 int srtp_cipher_get_key_length (const srtp_cipher_t *c)
@@ -57,6 +57,26 @@
 
 extern srtp_debug_module_t srtp_mod_cipher;
 
+static srtp_err_status_t srtp_null_cipher_place (srtp_cipher_t *c, void *state, int key_len, int tlen)
+{
+    extern const srtp_cipher_type_t srtp_null_cipher;
+
+    debug_print(srtp_mod_cipher,
+                "placing cipher with key length %d", key_len);
+
+    memset(c, 0x0, sizeof(srtp_cipher_t));
+
+    /* set pointers */
+    c->algorithm = SRTP_NULL_CIPHER;
+    c->type = &srtp_null_cipher;
+    c->state = (void *) 0x1; /* The null cipher does not maintain state */
+
+    /* set key size */
+    c->key_len = key_len;
+
+    return srtp_err_status_ok;
+}
+
 static srtp_err_status_t srtp_null_cipher_alloc (srtp_cipher_t **c, int key_len, int tlen)
 {
     extern const srtp_cipher_type_t srtp_null_cipher;
@@ -69,18 +89,8 @@ static srtp_err_status_t srtp_null_cipher_alloc (srtp_cipher_t **c, int key_len,
     if (*c == NULL) {
         return srtp_err_status_alloc_fail;
     }
-    memset(*c, 0x0, sizeof(srtp_cipher_t));
-
-    /* set pointers */
-    (*c)->algorithm = SRTP_NULL_CIPHER;
-    (*c)->type = &srtp_null_cipher;
-    (*c)->state = (void *) 0x1; /* The null cipher does not maintain state */
-
-    /* set key size */
-    (*c)->key_len = key_len;
-
-    return srtp_err_status_ok;
 
+    return srtp_null_cipher_place(*c, NULL, key_len, tlen);
 }
 
 static srtp_err_status_t srtp_null_cipher_dealloc (srtp_cipher_t *c)
@@ -151,6 +161,8 @@ const srtp_cipher_type_t srtp_null_cipher = {
     0,                     /* get_tag */
     srtp_null_cipher_description,
     &srtp_null_cipher_test_0,
-    SRTP_NULL_CIPHER
+    SRTP_NULL_CIPHER,
+    srtp_null_cipher_place,
+    0                      /* the null cipher has no state to place */
 };
 
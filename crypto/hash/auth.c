@@ -74,6 +74,30 @@ int srtp_auth_get_prefix_length (const srtp_auth_t *a)
     return a->prefix_len;
 }
 
+srtp_err_status_t srtp_auth_clone (const srtp_auth_t *a, srtp_auth_t **a_out)
+{
+    srtp_err_status_t status;
+
+    if (!a || !a->type || !a_out) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* only types with flat state can be duplicated by copy */
+    if (a->type->state_octets == 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = a->type->alloc(a_out, a->key_len, a->out_len);
+    if (status) {
+        return status;
+    }
+
+    (*a_out)->prefix_len = a->prefix_len;
+    memcpy((*a_out)->state, a->state, a->type->state_octets);
+
+    return srtp_err_status_ok;
+}
+
 /*
  * srtp_auth_type_test() tests an auth function of type ct against
  * test cases provided in a list test_data of values of key, data, and tag
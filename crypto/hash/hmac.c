@@ -111,6 +111,7 @@ static srtp_err_status_t srtp_hmac_init (void *statev, const uint8_t *key, int k
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
     int i;
     uint8_t ipad[64];
+    uint8_t opad[64];
 
     /*
      * check key length - note that we don't support keys larger
@@ -126,27 +127,32 @@ static srtp_err_status_t srtp_hmac_init (void *statev, const uint8_t *key, int k
      */
     for (i = 0; i < key_len; i++) {
         ipad[i] = key[i] ^ 0x36;
-        state->opad[i] = key[i] ^ 0x5c;
+        opad[i] = key[i] ^ 0x5c;
     }
     /* set the rest of ipad, opad to constant values */
     for (; i < 64; i++) {
         ipad[i] = 0x36;
-        ((uint8_t*)state->opad)[i] = 0x5c;
+        opad[i] = 0x5c;
     }
 
     debug_print(srtp_mod_hmac, "ipad: %s", srtp_octet_string_hex_string(ipad, 64));
 
-    /* initialize sha1 context */
+    /*
+     * precompute the sha1 midstates for both pads; the key is fixed
+     * for the lifetime of the stream, so each packet can start from
+     * these rather than re-hashing a 64-octet pad block
+     */
     srtp_sha1_init(&state->init_ctx);
-
-    /* hash ipad ^ key */
     srtp_sha1_update(&state->init_ctx, ipad, 64);
     memcpy(&state->ctx, &state->init_ctx, sizeof(srtp_sha1_ctx_t));
 
+    srtp_sha1_init(&state->opad_ctx);
+    srtp_sha1_update(&state->opad_ctx, opad, 64);
+
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_hmac_start (void *statev)
+srtp_err_status_t srtp_hmac_start (void *statev)
 {
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
 
@@ -155,7 +161,7 @@ static srtp_err_status_t srtp_hmac_start (void *statev)
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_hmac_update (void *statev, const uint8_t *message, int msg_octets)
+srtp_err_status_t srtp_hmac_update (void *statev, const uint8_t *message, int msg_octets)
 {
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
 
@@ -168,7 +174,7 @@ static srtp_err_status_t srtp_hmac_update (void *statev, const uint8_t *message,
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t srtp_hmac_compute (void *statev, const uint8_t *message,
+srtp_err_status_t srtp_hmac_compute (void *statev, const uint8_t *message,
                                             int msg_octets, int tag_len, uint8_t *result)
 {
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
@@ -181,28 +187,80 @@ static srtp_err_status_t srtp_hmac_compute (void *statev, const uint8_t *message
         return srtp_err_status_bad_param;
     }
 
-    /* hash message, copy output into H */
-    srtp_hmac_update(state, message, msg_octets);
-    srtp_sha1_final(&state->ctx, H);
-
-    /*
-     * note that we don't need to debug_print() the input, since the
-     * function hmac_update() already did that for us
-     */
-    debug_print(srtp_mod_hmac, "intermediate state: %s",
-                srtp_octet_string_hex_string((uint8_t*)H, 20));
-
-    /* re-initialize hash context */
-    srtp_sha1_init(&state->ctx);
-
-    /* hash opad ^ key  */
-    srtp_sha1_update(&state->ctx, (uint8_t*)state->opad, 64);
-
-    /* hash the result of the inner hash */
-    srtp_sha1_update(&state->ctx, (uint8_t*)H, 20);
-
-    /* the result is returned in the array hash_value[] */
-    srtp_sha1_final(&state->ctx, hash_value);
+    if (state->ctx.octets_in_buffer + msg_octets <= 55) {
+
+        /*
+         * short-message fast path: everything hashed since
+         * srtp_hmac_start() - octets buffered by srtp_hmac_update()
+         * plus this message - fits in a single padded block, so the
+         * whole hmac is exactly two compressions, one from each
+         * cached pad midstate, with no context copies or buffer
+         * management in between.  voice-sized srtp packets land here
+         */
+        uint32_t M[16];
+        uint8_t *block = (uint8_t*)M;
+        int total = state->ctx.octets_in_buffer + msg_octets;
+        uint32_t bits = state->ctx.num_bits_in_msg + msg_octets * 8;
+
+        debug_print(srtp_mod_hmac, "input: %s",
+                    srtp_octet_string_hex_string(message, msg_octets));
+
+        /* inner hash: buffered octets, message, pad and bit-count */
+        memcpy(block, state->ctx.M, state->ctx.octets_in_buffer);
+        memcpy(block + state->ctx.octets_in_buffer, message, msg_octets);
+        block[total] = 0x80;
+        memset(block + total + 1, 0, 59 - total);
+        block[60] = (uint8_t)(bits >> 24);
+        block[61] = (uint8_t)(bits >> 16);
+        block[62] = (uint8_t)(bits >> 8);
+        block[63] = (uint8_t)bits;
+
+        memcpy(H, state->ctx.H, sizeof(H));
+        srtp_sha1_core(M, H);
+
+        /* put the inner hash into network byte order */
+        for (i = 0; i < 5; i++) {
+            H[i] = be32_to_cpu(H[i]);
+        }
+
+        debug_print(srtp_mod_hmac, "intermediate state: %s",
+                    srtp_octet_string_hex_string((uint8_t*)H, 20));
+
+        /* outer hash: the 20-octet inner hash always fits one block */
+        memcpy(M, H, 20);
+        M[5] = be32_to_cpu(0x80000000);
+        memset(&M[6], 0, 9 * sizeof(uint32_t));
+        M[15] = be32_to_cpu(512 + 160);
+
+        memcpy(hash_value, state->opad_ctx.H, sizeof(hash_value));
+        srtp_sha1_core(M, hash_value);
+
+        for (i = 0; i < 5; i++) {
+            hash_value[i] = be32_to_cpu(hash_value[i]);
+        }
+
+    } else {
+
+        /* hash message, copy output into H */
+        srtp_hmac_update(state, message, msg_octets);
+        srtp_sha1_final(&state->ctx, H);
+
+        /*
+         * note that we don't need to debug_print() the input, since the
+         * function hmac_update() already did that for us
+         */
+        debug_print(srtp_mod_hmac, "intermediate state: %s",
+                    srtp_octet_string_hex_string((uint8_t*)H, 20));
+
+        /* start the outer hash from the cached post-opad midstate */
+        memcpy(&state->ctx, &state->opad_ctx, sizeof(srtp_sha1_ctx_t));
+
+        /* hash the result of the inner hash */
+        srtp_sha1_update(&state->ctx, (uint8_t*)H, 20);
+
+        /* the result is returned in the array hash_value[] */
+        srtp_sha1_final(&state->ctx, hash_value);
+    }
 
     /* copy hash_value to *result */
     for (i = 0; i < tag_len; i++) {
@@ -261,6 +319,7 @@ const srtp_auth_type_t srtp_hmac  = {
     srtp_hmac_start,
     srtp_hmac_description,
     &srtp_hmac_test_case_0,
-    SRTP_HMAC_SHA1
+    SRTP_HMAC_SHA1,
+    sizeof(srtp_hmac_ctx_t)
 };
 
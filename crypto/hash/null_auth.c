@@ -155,6 +155,7 @@ const srtp_auth_type_t srtp_null_auth  = {
     srtp_null_auth_start,
     srtp_null_auth_description,
     &srtp_null_auth_test_case_0,
-    SRTP_NULL_AUTH
+    SRTP_NULL_AUTH,
+    sizeof(srtp_null_auth_ctx_t)
 };
 
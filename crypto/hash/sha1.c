@@ -98,8 +98,378 @@ void srtp_sha1 (const uint8_t *msg,  int octets_in_msg, uint32_t hash_value[5])
  *  (crypto/cipher/seal.c)
  */
 
+/*
+ * hardware-accelerated SHA-1 compression
+ *
+ * when the compiler and CPU support it, srtp_sha1_core() dispatches
+ * to the SHA instruction set extensions (SHA-NI on x86, the ARMv8
+ * SHA-1 crypto extensions on aarch64) instead of the scalar code
+ * below; M is the raw big-endian message block in both cases, so the
+ * hardware paths shuffle bytes as they load
+ *
+ * on x86 the CPU capability is detected at runtime (and cached); on
+ * aarch64 the crypto extensions are a compile-time target feature
+ */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SHA1_HAVE_NI 1
+
+#include <immintrin.h>
+
+static int sha1_ni_available (void)
+{
+    static int available = -1;
+
+    if (available < 0) {
+        available = __builtin_cpu_supports("sha");
+    }
+    return available;
+}
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha1_core_ni (const uint32_t M[16], uint32_t hash_value[5])
+{
+    __m128i abcd, abcd_save, e0, e0_save, e1;
+    __m128i msg0, msg1, msg2, msg3;
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+
+    abcd = _mm_loadu_si128((const __m128i*)hash_value);
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    e0 = _mm_set_epi32((int)hash_value[4], 0, 0, 0);
+    abcd_save = abcd;
+    e0_save = e0;
+
+    /* rounds 0-3 */
+    msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(M + 0)), mask);
+    e0 = _mm_add_epi32(e0, msg0);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+    /* rounds 4-7 */
+    msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(M + 4)), mask);
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+
+    /* rounds 8-11 */
+    msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(M + 8)), mask);
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    /* rounds 12-15 */
+    msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(M + 12)), mask);
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    /* rounds 16-19 */
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    /* rounds 20-23 */
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    /* rounds 24-27 */
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    /* rounds 28-31 */
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    /* rounds 32-35 */
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 1);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    /* rounds 36-39 */
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 1);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    /* rounds 40-43 */
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    /* rounds 44-47 */
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    /* rounds 48-51 */
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    /* rounds 52-55 */
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 2);
+    msg0 = _mm_sha1msg1_epu32(msg0, msg1);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    /* rounds 56-59 */
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 2);
+    msg1 = _mm_sha1msg1_epu32(msg1, msg2);
+    msg0 = _mm_xor_si128(msg0, msg2);
+
+    /* rounds 60-63 */
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    msg0 = _mm_sha1msg2_epu32(msg0, msg3);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    msg2 = _mm_sha1msg1_epu32(msg2, msg3);
+    msg1 = _mm_xor_si128(msg1, msg3);
+
+    /* rounds 64-67 */
+    e0 = _mm_sha1nexte_epu32(e0, msg0);
+    e1 = abcd;
+    msg1 = _mm_sha1msg2_epu32(msg1, msg0);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+    msg3 = _mm_sha1msg1_epu32(msg3, msg0);
+    msg2 = _mm_xor_si128(msg2, msg0);
+
+    /* rounds 68-71 */
+    e1 = _mm_sha1nexte_epu32(e1, msg1);
+    e0 = abcd;
+    msg2 = _mm_sha1msg2_epu32(msg2, msg1);
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+    msg3 = _mm_xor_si128(msg3, msg1);
+
+    /* rounds 72-75 */
+    e0 = _mm_sha1nexte_epu32(e0, msg2);
+    e1 = abcd;
+    msg3 = _mm_sha1msg2_epu32(msg3, msg2);
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+    /* rounds 76-79 */
+    e1 = _mm_sha1nexte_epu32(e1, msg3);
+    e0 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+    /* add the block's contribution into the intermediate state */
+    e0 = _mm_sha1nexte_epu32(e0, e0_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+
+    abcd = _mm_shuffle_epi32(abcd, 0x1b);
+    _mm_storeu_si128((__m128i*)hash_value, abcd);
+    hash_value[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)
+#define SHA1_HAVE_CE 1
+
+#include <arm_neon.h>
+
+static void sha1_core_ce (const uint32_t M[16], uint32_t hash_value[5])
+{
+    uint32x4_t abcd = vld1q_u32(hash_value);
+    uint32_t e = hash_value[4];
+    uint32x4_t abcd_save = abcd;
+    uint32_t e_save = e;
+    uint32x4_t msg0, msg1, msg2, msg3, tmp0, tmp1;
+    uint32_t e0, e1;
+    const uint32x4_t k0 = vdupq_n_u32(0x5a827999);
+    const uint32x4_t k1 = vdupq_n_u32(0x6ed9eba1);
+    const uint32x4_t k2 = vdupq_n_u32(0x8f1bbcdc);
+    const uint32x4_t k3 = vdupq_n_u32(0xca62c1d6);
+
+    /* the message block is big-endian in memory */
+    msg0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((const uint8_t*)(M + 0))));
+    msg1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((const uint8_t*)(M + 4))));
+    msg2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((const uint8_t*)(M + 8))));
+    msg3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8((const uint8_t*)(M + 12))));
+
+    tmp0 = vaddq_u32(msg0, k0);
+    tmp1 = vaddq_u32(msg1, k0);
+
+    /* rounds 0-3 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e, tmp0);
+    tmp0 = vaddq_u32(msg2, k0);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    /* rounds 4-7 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg3, k0);
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    /* rounds 8-11 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg0, k0);
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    /* rounds 12-15 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg1, k1);
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    /* rounds 16-19 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1cq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg2, k1);
+    msg3 = vsha1su1q_u32(msg3, msg2);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    /* rounds 20-23 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg3, k1);
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    /* rounds 24-27 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg0, k1);
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    /* rounds 28-31 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg1, k1);
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    /* rounds 32-35 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg2, k2);
+    msg3 = vsha1su1q_u32(msg3, msg2);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    /* rounds 36-39 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg3, k2);
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    /* rounds 40-43 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg0, k2);
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    /* rounds 44-47 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg1, k2);
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    /* rounds 48-51 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg2, k2);
+    msg3 = vsha1su1q_u32(msg3, msg2);
+    msg0 = vsha1su0q_u32(msg0, msg1, msg2);
+
+    /* rounds 52-55 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg3, k3);
+    msg0 = vsha1su1q_u32(msg0, msg3);
+    msg1 = vsha1su0q_u32(msg1, msg2, msg3);
+
+    /* rounds 56-59 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1mq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg0, k3);
+    msg1 = vsha1su1q_u32(msg1, msg0);
+    msg2 = vsha1su0q_u32(msg2, msg3, msg0);
+
+    /* rounds 60-63 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg1, k3);
+    msg2 = vsha1su1q_u32(msg2, msg1);
+    msg3 = vsha1su0q_u32(msg3, msg0, msg1);
+
+    /* rounds 64-67 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp0);
+    tmp0 = vaddq_u32(msg2, k3);
+    msg3 = vsha1su1q_u32(msg3, msg2);
+
+    /* rounds 68-71 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp1);
+    tmp1 = vaddq_u32(msg3, k3);
+
+    /* rounds 72-75 */
+    e0 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e1, tmp0);
+
+    /* rounds 76-79 */
+    e1 = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+    abcd = vsha1pq_u32(abcd, e0, tmp1);
+
+    /* add the block's contribution into the intermediate state */
+    vst1q_u32(hash_value, vaddq_u32(abcd, abcd_save));
+    hash_value[4] = e1 + e_save;
+}
+
+#endif  /* SHA-1 hardware support */
+
 void srtp_sha1_core (const uint32_t M[16], uint32_t hash_value[5])
 {
+#ifdef SHA1_HAVE_CE
+    sha1_core_ce(M, hash_value);
+#else
     uint32_t H0;
     uint32_t H1;
     uint32_t H2;
@@ -109,6 +479,13 @@ void srtp_sha1_core (const uint32_t M[16], uint32_t hash_value[5])
     uint32_t A, B, C, D, E, TEMP;
     int t;
 
+#ifdef SHA1_HAVE_NI
+    if (sha1_ni_available()) {
+        sha1_core_ni(M, hash_value);
+        return;
+    }
+#endif
+
     /* copy hash_value into H0, H1, H2, H3, H4 */
     H0 = hash_value[0];
     H1 = hash_value[1];
@@ -181,6 +558,7 @@ void srtp_sha1_core (const uint32_t M[16], uint32_t hash_value[5])
     hash_value[2] = H2 + C;
     hash_value[3] = H3 + D;
     hash_value[4] = H4 + E;
+#endif  /* SHA1_HAVE_CE */
 
     return;
 }
@@ -205,7 +583,6 @@ void srtp_sha1_init (srtp_sha1_ctx_t *ctx)
 
 void srtp_sha1_update (srtp_sha1_ctx_t *ctx, const uint8_t *msg, int octets_in_msg)
 {
-    int i;
     uint8_t *buf = (uint8_t*)ctx->M;
 
     /* update message bit-count */
@@ -216,14 +593,11 @@ void srtp_sha1_update (srtp_sha1_ctx_t *ctx, const uint8_t *msg, int octets_in_m
 
         if (octets_in_msg + ctx->octets_in_buffer >= 64) {
 
-            /*
-             * copy words of M into msg buffer until that buffer is full,
-             * converting them into host byte order as needed
-             */
+            /* fill the message buffer up to a whole block */
+            memcpy(buf + ctx->octets_in_buffer, msg,
+                   64 - ctx->octets_in_buffer);
+            msg += 64 - ctx->octets_in_buffer;
             octets_in_msg -= (64 - ctx->octets_in_buffer);
-            for (i = ctx->octets_in_buffer; i < 64; i++) {
-                buf[i] = *msg++;
-            }
             ctx->octets_in_buffer = 0;
 
             /* process a whole block */
@@ -236,10 +610,7 @@ void srtp_sha1_update (srtp_sha1_ctx_t *ctx, const uint8_t *msg, int octets_in_m
 
             debug_print(srtp_mod_sha1, "(update) not running srtp_sha1_core()", NULL);
 
-            for (i = ctx->octets_in_buffer;
-                 i < (ctx->octets_in_buffer + octets_in_msg); i++) {
-                buf[i] = *msg++;
-            }
+            memcpy(buf + ctx->octets_in_buffer, msg, octets_in_msg);
             ctx->octets_in_buffer += octets_in_msg;
             octets_in_msg = 0;
         }
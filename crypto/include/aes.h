@@ -74,6 +74,20 @@ void srtp_aes_encrypt(v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key)
 
 void srtp_aes_decrypt(v128_t *plaintext, const srtp_aes_expanded_key_t *exp_key);
 
+/*
+ * srtp_aes_encrypt_ct4(blocks, exp_key) encrypts four blocks in place
+ * using the constant-time bitsliced implementation; it produces the
+ * same output as four srtp_aes_encrypt() calls.  counter mode uses it
+ * for its bulk keystream generation on CPUs without AES instructions
+ */
+void srtp_aes_encrypt_ct4(v128_t blocks[4], const srtp_aes_expanded_key_t *exp_key);
+
+/*
+ * srtp_aes_hardware_accelerated() returns nonzero when
+ * srtp_aes_encrypt() is backed by CPU AES instructions
+ */
+int srtp_aes_hardware_accelerated(void);
+
 #ifdef __cplusplus
 }
 #endif
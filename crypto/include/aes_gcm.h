@@ -0,0 +1,83 @@
+/*
+ * aes_gcm.h
+ *
+ * Header for AES Galois Counter Mode (native implementation)
+ *
+ * David A. McGrew
+ * Cisco Systems, Inc.
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef AES_GCM_H
+#define AES_GCM_H
+
+#include "aes.h"
+#include "cipher.h"
+
+/*
+ * the GHASH key schedule: the hash subkey H = E(K, 0^128) expanded
+ * into a 4-bit Shoup table, so the portable multiply processes a
+ * nibble per step instead of a bit; when the CPU has a carry-less
+ * multiply instruction (PCLMULQDQ), only H itself is used and the
+ * table stays cold
+ */
+typedef struct {
+    uint64_t hh[16]; /* high halves of the 16 low multiples of H */
+    uint64_t hl[16]; /* low halves                               */
+} srtp_ghash_key_t;
+
+typedef struct {
+    srtp_aes_expanded_key_t expanded_key; /* the cipher key               */
+    srtp_ghash_key_t hash_key;            /* GHASH subkey table           */
+    uint8_t h[16];                        /* hash subkey H, raw, for the
+                                           * carry-less multiply path     */
+    v128_t counter;                       /* CTR block for the payload    */
+    v128_t j0;                            /* pre-counter block (IV'd)     */
+    uint64_t ghash_h;                     /* running GHASH state, high    */
+    uint64_t ghash_l;                     /* running GHASH state, low     */
+    uint8_t aad_part[16];                 /* AAD octets short of a block,
+                                           * carried between set_aad calls */
+    unsigned int aad_part_len;            /* octets held in aad_part      */
+    uint64_t aad_octets;                  /* AAD length for the final     */
+    uint64_t text_octets;                 /* text length   length block   */
+    int key_size;                         /* AES key size (without salt)  */
+    int tag_len;                          /* octets of tag to produce     */
+    srtp_cipher_direction_t dir;          /* direction set by set_iv      */
+} srtp_aes_gcm_ctx_t;
+
+#endif /* AES_GCM_H */
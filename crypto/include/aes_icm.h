@@ -59,5 +59,24 @@ typedef struct {
     int key_size;                         /* AES key size + 14 byte SALT */
 } srtp_aes_icm_ctx_t;
 
+/*
+ * direct entry points into the ICM implementation, for callers that
+ * have already established the cipher type and want to skip the
+ * function-pointer dispatch in srtp_cipher_t
+ */
+srtp_err_status_t srtp_aes_icm_set_iv(void *cv, uint8_t *iv,
+                                      srtp_cipher_direction_t direction);
+srtp_err_status_t srtp_aes_icm_encrypt(void *cv, unsigned char *buf,
+                                       unsigned int *enc_len);
+
+/*
+ * srtp_aes_icm_context_init_from_schedule(cv, key, schedule)
+ * initializes the context exactly as the cipher's init function does,
+ * but copies in the caller's already-expanded key schedule instead of
+ * re-running the AES key expansion; key is still needed for the salt
+ */
+srtp_err_status_t srtp_aes_icm_context_init_from_schedule(void *cv, const uint8_t *key,
+                                                          const srtp_aes_expanded_key_t *schedule);
+
 #endif /* AES_ICM_H */
 
@@ -47,6 +47,7 @@
 #define CRYPTO_ALLOC_H
 
 #include "datatypes.h"
+#include "err.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,6 +57,81 @@ void * srtp_crypto_alloc(size_t size);
 
 void srtp_crypto_free(void *ptr);
 
+/*
+ * optional application-installed allocation callbacks
+ *
+ * an srtp_alloc_func_t returns at least size octets of memory, with
+ * the alignment malloc() would provide, or NULL on failure; an
+ * srtp_dealloc_func_t releases a block previously obtained from the
+ * paired alloc function.  both receive the opaque arena handle that
+ * was current when the block was allocated, so a NUMA-aware
+ * application can back each arena with node-local (e.g. hugepage)
+ * memory and release blocks to the arena they came from
+ */
+typedef void *(*srtp_alloc_func_t)(void *arena, size_t size);
+typedef void (*srtp_dealloc_func_t)(void *arena, void *ptr, size_t size);
+
+/*
+ * srtp_install_alloc_callbacks(alloc_cb, dealloc_cb, arena) routes all
+ * subsequent srtp_crypto_alloc() and srtp_crypto_free() calls through
+ * the given callbacks; passing NULL for both restores the built-in
+ * allocator.  the internal free lists (and srtp_crypto_alloc_reserve)
+ * apply only to the built-in allocator and are bypassed while
+ * callbacks are installed.  blocks allocated through the callbacks
+ * are always released through them, so they must remain installed
+ * until every such block has been freed
+ */
+srtp_err_status_t srtp_install_alloc_callbacks(srtp_alloc_func_t alloc_cb,
+                                               srtp_dealloc_func_t dealloc_cb,
+                                               void *arena);
+
+/*
+ * srtp_set_alloc_arena(arena) selects the arena handle passed to the
+ * installed callbacks for subsequent allocations, and returns the
+ * previous handle.  since a session allocates only while it is being
+ * set up, bracketing srtp_create() (and any later srtp_add_stream()
+ * calls) with the session's arena pins all of its memory to that
+ * arena; blocks remember their arena and are released to it
+ * regardless of the handle current at free time
+ */
+void * srtp_set_alloc_arena(void *arena);
+
+/*
+ * srtp_crypto_alloc_reserve(size, count) preallocates count blocks
+ * large enough to satisfy srtp_crypto_alloc(size), so that a burst of
+ * stream or cipher context allocations (e.g. participants joining a
+ * large conference) does not hit the system allocator.  the free
+ * lists are per-thread, so the reserve benefits allocations made on
+ * the calling thread
+ */
+srtp_err_status_t srtp_crypto_alloc_reserve(size_t size, unsigned int count);
+
+/*
+ * srtp_crypto_alloc_octets_outstanding() returns the octets currently
+ * handed out by the allocator (blocks parked on the free lists do not
+ * count).  sampling it around a stream or session creation measures
+ * that object's heap footprint
+ */
+size_t srtp_crypto_alloc_octets_outstanding(void);
+
+/*
+ * allocation guard, used to enforce the guarantee that packet
+ * processing performs no dynamic allocation once a stream is set up
+ *
+ * srtp_protect() and srtp_unprotect() (and their RTCP counterparts)
+ * bracket their work with begin/end; any srtp_crypto_alloc() that
+ * fires inside a guarded section increments the violation counter
+ * (and aborts, if the library was built with SRTP_ALLOC_GUARD_ABORT).
+ * suspend/resume exempt the paths that are allowed to allocate from
+ * within a guarded section, such as the first-packet instantiation of
+ * a stream from a wildcard template
+ */
+void srtp_crypto_alloc_guard_begin(void);
+void srtp_crypto_alloc_guard_end(void);
+void srtp_crypto_alloc_guard_suspend(void);
+void srtp_crypto_alloc_guard_resume(void);
+uint32_t srtp_crypto_alloc_guard_violations(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,7 @@
 #ifndef SRTP_AUTH_H
 #define SRTP_AUTH_H
 
+#include <stddef.h>             /* for size_t                   */
 #include "srtp.h"
 #include "crypto_types.h"       /* for values of auth_type_id_t */
 
@@ -125,6 +126,9 @@ typedef struct srtp_auth_type_t {
     const char                *description;
     const srtp_auth_test_case_t    *test_data;
     srtp_auth_type_id_t id;
+    size_t state_octets;          /* size of the (flat) state, or zero
+                                   * if the state holds pointers and
+                                   * cannot be duplicated by copy      */
 } srtp_auth_type_t;
 
 typedef struct srtp_auth_t {
@@ -150,6 +154,15 @@ srtp_err_status_t srtp_auth_type_self_test(const srtp_auth_type_t *at);
 srtp_err_status_t srtp_auth_type_test(const srtp_auth_type_t *at, 
 	const srtp_auth_test_case_t *test_data);
 
+/*
+ * srtp_auth_clone(a, a_out) allocates a new authentication function of
+ * the same type as a and copies a's state into it, so that the clone
+ * can compute tags concurrently with the original.  only types whose
+ * state is flat (state_octets nonzero) can be cloned; others return
+ * srtp_err_status_bad_param
+ */
+srtp_err_status_t srtp_auth_clone(const srtp_auth_t *a, srtp_auth_t **a_out);
+
 /*
  * srtp_replace_auth_type(ct, id)
  *
@@ -46,6 +46,7 @@
 #ifndef SRTP_CIPHER_H
 #define SRTP_CIPHER_H
 
+#include <stddef.h>             /* for size_t                     */
 #include "srtp.h"
 #include "crypto_types.h"       /* for values of cipher_type_id_t */
 
@@ -79,6 +80,14 @@ typedef struct srtp_cipher_t      *srtp_cipher_pointer_t;
 typedef srtp_err_status_t (*srtp_cipher_alloc_func_t)
     (srtp_cipher_pointer_t *cp, int key_len, int tag_len);
 
+/*
+ * a srtp_cipher_place_func_t initializes a caller-provided srtp_cipher_t
+ * and state buffer, so that short-lived ciphers (such as the KDF cipher
+ * used during key derivation) can live on the stack instead of the heap
+ */
+typedef srtp_err_status_t (*srtp_cipher_place_func_t)
+    (srtp_cipher_pointer_t cp, void *state, int key_len, int tag_len);
+
 /*
  * a srtp_cipher_init_func_t [re-]initializes a cipher_t with a given key
  */
@@ -116,6 +125,23 @@ typedef srtp_err_status_t (*srtp_cipher_set_iv_func_t)
 typedef srtp_err_status_t (*srtp_cipher_get_tag_func_t)
     (void *state, uint8_t *tag, uint32_t *len);
 
+/*
+ * a srtp_cipher_aead_func_t runs a complete AEAD operation in one
+ * call: IV setup, AAD processing, in-place encryption or decryption
+ * of the buffer, and the tag.  when encrypting, *octets_in_buffer
+ * gives the plaintext length on entry and the ciphertext-plus-tag
+ * length on return; when decrypting, it gives the ciphertext-plus-tag
+ * length on entry and the plaintext length on return (with
+ * srtp_err_status_auth_fail reported on a tag mismatch).  backends
+ * provide this entry so that a short packet costs one boundary
+ * crossing instead of the four discrete set_iv/set_aad/encrypt/
+ * get_tag calls
+ */
+typedef srtp_err_status_t (*srtp_cipher_aead_func_t)
+    (void *state, uint8_t *iv, srtp_cipher_direction_t direction,
+     const uint8_t *aad, uint32_t aad_len,
+     uint8_t *buffer, unsigned int *octets_in_buffer);
+
 
 /*
  * srtp_cipher_test_case_t is a (list of) key, salt, plaintext, ciphertext,
@@ -151,6 +177,12 @@ typedef struct srtp_cipher_type_t {
     const char                       *description;
     const srtp_cipher_test_case_t         *test_data;
     srtp_cipher_type_id_t id;
+    srtp_cipher_place_func_t place;  /* NULL if the type cannot be placed  */
+    size_t state_octets;             /* storage place() needs for state    */
+    srtp_cipher_aead_func_t aead;    /* fused one-shot AEAD entry; NULL
+                                      * for non-AEAD types and backends
+                                      * without one (the discrete calls
+                                      * are used instead)                  */
 } srtp_cipher_type_t;
 
 /*
@@ -198,6 +230,26 @@ uint64_t srtp_cipher_bits_per_second(srtp_cipher_t *c, int octets_in_buffer, int
 
 srtp_err_status_t srtp_cipher_type_alloc(const srtp_cipher_type_t *ct, srtp_cipher_t **c, int key_len, int tlen);
 srtp_err_status_t srtp_cipher_dealloc(srtp_cipher_t *c);
+
+/*
+ * srtp_cipher_type_place(ct, c, state, state_octets, key_len, tlen) sets
+ * up the caller-provided cipher context c and cipher state buffer state
+ * (whose capacity state_octets must be at least ct->state_octets), instead
+ * of allocating them; a cipher set up this way must be torn down with
+ * srtp_cipher_clear_placed(), which zeroizes without freeing.  cipher
+ * types that cannot be placed return srtp_err_status_bad_param
+ */
+srtp_err_status_t srtp_cipher_type_place(const srtp_cipher_type_t *ct, srtp_cipher_t *c, void *state, size_t state_octets, int key_len, int tlen);
+srtp_err_status_t srtp_cipher_clear_placed(srtp_cipher_t *c);
+
+/*
+ * srtp_cipher_clone(c, c_out) allocates a new cipher of the same type as
+ * c and copies c's entire state - key schedule and per-operation scratch
+ * alike - into it, so that the clone can run operations concurrently
+ * with (and independently of) the original.  only types whose state is
+ * flat and placeable can be cloned; others return srtp_err_status_bad_param
+ */
+srtp_err_status_t srtp_cipher_clone(const srtp_cipher_t *c, srtp_cipher_t **c_out);
 srtp_err_status_t srtp_cipher_init(srtp_cipher_t *c, const uint8_t *key);
 srtp_err_status_t srtp_cipher_set_iv(srtp_cipher_t *c, uint8_t *iv, int direction);
 srtp_err_status_t srtp_cipher_output(srtp_cipher_t *c, uint8_t *buffer, uint32_t *num_octets_to_output); 
@@ -206,6 +258,16 @@ srtp_err_status_t srtp_cipher_decrypt(srtp_cipher_t *c, uint8_t *buffer, uint32_
 srtp_err_status_t srtp_cipher_get_tag(srtp_cipher_t *c, uint8_t *buffer, uint32_t *tag_len);
 srtp_err_status_t srtp_cipher_set_aad(srtp_cipher_t *c, const uint8_t *aad, uint32_t aad_len);
 
+/*
+ * srtp_cipher_aead(c, iv, direction, aad, aad_len, buffer, octets)
+ * performs one complete AEAD operation (see srtp_cipher_aead_func_t
+ * for the length conventions), using the cipher type's fused entry
+ * when it provides one and the discrete set_iv/set_aad/encrypt/
+ * get_tag (or decrypt) sequence otherwise; callers therefore get the
+ * single-call interface whether or not the backend has been updated
+ */
+srtp_err_status_t srtp_cipher_aead(srtp_cipher_t *c, uint8_t *iv, int direction, const uint8_t *aad, uint32_t aad_len, uint8_t *buffer, unsigned int *octets_in_buffer);
+
 /*
  * srtp_replace_cipher_type(ct, id)
  *
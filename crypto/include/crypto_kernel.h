@@ -46,6 +46,11 @@
 #ifndef CRYPTO_KERNEL
 #define CRYPTO_KERNEL
 
+/* build-time policy specialization (see include/srtp_profile_gcm128.h) */
+#ifdef SRTP_STATIC_PROFILE
+#include SRTP_STATIC_PROFILE
+#endif
+
 #include "cipher.h"
 #include "auth.h"
 #include "err.h"
@@ -67,6 +72,22 @@ typedef enum {
     srtp_crypto_kernel_state_secure
 } srtp_crypto_kernel_state_t;
 
+/*
+ * srtp_self_test_policy_t selects when the known-answer self-tests of
+ * the built-in cipher/auth types run:
+ *
+ *    eager    - all tests run inside srtp_crypto_kernel_init(), which
+ *               does not return srtp_err_status_ok until every type
+ *               has passed (the default, FIPS-style behavior)
+ *    deferred - srtp_crypto_kernel_init() returns immediately and each
+ *               type is tested on the first attempt to allocate it; a
+ *               test failure then surfaces from that allocation
+ */
+typedef enum {
+    srtp_self_test_eager,
+    srtp_self_test_deferred
+} srtp_self_test_policy_t;
+
 /*
  * linked list of cipher types
  */
@@ -126,6 +147,15 @@ typedef struct {
  */
 srtp_err_status_t srtp_crypto_kernel_init(void);
 
+/*
+ * srtp_crypto_kernel_set_self_test_policy() chooses between eager and
+ * deferred self-testing (see srtp_self_test_policy_t).  Call it before
+ * srtp_crypto_kernel_init(); changing the policy afterwards only
+ * affects a later re-initialization.  Results are cached either way,
+ * so no test case ever runs more than once per binary image.
+ */
+srtp_err_status_t srtp_crypto_kernel_set_self_test_policy(srtp_self_test_policy_t policy);
+
 
 /*
  * The function srtp_crypto_kernel_shutdown() de-initializes the
@@ -179,6 +209,21 @@ srtp_err_status_t srtp_crypto_kernel_load_debug_module(srtp_debug_module_t *new_
  */
 srtp_err_status_t srtp_crypto_kernel_alloc_cipher(srtp_cipher_type_id_t id, srtp_cipher_pointer_t *cp, int key_len, int tag_len);
 
+/*
+ * srtp_crypto_kernel_place_cipher(id, c, state, state_octets, key_len, tag_len);
+ *
+ * sets up a cipher of type id in the caller-provided cipher context c
+ * and state buffer state of capacity state_octets, performing no
+ * allocation; tear down with srtp_cipher_clear_placed().  Return
+ * values are:
+ *
+ *    srtp_err_status_ok           no problems
+ *    srtp_err_status_bad_param    cipher cannot be placed, or the
+ *                                 state buffer is too small
+ *    srtp_err_status_fail         couldn't find cipher with identifier 'id'
+ */
+srtp_err_status_t srtp_crypto_kernel_place_cipher(srtp_cipher_type_id_t id, srtp_cipher_t *c, void *state, size_t state_octets, int key_len, int tag_len);
+
 /*
  * srtp_crypto_kernel_alloc_auth(id, ap, key_len, tag_len);
  *
@@ -307,6 +307,17 @@ v128_set_bit_to(v128_t *x, int i, int y);
 int
 octet_string_is_eq(uint8_t *a, uint8_t *b, int len);
 
+/*
+ * srtp_octet_string_xor(dst, src, len) xors the length len octet
+ * string src into dst.  Neither pointer needs any particular
+ * alignment; the implementation runs at word (or vector) width where
+ * the hardware allows.  This is the keystream-application primitive
+ * used by the counter-mode ciphers and by header-extension
+ * encryption.
+ */
+void
+srtp_octet_string_xor(uint8_t *dst, const uint8_t *src, int len);
+
 /*
  * A portable way to zero out memory as recommended by
  * https://cryptocoding.net/index.php/Coding_rules#Clean_memory_of_secret_data
@@ -442,9 +453,6 @@ bitvector_dealloc(bitvector_t *v);
 void
 bitvector_set_to_zero(bitvector_t *x);
 
-void
-bitvector_left_shift(bitvector_t *x, int index);
-
 char *
 bitvector_bit_string(bitvector_t *x, char* buf, int len);
 
@@ -99,6 +99,68 @@ srtp_err_status_t srtp_install_err_report_handler(srtp_err_report_handler_func_t
 void
 srtp_err_report(srtp_err_reporting_level_t level, const char *format, ...);
 
+/*
+ * structured event log
+ *
+ * srtp_err_report() formats its arguments with vfprintf/vsnprintf,
+ * which is far too slow to leave enabled on a packet path; the
+ * structured event log is the production alternative.  An event is a
+ * fixed-size binary record - no formatting happens at log time - and
+ * events are stored in a lock-free ring buffer owned by the logging
+ * thread, so srtp_err_event_log() costs a few stores plus a timestamp
+ * read and can stay enabled at srtp_err_level_warning in production.
+ *
+ * The log is controlled through the usual debug module machinery: it
+ * is off by default, and is switched on with
+ *
+ *   srtp_crypto_kernel_set_debug_module("event log", 1);
+ *
+ * Events at levels numerically greater than the threshold set with
+ * srtp_err_event_set_level() (default srtp_err_level_warning) are
+ * discarded at the logging site.
+ */
+
+typedef struct {
+    uint64_t timestamp; /* CLOCK_MONOTONIC nanoseconds at log time      */
+    uint64_t index;     /* extended packet index, zero if inapplicable  */
+    uint32_t code;      /* srtp_err_status_t value describing the event */
+    uint32_t ssrc;      /* SSRC of the stream, host byte order          */
+    uint32_t level;     /* srtp_err_reporting_level_t of the event      */
+    uint32_t reserved;  /* pads the record to 32 octets, always zero    */
+} srtp_err_event_t;
+
+/*
+ * srtp_err_event_log() appends one record to the calling thread's
+ * ring.  If the ring is full (the drainer has fallen behind), the
+ * event is counted as dropped rather than overwriting unread records.
+ * Safe to call from any thread without external locking.
+ */
+
+void
+srtp_err_event_log(srtp_err_reporting_level_t level, uint32_t code,
+                   uint32_t ssrc, uint64_t index);
+
+/*
+ * srtp_err_event_drain() copies up to max_events pending records from
+ * the rings of all threads that have logged events into the caller's
+ * array and returns the number copied.  If dropped is non-NULL, the
+ * total number of events lost to ring overflow since startup is
+ * written through it.  Only one thread may drain at a time; draining
+ * runs concurrently with logging threads.
+ */
+
+size_t
+srtp_err_event_drain(srtp_err_event_t *events, size_t max_events,
+                     uint64_t *dropped);
+
+/*
+ * srtp_err_event_set_level() sets the maximum level recorded by
+ * srtp_err_event_log(); events above it are discarded.
+ */
+
+srtp_err_status_t
+srtp_err_event_set_level(srtp_err_reporting_level_t level);
+
 
 /*
  * debug_module_t defines a debug module
@@ -50,9 +50,21 @@
 #include "sha1.h"
 
 typedef struct {
-    uint8_t opad[64];
     srtp_sha1_ctx_t ctx;
-    srtp_sha1_ctx_t init_ctx;
+    srtp_sha1_ctx_t init_ctx;      /* post-ipad midstate */
+    srtp_sha1_ctx_t opad_ctx;      /* post-opad midstate */
 } srtp_hmac_ctx_t;
 
+/*
+ * direct entry points into the HMAC implementation, for callers that
+ * have already established the auth type and want to skip the
+ * function-pointer dispatch in srtp_auth_t
+ */
+srtp_err_status_t srtp_hmac_start(void *statev);
+srtp_err_status_t srtp_hmac_update(void *statev, const uint8_t *message,
+                                   int msg_octets);
+srtp_err_status_t srtp_hmac_compute(void *statev, const uint8_t *message,
+                                    int msg_octets, int tag_len,
+                                    uint8_t *result);
+
 #endif /* HMAC_H */
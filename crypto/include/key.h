@@ -68,6 +68,25 @@ srtp_err_status_t srtp_key_limit_check(const srtp_key_limit_t key);
 
 srtp_key_event_t srtp_key_limit_update(srtp_key_limit_t key);
 
+/*
+ * srtp_key_limit_update_batched() charges one packet like
+ * srtp_key_limit_update(), but while usage is at least a full batch
+ * above the soft limit it accumulates packets in a pending counter
+ * and charges them with a single subtraction, so that the per-packet
+ * cost is a counter increment and a compare; the batch path is left
+ * before any limit can be reached, so soft- and hard-limit events
+ * fire on exactly the same packet as with per-packet accounting
+ */
+srtp_key_event_t srtp_key_limit_update_batched(srtp_key_limit_t key);
+
+/*
+ * the number of packets charged per accounting flush on the batched
+ * path; may be overridden at build time
+ */
+#ifndef SRTP_KEY_LIMIT_BATCH
+#define SRTP_KEY_LIMIT_BATCH 128
+#endif
+
 typedef enum {
     srtp_key_state_normal,
     srtp_key_state_past_soft_limit,
@@ -77,6 +96,7 @@ typedef enum {
 typedef struct srtp_key_limit_ctx_t {
     srtp_xtd_seq_num_t num_left;
     srtp_key_state_t state;
+    uint32_t pending;           /* packets used but not yet charged */
 } srtp_key_limit_ctx_t;
 
 #ifdef __cplusplus
@@ -97,6 +97,24 @@ srtp_err_status_t srtp_rdb_check(const srtp_rdb_t *rdb, uint32_t rdb_index);
  */
 srtp_err_status_t srtp_rdb_add_index(srtp_rdb_t *rdb, uint32_t rdb_index);
 
+/*
+ * srtp_rdb_check_add_bulk
+ *
+ * validates and commits a sorted (ascending) run of indices in a
+ * single pass, for use on batched paths that carry several indices at
+ * once; status[i] receives the value srtp_rdb_check() would have
+ * returned for indices[i], and each index that checks out is entered
+ * into the database before the next element is considered, so
+ * duplicates within the run are caught as well
+ *
+ * returns srtp_err_status_ok when every index was fresh, and
+ * srtp_err_status_fail if any element failed its check
+ */
+srtp_err_status_t srtp_rdb_check_add_bulk(srtp_rdb_t *rdb,
+                                          const uint32_t *indices,
+                                          srtp_err_status_t *status,
+                                          int num_indices);
+
 /*
  * the functions srtp_rdb_increment() and srtp_rdb_get_value() are for use by
  * senders, not receivers - DO NOT use these functions on the same
@@ -81,12 +81,33 @@ typedef uint64_t srtp_xtd_seq_num_t;
 /*
  * An srtp_rdbx_t is a replay database with extended range; it uses an
  * xtd_seq_num_t and a bitmask of recently received indices.
+ *
+ * The bitmask is operated as a ring: logical window position p lives
+ * at physical bit (p + window_offset) mod window length, so sliding
+ * the window forward is an offset advance plus clearing of the
+ * vacated bits rather than a shift of the whole bitmask.  This keeps
+ * window slides O(delta) even for very large (multi-kilobit) windows.
+ *
+ * A window may also be adaptive (max_window != 0): it starts small
+ * and is grown toward max_window only when the observed reorder depth
+ * approaches the current length, and shrunk back when a long run of
+ * packets stays shallow, so that streams which never see deep reorder
+ * never pay for a deep window.  reorder_depth records the deepest
+ * in-window arrival seen since the last adaptation decision, and
+ * adapt_count the number of packets accepted since then.
  */
 typedef struct {
     srtp_xtd_seq_num_t index;
     bitvector_t bitmask;
+    uint32_t window_offset;
+    uint32_t max_window;     /* adaptive size limit; 0 for a fixed window */
+    uint32_t reorder_depth;
+    uint32_t adapt_count;
 } srtp_rdbx_t;
 
+/* the length, in bits, at which an adaptive window starts out */
+#define SRTP_RDBX_ADAPTIVE_START_WINDOW 128
+
 
 /*
  * srtp_rdbx_init(rdbx_ptr, ws)
@@ -96,6 +117,25 @@ typedef struct {
  */
 srtp_err_status_t srtp_rdbx_init(srtp_rdbx_t *rdbx, unsigned long ws);
 
+/*
+ * srtp_rdbx_set_adaptive(rdbx_ptr, max_ws)
+ *
+ * converts an initialized rdbx to an adaptive window with the size
+ * limit max_ws, resizing it down to SRTP_RDBX_ADAPTIVE_START_WINDOW;
+ * entries older than the new window length are dropped, which can
+ * only turn an accept into a (safe) replay_old rejection.  max_ws
+ * must be at least the start size.  passing max_ws of 0 pins the
+ * window at its current size again
+ */
+srtp_err_status_t srtp_rdbx_set_adaptive(srtp_rdbx_t *rdbx, unsigned long max_ws);
+
+/*
+ * srtp_rdbx_get_adaptive_max(rdbx_ptr)
+ *
+ * returns the adaptive size limit of the rdbx, or 0 for a fixed window
+ */
+unsigned long srtp_rdbx_get_adaptive_max(const srtp_rdbx_t *rdbx);
+
 
 /*
  * srtp_rdbx_dealloc(rdbx_ptr)
@@ -136,6 +176,20 @@ srtp_err_status_t srtp_rdbx_check(const srtp_rdbx_t *rdbx, int difference);
  */
 srtp_err_status_t srtp_rdbx_add_index(srtp_rdbx_t *rdbx, int delta);
 
+/*
+ * srtp_rdbx_advance_sender(rdbx, s)
+ *
+ * fast path for locally generated indices: if s is exactly the
+ * sequence number that follows the stored index, advances the index
+ * by one (recording it in the window) and returns srtp_err_status_ok;
+ * the replay check is unnecessary, as a one-ahead index can never
+ * collide with a recorded one.  otherwise srtp_err_status_fail is
+ * returned and the caller must run the full estimate/check/add
+ * machinery
+ */
+srtp_err_status_t srtp_rdbx_advance_sender(srtp_rdbx_t *rdbx,
+                                           srtp_sequence_number_t s);
+
 
 /*
  * srtp_rdbx_set_roc(rdbx, roc) initalizes the srtp_rdbx_t at the location rdbx
@@ -67,12 +67,232 @@ srtp_debug_module_t mod_alloc = {
 
 #if defined(HAVE_STDLIB_H)
 
+/*
+ * the allocator below maintains size-classed free lists for the
+ * small, fixed-size objects that make up stream and cipher contexts,
+ * so that stream churn recycles blocks instead of fragmenting the
+ * heap with malloc()/free() pairs
+ *
+ * each block carries a header identifying its size class; blocks in
+ * a class are kept on a singly-linked free list once freed, and
+ * requests larger than the biggest class fall through to malloc()
+ *
+ * the free lists are kept per-thread, so that sessions on different
+ * threads can set up and tear down streams concurrently without
+ * contending on (or corrupting) a shared list; a block freed on a
+ * different thread from the one that allocated it simply joins the
+ * freeing thread's list
+ */
+
+#if defined(_MSC_VER)
+#define ALLOC_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define ALLOC_THREAD_LOCAL __thread
+#else
+/* without compiler support the allocator degrades to single-threaded use */
+#define ALLOC_THREAD_LOCAL
+#endif
+
+#define ALLOC_NUM_CLASSES 6
+
+static const size_t alloc_class_size[ALLOC_NUM_CLASSES] = {
+  32, 64, 128, 256, 512, 1024
+};
+
+typedef struct alloc_block_t {
+  struct alloc_block_t *next;
+} alloc_block_t;
+
+static ALLOC_THREAD_LOCAL alloc_block_t *alloc_free_list[ALLOC_NUM_CLASSES];
+
+/*
+ * the header keeps the size class (plus one, so that zero marks a
+ * block that came straight from malloc), the block size, and - for
+ * blocks obtained through application-installed callbacks - the arena
+ * handle the block came from, so that it is released back to the same
+ * arena even if the current arena has changed since; it is padded to
+ * 32 octets to preserve the alignment that malloc() provides
+ */
+typedef union {
+  struct {
+    size_t class_plus_one;
+    size_t octets;
+    void *arena;
+    size_t from_callbacks;
+  } info;
+  uint8_t pad[32];
+} alloc_header_t;
+
+/*
+ * optional application-installed allocation callbacks (see alloc.h);
+ * when installed, the size-class free lists are bypassed so that
+ * block placement is entirely under the application's control
+ */
+static srtp_alloc_func_t alloc_callback = NULL;
+static srtp_dealloc_func_t dealloc_callback = NULL;
+static void *alloc_arena = NULL;
+
+srtp_err_status_t srtp_install_alloc_callbacks(srtp_alloc_func_t alloc_cb,
+                                               srtp_dealloc_func_t dealloc_cb,
+                                               void *arena) {
+  /* the callbacks come and go as a pair */
+  if ((alloc_cb == NULL) != (dealloc_cb == NULL)) {
+    return srtp_err_status_bad_param;
+  }
+
+  alloc_callback = alloc_cb;
+  dealloc_callback = dealloc_cb;
+  alloc_arena = arena;
+  return srtp_err_status_ok;
+}
+
+void * srtp_set_alloc_arena(void *arena) {
+  void *previous = alloc_arena;
+
+  alloc_arena = arena;
+  return previous;
+}
+
+/*
+ * octets currently handed out by the allocator; blocks parked on the
+ * free lists do not count.  this supports measuring the heap
+ * footprint of a stream or session (see
+ * srtp_crypto_alloc_octets_outstanding).  unlike the free lists, the
+ * counter is a process-wide total, so it is updated atomically
+ */
+static size_t alloc_octets_outstanding = 0;
+
+#if defined(__GNUC__)
+#define alloc_octets_add(n) \
+  (void)__atomic_add_fetch(&alloc_octets_outstanding, (n), __ATOMIC_RELAXED)
+#define alloc_octets_sub(n) \
+  (void)__atomic_sub_fetch(&alloc_octets_outstanding, (n), __ATOMIC_RELAXED)
+#define alloc_octets_get() \
+  __atomic_load_n(&alloc_octets_outstanding, __ATOMIC_RELAXED)
+#else
+#define alloc_octets_add(n) (alloc_octets_outstanding += (n))
+#define alloc_octets_sub(n) (alloc_octets_outstanding -= (n))
+#define alloc_octets_get()  (alloc_octets_outstanding)
+#endif
+
+/*
+ * guard state for the zero-allocation contract on the packet
+ * processing paths; depth counts nested guarded sections, suspended
+ * counts nested exemptions within them (see alloc.h).  a guarded
+ * section belongs to the thread that entered it, so the depth and
+ * suspension are per-thread - one thread's exemption must not exempt
+ * another thread's packet path - while the violation count is a
+ * process-wide total, updated atomically
+ */
+static ALLOC_THREAD_LOCAL uint32_t alloc_guard_depth = 0;
+static ALLOC_THREAD_LOCAL uint32_t alloc_guard_suspended = 0;
+static uint32_t alloc_guard_violation_count = 0;
+
+#if defined(__GNUC__)
+#define alloc_guard_count_violation() \
+  (void)__atomic_add_fetch(&alloc_guard_violation_count, 1, __ATOMIC_RELAXED)
+#define alloc_guard_violations_get() \
+  __atomic_load_n(&alloc_guard_violation_count, __ATOMIC_RELAXED)
+#else
+#define alloc_guard_count_violation() (alloc_guard_violation_count++)
+#define alloc_guard_violations_get()  (alloc_guard_violation_count)
+#endif
+
+void srtp_crypto_alloc_guard_begin(void) {
+  alloc_guard_depth++;
+}
+
+void srtp_crypto_alloc_guard_end(void) {
+  if (alloc_guard_depth > 0) {
+    alloc_guard_depth--;
+  }
+}
+
+void srtp_crypto_alloc_guard_suspend(void) {
+  alloc_guard_suspended++;
+}
+
+void srtp_crypto_alloc_guard_resume(void) {
+  if (alloc_guard_suspended > 0) {
+    alloc_guard_suspended--;
+  }
+}
+
+uint32_t srtp_crypto_alloc_guard_violations(void) {
+  return alloc_guard_violations_get();
+}
+
+static int alloc_size_class(size_t size) {
+  int c;
+
+  for (c = 0; c < ALLOC_NUM_CLASSES; c++) {
+    if (size <= alloc_class_size[c]) {
+      return c;
+    }
+  }
+  return -1;
+}
+
+static void * alloc_block_raw(int c, size_t size) {
+  size_t block_size = (c < 0) ? size : alloc_class_size[c];
+  alloc_header_t *hdr = malloc(sizeof(alloc_header_t) + block_size);
+
+  if (hdr == NULL) {
+    return NULL;
+  }
+  hdr->info.class_plus_one = (size_t)(c + 1);
+  hdr->info.octets = block_size;
+  hdr->info.arena = NULL;
+  hdr->info.from_callbacks = 0;
+  return hdr + 1;
+}
+
 void * srtp_crypto_alloc(size_t size) {
+  int c = alloc_size_class(size);
   void *ptr;
 
-  ptr = malloc(size);
-    
+  if (alloc_guard_depth > 0 && alloc_guard_suspended == 0) {
+    /* allocation on a path that promised not to allocate */
+    alloc_guard_count_violation();
+    debug_print(mod_alloc, "allocation inside guarded section (%d bytes)",
+                size);
+#ifdef SRTP_ALLOC_GUARD_ABORT
+    abort();
+#endif
+  }
+
+  if (alloc_callback != NULL) {
+    /*
+     * route the request through the installed callbacks; the free
+     * lists are bypassed, since a recycled block could sit in the
+     * wrong arena
+     */
+    alloc_header_t *hdr = alloc_callback(alloc_arena,
+                                         sizeof(alloc_header_t) + size);
+
+    if (hdr == NULL) {
+      debug_print(mod_alloc, "allocation failed (asked for %d bytes)\n", size);
+      return NULL;
+    }
+    hdr->info.class_plus_one = 0;
+    hdr->info.octets = size;
+    hdr->info.arena = alloc_arena;
+    hdr->info.from_callbacks = 1;
+    alloc_octets_add(size);
+    debug_print(mod_alloc, "(location: %p) allocated", hdr + 1);
+    return hdr + 1;
+  }
+
+  if (c >= 0 && alloc_free_list[c] != NULL) {
+    /* recycle a block from the class free list */
+    ptr = alloc_free_list[c];
+    alloc_free_list[c] = alloc_free_list[c]->next;
+  } else {
+    ptr = alloc_block_raw(c, size);
+  }
+
   if (ptr) {
+    alloc_octets_add((c < 0) ? size : alloc_class_size[c]);
     debug_print(mod_alloc, "(location: %p) allocated", ptr);
   } else {
     debug_print(mod_alloc, "allocation failed (asked for %d bytes)\n", size);
@@ -82,10 +302,54 @@ void * srtp_crypto_alloc(size_t size) {
 }
 
 void srtp_crypto_free(void *ptr) {
+  alloc_header_t *hdr;
+  int c;
+
+  if (ptr == NULL) {
+    return;
+  }
 
   debug_print(mod_alloc, "(location: %p) freed", ptr);
 
-  free(ptr);
+  hdr = ((alloc_header_t *)ptr) - 1;
+  alloc_octets_sub(hdr->info.octets);
+  if (hdr->info.from_callbacks != 0) {
+    /* hand the block back to the arena that produced it */
+    dealloc_callback(hdr->info.arena, hdr,
+                     sizeof(alloc_header_t) + hdr->info.octets);
+  } else if (hdr->info.class_plus_one != 0) {
+    /* return the block to its class free list */
+    c = (int)hdr->info.class_plus_one - 1;
+    ((alloc_block_t *)ptr)->next = alloc_free_list[c];
+    alloc_free_list[c] = (alloc_block_t *)ptr;
+  } else {
+    free(hdr);
+  }
+}
+
+size_t srtp_crypto_alloc_octets_outstanding(void) {
+  return alloc_octets_get();
+}
+
+srtp_err_status_t srtp_crypto_alloc_reserve(size_t size, unsigned int count) {
+  int c = alloc_size_class(size);
+  unsigned int i;
+
+  if (c < 0) {
+    return srtp_err_status_bad_param;
+  }
+
+  for (i = 0; i < count; i++) {
+    void *ptr = alloc_block_raw(c, size);
+
+    if (ptr == NULL) {
+      return srtp_err_status_alloc_fail;
+    }
+    ((alloc_block_t *)ptr)->next = alloc_free_list[c];
+    alloc_free_list[c] = (alloc_block_t *)ptr;
+  }
+
+  return srtp_err_status_ok;
 }
 
 #else  /* we need to define our own memory allocation routines */
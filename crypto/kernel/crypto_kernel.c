@@ -66,6 +66,7 @@ extern srtp_debug_module_t srtp_mod_auth;
 extern srtp_debug_module_t srtp_mod_cipher;
 extern srtp_debug_module_t mod_stat;
 extern srtp_debug_module_t mod_alloc;
+extern srtp_debug_module_t srtp_mod_event_log;
 
 /*
  * cipher types that can be included in the kernel
@@ -78,11 +79,14 @@ extern srtp_cipher_type_t srtp_aes_icm_256;
 extern srtp_cipher_type_t srtp_aes_icm_192;
 extern srtp_cipher_type_t srtp_aes_gcm_128_openssl;
 extern srtp_cipher_type_t srtp_aes_gcm_256_openssl;
+#elif !defined(NO_64BIT_MATH)
+extern srtp_cipher_type_t srtp_aes_gcm_128;
+extern srtp_cipher_type_t srtp_aes_gcm_256;
 #endif
 
 /* debug modules for cipher types */
 extern srtp_debug_module_t srtp_mod_aes_icm;
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 extern srtp_debug_module_t srtp_mod_aes_gcm;
 #endif
 
@@ -105,98 +109,248 @@ srtp_crypto_kernel_t crypto_kernel = {
     NULL                               /* no debug modules yet        */
 };
 
-#define MAX_RNG_TRIALS 25
+/*
+ * the built-in cipher and auth types live in immutable tables that are
+ * complete at compile time - looking one up needs no allocation and no
+ * initialization, so a freshly forked worker can resolve types before
+ * (or without) calling srtp_crypto_kernel_init().  the linked lists in
+ * crypto_kernel carry only types loaded at runtime through
+ * srtp_crypto_kernel_load_cipher_type() and friends.
+ *
+ * self-test results are cached in the parallel 'verified' arrays: each
+ * built-in type is tested at most once per binary image.  the flags
+ * live in static storage, so a process that initializes the kernel and
+ * then forks hands every child a kernel whose self-tests are already
+ * vouched for, and the Nth srtp_crypto_kernel_init() call reduces to a
+ * handful of flag checks.  the cache deliberately survives
+ * srtp_crypto_kernel_shutdown(): shutting down releases dynamic state
+ * but does not invalidate what the self-tests proved about the code in
+ * this image.  (an exec loads a new image and implicitly clears the
+ * cache along with the rest of the address space.)
+ */
 
-srtp_err_status_t srtp_crypto_kernel_init ()
-{
-    srtp_err_status_t status;
+typedef struct {
+    srtp_cipher_type_id_t id;
+    const srtp_cipher_type_t *cipher_type;
+} srtp_builtin_cipher_entry_t;
 
-    /* check the security state */
-    if (crypto_kernel.state == srtp_crypto_kernel_state_secure) {
+typedef struct {
+    srtp_auth_type_id_t id;
+    const srtp_auth_type_t *auth_type;
+} srtp_builtin_auth_entry_t;
 
-        /*
-         * we're already in the secure state, but we've been asked to
-         * re-initialize, so we just re-run the self-tests and then return
-         */
-        return srtp_crypto_kernel_status();
-    }
+#ifdef SRTP_PROFILE_CIPHERS_MINIMAL
 
-    /* initialize error reporting system */
-    status = srtp_err_reporting_init();
-    if (status) {
-        return status;
-    }
+/*
+ * fixed-profile build: only the profile's transform, the null types,
+ * and AES-ICM-128 (which backs the KDF) are compiled in
+ */
+static const srtp_builtin_cipher_entry_t srtp_builtin_cipher_types[] = {
+    { SRTP_NULL_CIPHER,  &srtp_null_cipher },
+    { SRTP_AES_ICM_128,  &srtp_aes_icm_128 },
+#ifdef OPENSSL
+    { SRTP_AES_GCM_128,  &srtp_aes_gcm_128_openssl },
+#elif !defined(NO_64BIT_MATH)
+    { SRTP_AES_GCM_128,  &srtp_aes_gcm_128 },
+#endif
+};
 
-    /* load debug modules */
-    status = srtp_crypto_kernel_load_debug_module(&srtp_mod_crypto_kernel);
-    if (status) {
-        return status;
-    }
-    status = srtp_crypto_kernel_load_debug_module(&srtp_mod_auth);
-    if (status) {
-        return status;
-    }
-    status = srtp_crypto_kernel_load_debug_module(&srtp_mod_cipher);
-    if (status) {
-        return status;
-    }
-    status = srtp_crypto_kernel_load_debug_module(&mod_stat);
-    if (status) {
-        return status;
-    }
-    status = srtp_crypto_kernel_load_debug_module(&mod_alloc);
-    if (status) {
-        return status;
-    }
+static const srtp_builtin_auth_entry_t srtp_builtin_auth_types[] = {
+    { SRTP_NULL_AUTH,    &srtp_null_auth },
+};
 
-    /* load cipher types */
-    status = srtp_crypto_kernel_load_cipher_type(&srtp_null_cipher, SRTP_NULL_CIPHER);
-    if (status) {
-        return status;
-    }
-    status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_icm_128, SRTP_AES_ICM_128);
-    if (status) {
-        return status;
+#else /* SRTP_PROFILE_CIPHERS_MINIMAL */
+
+static const srtp_builtin_cipher_entry_t srtp_builtin_cipher_types[] = {
+    { SRTP_NULL_CIPHER,  &srtp_null_cipher },
+    { SRTP_AES_ICM_128,  &srtp_aes_icm_128 },
+    { SRTP_AES_ICM_256,  &srtp_aes_icm_256 },
+#ifdef OPENSSL
+    { SRTP_AES_ICM_192,  &srtp_aes_icm_192 },
+    { SRTP_AES_GCM_128,  &srtp_aes_gcm_128_openssl },
+    { SRTP_AES_GCM_256,  &srtp_aes_gcm_256_openssl },
+#elif !defined(NO_64BIT_MATH)
+    /* the native GCM engine stands in when OpenSSL is not linked */
+    { SRTP_AES_GCM_128,  &srtp_aes_gcm_128 },
+    { SRTP_AES_GCM_256,  &srtp_aes_gcm_256 },
+#endif
+};
+
+static const srtp_builtin_auth_entry_t srtp_builtin_auth_types[] = {
+    { SRTP_NULL_AUTH,    &srtp_null_auth },
+    { SRTP_HMAC_SHA1,    &srtp_hmac },
+};
+
+#endif /* SRTP_PROFILE_CIPHERS_MINIMAL */
+
+#define SRTP_NUM_BUILTIN_CIPHERS \
+    (sizeof(srtp_builtin_cipher_types) / sizeof(srtp_builtin_cipher_types[0]))
+#define SRTP_NUM_BUILTIN_AUTHS \
+    (sizeof(srtp_builtin_auth_types) / sizeof(srtp_builtin_auth_types[0]))
+
+/* self-test caches: nonzero once the corresponding built-in passed */
+static int srtp_builtin_cipher_verified[SRTP_NUM_BUILTIN_CIPHERS];
+static int srtp_builtin_auth_verified[SRTP_NUM_BUILTIN_AUTHS];
+
+/*
+ * runtime overrides installed by srtp_replace_cipher_type() /
+ * srtp_replace_auth_type(); a non-NULL entry shadows the built-in
+ * with the same index
+ */
+static const srtp_cipher_type_t *srtp_builtin_cipher_override[SRTP_NUM_BUILTIN_CIPHERS];
+static const srtp_auth_type_t *srtp_builtin_auth_override[SRTP_NUM_BUILTIN_AUTHS];
+
+/* debug modules belonging to the built-in types, registered en bloc */
+static srtp_debug_module_t *srtp_builtin_debug_modules[] = {
+    &srtp_mod_crypto_kernel,
+    &srtp_mod_auth,
+    &srtp_mod_cipher,
+    &mod_stat,
+    &mod_alloc,
+    &srtp_mod_event_log,
+    &srtp_mod_aes_icm,
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+    &srtp_mod_aes_gcm,
+#endif
+    &srtp_mod_hmac,
+};
+
+#define SRTP_NUM_BUILTIN_DEBUG_MODULES \
+    (sizeof(srtp_builtin_debug_modules) / sizeof(srtp_builtin_debug_modules[0]))
+
+#define MAX_RNG_TRIALS 25
+
+/*
+ * O(1) resolution of a type id to its slot in the built-in tables
+ * (-1 when the id is not built in).  the case values must mirror the
+ * table order above; the compiler turns these switches into direct
+ * jumps, so allocation-time lookups cost a single indexed access
+ * instead of a list walk
+ */
+static int srtp_builtin_cipher_index (srtp_cipher_type_id_t id)
+{
+    switch (id) {
+#ifdef SRTP_PROFILE_CIPHERS_MINIMAL
+    case SRTP_NULL_CIPHER:  return 0;
+    case SRTP_AES_ICM_128:  return 1;
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+    case SRTP_AES_GCM_128:  return 2;
+#endif
+#else /* SRTP_PROFILE_CIPHERS_MINIMAL */
+    case SRTP_NULL_CIPHER:  return 0;
+    case SRTP_AES_ICM_128:  return 1;
+    case SRTP_AES_ICM_256:  return 2;
+#ifdef OPENSSL
+    case SRTP_AES_ICM_192:  return 3;
+    case SRTP_AES_GCM_128:  return 4;
+    case SRTP_AES_GCM_256:  return 5;
+#elif !defined(NO_64BIT_MATH)
+    case SRTP_AES_GCM_128:  return 3;
+    case SRTP_AES_GCM_256:  return 4;
+#endif
+#endif /* SRTP_PROFILE_CIPHERS_MINIMAL */
+    default:                return -1;
     }
-    status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_icm_256, SRTP_AES_ICM_256);
-    if (status) {
-        return status;
+}
+
+static int srtp_builtin_auth_index (srtp_auth_type_id_t id)
+{
+    switch (id) {
+    case SRTP_NULL_AUTH:    return 0;
+#ifndef SRTP_PROFILE_CIPHERS_MINIMAL
+    case SRTP_HMAC_SHA1:    return 1;
+#endif
+    default:                return -1;
     }
-    status = srtp_crypto_kernel_load_debug_module(&srtp_mod_aes_icm);
-    if (status) {
-        return status;
+}
+
+/* when the known-answer tests run; see srtp_self_test_policy_t */
+static srtp_self_test_policy_t srtp_self_test_policy = srtp_self_test_eager;
+
+srtp_err_status_t srtp_crypto_kernel_set_self_test_policy (srtp_self_test_policy_t policy)
+{
+    if (policy != srtp_self_test_eager && policy != srtp_self_test_deferred) {
+        return srtp_err_status_bad_param;
     }
-#ifdef OPENSSL
-    status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_icm_192, SRTP_AES_ICM_192);
-    if (status) {
-        return status;
+    srtp_self_test_policy = policy;
+    return srtp_err_status_ok;
+}
+
+/*
+ * run the self-test for built-in cipher/auth table entry i, unless a
+ * previous run in this image already passed it
+ */
+static srtp_err_status_t srtp_builtin_cipher_self_test (unsigned int i)
+{
+    srtp_err_status_t status;
+
+    if (srtp_builtin_cipher_verified[i]) {
+        return srtp_err_status_ok;
     }
-    status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_gcm_128_openssl, SRTP_AES_GCM_128);
+    status = srtp_cipher_type_self_test(srtp_builtin_cipher_types[i].cipher_type);
     if (status) {
         return status;
     }
-    status = srtp_crypto_kernel_load_cipher_type(&srtp_aes_gcm_256_openssl, SRTP_AES_GCM_256);
-    if (status) {
-        return status;
+    srtp_builtin_cipher_verified[i] = 1;
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_builtin_auth_self_test (unsigned int i)
+{
+    srtp_err_status_t status;
+
+    if (srtp_builtin_auth_verified[i]) {
+        return srtp_err_status_ok;
     }
-    status = srtp_crypto_kernel_load_debug_module(&srtp_mod_aes_gcm);
+    status = srtp_auth_type_self_test(srtp_builtin_auth_types[i].auth_type);
     if (status) {
         return status;
     }
-#endif
+    srtp_builtin_auth_verified[i] = 1;
+    return srtp_err_status_ok;
+}
 
-    /* load auth func types */
-    status = srtp_crypto_kernel_load_auth_type(&srtp_null_auth, SRTP_NULL_AUTH);
-    if (status) {
-        return status;
+srtp_err_status_t srtp_crypto_kernel_init ()
+{
+    srtp_err_status_t status;
+    unsigned int i;
+
+    /* check the security state */
+    if (crypto_kernel.state == srtp_crypto_kernel_state_secure) {
+
+        /*
+         * we're already in the secure state; the self-test caches make
+         * this re-initialization a handful of flag checks
+         */
+        return srtp_err_status_ok;
     }
-    status = srtp_crypto_kernel_load_auth_type(&srtp_hmac, SRTP_HMAC_SHA1);
+
+    /* initialize error reporting system */
+    status = srtp_err_reporting_init();
     if (status) {
         return status;
     }
-    status = srtp_crypto_kernel_load_debug_module(&srtp_mod_hmac);
-    if (status) {
-        return status;
+
+    /*
+     * self-test the built-in types; results are cached, so only the
+     * first initialization in this image pays for the tests.  under
+     * the deferred policy the tests are left for first use: each type
+     * is verified by srtp_crypto_kernel_alloc_cipher()/_alloc_auth()
+     * before its first context is handed out
+     */
+    if (srtp_self_test_policy == srtp_self_test_eager) {
+        for (i = 0; i < SRTP_NUM_BUILTIN_CIPHERS; i++) {
+            status = srtp_builtin_cipher_self_test(i);
+            if (status) {
+                return status;
+            }
+        }
+        for (i = 0; i < SRTP_NUM_BUILTIN_AUTHS; i++) {
+            status = srtp_builtin_auth_self_test(i);
+            if (status) {
+                return status;
+            }
+        }
     }
 
     /* change state to secure */
@@ -210,8 +364,39 @@ srtp_err_status_t srtp_crypto_kernel_status ()
     srtp_err_status_t status;
     srtp_kernel_cipher_type_t  *ctype = crypto_kernel.cipher_type_list;
     srtp_kernel_auth_type_t    *atype = crypto_kernel.auth_type_list;
+    unsigned int i;
+
+    /* for each built-in cipher type, describe and test */
+    for (i = 0; i < SRTP_NUM_BUILTIN_CIPHERS; i++) {
+        const srtp_cipher_type_t *ct = srtp_builtin_cipher_override[i] ?
+            srtp_builtin_cipher_override[i] :
+            srtp_builtin_cipher_types[i].cipher_type;
+        srtp_err_report(srtp_err_level_info, "cipher: %s\n", ct->description);
+        srtp_err_report(srtp_err_level_info, "  self-test: ");
+        status = srtp_cipher_type_self_test(ct);
+        if (status) {
+            srtp_err_report(srtp_err_level_error, "failed with error code %d\n", status);
+            exit(status);
+        }
+        srtp_err_report(srtp_err_level_info, "passed\n");
+    }
+
+    /* for each built-in auth type, describe and test */
+    for (i = 0; i < SRTP_NUM_BUILTIN_AUTHS; i++) {
+        const srtp_auth_type_t *at = srtp_builtin_auth_override[i] ?
+            srtp_builtin_auth_override[i] :
+            srtp_builtin_auth_types[i].auth_type;
+        srtp_err_report(srtp_err_level_info, "auth func: %s\n", at->description);
+        srtp_err_report(srtp_err_level_info, "  self-test: ");
+        status = srtp_auth_type_self_test(at);
+        if (status) {
+            srtp_err_report(srtp_err_level_error, "failed with error code %d\n", status);
+            exit(status);
+        }
+        srtp_err_report(srtp_err_level_info, "passed\n");
+    }
 
-    /* for each cipher type, describe and test */
+    /* for each runtime-loaded cipher type, describe and test */
     while (ctype != NULL) {
         srtp_err_report(srtp_err_level_info, "cipher: %s\n", ctype->cipher_type->description);
         srtp_err_report(srtp_err_level_info, "  self-test: ");
@@ -224,7 +409,7 @@ srtp_err_status_t srtp_crypto_kernel_status ()
         ctype = ctype->next;
     }
 
-    /* for each auth type, describe and test */
+    /* for each runtime-loaded auth type, describe and test */
     while (atype != NULL) {
         srtp_err_report(srtp_err_level_info, "auth func: %s\n", atype->auth_type->description);
         srtp_err_report(srtp_err_level_info, "  self-test: ");
@@ -245,9 +430,18 @@ srtp_err_status_t srtp_crypto_kernel_status ()
 srtp_err_status_t srtp_crypto_kernel_list_debug_modules ()
 {
     srtp_kernel_debug_module_t *dm = crypto_kernel.debug_module_list;
+    unsigned int i;
 
     /* describe each debug module */
     srtp_err_report(srtp_err_level_info, "debug modules loaded:\n");
+    for (i = 0; i < SRTP_NUM_BUILTIN_DEBUG_MODULES; i++) {
+        srtp_err_report(srtp_err_level_info, "  %s ", srtp_builtin_debug_modules[i]->name);
+        if (srtp_builtin_debug_modules[i]->on) {
+            srtp_err_report(srtp_err_level_info, "(on)\n");
+        } else{
+            srtp_err_report(srtp_err_level_info, "(off)\n");
+        }
+    }
     while (dm != NULL) {
         srtp_err_report(srtp_err_level_info, "  %s ", dm->mod->name);
         if (dm->mod->on) {
@@ -263,10 +457,22 @@ srtp_err_status_t srtp_crypto_kernel_list_debug_modules ()
 
 srtp_err_status_t srtp_crypto_kernel_shutdown ()
 {
+    unsigned int i;
+
     /*
-     * free dynamic memory used in crypto_kernel at present
+     * free dynamic memory used in crypto_kernel at present; the
+     * built-in tables are static and the self-test caches survive,
+     * so a later re-initialization is nearly free
      */
 
+    /* drop any runtime overrides of built-in types */
+    for (i = 0; i < SRTP_NUM_BUILTIN_CIPHERS; i++) {
+        srtp_builtin_cipher_override[i] = NULL;
+    }
+    for (i = 0; i < SRTP_NUM_BUILTIN_AUTHS; i++) {
+        srtp_builtin_auth_override[i] = NULL;
+    }
+
     /* walk down cipher type list, freeing memory */
     while (crypto_kernel.cipher_type_list != NULL) {
         srtp_kernel_cipher_type_t *ctype = crypto_kernel.cipher_type_list;
@@ -307,6 +513,7 @@ static inline srtp_err_status_t srtp_crypto_kernel_do_load_cipher_type (const sr
 {
     srtp_kernel_cipher_type_t *ctype, *new_ctype;
     srtp_err_status_t status;
+    int i;
 
     /* defensive coding */
     if (new_ct == NULL) {
@@ -323,6 +530,24 @@ static inline srtp_err_status_t srtp_crypto_kernel_do_load_cipher_type (const sr
         return status;
     }
 
+    /*
+     * a built-in id can only be replaced, not loaded a second time;
+     * a replacement shadows the built-in through its override slot
+     */
+    i = srtp_builtin_cipher_index(id);
+    if (i >= 0) {
+        if (!replace) {
+            return srtp_err_status_bad_param;
+        }
+        status = srtp_cipher_type_test(new_ct,
+            srtp_builtin_cipher_types[i].cipher_type->test_data);
+        if (status) {
+            return status;
+        }
+        srtp_builtin_cipher_override[i] = new_ct;
+        return srtp_err_status_ok;
+    }
+
     /* walk down list, checking if this type is in the list already  */
     ctype = crypto_kernel.cipher_type_list;
     while (ctype != NULL) {
@@ -376,6 +601,7 @@ srtp_err_status_t srtp_crypto_kernel_do_load_auth_type (const srtp_auth_type_t *
 {
     srtp_kernel_auth_type_t *atype, *new_atype;
     srtp_err_status_t status;
+    int i;
 
     /* defensive coding */
     if (new_at == NULL) {
@@ -392,6 +618,24 @@ srtp_err_status_t srtp_crypto_kernel_do_load_auth_type (const srtp_auth_type_t *
         return status;
     }
 
+    /*
+     * a built-in id can only be replaced, not loaded a second time;
+     * a replacement shadows the built-in through its override slot
+     */
+    i = srtp_builtin_auth_index(id);
+    if (i >= 0) {
+        if (!replace) {
+            return srtp_err_status_bad_param;
+        }
+        status = srtp_auth_type_test(new_at,
+            srtp_builtin_auth_types[i].auth_type->test_data);
+        if (status) {
+            return status;
+        }
+        srtp_builtin_auth_override[i] = new_at;
+        return srtp_err_status_ok;
+    }
+
     /* walk down list, checking if this type is in the list already  */
     atype = crypto_kernel.auth_type_list;
     while (atype != NULL) {
@@ -446,6 +690,16 @@ srtp_err_status_t srtp_replace_auth_type (const srtp_auth_type_t *new_at, srtp_a
 const srtp_cipher_type_t * srtp_crypto_kernel_get_cipher_type (srtp_cipher_type_id_t id)
 {
     srtp_kernel_cipher_type_t *ctype;
+    int i;
+
+    /* resolve built-in ids with a direct index */
+    i = srtp_builtin_cipher_index(id);
+    if (i >= 0) {
+        if (srtp_builtin_cipher_override[i] != NULL) {
+            return srtp_builtin_cipher_override[i];
+        }
+        return srtp_builtin_cipher_types[i].cipher_type;
+    }
 
     /* walk down list, looking for id  */
     ctype = crypto_kernel.cipher_type_list;
@@ -464,6 +718,8 @@ const srtp_cipher_type_t * srtp_crypto_kernel_get_cipher_type (srtp_cipher_type_
 srtp_err_status_t srtp_crypto_kernel_alloc_cipher (srtp_cipher_type_id_t id, srtp_cipher_pointer_t *cp, int key_len, int tag_len)
 {
     const srtp_cipher_type_t *ct;
+    srtp_err_status_t status;
+    int i;
 
     /*
      * if the crypto_kernel is not yet initialized, we refuse to allocate
@@ -473,6 +729,18 @@ srtp_err_status_t srtp_crypto_kernel_alloc_cipher (srtp_cipher_type_id_t id, srt
         return srtp_err_status_init_fail;
     }
 
+    /*
+     * under the deferred self-test policy, the known-answer tests run
+     * here, on first use; the cached flag makes this a no-op afterwards
+     */
+    i = srtp_builtin_cipher_index(id);
+    if (i >= 0) {
+        status = srtp_builtin_cipher_self_test((unsigned int)i);
+        if (status) {
+            return status;
+        }
+    }
+
     ct = srtp_crypto_kernel_get_cipher_type(id);
     if (!ct) {
         return srtp_err_status_fail;
@@ -481,11 +749,55 @@ srtp_err_status_t srtp_crypto_kernel_alloc_cipher (srtp_cipher_type_id_t id, srt
     return ((ct)->alloc(cp, key_len, tag_len));
 }
 
+srtp_err_status_t srtp_crypto_kernel_place_cipher (srtp_cipher_type_id_t id, srtp_cipher_t *c, void *state, size_t state_octets, int key_len, int tag_len)
+{
+    const srtp_cipher_type_t *ct;
+    srtp_err_status_t status;
+    int i;
+
+    /*
+     * if the crypto_kernel is not yet initialized, we refuse to set up
+     * any ciphers - this is a bit extra-paranoid
+     */
+    if (crypto_kernel.state != srtp_crypto_kernel_state_secure) {
+        return srtp_err_status_init_fail;
+    }
+
+    /*
+     * under the deferred self-test policy, the known-answer tests run
+     * here, on first use; the cached flag makes this a no-op afterwards
+     */
+    i = srtp_builtin_cipher_index(id);
+    if (i >= 0) {
+        status = srtp_builtin_cipher_self_test((unsigned int)i);
+        if (status) {
+            return status;
+        }
+    }
+
+    ct = srtp_crypto_kernel_get_cipher_type(id);
+    if (!ct) {
+        return srtp_err_status_fail;
+    }
+
+    return srtp_cipher_type_place(ct, c, state, state_octets, key_len, tag_len);
+}
+
 
 
 const srtp_auth_type_t * srtp_crypto_kernel_get_auth_type (srtp_auth_type_id_t id)
 {
     srtp_kernel_auth_type_t *atype;
+    int i;
+
+    /* resolve built-in ids with a direct index */
+    i = srtp_builtin_auth_index(id);
+    if (i >= 0) {
+        if (srtp_builtin_auth_override[i] != NULL) {
+            return srtp_builtin_auth_override[i];
+        }
+        return srtp_builtin_auth_types[i].auth_type;
+    }
 
     /* walk down list, looking for id  */
     atype = crypto_kernel.auth_type_list;
@@ -503,6 +815,8 @@ const srtp_auth_type_t * srtp_crypto_kernel_get_auth_type (srtp_auth_type_id_t i
 srtp_err_status_t srtp_crypto_kernel_alloc_auth (srtp_auth_type_id_t id, srtp_auth_pointer_t *ap, int key_len, int tag_len)
 {
     const srtp_auth_type_t *at;
+    srtp_err_status_t status;
+    int i;
 
     /*
      * if the crypto_kernel is not yet initialized, we refuse to allocate
@@ -512,6 +826,18 @@ srtp_err_status_t srtp_crypto_kernel_alloc_auth (srtp_auth_type_id_t id, srtp_au
         return srtp_err_status_init_fail;
     }
 
+    /*
+     * under the deferred self-test policy, the known-answer tests run
+     * here, on first use; the cached flag makes this a no-op afterwards
+     */
+    i = srtp_builtin_auth_index(id);
+    if (i >= 0) {
+        status = srtp_builtin_auth_self_test((unsigned int)i);
+        if (status) {
+            return status;
+        }
+    }
+
     at = srtp_crypto_kernel_get_auth_type(id);
     if (!at) {
         return srtp_err_status_fail;
@@ -523,12 +849,20 @@ srtp_err_status_t srtp_crypto_kernel_alloc_auth (srtp_auth_type_id_t id, srtp_au
 srtp_err_status_t srtp_crypto_kernel_load_debug_module (srtp_debug_module_t *new_dm)
 {
     srtp_kernel_debug_module_t *kdm, *new;
+    unsigned int i;
 
     /* defensive coding */
     if (new_dm == NULL) {
         return srtp_err_status_bad_param;
     }
 
+    /* the built-in modules are registered at compile time */
+    for (i = 0; i < SRTP_NUM_BUILTIN_DEBUG_MODULES; i++) {
+        if (strncmp(new_dm->name, srtp_builtin_debug_modules[i]->name, 64) == 0) {
+            return srtp_err_status_bad_param;
+        }
+    }
+
     /* walk down list, checking if this type is in the list already  */
     kdm = crypto_kernel.debug_module_list;
     while (kdm != NULL) {
@@ -558,6 +892,15 @@ srtp_err_status_t srtp_crypto_kernel_load_debug_module (srtp_debug_module_t *new
 srtp_err_status_t srtp_crypto_kernel_set_debug_module (const char *name, int on)
 {
     srtp_kernel_debug_module_t *kdm;
+    unsigned int i;
+
+    /* check the built-in modules first */
+    for (i = 0; i < SRTP_NUM_BUILTIN_DEBUG_MODULES; i++) {
+        if (strncmp(name, srtp_builtin_debug_modules[i]->name, 64) == 0) {
+            srtp_builtin_debug_modules[i]->on = on;
+            return srtp_err_status_ok;
+        }
+    }
 
     /* walk down list, checking if this type is in the list already  */
     kdm = crypto_kernel.debug_module_list;
@@ -47,8 +47,10 @@
 #endif
 
 #include "err.h"
+#include "alloc.h"
 #include "datatypes.h"
 #include <string.h>
+#include <time.h>
 
 /* srtp_err_file is the FILE to which errors are reported */
 
@@ -104,3 +106,172 @@ void srtp_err_report (srtp_err_reporting_level_t level, const char *format, ...)
         va_end(args);
     }
 }
+
+/*
+ * structured event log
+ *
+ * each thread that calls srtp_err_event_log() owns a single-producer
+ * ring; the drain thread is the only consumer.  the producer publishes
+ * a record by filling the slot and then advancing head with a release
+ * store, and the consumer advances tail the same way, so neither side
+ * ever takes a lock.  head and tail are free-running counters; the
+ * ring is full when they differ by the ring size, and a full ring
+ * drops the new event (counted in 'dropped') rather than overwriting
+ * records the drainer has not read yet.
+ *
+ * rings are pushed onto a global list when first used and are retained
+ * for the lifetime of the process, so the thread-local ring pointer
+ * never dangles and needs no synchronization against teardown.
+ */
+
+srtp_debug_module_t srtp_mod_event_log = {
+    0,           /* debugging is off by default */
+    "event log"  /* printable name              */
+};
+
+#define SRTP_ERR_EVENT_RING_SIZE 256 /* events per thread, a power of two */
+
+typedef struct srtp_err_event_ring_t {
+    srtp_err_event_t event[SRTP_ERR_EVENT_RING_SIZE];
+    volatile uint32_t head;    /* next slot to fill, owned by logger  */
+    volatile uint32_t tail;    /* next slot to read, owned by drainer */
+    volatile uint32_t dropped; /* events lost to ring overflow        */
+    struct srtp_err_event_ring_t *next;
+} srtp_err_event_ring_t;
+
+#if defined(__GNUC__)
+#define err_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define err_load_acquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ERR_THREAD_LOCAL        __thread
+#else
+/* without compiler support the log degrades to single-threaded use */
+#define err_store_release(p, v) (*(p) = (v))
+#define err_load_acquire(p)     (*(p))
+#define ERR_THREAD_LOCAL
+#endif
+
+/* list of every ring ever created, walked by the drainer */
+static srtp_err_event_ring_t * volatile srtp_err_event_ring_list = NULL;
+
+/* the calling thread's own ring, NULL until its first event */
+static ERR_THREAD_LOCAL srtp_err_event_ring_t *srtp_err_event_ring = NULL;
+
+static srtp_err_reporting_level_t srtp_err_event_level = srtp_err_level_warning;
+
+static uint64_t srtp_err_event_timestamp (void)
+{
+#ifdef NO_64BIT_MATH
+    return make64(0, (uint32_t)time(NULL));
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)time(NULL) * 1000000000;
+#endif
+}
+
+/*
+ * allocates the calling thread's ring and publishes it on the global
+ * list; runs once per logging thread
+ */
+static srtp_err_event_ring_t * srtp_err_event_ring_create (void)
+{
+    srtp_err_event_ring_t *ring;
+
+    ring = (srtp_err_event_ring_t*)srtp_crypto_alloc(sizeof(srtp_err_event_ring_t));
+    if (ring == NULL) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(srtp_err_event_ring_t));
+
+#if defined(__GNUC__)
+    {
+        srtp_err_event_ring_t *head = srtp_err_event_ring_list;
+        do {
+            ring->next = head;
+        } while (!__atomic_compare_exchange_n(&srtp_err_event_ring_list,
+                                              &head, ring, 0,
+                                              __ATOMIC_RELEASE,
+                                              __ATOMIC_RELAXED));
+    }
+#else
+    ring->next = srtp_err_event_ring_list;
+    srtp_err_event_ring_list = ring;
+#endif
+    srtp_err_event_ring = ring;
+
+    return ring;
+}
+
+void srtp_err_event_log (srtp_err_reporting_level_t level, uint32_t code,
+                         uint32_t ssrc, uint64_t index)
+{
+    srtp_err_event_ring_t *ring = srtp_err_event_ring;
+    srtp_err_event_t *e;
+    uint32_t head, tail;
+
+    if (!srtp_mod_event_log.on || level > srtp_err_event_level) {
+        return;
+    }
+    if (ring == NULL) {
+        ring = srtp_err_event_ring_create();
+        if (ring == NULL) {
+            return; /* out of memory - drop the event */
+        }
+    }
+
+    head = ring->head;
+    tail = err_load_acquire(&ring->tail);
+    if (head - tail == SRTP_ERR_EVENT_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+
+    e = &ring->event[head & (SRTP_ERR_EVENT_RING_SIZE - 1)];
+    e->timestamp = srtp_err_event_timestamp();
+    e->index = index;
+    e->code = code;
+    e->ssrc = ssrc;
+    e->level = (uint32_t)level;
+    e->reserved = 0;
+    err_store_release(&ring->head, head + 1);
+}
+
+size_t srtp_err_event_drain (srtp_err_event_t *events, size_t max_events,
+                             uint64_t *dropped)
+{
+    srtp_err_event_ring_t *ring;
+    uint32_t head, tail, total_dropped = 0;
+    size_t count = 0;
+
+    for (ring = err_load_acquire(&srtp_err_event_ring_list);
+         ring != NULL; ring = ring->next) {
+        tail = ring->tail;
+        head = err_load_acquire(&ring->head);
+        while (tail != head && count < max_events) {
+            events[count++] = ring->event[tail & (SRTP_ERR_EVENT_RING_SIZE - 1)];
+            tail++;
+        }
+        err_store_release(&ring->tail, tail);
+        total_dropped += ring->dropped;
+    }
+    if (dropped != NULL) {
+#ifdef NO_64BIT_MATH
+        *dropped = make64(0, total_dropped);
+#else
+        *dropped = total_dropped;
+#endif
+    }
+
+    return count;
+}
+
+srtp_err_status_t srtp_err_event_set_level (srtp_err_reporting_level_t level)
+{
+    if (level > srtp_err_level_debug) {
+        return srtp_err_status_bad_param;
+    }
+    srtp_err_event_level = level;
+    return srtp_err_status_ok;
+}
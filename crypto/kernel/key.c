@@ -63,6 +63,7 @@ srtp_err_status_t srtp_key_limit_set (srtp_key_limit_t key, const srtp_xtd_seq_n
 #endif
     key->num_left = s;
     key->state = srtp_key_state_normal;
+    key->pending = 0;
     return srtp_err_status_ok;
 }
 
@@ -118,3 +119,30 @@ srtp_key_event_t srtp_key_limit_update (srtp_key_limit_t key)
     return srtp_key_event_soft_limit;
 }
 
+srtp_key_event_t srtp_key_limit_update_batched (srtp_key_limit_t key)
+{
+#ifndef NO_64BIT_MATH
+    /*
+     * fast path: while at least a full batch (plus the packets already
+     * pending) remains above the soft limit, just count the packet and
+     * charge the batch in one subtraction when it fills up
+     */
+    if (key->state == srtp_key_state_normal &&
+        key->num_left > (srtp_xtd_seq_num_t)soft_limit + SRTP_KEY_LIMIT_BATCH) {
+        if (++key->pending < SRTP_KEY_LIMIT_BATCH) {
+            return srtp_key_event_normal;
+        }
+        key->num_left -= key->pending;
+        key->pending = 0;
+        return srtp_key_event_normal;
+    }
+    /* nearing the soft limit; flush the pending count and fall back to
+     * exact per-packet accounting */
+    if (key->pending > 0) {
+        key->num_left -= key->pending;
+        key->pending = 0;
+    }
+#endif
+    return srtp_key_limit_update(key);
+}
+
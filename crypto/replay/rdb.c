@@ -58,6 +58,10 @@
  * bitmask      a bit-buffer, containing the most recently entered
  *              index as the leftmost bit
  *
+ * the bitmask is held in a v128_t but operated on through its 64-bit
+ * lanes, so the test, set and shift on the packet-receipt path are
+ * each one or two word operations instead of the bit-granular v128
+ * macros
  */
 
 /* srtp_rdb_init initalizes rdb */
@@ -73,6 +77,7 @@ srtp_err_status_t srtp_rdb_init (srtp_rdb_t *rdb)
  */
 srtp_err_status_t srtp_rdb_check (const srtp_rdb_t *rdb, uint32_t p_index)
 {
+    uint32_t delta;
 
     /* if the index appears after (or at very end of) the window, its good */
     if (p_index >= rdb->window_start + rdb_bits_in_bitmask) {
@@ -85,7 +90,8 @@ srtp_err_status_t srtp_rdb_check (const srtp_rdb_t *rdb, uint32_t p_index)
     }
 
     /* otherwise, the index appears within the window, so check the bitmask */
-    if (v128_get_bit(&rdb->bitmask, (p_index - rdb->window_start)) == 1) {
+    delta = p_index - rdb->window_start;
+    if ((rdb->bitmask.v64[delta >> 6] >> (delta & 63)) & 1) {
         return srtp_err_status_replay_fail;
     }
 
@@ -93,6 +99,26 @@ srtp_err_status_t srtp_rdb_check (const srtp_rdb_t *rdb, uint32_t p_index)
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_rdb_shift shifts the window forward by delta bits, moving bits
+ * toward index zero; it is the two-word equivalent of the old
+ * v128_left_shift() call
+ */
+static void srtp_rdb_shift (srtp_rdb_t *rdb, uint32_t delta)
+{
+    if (delta >= rdb_bits_in_bitmask) {
+        rdb->bitmask.v64[0] = 0;
+        rdb->bitmask.v64[1] = 0;
+    } else if (delta >= 64) {
+        rdb->bitmask.v64[0] = rdb->bitmask.v64[1] >> (delta - 64);
+        rdb->bitmask.v64[1] = 0;
+    } else if (delta > 0) {
+        rdb->bitmask.v64[0] = (rdb->bitmask.v64[0] >> delta) |
+                              (rdb->bitmask.v64[1] << (64 - delta));
+        rdb->bitmask.v64[1] >>= delta;
+    }
+}
+
 /*
  * srtp_rdb_add_index adds index to srtp_rdb_t (and does *not* check if
  * index appears in db)
@@ -103,7 +129,7 @@ srtp_err_status_t srtp_rdb_check (const srtp_rdb_t *rdb, uint32_t p_index)
  */
 srtp_err_status_t srtp_rdb_add_index (srtp_rdb_t *rdb, uint32_t p_index)
 {
-    int delta;
+    uint32_t delta;
 
     /* here we *assume* that p_index > rdb->window_start */
 
@@ -111,15 +137,15 @@ srtp_err_status_t srtp_rdb_add_index (srtp_rdb_t *rdb, uint32_t p_index)
     if (delta < rdb_bits_in_bitmask) {
 
         /* if the p_index is within the window, set the appropriate bit */
-        v128_set_bit(&rdb->bitmask, delta);
+        rdb->bitmask.v64[delta >> 6] |= ((uint64_t)1) << (delta & 63);
 
     } else {
 
         delta -= rdb_bits_in_bitmask - 1;
 
         /* shift the window forward by delta bits*/
-        v128_left_shift(&rdb->bitmask, delta);
-        v128_set_bit(&rdb->bitmask, rdb_bits_in_bitmask - 1);
+        srtp_rdb_shift(rdb, delta);
+        rdb->bitmask.v64[1] |= ((uint64_t)1) << 63;
         rdb->window_start += delta;
 
     }
@@ -127,6 +153,56 @@ srtp_err_status_t srtp_rdb_add_index (srtp_rdb_t *rdb, uint32_t p_index)
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_rdb_check_add_bulk validates and commits a sorted run of
+ * indices in a single pass; see rdb.h for the full contract
+ */
+srtp_err_status_t srtp_rdb_check_add_bulk (srtp_rdb_t *rdb,
+                                           const uint32_t *indices,
+                                           srtp_err_status_t *status,
+                                           int num_indices)
+{
+    srtp_err_status_t rc = srtp_err_status_ok;
+    uint32_t delta;
+    int i;
+
+    for (i = 0; i < num_indices; i++) {
+
+        /* since the run is sorted, indices behind the window can only
+           appear at its front */
+        if (indices[i] < rdb->window_start) {
+            status[i] = srtp_err_status_replay_old;
+            rc = srtp_err_status_fail;
+            continue;
+        }
+
+        delta = indices[i] - rdb->window_start;
+        if (delta >= rdb_bits_in_bitmask) {
+
+            /* the index is ahead of the window, so slide the window
+               forward and enter it as the leftmost bit */
+            delta -= rdb_bits_in_bitmask - 1;
+            srtp_rdb_shift(rdb, delta);
+            rdb->bitmask.v64[1] |= ((uint64_t)1) << 63;
+            rdb->window_start += delta;
+            status[i] = srtp_err_status_ok;
+
+        } else if ((rdb->bitmask.v64[delta >> 6] >> (delta & 63)) & 1) {
+
+            status[i] = srtp_err_status_replay_fail;
+            rc = srtp_err_status_fail;
+
+        } else {
+
+            rdb->bitmask.v64[delta >> 6] |= ((uint64_t)1) << (delta & 63);
+            status[i] = srtp_err_status_ok;
+
+        }
+    }
+
+    return rc;
+}
+
 srtp_err_status_t srtp_rdb_increment (srtp_rdb_t *rdb)
 {
 
@@ -134,41 +134,34 @@ int32_t srtp_index_guess (const srtp_xtd_seq_num_t *local, srtp_xtd_seq_num_t *g
     uint32_t local_roc = (uint32_t)(*local >> 16);
     uint16_t local_seq = (uint16_t)*local;
 #endif
-#ifdef NO_64BIT_MATH
-    uint32_t guess_roc = ((high32(*guess) << 16) |
-                          (low32(*guess) >> 16));
-    uint16_t guess_seq = (uint16_t)(low32(*guess));
-#else
-    uint32_t guess_roc = (uint32_t)(*guess >> 16);
-    uint16_t guess_seq = (uint16_t)*guess;
-#endif
+    uint32_t guess_roc;
     int32_t difference;
+    int32_t d, wrap_fwd, wrap_back;
 
-    if (local_seq < seq_num_median) {
-        if (s - local_seq > seq_num_median) {
-            guess_roc = local_roc - 1;
-            difference = s - local_seq - seq_num_max;
-        } else {
-            guess_roc = local_roc;
-            difference = s - local_seq;
-        }
-    } else {
-        if (local_seq - seq_num_median > s) {
-            guess_roc = local_roc + 1;
-            difference = s - local_seq + seq_num_max;
-        } else {
-            guess_roc = local_roc;
-            difference = s - local_seq;
-        }
-    }
-    guess_seq = s;
+    /*
+     * branchless estimate: either s lies within half the sequence
+     * space of local_seq (same rollover epoch), or the difference
+     * crossed a 2^16 boundary in one direction or the other.  the
+     * original nested comparisons on local_seq and the median reduce
+     * to these two symmetric conditions on the raw difference, which
+     * the compiler turns into flag-setting instructions instead of
+     * branches - on randomized reorder traffic the branchy form
+     * mispredicts constantly, and this function sits on the unprotect
+     * fast path
+     */
+    d = (int32_t)s - (int32_t)local_seq;
+    wrap_back = (d > (int32_t)seq_num_median);  /* s is from the previous epoch */
+    wrap_fwd = (d < -(int32_t)seq_num_median);  /* s is from the next epoch     */
+
+    guess_roc = local_roc + (uint32_t)wrap_fwd - (uint32_t)wrap_back;
+    difference = d + (wrap_fwd - wrap_back) * 65536;
 
     /* Note: guess_roc is 32 bits, so this generates a 48-bit result! */
 #ifdef NO_64BIT_MATH
     *guess = make64(guess_roc >> 16,
-                    (guess_roc << 16) | guess_seq);
+                    (guess_roc << 16) | s);
 #else
-    *guess = (((uint64_t)guess_roc) << 16) | guess_seq;
+    *guess = (((uint64_t)guess_roc) << 16) | s;
 #endif
 
     return difference;
@@ -194,10 +187,160 @@ srtp_err_status_t srtp_rdbx_init (srtp_rdbx_t *rdbx, unsigned long ws)
     }
 
     srtp_index_init(&rdbx->index);
+    rdbx->window_offset = 0;
+    rdbx->max_window = 0;
+    rdbx->reorder_depth = 0;
+    rdbx->adapt_count = 0;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * ring operations on the replay window
+ *
+ * logical window position p (0 = oldest, length-1 = newest) is stored
+ * at physical bit (p + window_offset) mod length, so sliding the
+ * window forward only advances the offset and clears the vacated
+ * bits; membership tests and insertions stay O(1) and a slide by
+ * delta touches at most delta bits' worth of words, independent of
+ * the window size
+ */
+
+static inline uint32_t srtp_rdbx_phys_bit (const srtp_rdbx_t *rdbx, uint32_t p)
+{
+    uint32_t idx = p + rdbx->window_offset;
+    uint32_t len = bitvector_get_length(&rdbx->bitmask);
+
+    return (idx >= len) ? idx - len : idx;
+}
+
+static void srtp_rdbx_window_slide (srtp_rdbx_t *rdbx, int delta)
+{
+    uint32_t len = bitvector_get_length(&rdbx->bitmask);
+    int i = 0;
+
+    if (delta >= (int)len) {
+        bitvector_set_to_zero(&rdbx->bitmask);
+        rdbx->window_offset = 0;
+        return;
+    }
+
+    /* clear the physical bits vacated by the slide; whole words are
+       cleared at once where the alignment allows */
+    while (i < delta && (srtp_rdbx_phys_bit(rdbx, (uint32_t)i) & 31) != 0) {
+        bitvector_clear_bit(&rdbx->bitmask, srtp_rdbx_phys_bit(rdbx, (uint32_t)i));
+        i++;
+    }
+    while (delta - i >= 32) {
+        rdbx->bitmask.word[srtp_rdbx_phys_bit(rdbx, (uint32_t)i) >> 5] = 0;
+        i += 32;
+    }
+    while (i < delta) {
+        bitvector_clear_bit(&rdbx->bitmask, srtp_rdbx_phys_bit(rdbx, (uint32_t)i));
+        i++;
+    }
+
+    rdbx->window_offset += delta;
+    if (rdbx->window_offset >= len) {
+        rdbx->window_offset -= len;
+    }
+}
+
+/*
+ * srtp_rdbx_resize(rdbx, new_ws) reallocates the bitmask to new_ws
+ * bits, keeping the newest entries aligned at the newest end of the
+ * window.  entries that do not fit into a smaller window are dropped,
+ * so a shrink can only turn an accept into a replay_old rejection,
+ * never a replay into an accept.  on a grow, the newly exposed older
+ * positions are marked as already seen: those indices had slid off
+ * the old window and were being rejected as replay_old, and leaving
+ * them clear would reopen them for replay.  resizes are rare (they
+ * happen on adaptation decisions, not per packet), so the bit-by-bit
+ * copy is not a concern
+ */
+static srtp_err_status_t srtp_rdbx_resize (srtp_rdbx_t *rdbx, unsigned long new_ws)
+{
+    bitvector_t new_mask;
+    uint32_t old_len = bitvector_get_length(&rdbx->bitmask);
+    uint32_t p;
+    int rv;
+
+    /*
+     * adaptation decisions run inside the packet paths, which are
+     * otherwise guarded as allocation-free; the replacement window is
+     * the one documented exception (see
+     * srtp_set_adaptive_replay_window()), so it is exempted from the
+     * guard
+     */
+    srtp_crypto_alloc_guard_suspend();
+    rv = bitvector_alloc(&new_mask, new_ws);
+    srtp_crypto_alloc_guard_resume();
+    if (rv != 0) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    for (p = 0; p < old_len && p < (uint32_t)new_ws; p++) {
+        if (bitvector_get_bit(&rdbx->bitmask,
+                              srtp_rdbx_phys_bit(rdbx, old_len - 1 - p)) == 1) {
+            bitvector_set_bit(&new_mask,
+                              bitvector_get_length(&new_mask) - 1 - p);
+        }
+    }
+    for (; p < (uint32_t)new_ws; p++) {
+        bitvector_set_bit(&new_mask, bitvector_get_length(&new_mask) - 1 - p);
+    }
+
+    bitvector_dealloc(&rdbx->bitmask);
+    rdbx->bitmask = new_mask;
+    rdbx->window_offset = 0;
 
     return srtp_err_status_ok;
 }
 
+/*
+ * adaptation policy for the window size
+ *
+ * the window is grown (doubled, up to max_window) as soon as the
+ * deepest in-window arrival since the last decision exceeds half the
+ * current length, i.e. before reordered packets start falling off the
+ * old edge; it is shrunk (halved, down to the start size) only after
+ * a long run of packets in which the observed depth stayed under an
+ * eighth of the length, so transient calm does not flap the size
+ */
+#define SRTP_RDBX_ADAPT_INTERVAL 4096
+
+static void srtp_rdbx_adapt (srtp_rdbx_t *rdbx, int delta)
+{
+    uint32_t len = bitvector_get_length(&rdbx->bitmask);
+    uint32_t depth = (delta <= 0) ? (uint32_t)(-delta) : 0;
+
+    if (depth > rdbx->reorder_depth) {
+        rdbx->reorder_depth = depth;
+    }
+
+    if (rdbx->reorder_depth > len / 2 && len < rdbx->max_window) {
+        uint32_t new_len = len * 2;
+
+        if (new_len > rdbx->max_window) {
+            new_len = rdbx->max_window;
+        }
+        /* on allocation failure, just keep the current window */
+        if (srtp_rdbx_resize(rdbx, new_len) == srtp_err_status_ok) {
+            rdbx->adapt_count = 0;
+        }
+        return;
+    }
+
+    if (++rdbx->adapt_count >= SRTP_RDBX_ADAPT_INTERVAL) {
+        rdbx->adapt_count = 0;
+        if (rdbx->reorder_depth < len / 8 &&
+            len / 2 >= SRTP_RDBX_ADAPTIVE_START_WINDOW) {
+            (void)srtp_rdbx_resize(rdbx, len / 2);
+        }
+        rdbx->reorder_depth = 0;
+    }
+}
+
 /*
  *  srtp_rdbx_dealloc(&r) frees memory for the srtp_rdbx_t pointed to by r
  */
@@ -218,6 +361,7 @@ srtp_err_status_t srtp_rdbx_dealloc (srtp_rdbx_t *rdbx)
 srtp_err_status_t srtp_rdbx_set_roc (srtp_rdbx_t *rdbx, uint32_t roc)
 {
     bitvector_set_to_zero(&rdbx->bitmask);
+    rdbx->window_offset = 0;
 
 #ifdef NO_64BIT_MATH
   #error not yet implemented
@@ -268,7 +412,8 @@ srtp_err_status_t srtp_rdbx_check (const srtp_rdbx_t *rdbx, int delta)
         /* if delta is lower than the bitmask, it's bad */
         return srtp_err_status_replay_old;
     } else if (bitvector_get_bit(&rdbx->bitmask,
-                                 (int)(bitvector_get_length(&rdbx->bitmask) - 1) + delta) == 1) {
+                                 srtp_rdbx_phys_bit(rdbx,
+                                     (uint32_t)((int)(bitvector_get_length(&rdbx->bitmask) - 1) + delta))) == 1) {
         /* delta is within the window, so check the bitmask */
         return srtp_err_status_replay_fail;
     }
@@ -289,20 +434,93 @@ srtp_err_status_t srtp_rdbx_add_index (srtp_rdbx_t *rdbx, int delta)
 {
 
     if (delta > 0) {
-        /* shift forward by delta */
+        /* slide the window forward by delta */
         srtp_index_advance(&rdbx->index, delta);
-        bitvector_left_shift(&rdbx->bitmask, delta);
-        bitvector_set_bit(&rdbx->bitmask, bitvector_get_length(&rdbx->bitmask) - 1);
+        srtp_rdbx_window_slide(rdbx, delta);
+        bitvector_set_bit(&rdbx->bitmask,
+                          srtp_rdbx_phys_bit(rdbx, bitvector_get_length(&rdbx->bitmask) - 1));
     } else {
         /* delta is in window */
-        bitvector_set_bit(&rdbx->bitmask, bitvector_get_length(&rdbx->bitmask) - 1 + delta);
+        bitvector_set_bit(&rdbx->bitmask,
+                          srtp_rdbx_phys_bit(rdbx, bitvector_get_length(&rdbx->bitmask) - 1 + delta));
     }
 
     /* note that we need not consider the case that delta == 0 */
 
+    if (rdbx->max_window != 0) {
+        srtp_rdbx_adapt(rdbx, delta);
+    }
+
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_rdbx_advance_sender(rdbx, s) advances the index by one when s
+ * is the sequence number immediately following it, which is the
+ * steady state of a sending stream; the estimator and the replay
+ * check are skipped, since a one-ahead index cannot appear in the
+ * window
+ */
+srtp_err_status_t srtp_rdbx_advance_sender (srtp_rdbx_t *rdbx,
+                                            srtp_sequence_number_t s)
+{
+    srtp_xtd_seq_num_t next = rdbx->index;
+
+    srtp_index_advance(&next, 1);
+#ifdef NO_64BIT_MATH
+    if ((srtp_sequence_number_t)low32(next) != s) {
+        return srtp_err_status_fail;
+    }
+#else
+    if ((srtp_sequence_number_t)next != s) {
+        return srtp_err_status_fail;
+    }
+#endif
+
+    return srtp_rdbx_add_index(rdbx, 1);
+}
+
+/*
+ * srtp_rdbx_set_adaptive(rdbx, max_ws) converts the rdbx to an
+ * adaptive window limited to max_ws bits, shrinking it to the start
+ * size; a max_ws of 0 pins the window at its current size again
+ */
+srtp_err_status_t srtp_rdbx_set_adaptive (srtp_rdbx_t *rdbx, unsigned long max_ws)
+{
+    srtp_err_status_t status;
+
+    if (max_ws == 0) {
+        rdbx->max_window = 0;
+        return srtp_err_status_ok;
+    }
+
+    if (max_ws < SRTP_RDBX_ADAPTIVE_START_WINDOW) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (bitvector_get_length(&rdbx->bitmask) != SRTP_RDBX_ADAPTIVE_START_WINDOW) {
+        status = srtp_rdbx_resize(rdbx, SRTP_RDBX_ADAPTIVE_START_WINDOW);
+        if (status) {
+            return status;
+        }
+    }
+
+    rdbx->max_window = (uint32_t)max_ws;
+    rdbx->reorder_depth = 0;
+    rdbx->adapt_count = 0;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_rdbx_get_adaptive_max(rdbx) returns the adaptive size limit of
+ * the rdbx, or 0 for a fixed window
+ */
+unsigned long srtp_rdbx_get_adaptive_max (const srtp_rdbx_t *rdbx)
+{
+    return rdbx->max_window;
+}
+
 
 
 /*
@@ -316,6 +534,23 @@ srtp_err_status_t srtp_rdbx_add_index (srtp_rdbx_t *rdbx, int delta)
 int32_t srtp_rdbx_estimate_index (const srtp_rdbx_t *rdbx, srtp_xtd_seq_num_t *guess, srtp_sequence_number_t s)
 {
 
+#ifndef NO_64BIT_MATH
+    /*
+     * fast path for strictly in-order traffic: nearly all packets on
+     * a wired path arrive with s equal to the last sequence number
+     * plus one, with no rollover, so handle that case with a single
+     * comparison before falling into the full guess logic
+     */
+    if (rdbx->index > seq_num_median) {
+        uint16_t next = (uint16_t)rdbx->index + 1;
+
+        if (s == next && next != 0) {
+            *guess = rdbx->index + 1;
+            return 1;
+        }
+    }
+#endif
+
     /*
      * if the sequence number and rollover counter in the rdbx are
      * non-zero, then use the srtp_index_guess(...) function, otherwise, just
@@ -390,6 +625,7 @@ srtp_err_status_t srtp_rdbx_set_roc_seq (srtp_rdbx_t *rdbx,
 #endif
 
     bitvector_set_to_zero(&rdbx->bitmask);
+    rdbx->window_offset = 0;
 
     return srtp_err_status_ok;
 }
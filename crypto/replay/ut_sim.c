@@ -79,11 +79,101 @@ ut_next_index(ut_connection *utc) {
   utc->buffer[0] = utc->index;
 
   qsort(utc->buffer, UT_BUF, sizeof(uint32_t), ut_compar);
-  
+
   return tmp;
 }
 
 
+/*
+ * the traffic model uses its own linear congruential generator
+ * (Numerical Recipes constants) rather than rand(), so that the
+ * sequence it emits depends only on the seed and is identical on
+ * every platform; the low-order bits of an LCG are weak, so only the
+ * high 24 bits are handed out
+ */
+static uint32_t
+ut_traffic_rand(ut_traffic *utt) {
+  utt->prng = utt->prng * 1664525 + 1013904223;
+  return utt->prng >> 8;
+}
+
+void
+ut_traffic_init(ut_traffic *utt, const ut_traffic_profile *profile,
+                uint32_t seed) {
+  uint32_t i;
+
+  utt->profile = *profile;
+  if (utt->profile.reorder_depth > UT_BUF)
+    utt->profile.reorder_depth = UT_BUF;
+  if (utt->profile.num_sizes > UT_SIZE_MIX_MAX)
+    utt->profile.num_sizes = UT_SIZE_MIX_MAX;
+  utt->prng = seed;
+  utt->next_index = 0;
+
+  /* prefill the in-flight buffer so that even the first packets can
+   * arrive out of order; it is kept one short of the reorder depth so
+   * that packets are normally picked at random and the forced
+   * delivery of an over-age packet below stays the exception */
+  utt->num_pending = 0;
+  for (i = 0; i + 1 < utt->profile.reorder_depth; i++)
+    utt->pending[utt->num_pending++] = utt->next_index++;
+
+  utt->ssrc = ut_traffic_rand(utt);
+  utt->key = 0;
+  utt->sent = 0;
+  utt->burst = 0;
+}
+
+void
+ut_traffic_next(ut_traffic *utt, ut_packet *pkt) {
+  const ut_traffic_profile *p = &utt->profile;
+  uint32_t slot, oldest, i;
+
+  /*
+   * pick the packet to deliver: a random in-flight slot, unless the
+   * oldest in-flight packet would exceed the reorder depth, in which
+   * case it is forced out first; this bounds the displacement of
+   * every packet by reorder_depth
+   */
+  if (utt->num_pending > 0) {
+    slot = ut_traffic_rand(utt) % utt->num_pending;
+    oldest = 0;
+    for (i = 1; i < utt->num_pending; i++)
+      if (utt->pending[i] < utt->pending[oldest])
+        oldest = i;
+    if (utt->next_index - utt->pending[oldest] >= p->reorder_depth)
+      slot = oldest;
+    pkt->index = utt->pending[slot];
+    utt->pending[slot] = utt->next_index++;
+  } else {
+    pkt->index = utt->next_index++;
+  }
+
+  utt->sent++;
+  if (p->ssrc_period != 0 && utt->sent % p->ssrc_period == 0)
+    utt->ssrc += ut_traffic_rand(utt) | 1;   /* guaranteed to change */
+  if (p->key_period != 0 && utt->sent % p->key_period == 0)
+    utt->key++;
+  pkt->ssrc = utt->ssrc;
+  pkt->key = utt->key;
+  pkt->size = (p->num_sizes > 0) ?
+    p->sizes[ut_traffic_rand(utt) % p->num_sizes] : 0;
+
+  /* a loss burst begins with probability loss_rate in 10000 and then
+   * swallows the next loss_burst packets */
+  if (utt->burst > 0) {
+    utt->burst--;
+    pkt->lost = 1;
+  } else if (p->loss_rate != 0 &&
+             ut_traffic_rand(utt) % 10000 < p->loss_rate) {
+    utt->burst = (p->loss_burst > 0) ? p->loss_burst - 1 : 0;
+    pkt->lost = 1;
+  } else {
+    pkt->lost = 0;
+  }
+}
+
+
 
 #ifdef UT_TEST
 
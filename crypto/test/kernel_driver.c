@@ -57,6 +57,9 @@ usage(char *prog_name) {
   exit(255);
 }
 
+srtp_err_status_t
+crypto_kernel_event_log_test(void);
+
 int
 main (int argc, char *argv[]) {
   int q;
@@ -103,6 +106,14 @@ main (int argc, char *argv[]) {
       exit(1);
     }
     printf("srtp_crypto_kernel passed self-tests\n");
+
+    printf("checking structured event log...\n");
+    status = crypto_kernel_event_log_test();
+    if (status) {
+      printf("failed\n");
+      exit(1);
+    }
+    printf("structured event log passed\n");
   }
 
   status = srtp_crypto_kernel_shutdown();
@@ -115,6 +126,88 @@ main (int argc, char *argv[]) {
   return 0;
 }
 
+/*
+ * crypto_kernel_event_log_test() exercises the structured event log:
+ * it verifies that the log is inert until its debug module is switched
+ * on, that logged records come back intact from the drain function,
+ * that the level threshold filters events, and that overflowing the
+ * ring drops events (counted) instead of overwriting unread ones
+ */
+
+srtp_err_status_t
+crypto_kernel_event_log_test(void) {
+  srtp_err_event_t events[64];
+  uint64_t dropped;
+  size_t count, total;
+  uint32_t i;
+  srtp_err_status_t status;
+
+  /* the log is off by default, so nothing should be recorded yet */
+  srtp_err_event_log(srtp_err_level_error, srtp_err_status_auth_fail,
+                     0xcafebabe, 0);
+  count = srtp_err_event_drain(events, 64, NULL);
+  if (count != 0)
+    return srtp_err_status_fail;
+
+  status = srtp_crypto_kernel_set_debug_module("event log", 1);
+  if (status)
+    return status;
+
+  /* events above the recording threshold (warning) are discarded */
+  srtp_err_event_log(srtp_err_level_debug, srtp_err_status_fail, 1, 2);
+
+  for (i = 0; i < 4; i++)
+    srtp_err_event_log(srtp_err_level_warning, srtp_err_status_replay_fail,
+                       0xdecafbad, 1000 + i);
+  count = srtp_err_event_drain(events, 64, &dropped);
+  if (count != 4 || dropped != 0)
+    return srtp_err_status_fail;
+  for (i = 0; i < 4; i++) {
+    if (events[i].code != srtp_err_status_replay_fail ||
+        events[i].ssrc != 0xdecafbad ||
+        events[i].level != (uint32_t)srtp_err_level_warning ||
+        events[i].timestamp == 0)
+      return srtp_err_status_fail;
+#ifndef NO_64BIT_MATH
+    if (events[i].index != 1000 + i)
+      return srtp_err_status_fail;
+#endif
+  }
+
+  /* raising the threshold lets debug events through */
+  status = srtp_err_event_set_level(srtp_err_level_debug);
+  if (status)
+    return status;
+  srtp_err_event_log(srtp_err_level_debug, srtp_err_status_fail, 1, 2);
+  count = srtp_err_event_drain(events, 64, NULL);
+  if (count != 1)
+    return srtp_err_status_fail;
+  status = srtp_err_event_set_level(srtp_err_level_warning);
+  if (status)
+    return status;
+
+  /* an out-of-range threshold is rejected */
+  if (srtp_err_event_set_level((srtp_err_reporting_level_t)42)
+      != srtp_err_status_bad_param)
+    return srtp_err_status_fail;
+
+  /*
+   * overflow the ring: a full ring drops new events, and every logged
+   * event is either drained or counted as dropped
+   */
+  for (i = 0; i < 1000; i++)
+    srtp_err_event_log(srtp_err_level_error, srtp_err_status_fail, i, i);
+  total = 0;
+  do {
+    count = srtp_err_event_drain(events, 64, &dropped);
+    total += count;
+  } while (count != 0);
+  if (total == 1000 || total + dropped != 1000)
+    return srtp_err_status_fail;
+
+  return srtp_crypto_kernel_set_debug_module("event log", 0);
+}
+
 /*
  * crypto_kernel_cipher_test() is a test of the cipher interface
  * of the crypto_kernel
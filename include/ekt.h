@@ -77,7 +77,9 @@ extern "C" {
 typedef uint16_t srtp_ekt_spi_t;
 
 
+#ifndef SRTP_PROFILE_NO_EKT
 unsigned srtp_ekt_octets_after_base_tag(srtp_ekt_stream_t ekt);
+#endif
 
 /*
  * an srtp_policy_t structure can contain a pointer to an
@@ -105,6 +107,7 @@ typedef struct srtp_ekt_data_t {
   uint8_t ekt_cipher_type;
   srtp_aes_expanded_key_t ekt_enc_key;
   srtp_aes_expanded_key_t ekt_dec_key;
+  uint8_t master_salt[SRTP_SALT_LEN]; /* shared via the EKT parameter set */
   struct ekt_data_t *next_ekt_data;
 } srtp_ekt_data_t;
 
@@ -123,49 +126,86 @@ typedef struct srtp_ekt_stream_ctx_t {
 
 
 
+#ifndef SRTP_PROFILE_NO_EKT
+
 srtp_err_status_t srtp_ekt_alloc(srtp_ekt_stream_t *stream_data, srtp_ekt_policy_t policy);
 
+srtp_err_status_t srtp_ekt_dealloc(srtp_ekt_stream_t stream_data);
+
 srtp_err_status_t srtp_ekt_stream_init(srtp_ekt_stream_t e, srtp_ekt_spi_t spi, void *ekt_key, unsigned ekt_cipher_type);
 
-srtp_err_status_t srtp_ekt_stream_init_from_policy(srtp_ekt_stream_t e, srtp_ekt_policy_t p);
-  
+/*
+ * srtp_ekt_stream_init_from_policy(e, p, master_key) (re)computes the
+ * cached Encrypted Master Key from the stream's master key (with
+ * salt), and records the master salt for receive-side provisioning.
+ * It runs at stream initialization and again on rekey, so the
+ * per-packet path never performs EKT crypto: appending a tag is a
+ * copy of the cached ciphertext plus the plaintext ROC/ISN/SPI
+ * fields.
+ */
+srtp_err_status_t srtp_ekt_stream_init_from_policy(srtp_ekt_stream_t e, srtp_ekt_policy_t p, const uint8_t *master_key);
+
 
 
 srtp_err_status_t srtp_stream_init_from_ekt(srtp_stream_t stream, const void *srtcp_hdr, unsigned pkt_octet_len);
-		
 
-void srtp_ekt_write_data(srtp_ekt_stream_t ekt, uint8_t *base_tag, unsigned base_tag_len, int *packet_len, srtp_xtd_seq_num_t pkt_index);		
 
 /*
- * We handle EKT by performing some additional steps before
- * authentication (copying the auth tag into a temporary location,
- * zeroizing the "base tag" field in the packet)
- *
- * With EKT, the tag_len parameter is actually the base tag
- * length
+ * srtp_ekt_write_data() appends the EKT fields (cached Encrypted
+ * Master Key, ROC, ISN, SPI) after the base authentication tag at
+ * base_tag, and grows *packet_len accordingly.  The base tag itself
+ * must already have been written by normal SRTCP authentication.
  */
-srtp_err_status_t srtp_ekt_tag_verification_preproces(uint8_t *pkt_tag, uint8_t *pkt_tag_copy, unsigned tag_len);
-
-srtp_err_status_t srtp_ekt_tag_verification_postproces(uint8_t *pkt_tag, uint8_t *pkt_tag_copy, unsigned tag_len);
+void srtp_ekt_write_data(srtp_ekt_stream_t ekt, uint8_t *base_tag, unsigned base_tag_len, int *packet_len, srtp_xtd_seq_num_t pkt_index);
 
+#else /* SRTP_PROFILE_NO_EKT */
 
 /*
- * @brief EKT pre-processing for srtcp tag generation
- *
- * This function does the pre-processing of the SRTCP authentication
- * tag format.  When EKT is used, it consists of writing the Encrypted
- * Master Key, the SRTP ROC, the Initial Sequence Number, and SPI
- * fields.  The Base Authentication Tag field is set to the all-zero
- * value
- * 
- * When EKT is not used, this function is a no-op.
- * 
+ * fixed-profile builds (see srtp_profile_gcm128.h) compile EKT out:
+ * the hooks below collapse to constants, and the EKT branches in
+ * srtp.c fold away with them
  */
-srtp_err_status_t srtp_stream_srtcp_auth_tag_generation_preprocess(const srtp_stream_t *s, uint8_t *pkt_tag, unsigned pkt_octet_len);
 
-/* it's not clear that a tag_generation_postprocess function is needed */
-srtp_err_status_t srtcp_auth_tag_generation_postprocess(void);
+static inline unsigned srtp_ekt_octets_after_base_tag(srtp_ekt_stream_t ekt) {
+  (void)ekt;
+  return 0;
+}
+
+static inline srtp_err_status_t srtp_ekt_alloc(srtp_ekt_stream_t *stream_data, srtp_ekt_policy_t policy) {
+  if (policy != NULL)
+    return srtp_err_status_bad_param;
+  *stream_data = NULL;
+  return srtp_err_status_ok;
+}
+
+static inline srtp_err_status_t srtp_ekt_dealloc(srtp_ekt_stream_t stream_data) {
+  (void)stream_data;
+  return srtp_err_status_ok;
+}
+
+static inline srtp_err_status_t srtp_ekt_stream_init(srtp_ekt_stream_t e, srtp_ekt_spi_t spi, void *ekt_key, unsigned ekt_cipher_type) {
+  (void)e; (void)spi; (void)ekt_key; (void)ekt_cipher_type;
+  return srtp_err_status_ok;
+}
+
+static inline srtp_err_status_t srtp_ekt_stream_init_from_policy(srtp_ekt_stream_t e, srtp_ekt_policy_t p, const uint8_t *master_key) {
+  (void)e; (void)master_key;
+  if (p != NULL)
+    return srtp_err_status_bad_param;
+  return srtp_err_status_ok;
+}
+
+static inline srtp_err_status_t srtp_stream_init_from_ekt(srtp_stream_t stream, const void *srtcp_hdr, unsigned pkt_octet_len) {
+  (void)stream; (void)srtcp_hdr; (void)pkt_octet_len;
+  return srtp_err_status_fail;
+}
+
+static inline void srtp_ekt_write_data(srtp_ekt_stream_t ekt, uint8_t *base_tag, unsigned base_tag_len, int *packet_len, srtp_xtd_seq_num_t pkt_index) {
+  (void)ekt; (void)base_tag; (void)base_tag_len; (void)packet_len;
+  (void)pkt_index;
+}
 
+#endif /* SRTP_PROFILE_NO_EKT */
 
 #ifdef __cplusplus
 }
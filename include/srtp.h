@@ -47,6 +47,7 @@
 #define SRTP_SRTP_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -192,6 +193,8 @@ typedef enum {
 
 typedef struct srtp_ctx_t_ srtp_ctx_t;
 
+typedef struct srtp_group_ctx_t_ *srtp_group_t;
+
 /**
  * @brief srtp_sec_serv_t describes a set of security services. 
  *
@@ -261,11 +264,27 @@ typedef enum {
  *
  */
 
-typedef struct { 
+typedef struct {
   srtp_ssrc_type_t type;  /**< The type of this particular SSRC */
   unsigned int     value; /**< The value of this SSRC, if it is not a wildcard */
 } srtp_ssrc_t;
 
+/**
+ * @brief srtp_stream_direction_t declares the expected direction of a
+ * stream in its policy.
+ *
+ * By default (srtp_stream_direction_any) a stream learns its direction
+ * from the first call made on it, and the opposite call then signals an
+ * SSRC collision.  A policy that declares the direction up front gets
+ * that collision detection from the first packet on, without the
+ * learn-on-first-use step.
+ */
+typedef enum {
+  srtp_stream_direction_any      = 0, /**< direction learned from first use */
+  srtp_stream_direction_sender   = 1, /**< stream is used with srtp_protect() */
+  srtp_stream_direction_receiver = 2  /**< stream is used with srtp_unprotect() */
+} srtp_stream_direction_t;
+
 
 /**
  * @brief points to an EKT policy
@@ -341,6 +360,25 @@ typedef struct srtp_policy_t {
 				*   is introduced!)                      */
   int *enc_xtn_hdr;            /**< List of header ids to encrypt.       */
   int enc_xtn_hdr_count;       /**< Number of entries in list of header ids. */
+  unsigned long max_template_streams; /**< For wildcard (SSRC_ANY_*)
+                                *   policies, the maximum number of
+                                *   streams that may be created from
+                                *   this template at one time, so that
+                                *   an SSRC flood cannot drive
+                                *   unbounded stream creation; zero
+                                *   (the default) means no limit.     */
+  srtp_stream_direction_t stream_direction; /**< The expected direction
+                                *   of the stream; the default
+                                *   (srtp_stream_direction_any) keeps
+                                *   the learn-on-first-use behavior. */
+  int rtp_only;                /**< When nonzero, no SRTCP cipher or
+                                *   auth contexts are allocated for
+                                *   this stream, and the RTCP calls on
+                                *   it fail with
+                                *   srtp_err_status_no_ctx; this
+                                *   roughly halves the per-stream
+                                *   crypto state for RTP-only
+                                *   receive fan-out.                  */
   struct srtp_policy_t *next;  /**< Pointer to next stream policy.       */
 } srtp_policy_t;
 
@@ -362,9 +400,41 @@ typedef struct srtp_policy_t {
 
 typedef srtp_ctx_t *srtp_t;
 
+/**
+ * @brief Thread safety of a session.
+ *
+ * libSRTP performs no locking of its own; instead, a session supports
+ * the following concurrent usage pattern without external locks:
+ *
+ *  - srtp_protect(), srtp_unprotect() and their variants may be called
+ *    concurrently from multiple threads on one session, provided that
+ *    all packets of a given SSRC are processed by a single thread at a
+ *    time (per-stream state - the rollover counter, replay window, and
+ *    cipher contexts - is written without synchronization).  This
+ *    per-SSRC guarantee holds only for streams added with
+ *    ssrc_specific policies: streams instantiated from a wildcard
+ *    template share the template's cipher and auth contexts, so all
+ *    packets of all template-cloned SSRCs together must be processed
+ *    by a single thread at a time.  Streams carrying a per-thread
+ *    cipher pool (see srtp_stream_set_thread_cipher_pool()) relax
+ *    this on the receive path: threads bound to distinct pool slots
+ *    may unprotect packets of that SSRC concurrently.
+ *
+ *  - At most one thread at a time may add a stream to the session
+ *    (srtp_add_stream(), or processing the first packet of an unknown
+ *    SSRC when the session has a wildcard template).  Such an addition
+ *    may run concurrently with data-path calls on other SSRCs; new
+ *    streams are published to the lookup structures so that a stream,
+ *    once found, is always fully initialized.
+ *
+ *  - Operations that destroy or replace state another thread might be
+ *    using - srtp_remove_stream(), srtp_update(), srtp_dealloc() -
+ *    require the session to be quiesced: no other call on the session
+ *    may be in flight.
+ */
 
 /**
- * @brief srtp_init() initializes the srtp library.  
+ * @brief srtp_init() initializes the srtp library.
  *
  * @warning This function @b must be called before any other srtp
  * functions.
@@ -372,6 +442,24 @@ typedef srtp_ctx_t *srtp_t;
 
 srtp_err_status_t srtp_init(void);
 
+/**
+ * @brief srtp_init_deferred() initializes the srtp library with
+ * deferred cipher self-tests.
+ *
+ * Like srtp_init(), but the known-answer self-tests of the crypto
+ * algorithms do not run during initialization; each algorithm is
+ * tested on the first srtp_create() that uses it, and a test failure
+ * surfaces from that call.  This trims srtp_init() to microseconds
+ * for latency-sensitive startup paths (e.g. per-call worker
+ * processes).  Deployments that require strictly synchronous
+ * verification before any use should keep calling srtp_init().
+ *
+ * @warning This function @b must be called before any other srtp
+ * functions.
+ */
+
+srtp_err_status_t srtp_init_deferred(void);
+
 /**
  * @brief srtp_shutdown() de-initializes the srtp library.
  *
@@ -567,6 +655,350 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx, void *srtp_hdr, int *len_ptr);
 srtp_err_status_t srtp_unprotect_mki(srtp_t ctx, void *srtp_hdr, int *len_ptr,
                                      unsigned int use_mki);
 
+/**
+ * @brief srtp_unprotect_info_t carries the processing details of one
+ * successfully unprotected packet.
+ *
+ * The structure reports values the library computed while verifying
+ * the packet, so callers that need them (jitter buffers, recorders,
+ * statistics pipelines) do not have to parse the RTP header a second
+ * time or track the rollover counter themselves.
+ */
+typedef struct srtp_unprotect_info_t {
+  uint64_t rtp_packet_index;   /**< full packet index of this packet:
+                                *   the rollover counter and the
+                                *   sequence number                    */
+  uint32_t roc;                /**< rollover counter of this packet    */
+  unsigned int payload_offset; /**< octets from the packet start to
+                                *   the payload, past any CSRCs and
+                                *   header extension                   */
+  unsigned int payload_length; /**< octets of decrypted payload        */
+  unsigned int mki_index;      /**< index of the master key that
+                                *   matched the packet's MKI; zero
+                                *   when MKI is not in use             */
+  int stream_created;          /**< nonzero when this packet caused
+                                *   the stream to be created from the
+                                *   session's wildcard template        */
+} srtp_unprotect_info_t;
+
+/**
+ * @brief srtp_unprotect_ex() is the Secure RTP receiver-side packet
+ * processing function that also reports packet processing details.
+ *
+ * The function call srtp_unprotect_ex(ctx, srtp_hdr, len_ptr, use_mki,
+ * info) behaves exactly as srtp_unprotect_mki(ctx, srtp_hdr, len_ptr,
+ * use_mki); in addition, when info is non-NULL and the packet is
+ * valid, *info is filled in with the details of the packet.  When any
+ * error is returned, no assumptions should be made about the contents
+ * of *info.
+ *
+ * @warning This function assumes that the SRTP packet is aligned on a
+ * 32-bit boundary.
+ *
+ * @param ctx is the SRTP session which applies to the particular packet.
+ *
+ * @param srtp_hdr is a pointer to the header of the SRTP packet
+ * (before the call).  after the function returns, it points to the
+ * rtp packet if srtp_err_status_ok was returned; otherwise, the value of
+ * the data to which it points is undefined.
+ *
+ * @param len_ptr is a pointer to the length in octets of the complete
+ * srtp packet (header and body) before the function call, and of the
+ * complete rtp packet after the call, if srtp_err_status_ok was returned.
+ * Otherwise, the value of the data to which it points is undefined.
+ *
+ * @param use_mki is a boolean to tell the system if mki is being used.  If
+ * set to false then will use the first set of session keys.  If set to true will
+ * use the session keys identified by the mki_index
+ *
+ * @param info is a pointer to the structure to fill in with the
+ * details of the packet, or NULL when they are not wanted.
+ *
+ * @return the same values as srtp_unprotect_mki().
+ *
+ */
+
+srtp_err_status_t srtp_unprotect_ex(srtp_t ctx, void *srtp_hdr, int *len_ptr,
+                                    unsigned int use_mki,
+                                    srtp_unprotect_info_t *info);
+
+/**
+ * @brief srtp_unprotect_copy() verifies and decrypts an SRTP packet
+ * into a caller-provided output buffer, leaving the input untouched.
+ *
+ * The function call srtp_unprotect_copy(ctx, srtp_hdr, srtp_len,
+ * rtp_hdr, rtp_len_ptr) behaves as srtp_unprotect() except that the
+ * plaintext RTP packet is written to rtp_hdr and the ciphertext at
+ * srtp_hdr is never modified.  This is intended for forwarding
+ * elements that must retain the original ciphertext (for repair or
+ * retransmission to further hops) and would otherwise have to copy
+ * every packet defensively before unprotecting it in place.
+ *
+ * When the function fails - including an authentication failure - the
+ * input is still intact, but no assumptions should be made about the
+ * contents of the output buffer.  The input and output buffers must
+ * not overlap.
+ *
+ * @warning This function assumes that both buffers are aligned on a
+ * 32-bit boundary.
+ *
+ * @param ctx is the SRTP session which applies to the particular packet.
+ *
+ * @param srtp_hdr is a pointer to the header of the SRTP packet; it
+ * is not modified by the call.
+ *
+ * @param srtp_len is the length in octets of the complete SRTP packet
+ * (header and body).
+ *
+ * @param rtp_hdr is a pointer to the buffer which receives the
+ * plaintext RTP packet.
+ *
+ * @param rtp_len_ptr is a pointer to the capacity in octets of the
+ * output buffer before the function call, which must be at least
+ * srtp_len, and to the length of the complete rtp packet after the
+ * call, if srtp_err_status_ok was returned.  Otherwise, the value of
+ * the data to which it points is undefined.
+ *
+ * @return the same values as srtp_unprotect(), plus
+ *    - srtp_err_status_bad_param  if the output capacity is less than
+ *                                 srtp_len
+ */
+srtp_err_status_t srtp_unprotect_copy(srtp_t ctx, const void *srtp_hdr,
+                                      int srtp_len, void *rtp_hdr,
+                                      int *rtp_len_ptr);
+
+/**
+ * @brief srtp_protect_batch() applies SRTP protection to a batch of
+ * RTP packets.
+ *
+ * The function call srtp_protect_batch(ctx, rtp_hdr, len_ptr, status,
+ * num_pkts) applies SRTP protection to each of the num_pkts RTP
+ * packets in the array rtp_hdr, exactly as srtp_protect() would, but
+ * amortizes the per-call entry cost (stream resolution and session
+ * key setup) across the batch.  Packets are processed in array order,
+ * so packets belonging to the same stream must appear in increasing
+ * sequence number order.  The status of each packet is written to the
+ * corresponding element of the status array, allowing individual
+ * packets to fail (e.g. replay check) without aborting the batch.
+ *
+ * @warning The per-packet assumptions and requirements of
+ * srtp_protect() apply to each packet in the batch.
+ *
+ * @param ctx is the SRTP context to use in processing the packets.
+ *
+ * @param rtp_hdr is an array of num_pkts pointers to RTP packets;
+ * after the function returns, each points to an srtp packet if the
+ * corresponding status is srtp_err_status_ok.
+ *
+ * @param len_ptr is an array of num_pkts packet lengths in octets,
+ * updated in place like the len_ptr argument of srtp_protect().
+ *
+ * @param status is an array of num_pkts elements which receives the
+ * srtp_protect() result for each packet.
+ *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok     all packets were protected successfully
+ *    - srtp_err_status_fail   at least one packet failed; see the
+ *                             status array for per-packet results
+ */
+
+srtp_err_status_t srtp_protect_batch(srtp_t ctx, void **rtp_hdr, int *len_ptr,
+                                     srtp_err_status_t *status, int num_pkts);
+
+/**
+ * @brief srtp_unprotect_batch() verifies and decrypts a batch of SRTP
+ * packets.
+ *
+ * The function call srtp_unprotect_batch(ctx, srtp_hdr, len_ptr,
+ * status, num_pkts) processes each of the num_pkts SRTP packets in
+ * the array srtp_hdr exactly as srtp_unprotect() would, writing the
+ * per-packet result into the status array.  A packet that fails
+ * authentication or the replay check does not abort the batch; the
+ * remaining packets are still processed.
+ *
+ * @warning The per-packet assumptions and requirements of
+ * srtp_unprotect() apply to each packet in the batch.
+ *
+ * @param ctx is the SRTP session which applies to the packets.
+ *
+ * @param srtp_hdr is an array of num_pkts pointers to SRTP packets;
+ * after the function returns, each points to an rtp packet if the
+ * corresponding status is srtp_err_status_ok.
+ *
+ * @param len_ptr is an array of num_pkts packet lengths in octets,
+ * updated in place like the len_ptr argument of srtp_unprotect().
+ *
+ * @param status is an array of num_pkts elements which receives the
+ * srtp_unprotect() result for each packet.
+ *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok     all packets were unprotected successfully
+ *    - srtp_err_status_fail   at least one packet failed; see the
+ *                             status array for per-packet results
+ */
+
+srtp_err_status_t srtp_unprotect_batch(srtp_t ctx, void **srtp_hdr,
+                                       int *len_ptr,
+                                       srtp_err_status_t *status,
+                                       int num_pkts);
+
+/**
+ * @brief srtp_protect_rtcp_batch() applies SRTCP protection to a
+ * batch of compound RTCP packets.
+ *
+ * The function call srtp_protect_rtcp_batch(ctx, rtcp_hdr, len_ptr,
+ * status, num_pkts) protects each of the num_pkts compound RTCP
+ * packets in the array rtcp_hdr exactly as srtp_protect_rtcp() would,
+ * but amortizes the per-call entry cost across the batch.  This fits
+ * the report-timer pattern of a forwarding unit, which emits RTCP for
+ * all of its streams in one burst.  The status of each packet is
+ * written to the corresponding element of the status array, so a
+ * failing packet does not abort the batch.
+ *
+ * @warning The per-packet assumptions and requirements of
+ * srtp_protect_rtcp() apply to each packet in the batch.
+ *
+ * @param ctx is the SRTP context to use in processing the packets.
+ *
+ * @param rtcp_hdr is an array of num_pkts pointers to RTCP packets;
+ * after the function returns, each points to an srtcp packet if the
+ * corresponding status is srtp_err_status_ok.
+ *
+ * @param len_ptr is an array of num_pkts packet lengths in octets,
+ * updated in place like the pkt_octet_len argument of
+ * srtp_protect_rtcp().
+ *
+ * @param status is an array of num_pkts elements which receives the
+ * srtp_protect_rtcp() result for each packet.
+ *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok     all packets were protected successfully
+ *    - srtp_err_status_fail   at least one packet failed; see the
+ *                             status array for per-packet results
+ */
+
+srtp_err_status_t srtp_protect_rtcp_batch(srtp_t ctx, void **rtcp_hdr,
+                                          int *len_ptr,
+                                          srtp_err_status_t *status,
+                                          int num_pkts);
+
+/**
+ * @brief srtp_unprotect_rtcp_batch() verifies and decrypts a batch of
+ * SRTCP packets.
+ *
+ * The function call srtp_unprotect_rtcp_batch(ctx, srtcp_hdr,
+ * len_ptr, status, num_pkts) processes each of the num_pkts SRTCP
+ * packets in the array srtcp_hdr exactly as srtp_unprotect_rtcp()
+ * would, writing the per-packet result into the status array.  A
+ * packet that fails authentication or the replay check does not abort
+ * the batch; the remaining packets are still processed.
+ *
+ * @warning The per-packet assumptions and requirements of
+ * srtp_unprotect_rtcp() apply to each packet in the batch.
+ *
+ * @param ctx is the SRTP session which applies to the packets.
+ *
+ * @param srtcp_hdr is an array of num_pkts pointers to SRTCP packets;
+ * after the function returns, each points to an rtcp packet if the
+ * corresponding status is srtp_err_status_ok.
+ *
+ * @param len_ptr is an array of num_pkts packet lengths in octets,
+ * updated in place like the pkt_octet_len argument of
+ * srtp_unprotect_rtcp().
+ *
+ * @param status is an array of num_pkts elements which receives the
+ * srtp_unprotect_rtcp() result for each packet.
+ *
+ * @param num_pkts is the number of packets in the batch.
+ *
+ * @return
+ *    - srtp_err_status_ok     all packets were unprotected successfully
+ *    - srtp_err_status_fail   at least one packet failed; see the
+ *                             status array for per-packet results
+ */
+
+srtp_err_status_t srtp_unprotect_rtcp_batch(srtp_t ctx, void **srtcp_hdr,
+                                            int *len_ptr,
+                                            srtp_err_status_t *status,
+                                            int num_pkts);
+
+/**
+ * @brief srtp_iovec_t describes one segment of a scattered packet.
+ */
+typedef struct {
+  void *iov_base;   /**< pointer to the segment data      */
+  int   iov_len;    /**< length of the segment, in octets */
+} srtp_iovec_t;
+
+/**
+ * @brief srtp_protect_iov() applies SRTP protection to a packet
+ * scattered over several buffers, without gathering it first.
+ *
+ * The function call srtp_protect_iov(ctx, iov, iov_count, len_ptr,
+ * trailer) behaves like srtp_protect() applied to the concatenation
+ * of the iov_count segments in iov, except that encryption runs in
+ * place within each segment and the authentication tag is written to
+ * the separate trailer buffer instead of after the payload.  On
+ * entry, *len_ptr must equal the sum of the segment lengths; on
+ * return it holds the protected length, i.e. the octets the caller
+ * should transmit: the segments followed by the first
+ * (*len_ptr - sum) octets of trailer.
+ *
+ * The first segment must contain the complete RTP header, including
+ * any CSRCs and header extension.  MKI, AEAD (GCM) policies, and
+ * RFC 6904 header-extension encryption are not supported through this
+ * interface and yield srtp_err_status_bad_param; use the contiguous
+ * API for those policies.
+ *
+ * @param ctx is the SRTP context to use in processing the packet.
+ *
+ * @param iov is the array of packet segments, modified in place.
+ *
+ * @param iov_count is the number of segments.
+ *
+ * @param len_ptr points to the total packet length, updated as
+ * described above.
+ *
+ * @param trailer points to a buffer of at least SRTP_MAX_TRAILER_LEN
+ * octets which receives the authentication tag.
+ */
+srtp_err_status_t srtp_protect_iov(srtp_t ctx, srtp_iovec_t *iov,
+                                   int iov_count, int *len_ptr,
+                                   void *trailer);
+
+/**
+ * @brief srtp_unprotect_iov() verifies and decrypts an SRTP packet
+ * scattered over several buffers.
+ *
+ * The function call srtp_unprotect_iov(ctx, iov, iov_count, len_ptr)
+ * behaves like srtp_unprotect() applied to the concatenation of the
+ * iov_count segments in iov, decrypting in place within each segment.
+ * On entry, *len_ptr must equal the sum of the segment lengths; on
+ * return it holds the plaintext length (the tag octets at the end of
+ * the final segment are no longer part of the packet).
+ *
+ * The first segment must contain the complete RTP header and the
+ * final segment must contain the complete authentication tag.  The
+ * policy restrictions of srtp_protect_iov() apply.
+ *
+ * @param ctx is the SRTP context to use in processing the packet.
+ *
+ * @param iov is the array of packet segments, modified in place.
+ *
+ * @param iov_count is the number of segments.
+ *
+ * @param len_ptr points to the total packet length, updated as
+ * described above.
+ */
+srtp_err_status_t srtp_unprotect_iov(srtp_t ctx, srtp_iovec_t *iov,
+                                     int iov_count, int *len_ptr);
+
 /**
  * @brief srtp_create() allocates and initializes an SRTP session.
 
@@ -591,6 +1023,217 @@ srtp_err_status_t srtp_unprotect_mki(srtp_t ctx, void *srtp_hdr, int *len_ptr,
 
 srtp_err_status_t srtp_create(srtp_t *session, const srtp_policy_t *policy);
 
+/**
+ * @brief srtp_create_ex() allocates and initializes an SRTP session,
+ * preallocating capacity for an expected stream population.
+ *
+ * The function call srtp_create_ex(session, policy, expected_streams)
+ * behaves like srtp_create(), and additionally sizes the session for
+ * expected_streams streams up front: the SSRC lookup table is built
+ * at its final size, and, when the policy contains a wildcard
+ * template, expected_streams stream contexts are cloned from the
+ * template onto the session free list, with their session keys
+ * already derived.  A burst of joins then instantiates streams from
+ * the free list without calling the allocator or the key derivation
+ * function on the packet path, so the first packets of a mass-join
+ * event are processed at steady-state cost.
+ *
+ * The cipher configuration is taken from the policy, as with
+ * srtp_create(); passing zero for expected_streams makes this call
+ * identical to srtp_create().
+ *
+ * @param session is a pointer to the SRTP session to be created.
+ *
+ * @param policy is the srtp_policy_t list describing the session
+ * policy, as for srtp_create().
+ *
+ * @param expected_streams is the number of streams the session is
+ * expected to carry.  This is a hint: the session still grows beyond
+ * it on demand.
+ *
+ * @return
+ *    - srtp_err_status_ok           if creation succeded.
+ *    - srtp_err_status_alloc_fail   if allocation failed.
+ *    - srtp_err_status_init_fail    if initialization failed.
+ */
+
+srtp_err_status_t srtp_create_ex(srtp_t *session,
+                                 const srtp_policy_t *policy,
+                                 unsigned int expected_streams);
+
+/**
+ * @brief srtp_set_deterministic_latency() bounds the worst-case
+ * execution time of the packet processing functions.
+ *
+ * With the mode enabled, srtp_protect() and srtp_unprotect() (and
+ * their RTCP counterparts) never take a slow path: a packet from an
+ * SSRC without a stream context is instantiated only from a context
+ * stocked at setup time (by srtp_create_ex() preallocation, or
+ * recycled by srtp_remove_stream()), and is rejected with
+ * srtp_err_status_no_ctx otherwise, instead of allocating memory and
+ * deriving keys on the packet path.
+ *
+ * The per-call work is then bounded by the cipher and authentication
+ * over one packet plus one replay window update; the window update
+ * is itself capped at one window-length bitvector shift, since a
+ * reordering gap larger than the window clears it in constant time.
+ * Applications that pin their worst case this way should register
+ * every expected SSRC with srtp_add_stream(), or size the
+ * srtp_create_ex() preallocation for the expected population.
+ *
+ * The mode only affects stream instantiation; it may be enabled and
+ * disabled at any time during the life of the session.
+ *
+ * @param session is the session to configure.
+ *
+ * @param enable is nonzero to enable deterministic-latency mode,
+ * zero to restore on-demand stream instantiation.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if session is NULL.
+ */
+
+srtp_err_status_t srtp_set_deterministic_latency(srtp_t session, int enable);
+
+/**
+ * @brief srtp_set_roc_recovery_window() enables native rollover
+ * counter (ROC) recovery for receivers that join a stream mid-life.
+ *
+ * The packet index of the first packet from an unknown SSRC is
+ * estimated with a rollover counter of zero, so a sender that has
+ * already rolled over fails authentication even though the keys are
+ * correct, until signaling delivers the ROC out of band
+ * (srtp_set_stream_roc()).
+ *
+ * With a nonzero recovery window, an authentication failure on the
+ * first packet of a new stream triggers a search over the candidate
+ * counters 1..window: the authentication function is run over the
+ * packet body once, and each candidate costs only the 4-octet ROC
+ * trailer computation and a tag comparison when the authentication
+ * algorithm supports partial recomputation (the built-in HMAC does).
+ * A matching candidate is cryptographically as strong as a normal tag
+ * check; the discovered ROC is recorded in the new stream's replay
+ * database, so later packets pay nothing.
+ *
+ * Recovery applies to the HMAC-authenticated transforms; AEAD (GCM)
+ * streams bind the ROC into the IV and would need a full trial
+ * decryption per candidate, so they are not searched.
+ *
+ * @param session is the session to configure.
+ *
+ * @param window is the number of candidate rollover counters to try
+ * (at most 65535); zero disables recovery (the default).
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if session is NULL or window is
+ *                                   out of range.
+ */
+
+srtp_err_status_t srtp_set_roc_recovery_window(srtp_t session, uint32_t window);
+
+/**
+ * @brief srtp_set_adaptive_replay_window() makes the replay windows
+ * of a session adapt their size to the observed reorder depth.
+ *
+ * A replay window sized for the worst network path makes every stream
+ * pay that window's memory and cache cost.  With an adaptive window,
+ * each stream's replay database starts at 128 entries and is grown
+ * (doubled, up to max_window_size) only when packets are observed
+ * arriving more than half the current window length out of order;
+ * after a long run of shallow traffic it is shrunk back.  A shrink
+ * drops the oldest entries, which can only turn an accept into a
+ * replay_old rejection, never admit a replayed packet.  A resize
+ * allocates the replacement window from the heap during packet
+ * processing - the one exception to the otherwise allocation-free
+ * processing paths - so deployments that cannot tolerate any
+ * packet-path allocation should keep fixed windows sized for their
+ * worst path.
+ *
+ * The conversion applies to the session's existing streams and its
+ * template; streams created from the template afterwards inherit the
+ * limit and start small again.
+ *
+ * @param session is the session to configure.
+ *
+ * @param max_window_size is the size limit, in packets, that a window
+ * may grow to (at least 128 and less than 2^15); zero converts the
+ * windows back to fixed size, pinned at their current length.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_bad_param    if session is NULL or
+ *                                   max_window_size is out of range.
+ */
+
+srtp_err_status_t srtp_set_adaptive_replay_window(srtp_t session, unsigned long max_window_size);
+
+/**
+ * @brief srtp_stream_set_thread_cipher_pool() attaches per-thread
+ * cipher replicas to a stream, so that several threads can unprotect
+ * packets of one stream concurrently.
+ *
+ * The cipher and authentication contexts of a stream are mutable per
+ * operation (counter blocks, keystream buffers, hash state), which is
+ * what normally restricts each SSRC to a single processing thread at
+ * a time.  This call clones those contexts of the stream's first
+ * master key into a pool of count replicas.  A processing thread
+ * claims one replica by calling srtp_set_thread_cipher_slot() with a
+ * slot between 1 and count; srtp_unprotect() (and its variants) on
+ * that thread then runs on the thread's private replica, so threads
+ * bound to distinct slots may unprotect different packets of the
+ * pooled stream simultaneously.  Slot 0, the default, selects the
+ * stream's own contexts.
+ *
+ * Limitations: the pool serves the receive path (srtp_protect()
+ * advances shared sequencing state and remains single-threaded per
+ * SSRC), and only streams keyed without MKI can be pooled.  The
+ * replay-window update is not synchronized: two threads concurrently
+ * presenting packets with the same index can both accept one of them,
+ * so applications needing a strict replay guarantee under concurrency
+ * must suppress duplicates themselves.  The pool must be replaced
+ * after srtp_update() or srtp_rekey_stream(), since the replicas
+ * carry the keys current when it was built.
+ *
+ * Passing zero for count removes an attached pool.
+ *
+ * @param session is the session holding the stream.
+ *
+ * @param ssrc is the SSRC of the stream, in network byte order (as
+ * for srtp_remove_stream()).
+ *
+ * @param count is the number of replicas to provide, or zero.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_no_ctx       if no stream matches ssrc.
+ *    - srtp_err_status_bad_param    if the stream uses MKI, or its
+ *                                   crypto engine does not support
+ *                                   duplication.
+ *    - srtp_err_status_alloc_fail   if allocation failed.
+ */
+
+srtp_err_status_t srtp_stream_set_thread_cipher_pool(srtp_t session,
+                                                     uint32_t ssrc,
+                                                     unsigned int count);
+
+/**
+ * @brief srtp_set_thread_cipher_slot() selects the pool slot used by
+ * the calling thread.
+ *
+ * The slot applies to every stream carrying a cipher pool that the
+ * thread subsequently processes; slots of concurrently processing
+ * threads must be distinct.  A slot beyond a given stream's pool size
+ * falls back to the stream's own contexts.  See
+ * srtp_stream_set_thread_cipher_pool().
+ *
+ * @param slot is the slot to claim (1 to the pool's count), or zero
+ * to release it.
+ */
+
+void srtp_set_thread_cipher_slot(unsigned int slot);
+
 
 /**
  * @brief srtp_add_stream() allocates and initializes an SRTP stream
@@ -685,6 +1328,480 @@ srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t *policy);
 
 srtp_err_status_t srtp_update_stream(srtp_t session, const srtp_policy_t *policy);
 
+/**
+ * @brief srtp_rekey_stream() rekeys a stream without interrupting
+ * in-flight traffic.
+ *
+ * Unlike srtp_update_stream(), which tears the stream down and
+ * recreates it, srtp_rekey_stream() installs the new session keys
+ * alongside the old ones.  Outbound packets are protected under the
+ * new keys immediately; inbound packets whose estimated index lies
+ * below the rekey watermark (the stream's current index plus one at
+ * the time of the call) are still processed under the old keys, so a
+ * rekey costs no dropped or delayed packets.  The old keys are
+ * retired automatically once the replay window has moved wholly past
+ * the watermark, or eagerly via srtp_rekey_stream_complete().
+ *
+ * The policy must target a specific SSRC with a single master key
+ * (streams that carry an MKI already select keys per packet by MKI
+ * and do not need the watermark).  Streams sharing keys with the
+ * session's wildcard template cannot be rekeyed this way; use
+ * srtp_update() for those.  RTCP switches to the new keys
+ * immediately.  Only one rekey may be in flight per stream.
+ *
+ * @param session is the SRTP session containing the stream.
+ *
+ * @param policy describes the new policy and key for the stream.
+ *
+ * @return
+ *    - srtp_err_status_ok           if the new keys were installed.
+ *    - srtp_err_status_bad_param    if the stream does not exist, is
+ *                                   template-shared, or a rekey is
+ *                                   already in flight.
+ *    - [other]                      otherwise.
+ *
+ */
+
+srtp_err_status_t srtp_rekey_stream(srtp_t session, const srtp_policy_t *policy);
+
+/**
+ * @brief srtp_rekey_stream_at() rekeys a stream with an explicit
+ * switchover point.
+ *
+ * This behaves as srtp_rekey_stream(), but the watermark is set to
+ * the packet index formed from the given rollover counter and
+ * sequence number instead of the stream's current index.  Receivers
+ * should use this with the sender's signalled switch point, so that
+ * in-flight packets protected under the old keys select them even
+ * when they arrive after the rekey.
+ *
+ * @param session is the SRTP session containing the stream.
+ *
+ * @param policy describes the new policy and key for the stream.
+ *
+ * @param roc is the rollover counter of the first packet protected
+ *        under the new keys.
+ *
+ * @param seq is the sequence number of the first packet protected
+ *        under the new keys.
+ *
+ * @return as for srtp_rekey_stream().
+ *
+ */
+
+srtp_err_status_t srtp_rekey_stream_at(srtp_t session,
+                                       const srtp_policy_t *policy,
+                                       uint32_t roc, uint16_t seq);
+
+/**
+ * @brief srtp_rekey_stream_complete() retires the previous keys of a
+ * rekeyed stream.
+ *
+ * The function call srtp_rekey_stream_complete(session, ssrc)
+ * immediately frees the session keys that srtp_rekey_stream()
+ * replaced, instead of waiting for the replay window to drain.  It is
+ * a no-op if no rekey is in flight.
+ *
+ * @param session is the SRTP session containing the stream.
+ *
+ * @param ssrc is the SSRC of the rekeyed stream, in host byte order.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success (including no-op).
+ *    - srtp_err_status_bad_param    if the stream does not exist.
+ *
+ */
+
+srtp_err_status_t srtp_rekey_stream_complete(srtp_t session, uint32_t ssrc);
+
+/**
+ * @brief srtp_stream_set_keystream_prefetch() enables or disables the
+ * AES-ICM keystream prefetch cache on a stream.
+ *
+ * For the AES-ICM transforms, the keystream depends only on the key
+ * and the packet index, so it can be computed before a packet
+ * arrives.  This call attaches a ring buffer of @p depth slots, each
+ * holding up to @p max_payload_octets of keystream, to the stream
+ * with the given SSRC; srtp_stream_prefetch_keystream() then fills it
+ * for the predicted next indices.  A packet whose keystream is found
+ * in the cache is processed with an exor instead of the cipher run.
+ * Packets longer than @p max_payload_octets, or carrying an MKI, fall
+ * back to the normal path.  Calling with a @p depth of zero disables
+ * the cache and releases its memory.
+ *
+ * @param session is the SRTP session containing the stream.
+ *
+ * @param ssrc is the SSRC of the stream, in host byte order.
+ *
+ * @param depth is the number of packets of keystream to retain, or
+ * zero to disable.
+ *
+ * @param max_payload_octets is the keystream length held per packet.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_no_ctx       if the stream does not exist.
+ *    - srtp_err_status_bad_param    if the stream's RTP cipher is not
+ *                                   an AES-ICM transform, or the
+ *                                   arguments are out of range.
+ *    - srtp_err_status_alloc_fail   if the cache cannot be allocated.
+ *
+ */
+
+srtp_err_status_t srtp_stream_set_keystream_prefetch(srtp_t session,
+                                                     uint32_t ssrc,
+                                                     int depth,
+                                                     int max_payload_octets);
+
+/**
+ * @brief srtp_stream_prefetch_keystream() precomputes keystream for
+ * the next packets of a stream.
+ *
+ * The function call srtp_stream_prefetch_keystream(session, ssrc,
+ * max_packets) computes the AES-ICM keystream for up to
+ * @p max_packets of the packet indices predicted to arrive next on
+ * the stream, and stores it in the cache attached by
+ * srtp_stream_set_keystream_prefetch().  It is intended to run during
+ * idle cycles, or on a helper thread, between packets; callers must
+ * serialize it against the packet-processing calls on the same
+ * stream, since it shares the stream's cipher context.
+ *
+ * @param session is the SRTP session containing the stream.
+ *
+ * @param ssrc is the SSRC of the stream, in host byte order.
+ *
+ * @param max_packets caps the work done in this call.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success.
+ *    - srtp_err_status_no_ctx       if the stream does not exist.
+ *    - srtp_err_status_bad_param    if no cache is attached.
+ *    - srtp_err_status_cipher_fail  if keystream generation fails.
+ *
+ */
+
+srtp_err_status_t srtp_stream_prefetch_keystream(srtp_t session,
+                                                 uint32_t ssrc,
+                                                 int max_packets);
+
+/**
+ * @brief srtp_session_stats_t holds the aggregated hot-path counters
+ * of a session.
+ *
+ * Every stream in a session maintains an always-on block of packet
+ * and failure counters which are updated as packets are processed;
+ * srtp_get_session_stats() sums them over all streams (including the
+ * wildcard template, which accounts for provisional processing).
+ * All counters are monotonic, so rates can be derived by periodic
+ * sampling.
+ */
+typedef struct srtp_session_stats_t {
+  uint64_t packets_protected;        /**< successful srtp_protect() calls  */
+  uint64_t octets_protected;         /**< total octets through protect     */
+  uint64_t packets_unprotected;      /**< successful srtp_unprotect() calls*/
+  uint64_t octets_unprotected;       /**< total octets through unprotect   */
+  uint64_t rtcp_packets_protected;   /**< successful srtp_protect_rtcp()   */
+  uint64_t rtcp_packets_unprotected; /**< successful srtp_unprotect_rtcp() */
+  uint64_t auth_failures;            /**< authentication check failures    */
+  uint64_t replay_drops;             /**< replay-check rejections          */
+  uint32_t stream_count;             /**< streams currently in the session */
+} srtp_session_stats_t;
+
+/**
+ * @brief srtp_get_session_stats() aggregates the per-stream counters
+ * of a session.
+ *
+ * The function call srtp_get_session_stats(session, stats) fills in
+ * the structure at stats with the sum of the counter blocks of all
+ * streams in the session.  It only reads the counters and may be
+ * called at any time, including concurrently with packet processing
+ * under the usage model described in the thread-safety notes above.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if session or stats is NULL
+ */
+srtp_err_status_t srtp_get_session_stats(srtp_t session,
+                                         srtp_session_stats_t *stats);
+
+/**
+ * @defgroup SessionGroups Session groups
+ *
+ * A session group shares one wildcard template - and with it the
+ * derived keys, key-usage limit and MKI table - across several
+ * sessions, for deployments that shard one conference over multiple
+ * worker threads with identical policy and master keys.  Without a
+ * group, each shard stores its own copy of the template and must be
+ * rekeyed individually; with one, the template exists once, members
+ * are lightweight references to it, and a single srtp_group_update()
+ * rekeys every member.
+ *
+ * Each member is an ordinary srtp_t: packets are processed with the
+ * usual per-session calls, under the usual threading model (one
+ * member per worker thread needs no locking on the packet path,
+ * since streams instantiated from the template are per-member).
+ * Group-level calls - create, add, update, stats, dealloc - require
+ * all members to be quiesced, like srtp_update().
+ *
+ * @{
+ */
+
+/**
+ * @brief srtp_group_stats_t reports a group's aggregate counters and
+ * memory accounting.
+ *
+ * The totals are summed over every member session, with the shared
+ * template counted once.  template_octets is the heap footprint of
+ * the shared template as measured when it was created, and
+ * octets_saved is what the members would additionally consume if each
+ * held its own template copy.
+ */
+typedef struct srtp_group_stats_t {
+  srtp_session_stats_t totals;  /**< counters over all member sessions */
+  unsigned int num_sessions;    /**< current number of members         */
+  size_t template_octets;       /**< heap octets of the shared template */
+  size_t octets_saved;          /**< octets saved vs. per-member copies */
+} srtp_group_stats_t;
+
+/**
+ * @brief srtp_group_create() allocates a session group.
+ *
+ * The function call srtp_group_create(group, policy) allocates a
+ * group holding one template stream built from the given policy,
+ * which must be a single policy element with a wildcard SSRC
+ * (ssrc_any_inbound or ssrc_any_outbound).  The group starts with no
+ * member sessions.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if the policy is not a single
+ *                                   wildcard element
+ *    - srtp_err_status_alloc_fail   on allocation failure
+ */
+srtp_err_status_t srtp_group_create(srtp_group_t *group,
+                                    const srtp_policy_t *policy);
+
+/**
+ * @brief srtp_group_add_session() creates a member session.
+ *
+ * The function call srtp_group_add_session(group, session) creates a
+ * new session whose template is the group's shared stream and adds it
+ * to the group.  The member is used exactly like any other srtp_t;
+ * deallocating it with srtp_dealloc() removes it from the group and
+ * leaves the shared template intact.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if group or session is NULL
+ *    - srtp_err_status_alloc_fail   on allocation failure
+ */
+srtp_err_status_t srtp_group_add_session(srtp_group_t group, srtp_t *session);
+
+/**
+ * @brief srtp_group_remove_session() removes and deallocates a member.
+ *
+ * The function call srtp_group_remove_session(group, session) removes
+ * the given member from the group and deallocates it, including any
+ * streams instantiated from the shared template.  The template itself
+ * stays with the group.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if session is not a member of group
+ */
+srtp_err_status_t srtp_group_remove_session(srtp_group_t group,
+                                            srtp_t session);
+
+/**
+ * @brief srtp_group_update() rekeys the whole group in one call.
+ *
+ * The function call srtp_group_update(group, policy) replaces the
+ * shared template with one built from the given policy (subject to
+ * the same restrictions as in srtp_group_create()) and rekeys every
+ * stream instantiated from the old template in every member session,
+ * preserving each stream's ROC and replay state as srtp_update()
+ * does.  All members must be quiesced for the duration of the call.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if the policy is not a single
+ *                                   wildcard element
+ *    - srtp_err_status_alloc_fail   on allocation failure
+ */
+srtp_err_status_t srtp_group_update(srtp_group_t group,
+                                    const srtp_policy_t *policy);
+
+/**
+ * @brief srtp_group_get_stats() reports aggregate counters and memory
+ * accounting for a group.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if group or stats is NULL
+ */
+srtp_err_status_t srtp_group_get_stats(srtp_group_t group,
+                                       srtp_group_stats_t *stats);
+
+/**
+ * @brief srtp_group_dealloc() deallocates a group.
+ *
+ * The function call srtp_group_dealloc(group) deallocates any member
+ * sessions still in the group, the shared template and the group
+ * itself.
+ *
+ * @return
+ *    - srtp_err_status_ok            on success
+ *    - srtp_err_status_dealloc_fail  on failure
+ */
+srtp_err_status_t srtp_group_dealloc(srtp_group_t group);
+
+/**
+ * @}
+ */
+
+/**
+ * @brief srtp_stream_info_t describes one stream of a session, as
+ * captured by srtp_session_foreach_stream() or
+ * srtp_session_get_stream_info().
+ *
+ * The key_usage_remaining field reflects the key usage limit charge,
+ * which is applied in batches on the packet path, so it may lag the
+ * true packet count by up to the batching granularity.
+ */
+typedef struct srtp_stream_info_t {
+  uint32_t ssrc;                /**< SSRC of the stream, host byte order   */
+  uint32_t roc;                 /**< current rollover counter              */
+  uint64_t rtp_packet_index;    /**< extended RTP packet index (the replay
+                                 *   window's leading edge)                */
+  uint64_t key_usage_remaining; /**< packets left before the key usage
+                                 *   hard limit is reached                 */
+} srtp_stream_info_t;
+
+/**
+ * @brief srtp_stream_visitor_func_t is the callback invoked by
+ * srtp_session_foreach_stream() once per stream.
+ *
+ * Returning a non-zero value stops the enumeration early.  The info
+ * structure is only valid for the duration of the call.
+ */
+typedef int (*srtp_stream_visitor_func_t)(void *data,
+                                          const srtp_stream_info_t *info);
+
+/**
+ * @brief srtp_session_foreach_stream() enumerates the streams of a
+ * session without external locking.
+ *
+ * The function call srtp_session_foreach_stream(session, visitor,
+ * data) invokes visitor once for every stream in the session (the
+ * wildcard template, which has no SSRC of its own, is not included),
+ * passing data through unchanged.  Like srtp_get_session_stats(), it
+ * only reads stream state and may run concurrently with packet
+ * processing under the usage model described in the thread-safety
+ * notes above; streams added concurrently may or may not be visited.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success (including early stop)
+ *    - srtp_err_status_bad_param    if session or visitor is NULL
+ */
+srtp_err_status_t srtp_session_foreach_stream(srtp_t session,
+                                              srtp_stream_visitor_func_t visitor,
+                                              void *data);
+
+/**
+ * @brief srtp_session_get_stream_info() snapshots the per-stream
+ * state of a session into a caller-provided array.
+ *
+ * The function call srtp_session_get_stream_info(session, info,
+ * max_streams, num_streams) fills in up to max_streams elements of
+ * info, one per stream, and writes the number filled in through
+ * num_streams.  If the session holds more streams than max_streams,
+ * the excess are silently omitted; the stream_count member of
+ * srtp_session_stats_t can be used to size the array.  The same
+ * concurrency guarantees as srtp_session_foreach_stream() apply.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if session, info or num_streams
+ *                                   is NULL
+ */
+srtp_err_status_t srtp_session_get_stream_info(srtp_t session,
+                                               srtp_stream_info_t *info,
+                                               unsigned int max_streams,
+                                               unsigned int *num_streams);
+
+/**
+ * @brief srtp_session_serialize() snapshots a session's stream state
+ * into a compact versioned binary format.
+ *
+ * The snapshot captures, for every stream in the session, the state a
+ * standby node cannot re-derive from the policy: the packet index
+ * (rollover counter and sequence number), the RTP and RTCP replay
+ * windows, and the pending ROC.  Key material is not serialized; a
+ * node restoring the snapshot must be configured with the same policy
+ * and master keys, from which it derives identical session keys.
+ * Because no secrets are included, a snapshot may be shipped to a
+ * standby continuously (e.g. once per second).
+ *
+ * Calling with buffer equal to NULL writes the required size to
+ * *length and returns srtp_err_status_ok, so a caller can size the
+ * buffer first.
+ *
+ * @warning The session must be quiesced for the duration of the call,
+ * like the other whole-session operations described in the
+ * thread-safety notes above.
+ *
+ * @param session is the session to snapshot.
+ *
+ * @param buffer receives the serialized state, or is NULL to query
+ *        the required size.
+ *
+ * @param length on entry, the capacity of buffer; on return, the
+ *        number of octets written (or required).
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    if an argument is NULL or the
+ *                                   buffer is too small (in which
+ *                                   case *length is set to the
+ *                                   required size)
+ */
+srtp_err_status_t srtp_session_serialize(srtp_t session, uint8_t *buffer,
+                                         unsigned int *length);
+
+/**
+ * @brief srtp_session_deserialize() restores stream state captured
+ * by srtp_session_serialize().
+ *
+ * The function call srtp_session_deserialize(session, buffer, length)
+ * applies the snapshot in buffer to the given session, which must
+ * have been created from the same policy (same replay window size and
+ * number of master keys) as the session that was serialized.  State
+ * is applied to existing streams by SSRC; a stream present in the
+ * snapshot but not in the session is instantiated from the session's
+ * wildcard template, exactly as the first packet of that SSRC would
+ * have done.
+ *
+ * @warning The session must be quiesced for the duration of the call.
+ *
+ * @param session is the session to restore into.
+ *
+ * @param buffer holds the serialized state.
+ *
+ * @param length is the length of the serialized state, in octets.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_parse_err    if the buffer is not a snapshot
+ *                                   or is truncated
+ *    - srtp_err_status_bad_param    if the snapshot does not match
+ *                                   the session's policy
+ *    - srtp_err_status_no_ctx       if a snapshot stream is missing
+ *                                   and the session has no template
+ */
+srtp_err_status_t srtp_session_deserialize(srtp_t session,
+                                           const uint8_t *buffer,
+                                           unsigned int length);
+
 /**
  * @brief srtp_crypto_policy_set_rtp_default() sets a crypto policy
  * structure to the SRTP default policy for RTP protection.
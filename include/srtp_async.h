@@ -0,0 +1,132 @@
+/*
+ * srtp_async.h
+ *
+ * interface to the asynchronous (worker-pool) packet processing
+ * engine for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2001-2017 Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_ASYNC_H
+#define SRTP_ASYNC_H
+
+#include "srtp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief An srtp_async_engine_t distributes packet processing for one
+ * session across a pool of worker threads.
+ *
+ * Packets are sharded onto workers by SSRC, so all packets of a given
+ * stream are processed by the same worker in submission order; the
+ * per-stream ordering and replay guarantees of the synchronous API
+ * are preserved.  Completion is delivered via a callback invoked on
+ * the worker thread.  The engine relies on the session concurrency
+ * model documented in srtp.h: while an engine is attached to a
+ * session, srtp_remove_stream(), srtp_update() and srtp_dealloc() on
+ * that session may only be called after srtp_async_drain().
+ */
+typedef struct srtp_async_engine_t_ *srtp_async_engine_t;
+
+/**
+ * @brief completion callback for asynchronous packet processing.
+ *
+ * Invoked on a worker thread once for every submitted packet.  pkt
+ * and user_data are as passed at submission; len is the packet length
+ * after processing, and status is the result that the corresponding
+ * synchronous call would have returned.
+ */
+typedef void (*srtp_async_complete_func_t)(void *pkt, int len,
+                                           srtp_err_status_t status,
+                                           void *user_data);
+
+/**
+ * @brief srtp_async_create() allocates an engine with num_workers
+ * worker threads processing packets for the given session.
+ *
+ * The session must outlive the engine.  num_workers must be at least
+ * one; values beyond the number of streams buy nothing.
+ */
+srtp_err_status_t srtp_async_create(srtp_async_engine_t *engine,
+                                    srtp_t session,
+                                    unsigned int num_workers);
+
+/**
+ * @brief srtp_async_protect() enqueues an RTP packet for sender-side
+ * processing, as srtp_protect() would perform on it.
+ *
+ * The packet buffer must remain valid (and have SRTP_MAX_TRAILER_LEN
+ * octets of tailroom) until the completion callback runs.  Returns
+ * srtp_err_status_alloc_fail if the worker's queue is full; the
+ * caller may retry after completions have drained.
+ */
+srtp_err_status_t srtp_async_protect(srtp_async_engine_t engine,
+                                     void *rtp_hdr, int len,
+                                     srtp_async_complete_func_t complete,
+                                     void *user_data);
+
+/**
+ * @brief srtp_async_unprotect() enqueues an SRTP packet for
+ * receiver-side processing, as srtp_unprotect() would perform on it.
+ *
+ * Queue-full behavior and buffer lifetime are as for
+ * srtp_async_protect().
+ */
+srtp_err_status_t srtp_async_unprotect(srtp_async_engine_t engine,
+                                       void *srtp_hdr, int len,
+                                       srtp_async_complete_func_t complete,
+                                       void *user_data);
+
+/**
+ * @brief srtp_async_drain() blocks until every packet submitted so
+ * far has completed.
+ */
+srtp_err_status_t srtp_async_drain(srtp_async_engine_t engine);
+
+/**
+ * @brief srtp_async_destroy() drains the engine, stops the workers,
+ * and frees the engine.  The session itself is not affected.
+ */
+srtp_err_status_t srtp_async_destroy(srtp_async_engine_t engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_ASYNC_H */
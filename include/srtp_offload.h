@@ -0,0 +1,214 @@
+/*
+ * srtp_offload.h
+ *
+ * interface to hardware crypto offload providers (lookaside
+ * accelerators, NICs with inline crypto) for libSRTP
+ */
+/*
+ *
+ * Copyright (c) 2001-2017 Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_OFFLOAD_H
+#define SRTP_OFFLOAD_H
+
+#include "srtp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup Offload Hardware crypto offload
+ *
+ * An offload provider plugs hardware crypto (a lookaside accelerator,
+ * or a NIC with inline crypto) in underneath the batch packet
+ * interfaces.  The library keeps all of the SRTP-layer work - stream
+ * lookup, replay and rollover bookkeeping, key-usage limits and IV
+ * formation - and hands the provider fully described AEAD transform
+ * descriptors, so the provider only ever sees (key handle, IV,
+ * aad/payload split) triples and never parses a packet.
+ *
+ * Providers are asynchronous: descriptors are submitted in batches
+ * and completions are collected by polling.  Every packet the
+ * provider cannot take - an unsupported transform, a full hardware
+ * queue - is processed by the library in software, so attaching a
+ * provider never changes observable behavior, only where the cipher
+ * work runs.
+ *
+ * Offload currently covers streams using an AEAD (AES-GCM) transform
+ * with a single master key and no EKT or header-extension encryption;
+ * all other streams simply stay in software.
+ *
+ * @{
+ */
+
+/**
+ * capability bits reported by a provider's capabilities() entry
+ */
+#define SRTP_OFFLOAD_CAP_PROTECT    0x1  /**< sender-side transform   */
+#define SRTP_OFFLOAD_CAP_UNPROTECT  0x2  /**< receiver-side transform */
+
+/**
+ * @brief an srtp_offload_desc_t describes one AEAD packet transform.
+ *
+ * The packet buffer holds the RTP header at offset zero; the first
+ * aad_octets are authenticated but not encrypted, and the
+ * body_octets that follow are transformed in place.  On encryption,
+ * body_octets counts the plaintext octets on submission and must
+ * count ciphertext plus tag on completion; on decryption it counts
+ * ciphertext plus tag on submission and plaintext on completion,
+ * with srtp_err_status_auth_fail reported in status when the tag
+ * does not verify.  The leading octets of iv hold the transform's
+ * initialization vector (12 for AES-GCM).
+ */
+typedef struct srtp_offload_desc_t {
+  uint64_t key_handle;       /**< from the provider's session_open()   */
+  int encrypt;               /**< nonzero for the sender direction     */
+  uint8_t iv[16];            /**< per-packet initialization vector     */
+  void *packet;              /**< packet buffer, RTP header at offset 0 */
+  unsigned int aad_octets;   /**< authenticated-only prefix            */
+  unsigned int body_octets;  /**< octets transformed in place (in/out) */
+  srtp_err_status_t status;  /**< per-descriptor completion status     */
+  void *cookie;              /**< owned by the submitting layer        */
+} srtp_offload_desc_t;
+
+/**
+ * @brief an srtp_offload_provider_t is the vtable a hardware backend
+ * implements.
+ *
+ * All entries are required.  data is passed back verbatim as the
+ * first argument of every call, and calls for one session are never
+ * issued concurrently; a provider serving several sessions must
+ * tolerate concurrent calls with distinct key handles.
+ */
+typedef struct srtp_offload_provider_t {
+  const char *description;   /**< printable name of the backend */
+  void *data;                /**< provider state, passed to every entry */
+
+  /**
+   * reports the SRTP_OFFLOAD_CAP_* bits the backend supports for the
+   * given cipher type (an srtp_cipher_type_id_t) and key length in
+   * octets, or 0 when it cannot serve the transform at all
+   */
+  uint32_t (*capabilities)(void *data, uint32_t cipher_type_id,
+                           int cipher_key_len);
+
+  /**
+   * programs the derived session key and salt into the backend and
+   * returns a key handle for use in descriptors.  key holds the
+   * cipher key (without the salt appended), salt the session salt
+   */
+  srtp_err_status_t (*session_open)(void *data, uint32_t cipher_type_id,
+                                    const uint8_t *key, int key_len,
+                                    const uint8_t *salt, int salt_len,
+                                    uint64_t *key_handle);
+
+  /**
+   * releases a key handle and the keying material behind it
+   */
+  srtp_err_status_t (*session_close)(void *data, uint64_t key_handle);
+
+  /**
+   * enqueues a prefix of the descriptor array for processing and
+   * returns how many descriptors were accepted; descriptors past the
+   * returned count (a full hardware queue, say) are processed by the
+   * library in software
+   */
+  int (*submit)(void *data, srtp_offload_desc_t **desc, int num_desc);
+
+  /**
+   * collects up to max_desc completed descriptors, in any order, and
+   * returns how many were collected; each accepted descriptor is
+   * returned exactly once
+   */
+  int (*poll)(void *data, srtp_offload_desc_t **done, int max_desc);
+} srtp_offload_provider_t;
+
+/**
+ * @brief srtp_offload_attach() plugs a provider into a session.
+ *
+ * Each existing stream whose transform the provider supports (and
+ * every stream later cloned from the session's template or added
+ * with srtp_add_stream()) gets a key handle opened for it; streams
+ * the provider cannot serve stay in software.  The provider must
+ * outlive its attachment.  Only one provider may be attached to a
+ * session at a time.
+ */
+srtp_err_status_t srtp_offload_attach(srtp_t session,
+                                      const srtp_offload_provider_t *provider);
+
+/**
+ * @brief srtp_offload_detach() closes all key handles and unplugs the
+ * session's provider; subsequent packets are processed in software.
+ * srtp_dealloc() detaches automatically.
+ */
+srtp_err_status_t srtp_offload_detach(srtp_t session);
+
+/**
+ * @brief srtp_offload_protect_batch() protects a batch of RTP packets
+ * through the session's offload provider.
+ *
+ * Behaves as srtp_protect_batch(): len_ptr and status are per-packet
+ * arrays, the return value is srtp_err_status_ok only when every
+ * packet succeeded, and each packet buffer needs
+ * SRTP_MAX_TRAILER_LEN octets of tailroom.  Packets on streams the
+ * provider does not serve - and packets the provider refuses - are
+ * processed in software.  Without an attached provider the call is
+ * equivalent to srtp_protect_batch().
+ */
+srtp_err_status_t srtp_offload_protect_batch(srtp_t session, void **rtp_hdr,
+                                             int *len_ptr,
+                                             srtp_err_status_t *status,
+                                             int num_pkts);
+
+/**
+ * @brief srtp_offload_unprotect_batch() verifies and decrypts a batch
+ * of SRTP packets through the session's offload provider, with the
+ * same conventions as srtp_offload_protect_batch().
+ */
+srtp_err_status_t srtp_offload_unprotect_batch(srtp_t session,
+                                               void **srtp_hdr, int *len_ptr,
+                                               srtp_err_status_t *status,
+                                               int num_pkts);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_OFFLOAD_H */
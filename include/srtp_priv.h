@@ -48,6 +48,11 @@
 // Leave this as the top level import. Ensures the existence of defines
 #include "config.h"
 
+/* build-time policy specialization (see include/srtp_profile_gcm128.h) */
+#ifdef SRTP_STATIC_PROFILE
+#include SRTP_STATIC_PROFILE
+#endif
+
 #include "srtp.h"
 #include "rdbx.h"
 #include "rdb.h"
@@ -91,7 +96,7 @@ srtp_err_status_t srtp_stream_init_keys(srtp_stream_ctx_t *srtp,
  * srtp_stream_init_all_master_keys(s, k, m) (re)initializes the srtp_stream_t s by
  * deriving all of the needed keys for all the master keys using the KDF and the keys from k.
  */
-srtp_err_status_t srtp_steam_init_all_master_keys(srtp_stream_ctx_t *srtp,
+srtp_err_status_t srtp_stream_init_all_master_keys(srtp_stream_ctx_t *srtp,
                                                   unsigned char *key,
                                                   srtp_master_key_t **keys,
                                                   const unsigned int max_master_keys);
@@ -129,45 +134,237 @@ typedef struct srtp_session_keys_t {
   uint8_t       *mki_id;
   unsigned int   mki_size;
   srtp_key_limit_ctx_t *limit;
+
+  /*
+   * only the RTP encryption and authentication keys are derived when
+   * a stream is initialized; SRTCP and header-extension key
+   * derivation is deferred until first use, so that stream setup
+   * stays cheap for late joiners.  the (zero-padded) master key and
+   * salt are retained here while any derivation is pending, and
+   * zeroized as soon as the last one completes
+   */
+  uint8_t        master_key[SRTP_AES_ICM_256_KEY_LEN_WSALT];
+  int            deferred_rtcp_keys;     /* SRTCP keys not yet derived */
+  int            deferred_xtn_hdr_keys;  /* header-ext keys not yet derived */
+
+  /*
+   * cached KDF key schedule: the AES key expansion of the master key
+   * is performed once, when the RTP keys are derived, and reused by
+   * the deferred SRTCP and header-extension derivations (and, since
+   * template clones share their session keys, by every stream cloned
+   * from a template).  kdf_schedule_key records the exact master key
+   * the schedule was expanded from, so a reinitialization with a new
+   * key simply misses the cache; kdf_schedule_key_len is zero while
+   * no schedule is cached
+   */
+  srtp_aes_expanded_key_t kdf_schedule;
+  uint8_t        kdf_schedule_key[SRTP_AES_ICM_256_KEY_LEN_WSALT];
+  int            kdf_schedule_key_len;
+
+  /*
+   * cached AEAD IV template: the zero-extended salt with the SSRC
+   * already folded in, so that per-packet IV formation only has to
+   * xor in the ROC and sequence number.  keyed by SSRC, since session
+   * keys may be shared between streams through the wildcard template
+   */
+  v128_t         aead_iv_tmpl;
+  uint32_t       aead_iv_ssrc;       /* SSRC folded into the template */
+  int            aead_iv_valid;
 } srtp_session_keys_t;
 
 
-/* 
+/*
+ * per-stream hot-path counters; every counter is incremented exactly
+ * once per packet on its path, so rates can be derived by sampling.
+ * the eight 64-bit counters fill one cache line, which keeps counter
+ * updates for streams processed on different threads from sharing a
+ * line with each other or with the stream's lookup fields
+ */
+typedef struct srtp_stream_stats_t {
+  uint64_t packets_protected;        /* successful srtp_protect()       */
+  uint64_t octets_protected;         /* total octets through protect    */
+  uint64_t packets_unprotected;      /* successful srtp_unprotect()     */
+  uint64_t octets_unprotected;       /* total octets through unprotect  */
+  uint64_t rtcp_packets_protected;   /* successful srtp_protect_rtcp()  */
+  uint64_t rtcp_packets_unprotected; /* successful srtp_unprotect_rtcp()*/
+  uint64_t auth_failures;            /* authentication check failures   */
+  uint64_t replay_drops;             /* replay-check rejections         */
+} srtp_stream_stats_t;
+
+/*
  * an srtp_stream_t has its own SSRC, encryption key, authentication
  * key, sequence number, and replay database
- * 
+ *
  * note that the keys might not actually be unique, in which case the
  * srtp_cipher_t and srtp_auth_t pointers will point to the same structures
+ *
+ * the struct is split into a hot and a cold section.  the hot section
+ * holds the per-packet working set - the hash chain and SSRC touched
+ * by the lookup, the session-key pointer, the replay state and the
+ * service masks - and fits in the first cache line, so that
+ * processing a packet for a stream that is cold in cache costs one
+ * line for the context (plus the counter line) rather than a walk
+ * over the whole struct.  the cold section holds setup- and
+ * rekey-time state that the data path never reads
+ */
+
+/*
+ * srtp_keystream_cache_t holds precomputed AES-ICM keystream for
+ * predicted packet indices, so that a packet whose keystream was
+ * prefetched costs only an exor plus the auth check.  it is opt-in,
+ * per stream, via srtp_stream_set_keystream_prefetch(); the ring slot
+ * for packet index i is (i mod depth).  each slot records the
+ * per-packet IV it was computed for, so a hit requires an exact index
+ * match; a rekey changes the session salt (and with it the keystream)
+ * but not the IV, so installing new keys must flush the cache
  */
+typedef struct srtp_keystream_cache_t {
+  int depth;                       /* number of ring slots              */
+  int entry_octets;                /* keystream octets held per slot    */
+  srtp_xtd_seq_num_t next_index;   /* next packet index to precompute   */
+  v128_t  *slot_iv;                /* per-slot packet IV                */
+  uint8_t *slot_valid;             /* per-slot validity flags           */
+  uint8_t *keystream;              /* depth * entry_octets of keystream */
+} srtp_keystream_cache_t;
 
 typedef struct srtp_stream_ctx_t_ {
+  /* hot: the per-packet working set, first cache line */
+  struct srtp_stream_ctx_t_ *next_hash; /* hash bucket chain for SSRC lookup */
   uint32_t   ssrc;
+  direction_t direction;
   srtp_session_keys_t *session_keys;
-  unsigned int num_master_keys;
   srtp_rdbx_t     rtp_rdbx;
   srtp_sec_serv_t rtp_services;
-  srtp_rdb_t      rtcp_rdb;
   srtp_sec_serv_t rtcp_services;
-  direction_t direction;
   int        allow_repeat_tx;
-  srtp_ekt_stream_t ekt; 
+  int        rtp_null_fast;          /* both RTP transforms are null, so
+                                      * protect/unprotect reduce to header
+                                      * validation and replay bookkeeping */
+  unsigned int last_mki_index;       /* most recently matched MKI */
+  srtp_rdb_t      rtcp_rdb;
+
+  /* cold: setup- and rekey-time state */
+  unsigned int num_master_keys;
+  srtp_ekt_stream_t ekt;
   int       *enc_xtn_hdr;
   int        enc_xtn_hdr_count;
   uint32_t pending_roc;
+
+  /*
+   * double-buffered rekey state: srtp_rekey_stream() installs a fresh
+   * session key array and parks the old one here; inbound packets
+   * with an estimated index below rekey_watermark are still processed
+   * under the old keys, which are retired once the replay window has
+   * moved wholly past the watermark (or srtp_rekey_stream_complete()
+   * is called)
+   */
+  srtp_session_keys_t *prev_session_keys;
+  unsigned int prev_num_master_keys;
+  srtp_xtd_seq_num_t rekey_watermark;   /* first index under the new keys */
+  srtp_keystream_cache_t *keystream_cache; /* optional ICM keystream
+                                            * prefetch; NULL unless enabled */
+
+  /*
+   * optional per-thread cipher pool: replicas of the first master
+   * key's cipher and auth contexts, one set per thread slot, so that
+   * several threads can unprotect packets of this stream concurrently
+   * (see srtp_stream_set_thread_cipher_pool).  NULL unless a pool has
+   * been attached
+   */
+  srtp_session_keys_t *thread_keys;
+  unsigned int thread_keys_count;
+
+  /*
+   * hardware offload state: the capability bits the session's
+   * provider reported for this stream's transform and the provider's
+   * key handle for it.  caps of zero means the stream is processed
+   * in software.  clones share the template's handle (they share its
+   * session keys) and do not own it
+   */
+  uint32_t   offload_caps;
+  uint64_t   offload_key_handle;
+  int        offload_owns_handle;
   struct srtp_stream_ctx_t_ *next;   /* linked list of streams */
+  srtp_stream_stats_t stats;         /* hot-path counters (see above) */
 } strp_stream_ctx_t_;
 
 
+/*
+ * the SSRC hash index is published through a single pointer so that
+ * the bucket count and bucket array always change together; a grown
+ * table supersedes (but does not free) its predecessor, which is kept
+ * on the retired chain until the session is deallocated so that a
+ * concurrent reader still traversing the old table remains safe
+ */
+
+typedef struct srtp_stream_hash_t_ {
+  unsigned int buckets;                 /* bucket count (a power of two)    */
+  struct srtp_stream_hash_t_ *retired;  /* superseded tables, freed at
+                                           session dealloc                  */
+  struct srtp_stream_ctx_t_ *bucket[1]; /* allocated to 'buckets' entries   */
+} srtp_stream_hash_t;
+
 /*
  * an srtp_ctx_t holds a stream list and a service description
+ *
+ * the stream list is the canonical store of the streams in the
+ * session; the stream hash table indexes the same streams by SSRC so
+ * that per-packet lookup is constant time even for sessions carrying
+ * a large number of streams
+ */
+
+/*
+ * the SSRC filter is a small counting bloom filter over the SSRCs of
+ * the streams in a session; on the receive path it definitively
+ * rejects traffic for unknown SSRCs before the stream lookup.  the
+ * counters saturate at 255 and a saturated counter is never
+ * decremented, so the filter can give false positives (costing only
+ * the lookup it would have saved) but never false negatives
  */
+#define SRTP_SSRC_FILTER_SIZE 256
+
+struct srtp_offload_provider_t;     /* see srtp_offload.h */
 
 typedef struct srtp_ctx_t_ {
   struct srtp_stream_ctx_t_ *stream_list;     /* linked list of streams            */
   struct srtp_stream_ctx_t_ *stream_template; /* act as template for other streams */
   void *user_data;                    /* user custom data */
+  srtp_stream_hash_t *stream_hash;    /* SSRC hash index (see above)       */
+  unsigned int stream_count;          /* number of streams in stream_list  */
+  struct srtp_stream_ctx_t_ *stream_free_list; /* recycled template clones */
+  uint8_t ssrc_filter[SRTP_SSRC_FILTER_SIZE]; /* counting bloom (see above) */
+  unsigned int template_stream_count; /* live streams cloned from template */
+  unsigned int max_template_streams;  /* cap on the above (0 = no limit)   */
+  unsigned int deterministic_latency; /* no slow paths in packet processing
+                                       * (see srtp_set_deterministic_latency) */
+  uint32_t roc_recovery_window;       /* candidate ROCs tried on first-packet
+                                       * auth failure (0 disables recovery)  */
+  const struct srtp_offload_provider_t *offload; /* hardware offload provider
+                                       * (see srtp_offload.h); NULL when all
+                                       * processing is in software          */
+  struct srtp_group_ctx_t_ *group;    /* session group this session belongs
+                                       * to, or NULL; the group owns the
+                                       * shared stream_template             */
+  struct srtp_ctx_t_ *group_next;     /* next member in the group's list   */
 } srtp_ctx_t_;
 
+/*
+ * srtp_group_ctx_t_ is the implementation of the srtp_group_t
+ * session-group handle: one template stream (with its derived keys,
+ * key-usage limit and MKI table) shared by every member session, plus
+ * the member list.  member sessions point their stream_template at
+ * the group's stream and never own it; clones instantiated inside a
+ * member share the template's cipher and auth contexts through the
+ * ordinary template-sharing machinery in srtp_stream_clone()
+ */
+typedef struct srtp_group_ctx_t_ {
+  struct srtp_stream_ctx_t_ *stream_template; /* shared, owned by the group */
+  struct srtp_ctx_t_ *sessions;       /* members, linked via group_next    */
+  unsigned int num_sessions;
+  unsigned int max_template_streams;  /* from the group policy             */
+  size_t template_octets;             /* heap footprint of the template    */
+} srtp_group_ctx_t_;
+
 
 /*
  * srtp_hdr_t represents an RTP or SRTP header.  The bit-fields in
@@ -0,0 +1,68 @@
+/*
+ * srtp_profile_gcm128.h
+ *
+ * build-time policy specialization for fixed-function deployments
+ * that use exactly one transform: AES-GCM-128 with 16-octet tags, no
+ * MKI and no EKT.
+ *
+ * a profile header is consumed when the library is compiled with
+ * -DSRTP_STATIC_PROFILE='"srtp_profile_<name>.h"' (the static-profile
+ * Makefile target does this); the macros it defines let the compiler
+ * fold the corresponding branches and table entries out of the
+ * library entirely.  the generic build, without SRTP_STATIC_PROFILE,
+ * is unaffected.
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_PROFILE_GCM128_H
+#define SRTP_PROFILE_GCM128_H
+
+/* pin use_mki to zero; every MKI branch folds away */
+#define SRTP_PROFILE_NO_MKI 1
+
+/* reduce the EKT hooks to constants; ekt.c compiles to nothing */
+#define SRTP_PROFILE_NO_EKT 1
+
+/*
+ * trim the built-in cipher and auth tables to AES-GCM-128, the null
+ * types (used by GCM policies for the auth slot) and AES-ICM-128,
+ * which backs the key derivation function
+ */
+#define SRTP_PROFILE_CIPHERS_MINIMAL 1
+
+#endif /* SRTP_PROFILE_GCM128_H */
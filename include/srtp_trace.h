@@ -0,0 +1,112 @@
+/*
+ * srtp_trace.h
+ *
+ * static tracepoints for the packet-processing hot path
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017 Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_TRACE_H
+#define SRTP_TRACE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * srtp_trace(stage, ssrc, len) marks a stage of srtp_protect() or
+ * srtp_unprotect() having completed for the packet with the given
+ * SSRC (network byte order) and current length.  the stages emitted
+ * are:
+ *
+ *   protect_lookup_done     unprotect_lookup_done
+ *   protect_replay_checked  unprotect_replay_checked
+ *   protect_iv_set          unprotect_iv_set
+ *   protect_cipher_done     unprotect_cipher_done
+ *   protect_auth_done       unprotect_auth_done
+ *
+ * three build configurations are supported:
+ *
+ *   -DSRTP_USE_USDT     emit USDT probes (provider "libsrtp") via
+ *                       <sys/sdt.h>, for bpftrace/systemtap; a
+ *                       disabled probe costs one nop in the text
+ *
+ *   -DSRTP_TRACE_HOOKS  call a hook registered at run time with
+ *                       srtp_set_trace_hook(), for platforms without
+ *                       USDT; an unregistered hook costs one load
+ *                       and branch
+ *
+ *   (neither)           the default: the macro expands to nothing
+ *                       and the hot path is unchanged
+ */
+
+#if defined(SRTP_USE_USDT)
+
+#include <sys/sdt.h>
+
+#define srtp_trace(stage, ssrc, len) \
+  DTRACE_PROBE2(libsrtp, stage, (ssrc), (len))
+
+#elif defined(SRTP_TRACE_HOOKS)
+
+typedef void (*srtp_trace_hook_t)(const char *stage, uint32_t ssrc, int len);
+
+/*
+ * srtp_set_trace_hook(hook) installs (or, with NULL, removes) the
+ * function called at every trace stage; registration is expected to
+ * happen before packet processing starts
+ */
+void srtp_set_trace_hook(srtp_trace_hook_t hook);
+
+void srtp_trace_emit(const char *stage, uint32_t ssrc, int len);
+
+#define srtp_trace(stage, ssrc, len) \
+  srtp_trace_emit(#stage, (ssrc), (len))
+
+#else
+
+#define srtp_trace(stage, ssrc, len) ((void)0)
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_TRACE_H */
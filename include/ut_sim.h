@@ -80,6 +80,74 @@ ut_init(ut_connection *utc);
 uint32_t
 ut_next_index(ut_connection *utc);
 
+
+/*
+ * The traffic model below extends the simulator with the knobs needed
+ * to reproduce production packet patterns: bounded reorder depth,
+ * bursty loss, SSRC churn, master key rotation and a packet-size mix.
+ * It is driven by a self-contained seeded generator, so two runs with
+ * the same profile and seed emit the exact same packet sequence; a
+ * profile plus a seed is therefore a complete, checkpointable
+ * description of a workload.
+ */
+
+#define UT_SIZE_MIX_MAX 8   /* maximum entries in a packet-size mix */
+
+typedef struct {
+  uint32_t reorder_depth;  /* maximum displacement, in packets, of a
+                            * reordered packet; 0 for in-order delivery
+                            * (values above UT_BUF are clipped)        */
+  uint32_t loss_rate;      /* chance in 10000 that a loss burst starts */
+  uint32_t loss_burst;     /* packets swallowed by each loss burst     */
+  uint32_t ssrc_period;    /* packets between SSRC changes; 0 keeps a
+                            * single SSRC                              */
+  uint32_t key_period;     /* packets between master key rotations;
+                            * 0 stays on key zero                      */
+  uint32_t num_sizes;      /* entries used in sizes[]                  */
+  uint32_t sizes[UT_SIZE_MIX_MAX]; /* payload sizes, drawn uniformly   */
+} ut_traffic_profile;
+
+/* one packet event, in (possibly reordered) arrival order */
+typedef struct {
+  uint32_t index;          /* packet index within the stream           */
+  uint32_t ssrc;
+  uint32_t key;            /* rotation count; selects the master key   */
+  uint32_t size;           /* payload size, in octets                  */
+  int lost;                /* nonzero if the network dropped it        */
+} ut_packet;
+
+typedef struct {
+  ut_traffic_profile profile;
+  uint32_t prng;           /* generator state, determined by the seed  */
+  uint32_t next_index;
+  uint32_t pending[UT_BUF];/* packets in flight, for reordering        */
+  uint32_t num_pending;
+  uint32_t ssrc;
+  uint32_t key;
+  uint32_t sent;           /* events generated so far                  */
+  uint32_t burst;          /* remaining length of the current burst    */
+} ut_traffic;
+
+/*
+ * ut_traffic_init(&t, profile, seed) initializes the traffic model t
+ * to generate packets following the given profile; the sequence of
+ * events is a pure function of the profile and the seed
+ */
+
+void
+ut_traffic_init(ut_traffic *utt, const ut_traffic_profile *profile,
+                uint32_t seed);
+
+/*
+ * ut_traffic_next(&t, &pkt) fills in pkt with the next packet event
+ * from the modeled connection; each index is emitted exactly once,
+ * displaced from its in-order position by at most
+ * profile->reorder_depth packets
+ */
+
+void
+ut_traffic_next(ut_traffic *utt, ut_packet *pkt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -46,6 +46,10 @@
 #include "srtp_priv.h"
 #include "err.h"
 #include "ekt.h"
+#include "alloc.h"
+
+/* fixed-profile builds replace this file with the inline stubs in ekt.h */
+#ifndef SRTP_PROFILE_NO_EKT
 
 extern srtp_debug_module_t mod_srtp;
 
@@ -115,6 +119,8 @@ static inline const uint8_t * srtcp_packet_get_emk_location(const uint8_t *packe
 
 
 srtp_err_status_t srtp_ekt_alloc(srtp_ekt_stream_t *stream_data, srtp_ekt_policy_t policy) {
+  srtp_ekt_stream_t ekt;
+  srtp_err_status_t status;
 
   /*
    * if the policy pointer is NULL, then EKT is not in use
@@ -125,67 +131,180 @@ srtp_err_status_t srtp_ekt_alloc(srtp_ekt_stream_t *stream_data, srtp_ekt_policy
     return srtp_err_status_ok;
   }
 
-  /* TODO */
-  *stream_data = NULL;
+  if (!policy->ekt_key)
+    return srtp_err_status_bad_param;
+
+  ekt = (srtp_ekt_stream_t)srtp_crypto_alloc(sizeof(srtp_ekt_stream_ctx_t));
+  if (!ekt)
+    return srtp_err_status_alloc_fail;
+
+  ekt->data = (srtp_ekt_data_t *)srtp_crypto_alloc(sizeof(srtp_ekt_data_t));
+  if (!ekt->data) {
+    srtp_crypto_free(ekt);
+    return srtp_err_status_alloc_fail;
+  }
+
+  status = srtp_ekt_stream_init(ekt, policy->spi, policy->ekt_key,
+                                policy->ekt_cipher_type);
+  if (status) {
+    srtp_crypto_free(ekt->data);
+    srtp_crypto_free(ekt);
+    return status;
+  }
+
+  *stream_data = ekt;
 
   return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_ekt_stream_init_from_policy(srtp_ekt_stream_t stream_data, srtp_ekt_policy_t policy) {
+srtp_err_status_t srtp_ekt_dealloc(srtp_ekt_stream_t stream_data) {
   if (!stream_data)
     return srtp_err_status_ok;
 
+  if (stream_data->data) {
+    octet_string_set_to_zero((uint8_t *)stream_data->data,
+                             sizeof(srtp_ekt_data_t));
+    srtp_crypto_free(stream_data->data);
+  }
+  octet_string_set_to_zero((uint8_t *)stream_data,
+                           sizeof(srtp_ekt_stream_ctx_t));
+  srtp_crypto_free(stream_data);
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_ekt_stream_init(srtp_ekt_stream_t e, srtp_ekt_spi_t spi, void *ekt_key, unsigned ekt_cipher_type) {
+#ifndef OPENSSL
+  srtp_err_status_t status;
+
+  if (!e || !ekt_key)
+    return srtp_err_status_bad_param;
+
+  /* only AES-128-ECB key protection is implemented at present */
+  if (ekt_cipher_type != SRTP_EKT_CIPHER_AES_128_ECB)
+    return srtp_err_status_bad_param;
+
+  e->data->spi = spi;
+  e->data->ekt_cipher_type = (uint8_t)ekt_cipher_type;
+
+  status = srtp_aes_expand_encryption_key((const uint8_t *)ekt_key, 16,
+                                          &e->data->ekt_enc_key);
+  if (status)
+    return status;
+  status = srtp_aes_expand_decryption_key((const uint8_t *)ekt_key, 16,
+                                          &e->data->ekt_dec_key);
+  if (status)
+    return status;
+
+  e->isn = 0;
+  octet_string_set_to_zero(e->data->master_salt, SRTP_SALT_LEN);
+  octet_string_set_to_zero(e->encrypted_master_key, SRTP_MAX_KEY_LEN);
+
   return srtp_err_status_ok;
+#else
+  /* the raw-AES key protection path is unavailable in OpenSSL builds */
+  return srtp_err_status_bad_param;
+#endif
 }
 
+srtp_err_status_t srtp_ekt_stream_init_from_policy(srtp_ekt_stream_t stream_data, srtp_ekt_policy_t policy, const uint8_t *master_key) {
+#ifndef OPENSSL
+  v128_t block;
+#endif
+
+  if (!stream_data)
+    return srtp_err_status_ok;
+
+  if (!policy || !master_key)
+    return srtp_err_status_bad_param;
 
-void aes_decrypt_with_raw_key(void *ciphertext, const void *key, int key_len) {
 #ifndef OPENSSL
-//FIXME: need to get this working through the crypto module interface
-  srtp_aes_expanded_key_t expanded_key;
+  /*
+   * refresh the cached Encrypted Master Key: one AES-ECB operation
+   * here, at (re)initialization, instead of one per packet.  the
+   * cache stays valid until the master key changes, at which point
+   * rekeying re-runs this function; the ROC travels in plaintext
+   * beside the EMK, so rollovers do not invalidate the cache
+   */
+  memcpy(block.v8, master_key, 16);
+  srtp_aes_encrypt(&block, &stream_data->data->ekt_enc_key);
+  memcpy(stream_data->encrypted_master_key, block.v8, 16);
+  octet_string_set_to_zero(block.v8, 16);
+
+  /*
+   * record the master salt; it is shared through the EKT parameter
+   * set rather than transported, and the receive side needs it to
+   * provision a stream from a decrypted EMK
+   */
+  memcpy(stream_data->data->master_salt, master_key + 16, SRTP_SALT_LEN);
 
-  srtp_aes_expand_decryption_key(key, key_len, &expanded_key);
-  srtp_aes_decrypt(ciphertext, &expanded_key);
+  debug_print(mod_srtp, "cached EKT EMK: %s,",
+              srtp_octet_string_hex_string(stream_data->encrypted_master_key, 16));
+
+  return srtp_err_status_ok;
+#else
+  return srtp_err_status_bad_param;
 #endif
 }
 
 /*
  * The function srtp_stream_init_from_ekt() initializes a stream using
- * the EKT data from an SRTCP trailer.  
+ * the EKT data from an SRTCP trailer.
  */
 
 srtp_err_status_t srtp_stream_init_from_ekt(srtp_stream_t stream, const void *srtcp_hdr, unsigned pkt_octet_len) {
+#ifndef OPENSSL
   srtp_err_status_t err;
-  const uint8_t *master_key;
-  srtp_policy_t srtp_policy;
+  const uint8_t *emk_location;
+  uint8_t key_with_salt[16 + SRTP_SALT_LEN];
+  v128_t block;
   uint32_t roc;
 
+  if (pkt_octet_len < EKT_OCTETS_AFTER_BASE_TAG)
+    return srtp_err_status_bad_param;
+
   /*
-   * NOTE: at present, we only support a single ekt_policy at a time.  
+   * NOTE: at present, we only support a single ekt_policy at a time.
    */
-  if (stream->ekt->data->spi != 
-      srtcp_packet_get_ekt_spi(srtcp_hdr, pkt_octet_len))
+  if (stream->ekt->data->spi !=
+      ntohs(srtcp_packet_get_ekt_spi(srtcp_hdr, pkt_octet_len)))
     return srtp_err_status_no_ctx;
 
   if (stream->ekt->data->ekt_cipher_type != SRTP_EKT_CIPHER_AES_128_ECB)
     return srtp_err_status_bad_param;
 
-  /* decrypt the Encrypted Master Key field */
-  master_key = srtcp_packet_get_emk_location(srtcp_hdr, pkt_octet_len);
-  /* FIX!? This decrypts the master key in-place, and never uses it */
-  /* FIX!? It's also passing to ekt_dec_key (which is an aes_expanded_key_t)
-   * to a function which expects a raw (unexpanded) key */
-  aes_decrypt_with_raw_key((void*)master_key, &stream->ekt->data->ekt_dec_key, 16);
+  /*
+   * decrypt a copy of the Encrypted Master Key field - the packet
+   * itself must stay intact for the authentication check that decides
+   * whether this provisional stream is accepted
+   */
+  emk_location = srtcp_packet_get_emk_location(srtcp_hdr, pkt_octet_len);
+  memcpy(block.v8, emk_location, 16);
+  srtp_aes_decrypt(&block, &stream->ekt->data->ekt_dec_key);
 
-  /* set the SRTP ROC */
-  roc = srtcp_packet_get_ekt_roc(srtcp_hdr, pkt_octet_len);
-  err = srtp_rdbx_set_roc(&stream->rtp_rdbx, roc);
+  /*
+   * re-key the stream with the decrypted master key and the master
+   * salt from the EKT parameter set.  this is stream setup, so the
+   * packet-path allocation guard is suspended around the derivation
+   */
+  memcpy(key_with_salt, block.v8, 16);
+  memcpy(key_with_salt + 16, stream->ekt->data->master_salt, SRTP_SALT_LEN);
+  srtp_crypto_alloc_guard_suspend();
+  err = srtp_stream_init_all_master_keys(stream, key_with_salt, NULL, 1);
+  srtp_crypto_alloc_guard_resume();
+  octet_string_set_to_zero(block.v8, 16);
+  octet_string_set_to_zero(key_with_salt, sizeof(key_with_salt));
   if (err) return err;
 
-  err = srtp_stream_init(stream, &srtp_policy);
+  /* set the SRTP ROC */
+  roc = ntohl(srtcp_packet_get_ekt_roc(srtcp_hdr, pkt_octet_len));
+  err = srtp_rdbx_set_roc(&stream->rtp_rdbx, roc);
   if (err) return err;
 
   return srtp_err_status_ok;
+#else
+  return srtp_err_status_bad_param;
+#endif
 }
 
 void srtp_ekt_write_data(srtp_ekt_stream_t ekt, uint8_t *base_tag, unsigned base_tag_len, int *packet_len, srtp_xtd_seq_num_t pkt_index) {
@@ -200,59 +319,44 @@ void srtp_ekt_write_data(srtp_ekt_stream_t ekt, uint8_t *base_tag, unsigned base
     return;
   }
 
-  /* write zeros into the location of the base tag */
-  octet_string_set_to_zero(base_tag, base_tag_len);
+  /*
+   * the base tag has already been written by the normal SRTCP
+   * authentication pass; the EKT fields follow it
+   */
   packet = base_tag + base_tag_len;
 
-  /* copy encrypted master key into packet */
-  emk_len = srtp_ekt_octets_after_base_tag(ekt);
+  /*
+   * copy the cached encrypted master key into the packet - the fast
+   * path common case, with no per-packet key-protection crypto
+   */
+  emk_len = srtp_ekt_octets_after_base_tag(ekt) - EKT_OCTETS_AFTER_EMK;
   memcpy(packet, ekt->encrypted_master_key, emk_len);
-  debug_print(mod_srtp, "writing EKT EMK: %s,", 
+  debug_print(mod_srtp, "writing EKT EMK: %s,",
 	      srtp_octet_string_hex_string(packet, emk_len));
   packet += emk_len;
 
   /* copy ROC into packet */
   roc = (uint32_t)(pkt_index >> 16);
   *((uint32_t *)packet) = be32_to_cpu(roc);
-  debug_print(mod_srtp, "writing EKT ROC: %s,", 
+  debug_print(mod_srtp, "writing EKT ROC: %s,",
 	      srtp_octet_string_hex_string(packet, sizeof(roc)));
   packet += sizeof(roc);
 
   /* copy ISN into packet */
   isn = (uint16_t)pkt_index;
   *((uint16_t *)packet) = htons(isn);
-  debug_print(mod_srtp, "writing EKT ISN: %s,", 
+  debug_print(mod_srtp, "writing EKT ISN: %s,",
 	      srtp_octet_string_hex_string(packet, sizeof(isn)));
   packet += sizeof(isn);
 
   /* copy SPI into packet */
   *((uint16_t *)packet) = htons(ekt->data->spi);
-  debug_print(mod_srtp, "writing EKT SPI: %s,", 
+  debug_print(mod_srtp, "writing EKT SPI: %s,",
 	      srtp_octet_string_hex_string(packet, sizeof(ekt->data->spi)));
 
   /* increase packet length appropriately */
   *packet_len += EKT_OCTETS_AFTER_EMK + emk_len;
 }
 
-
-/*
- * The function call srtcp_ekt_trailer(ekt, auth_len, auth_tag   )
- * 
- * If the pointer ekt is NULL, then the other inputs are unaffected.
- *
- * auth_tag is a pointer to the pointer to the location of the
- * authentication tag in the packet.  If EKT is in effect, then the
- * auth_tag pointer is set to the location 
- */
-
-void srtcp_ekt_trailer(srtp_ekt_stream_t ekt, unsigned *auth_len, void **auth_tag, void *tag_copy) { 
-  /* 
-   * if there is no EKT policy, then the other inputs are unaffected
-   */
-  if (!ekt) 
-    return;
-      
-  /* copy auth_tag into temporary location */
-  
-}
+#endif /* !SRTP_PROFILE_NO_EKT */
 
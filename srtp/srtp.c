@@ -49,7 +49,11 @@
 #include "crypto_types.h"
 #include "err.h"
 #include "ekt.h"             /* for SRTP Encrypted Key Transport */
+#include "srtp_offload.h"    /* for the hardware offload provider ABI */
 #include "alloc.h"           /* for srtp_crypto_alloc()          */
+#include "aes_icm.h"         /* for the devirtualized fast path  */
+#include "hmac.h"            /* likewise                         */
+#include "srtp_trace.h"      /* hot-path tracepoints (no-ops by default) */
 #ifdef OPENSSL
 #include "aes_gcm_ossl.h"    /* for AES GCM mode  */
 # ifdef OPENSSL_KDF
@@ -66,6 +70,22 @@
 #endif
 
 
+#ifdef SRTP_TRACE_HOOKS
+
+/* run-time registered tracepoint hook (see srtp_trace.h) */
+static srtp_trace_hook_t srtp_trace_hook = NULL;
+
+void srtp_set_trace_hook(srtp_trace_hook_t hook) {
+  srtp_trace_hook = hook;
+}
+
+void srtp_trace_emit(const char *stage, uint32_t ssrc, int len) {
+  if (srtp_trace_hook != NULL)
+    srtp_trace_hook(stage, ssrc, len);
+}
+
+#endif /* SRTP_TRACE_HOOKS */
+
 /* the debug module for srtp */
 
 srtp_debug_module_t mod_srtp = {
@@ -73,37 +93,164 @@ srtp_debug_module_t mod_srtp = {
   "srtp"              /* printable name for module   */
 };
 
+/*
+ * fixed-profile builds (see include/srtp_profile_gcm128.h) pin
+ * use_mki to zero at each entry point, so the compiler folds every
+ * MKI branch out of the packet paths
+ */
+#ifdef SRTP_PROFILE_NO_MKI
+#define SRTP_USE_MKI(use_mki) 0
+#else
+#define SRTP_USE_MKI(use_mki) (use_mki)
+#endif
+
+/* stream list / hash index maintenance (defined near srtp_get_stream) */
+static void
+srtp_stream_list_insert(srtp_t srtp, srtp_stream_ctx_t *stream);
+static void
+srtp_stream_hash_remove(srtp_t srtp, srtp_stream_ctx_t *stream);
+static srtp_err_status_t
+srtp_session_stream_clone(srtp_t ctx, uint32_t ssrc,
+                          srtp_stream_ctx_t **str_ptr);
+static inline int
+srtp_ssrc_filter_test(const srtp_t srtp, uint32_t ssrc);
+
+/*
+ * lock-free stream publication: a writer thread adding a stream (or a
+ * grown hash table) fully initializes the object, then publishes it
+ * with a release store; data-path readers pick up the pointer with an
+ * acquire load, so a stream found during lookup is always completely
+ * initialized.  See the thread-safety notes in srtp.h for the usage
+ * model these orderings support.
+ */
+#if defined(__GNUC__)
+#define srtp_store_ptr_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define srtp_load_ptr_acquire(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#else
+#define srtp_store_ptr_release(p, v) (*(p) = (v))
+#define srtp_load_ptr_acquire(p)     (*(p))
+#endif
+
+/*
+ * devirtualized fast path for the dominant configuration
+ *
+ * nearly all traffic runs AES-ICM-128 with HMAC-SHA1; the wrappers
+ * below test for that configuration and call straight into the
+ * implementations, replacing the function-pointer dispatch through
+ * srtp_cipher_t/srtp_auth_t with one well-predicted branch per call.
+ * every other configuration falls through to the generic dispatch
+ * unchanged.
+ */
+
+static inline srtp_err_status_t
+srtp_cipher_set_iv_fast(srtp_cipher_t *c, uint8_t *iv,
+                        srtp_cipher_direction_t direction) {
+  if (c->type->id == SRTP_AES_ICM_128)
+    return srtp_aes_icm_set_iv(c->state, iv, direction);
+  return srtp_cipher_set_iv(c, iv, direction);
+}
+
+static inline srtp_err_status_t
+srtp_cipher_encrypt_fast(srtp_cipher_t *c, uint8_t *buffer,
+                         uint32_t *num_octets) {
+  if (c->type->id == SRTP_AES_ICM_128)
+    return srtp_aes_icm_encrypt(c->state, buffer, num_octets);
+  return srtp_cipher_encrypt(c, buffer, num_octets);
+}
+
+static inline srtp_err_status_t
+srtp_cipher_decrypt_fast(srtp_cipher_t *c, uint8_t *buffer,
+                         uint32_t *num_octets) {
+  /* counter mode: decryption is the same keystream XOR */
+  if (c->type->id == SRTP_AES_ICM_128)
+    return srtp_aes_icm_encrypt(c->state, buffer, num_octets);
+  return srtp_cipher_decrypt(c, buffer, num_octets);
+}
+
+static inline srtp_err_status_t
+srtp_auth_start_fast(srtp_auth_t *a) {
+  if (a->type->id == SRTP_HMAC_SHA1)
+    return srtp_hmac_start(a->state);
+  return srtp_auth_start(a);
+}
+
+static inline srtp_err_status_t
+srtp_auth_update_fast(srtp_auth_t *a, uint8_t *buffer, int octets) {
+  if (a->type->id == SRTP_HMAC_SHA1)
+    return srtp_hmac_update(a->state, buffer, octets);
+  return srtp_auth_update(a, buffer, octets);
+}
+
+static inline srtp_err_status_t
+srtp_auth_compute_fast(srtp_auth_t *a, uint8_t *buffer, int octets,
+                       uint8_t *tag) {
+  if (a->type->id == SRTP_HMAC_SHA1)
+    return srtp_hmac_compute(a->state, buffer, octets, a->out_len, tag);
+  return srtp_auth_compute(a, buffer, octets, tag);
+}
+
 #define octets_in_rtp_header   12
 #define uint32s_in_rtp_header  3
 #define octets_in_rtcp_header  8
 #define uint32s_in_rtcp_header 2
 #define octets_in_rtp_extn_hdr 4
 
-static srtp_err_status_t
-srtp_validate_rtp_header(void *rtp_hdr, int *pkt_octet_len) {
-  if (*pkt_octet_len < octets_in_rtp_header)
-    return srtp_err_status_bad_param;
+/*
+ * srtp_parse_rtp_header computes the full rtp header length (that is,
+ * the payload offset) and the offset of the header extension, when one
+ * is present, directly from the leading octets of the packet.  the
+ * computation is branchless: the x and cc fields are folded into the
+ * offsets with arithmetic masks, and the validity conditions (version,
+ * truncated csrc list, truncated extension) are fused into a single
+ * flag that is tested once.  it runs on every packet in both
+ * directions, so it avoids the data-dependent branches on x/p/cc that
+ * the sequential field checks it replaces were taking on mixed traffic
+ */
+typedef struct {
+  int header_len;     /* octets from the start of the packet to the payload */
+  int xtn_hdr_offset; /* octets to the extension header, zero when x = 0    */
+} srtp_rtp_hdr_parse_t;
 
-  srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr;
+static srtp_err_status_t
+srtp_parse_rtp_header(const void *rtp_hdr, int pkt_octet_len,
+                      srtp_rtp_hdr_parse_t *parse) {
+  const uint8_t *pkt = (const uint8_t *)rtp_hdr;
+  uint32_t b0, x, base, have_xtn_hdr, profile_words, invalid;
+  const uint8_t *lenp;
 
-  /* Check RTP header length */
-  int rtp_header_len = octets_in_rtp_header + 4 * hdr->cc;
-  if (hdr->x == 1)
-    rtp_header_len += octets_in_rtp_extn_hdr;
+  if (pkt_octet_len < octets_in_rtp_header)
+    return srtp_err_status_bad_param;
 
-  if (*pkt_octet_len < rtp_header_len)
+  /* the first octet carries v, p, x, and cc regardless of host byte
+     order */
+  b0 = pkt[0];
+  x = (b0 >> 4) & 1;
+  base = octets_in_rtp_header + 4 * (b0 & 0x0f);
+
+  /* load the extension profile length through an offset that falls
+     back to the (always present) first header word when there is no
+     extension, or no room for one, then mask the value out again; this
+     keeps the load unconditional without ever reading past the end of
+     the packet */
+  have_xtn_hdr =
+    x & (base + octets_in_rtp_extn_hdr <= (uint32_t)pkt_octet_len);
+  lenp = pkt + ((base + 2) & (0u - have_xtn_hdr));
+  profile_words = (((uint32_t)lenp[0] << 8) | lenp[1]) & (0u - have_xtn_hdr);
+
+  /* profile length counts the number of 32-bit words that follow the
+     four-octet extension header */
+  parse->header_len = (int)(base +
+    ((octets_in_rtp_extn_hdr + 4 * profile_words) & (0u - have_xtn_hdr)));
+  parse->xtn_hdr_offset = (int)(base & (0u - have_xtn_hdr));
+
+  /* fuse the validity conditions into a single flag; anything but RTP
+     version 2 is garbage */
+  invalid = ((b0 >> 6) ^ 2)
+          | (x ^ have_xtn_hdr)
+          | ((uint32_t)pkt_octet_len < (uint32_t)parse->header_len);
+  if (invalid)
     return srtp_err_status_bad_param;
 
-  /* Verifing profile length. */
-  if (hdr->x == 1) {
-    srtp_hdr_xtnd_t *xtn_hdr =
-      (srtp_hdr_xtnd_t *)((uint32_t *)hdr + uint32s_in_rtp_header + hdr->cc);
-    int profile_len = ntohs(xtn_hdr->length);
-    rtp_header_len += profile_len * 4;
-    /* profile length counts the number of 32-bit words */
-    if (*pkt_octet_len < rtp_header_len)
-      return srtp_err_status_bad_param;
-  }
   return srtp_err_status_ok;
 }
 
@@ -261,27 +408,31 @@ srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
 
     /*
      * ...and now the RTCP-specific initialization - first, allocate
-     * the cipher 
+     * the cipher.  an rtp_only policy carries no RTCP traffic, so the
+     * SRTCP contexts are skipped entirely; the NULL pointers are what
+     * the RTCP entry points check
      */
-    stat = srtp_crypto_kernel_alloc_cipher(p->rtcp.cipher_type,
-                                           &session_keys->rtcp_cipher,
-                                           p->rtcp.cipher_key_len,
+    if (!p->rtp_only) {
+      stat = srtp_crypto_kernel_alloc_cipher(p->rtcp.cipher_type,
+                                             &session_keys->rtcp_cipher,
+                                             p->rtcp.cipher_key_len,
+                                             p->rtcp.auth_tag_len);
+      if (stat) {
+        srtp_stream_free(str);
+        return stat;
+      }
+
+      /* allocate auth function */
+      stat = srtp_crypto_kernel_alloc_auth(p->rtcp.auth_type,
+                                           &session_keys->rtcp_auth,
+                                           p->rtcp.auth_key_len,
                                            p->rtcp.auth_tag_len);
-    if (stat) {
-      srtp_stream_free(str);
-      return stat;
+      if (stat) {
+        srtp_stream_free(str);
+        return stat;
+      }
     }
 
-    /* allocate auth function */
-    stat = srtp_crypto_kernel_alloc_auth(p->rtcp.auth_type,
-                                         &session_keys->rtcp_auth,
-                                         p->rtcp.auth_key_len,
-                                         p->rtcp.auth_tag_len);
-    if (stat) {
-      srtp_stream_free(str);
-      return stat;
-    }
-   
     session_keys->mki_id = NULL;
 
     /* allocate key limit structure */
@@ -292,8 +443,12 @@ srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
     }
   }
 
-  /* allocate ekt data associated with stream */
-  stat = srtp_ekt_alloc(&str->ekt, p->ekt);
+  /*
+   * allocate ekt data associated with stream.  EKT transports a
+   * single master key, so it is not engaged for MKI policies (which
+   * carry their keys in p->keys instead of p->key)
+   */
+  stat = srtp_ekt_alloc(&str->ekt, p->key != NULL ? p->ekt : NULL);
   if (stat) {
     srtp_stream_free(str);
     return stat;
@@ -353,6 +508,160 @@ srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
   return srtp_err_status_ok;
 }
 
+/*
+ * srtp_session_keys_clear_kdf_cache(session_keys) zeroizes the cached
+ * KDF key schedule; it is called wherever the retained master key is
+ * zeroized, since the expanded schedule is equivalent key material
+ */
+static void
+srtp_session_keys_clear_kdf_cache(srtp_session_keys_t *session_keys) {
+  octet_string_set_to_zero(&session_keys->kdf_schedule,
+                           sizeof(session_keys->kdf_schedule));
+  octet_string_set_to_zero(session_keys->kdf_schedule_key,
+                           sizeof(session_keys->kdf_schedule_key));
+  session_keys->kdf_schedule_key_len = 0;
+}
+
+/*
+ * keystream prefetch cache helpers; see srtp_priv.h for the cache
+ * layout.  the cached keystream is key material, so teardown zeroizes
+ * it
+ */
+static void
+srtp_keystream_cache_free(srtp_keystream_cache_t *cache) {
+  if (cache->keystream) {
+    octet_string_set_to_zero(cache->keystream,
+                             (size_t)cache->depth * cache->entry_octets);
+    srtp_crypto_free(cache->keystream);
+  }
+  if (cache->slot_iv)
+    srtp_crypto_free(cache->slot_iv);
+  if (cache->slot_valid)
+    srtp_crypto_free(cache->slot_valid);
+  srtp_crypto_free(cache);
+}
+
+/*
+ * srtp_keystream_cache_flush(cache) invalidates every slot; it is
+ * called when new session keys are installed, since their keystream
+ * differs while the per-packet IVs do not
+ */
+static void
+srtp_keystream_cache_flush(srtp_keystream_cache_t *cache) {
+  memset(cache->slot_valid, 0, (size_t)cache->depth);
+}
+
+#ifndef NO_64BIT_MATH
+/*
+ * srtp_keystream_cache_take(cache, iv, est) returns the cached
+ * keystream for the packet with the given IV and index, consuming the
+ * slot, or NULL on a miss
+ */
+static uint8_t *
+srtp_keystream_cache_take(srtp_keystream_cache_t *cache, const v128_t *iv,
+                          srtp_xtd_seq_num_t est) {
+  int slot = (int)(est % (srtp_xtd_seq_num_t)cache->depth);
+
+  if (cache->slot_valid[slot] && v128_is_eq(&cache->slot_iv[slot], iv)) {
+    cache->slot_valid[slot] = 0;
+    return cache->keystream + (size_t)slot * cache->entry_octets;
+  }
+  return NULL;
+}
+#endif
+
+/*
+ * srtp_session_keys_retire(keys, num) zeroizes and frees a session
+ * key array that was replaced by srtp_rekey_stream(); such arrays are
+ * never shared with a template, so everything is freed
+ * unconditionally
+ */
+static void
+srtp_session_keys_retire(srtp_session_keys_t *keys, unsigned int num) {
+  unsigned int i;
+  srtp_session_keys_t *session_keys;
+
+  for (i = 0; i < num; i++) {
+    session_keys = &keys[i];
+
+    if (session_keys->rtp_xtn_hdr_cipher) {
+      srtp_cipher_dealloc(session_keys->rtp_xtn_hdr_cipher);
+    }
+    if (session_keys->rtcp_cipher) {
+      srtp_cipher_dealloc(session_keys->rtcp_cipher);
+    }
+    if (session_keys->rtcp_auth) {
+      srtp_auth_dealloc(session_keys->rtcp_auth);
+    }
+    if (session_keys->rtp_cipher) {
+      srtp_cipher_dealloc(session_keys->rtp_cipher);
+    }
+    if (session_keys->rtp_auth) {
+      srtp_auth_dealloc(session_keys->rtp_auth);
+    }
+    if (session_keys->mki_id) {
+      octet_string_set_to_zero(session_keys->mki_id, session_keys->mki_size);
+      srtp_crypto_free(session_keys->mki_id);
+    }
+    if (session_keys->limit) {
+      srtp_crypto_free(session_keys->limit);
+    }
+
+    octet_string_set_to_zero(session_keys->salt, SRTP_AEAD_SALT_LEN);
+    octet_string_set_to_zero(session_keys->c_salt, SRTP_AEAD_SALT_LEN);
+    octet_string_set_to_zero(session_keys->master_key,
+                             sizeof(session_keys->master_key));
+    srtp_session_keys_clear_kdf_cache(session_keys);
+  }
+
+  srtp_crypto_free(keys);
+}
+
+/*
+ * srtp_stream_free_thread_pool(stream) releases the per-thread cipher
+ * pool attached to a stream, if any; the pool is never shared with the
+ * template, so its contexts are always deallocated here
+ */
+static srtp_err_status_t
+srtp_stream_free_thread_pool(srtp_stream_ctx_t *stream) {
+  srtp_err_status_t status;
+  unsigned int i;
+
+  if (stream->thread_keys == NULL)
+    return srtp_err_status_ok;
+
+  for (i = 0; i < stream->thread_keys_count; i++) {
+    srtp_session_keys_t *session_keys = &stream->thread_keys[i];
+
+    status = srtp_cipher_dealloc(session_keys->rtp_cipher);
+    if (status)
+      return status;
+    status = srtp_auth_dealloc(session_keys->rtp_auth);
+    if (status)
+      return status;
+    if (session_keys->rtp_xtn_hdr_cipher) {
+      status = srtp_cipher_dealloc(session_keys->rtp_xtn_hdr_cipher);
+      if (status)
+        return status;
+    }
+    status = srtp_cipher_dealloc(session_keys->rtcp_cipher);
+    if (status)
+      return status;
+    status = srtp_auth_dealloc(session_keys->rtcp_auth);
+    if (status)
+      return status;
+  }
+
+  /* the pool entries carry copies of the master key and salts */
+  octet_string_set_to_zero((uint8_t *)stream->thread_keys,
+                           sizeof(srtp_session_keys_t) *
+                           stream->thread_keys_count);
+  srtp_crypto_free(stream->thread_keys);
+  stream->thread_keys = NULL;
+  stream->thread_keys_count = 0;
+  return srtp_err_status_ok;
+}
+
 srtp_err_status_t
 srtp_stream_dealloc(srtp_stream_ctx_t *stream, srtp_stream_ctx_t *stream_template) {
   srtp_err_status_t status;
@@ -365,7 +674,28 @@ srtp_stream_dealloc(srtp_stream_ctx_t *stream, srtp_stream_ctx_t *stream_templat
    * fails, then we report that fact without trying to deallocate
    * anything else
    */
-  for ( i = 0; i < stream->num_master_keys; i++) {
+  /* free the per-thread cipher pool, which is never shared */
+  status = srtp_stream_free_thread_pool(stream);
+  if (status)
+    return status;
+
+  /* retire any keys still parked by an in-flight rekey */
+  if (stream->prev_session_keys) {
+    srtp_session_keys_retire(stream->prev_session_keys,
+                             stream->prev_num_master_keys);
+    stream->prev_session_keys = NULL;
+  }
+
+  /*
+   * if the session key array itself is shared with the template (as
+   * it is for template clones), there is no per-key state to free
+   */
+  if (stream_template
+      && stream->session_keys == stream_template->session_keys) {
+    stream->session_keys = NULL;
+  }
+
+  for ( i = 0; stream->session_keys && i < stream->num_master_keys; i++) {
     session_keys = &stream->session_keys[i];
 
     if (stream_template) {
@@ -410,7 +740,7 @@ srtp_stream_dealloc(srtp_stream_ctx_t *stream, srtp_stream_ctx_t *stream_templat
     if (template_session_keys
         && session_keys->rtcp_cipher == template_session_keys->rtcp_cipher) {
       /* do nothing */
-    } else {
+    } else if (session_keys->rtcp_cipher) {
       status = srtp_cipher_dealloc(session_keys->rtcp_cipher);
       if (status)
         return status;
@@ -423,17 +753,20 @@ srtp_stream_dealloc(srtp_stream_ctx_t *stream, srtp_stream_ctx_t *stream_templat
     if (template_session_keys
         && session_keys->rtcp_auth == template_session_keys->rtcp_auth) {
       /* do nothing */
-    } else {
+    } else if (session_keys->rtcp_auth) {
       status = srtp_auth_dealloc(session_keys->rtcp_auth);
       if (status)
         return status;
     }
 
     /*
-     * zeroize the salt value
+     * zeroize the salt value and any retained master key material
      */
     octet_string_set_to_zero(session_keys->salt, SRTP_AEAD_SALT_LEN);
     octet_string_set_to_zero(session_keys->c_salt, SRTP_AEAD_SALT_LEN);
+    octet_string_set_to_zero(session_keys->master_key,
+                             sizeof(session_keys->master_key));
+    srtp_session_keys_clear_kdf_cache(session_keys);
 
     if (session_keys->mki_id) {
       octet_string_set_to_zero(session_keys->mki_id, session_keys->mki_size);
@@ -462,7 +795,14 @@ srtp_stream_dealloc(srtp_stream_ctx_t *stream, srtp_stream_ctx_t *stream_templat
   if (status)
     return status;
 
-  /* DAM - need to deallocate EKT here */
+  /* deallocate EKT data, unless it is shared with the template */
+  if (stream_template && stream->ekt == stream_template->ekt) {
+    /* do nothing */
+  } else if (stream->ekt) {
+    status = srtp_ekt_dealloc(stream->ekt);
+    if (status)
+      return status;
+  }
 
   if (stream_template
       && stream->enc_xtn_hdr == stream_template->enc_xtn_hdr) {
@@ -471,6 +811,10 @@ srtp_stream_dealloc(srtp_stream_ctx_t *stream, srtp_stream_ctx_t *stream_templat
     srtp_crypto_free(stream->enc_xtn_hdr);
   }
 
+  /* release the keystream prefetch cache, if one was attached */
+  if (stream->keystream_cache)
+    srtp_keystream_cache_free(stream->keystream_cache);
+
   /* deallocate srtp stream context */
   srtp_crypto_free(stream);
 
@@ -492,9 +836,6 @@ srtp_stream_clone(const srtp_stream_ctx_t *stream_template,
 		  srtp_stream_ctx_t **str_ptr) {
   srtp_err_status_t status;
   srtp_stream_ctx_t *str;
-  unsigned int i = 0;
-  srtp_session_keys_t *session_keys = NULL;
-  const srtp_session_keys_t *template_session_keys = NULL;
 
   debug_print(mod_srtp, "cloning stream (SSRC: 0x%08x)", ntohl(ssrc));
 
@@ -504,52 +845,15 @@ srtp_stream_clone(const srtp_stream_ctx_t *stream_template,
     return srtp_err_status_alloc_fail;
   *str_ptr = str;  
 
+  /*
+   * share the derived session keys with the template: the cipher,
+   * auth and key-limit state, the salts and the mki ids are all
+   * identical across clones of one template, so the clones reference
+   * the template's array instead of copying it; the per-stream state
+   * is limited to the SSRC, the replay databases and the pending ROC
+   */
   str->num_master_keys = stream_template->num_master_keys;
-  str->session_keys = (srtp_session_keys_t *)srtp_crypto_alloc(
-      sizeof(srtp_session_keys_t) * str->num_master_keys);
-
-  if (str->session_keys == NULL) {
-    srtp_crypto_free(*str_ptr);
-    *str_ptr = NULL;
-    return srtp_err_status_alloc_fail;
-  }
-
-  for (i = 0; i < stream_template->num_master_keys; i++){
-    session_keys = &str->session_keys[i];
-    template_session_keys = &stream_template->session_keys[i];
-
-    /* set cipher and auth pointers to those of the template */
-    session_keys->rtp_cipher  = template_session_keys->rtp_cipher;
-    session_keys->rtp_auth    = template_session_keys->rtp_auth;
-    session_keys->rtp_xtn_hdr_cipher = template_session_keys->rtp_xtn_hdr_cipher;
-    session_keys->rtcp_cipher = template_session_keys->rtcp_cipher;
-    session_keys->rtcp_auth   = template_session_keys->rtcp_auth;
-    session_keys->mki_size = template_session_keys->mki_size;
-
-    if (template_session_keys->mki_size == 0) {
-      session_keys->mki_id = NULL;
-    } else {
-      session_keys->mki_id = srtp_crypto_alloc(template_session_keys->mki_size);
-
-      if (session_keys->mki_id == NULL) {
-        return srtp_err_status_init_fail;
-      }
-      memset(session_keys->mki_id, 0x0, session_keys->mki_size);
-      memcpy(session_keys->mki_id, template_session_keys->mki_id, session_keys->mki_size);
-    }
-    /* Copy the salt values */
-    memcpy(session_keys->salt, template_session_keys->salt, SRTP_AEAD_SALT_LEN);
-    memcpy(session_keys->c_salt, template_session_keys->c_salt, SRTP_AEAD_SALT_LEN);
-
-    /* set key limit to point to that of the template */
-    status = srtp_key_limit_clone(template_session_keys->limit, &session_keys->limit);
-    if (status) { 
-      srtp_crypto_free(*str_ptr);
-      *str_ptr = NULL;
-      return status;
-    }
-  }
-
+  str->session_keys = stream_template->session_keys;
 
   /* initialize replay databases */
   status = srtp_rdbx_init(&str->rtp_rdbx,
@@ -559,19 +863,32 @@ srtp_stream_clone(const srtp_stream_ctx_t *stream_template,
     *str_ptr = NULL;
     return status;
   }
+  /* an adaptive template's clones start small and adapt on their own */
+  if (srtp_rdbx_get_adaptive_max(&stream_template->rtp_rdbx) != 0) {
+    status = srtp_rdbx_set_adaptive(&str->rtp_rdbx,
+                 srtp_rdbx_get_adaptive_max(&stream_template->rtp_rdbx));
+    if (status) {
+      srtp_rdbx_dealloc(&str->rtp_rdbx);
+      srtp_crypto_free(*str_ptr);
+      *str_ptr = NULL;
+      return status;
+    }
+  }
   srtp_rdb_init(&str->rtcp_rdb);
   str->allow_repeat_tx = stream_template->allow_repeat_tx;
 
   /* set ssrc to that provided */
   str->ssrc = ssrc;
 
-  /* reset pending ROC */
+  /* reset pending ROC and MKI cache */
   str->pending_roc = 0;
+  str->last_mki_index = 0;
 
   /* set direction and security services */
   str->direction     = stream_template->direction;
   str->rtp_services  = stream_template->rtp_services;
   str->rtcp_services = stream_template->rtcp_services;
+  str->rtp_null_fast = stream_template->rtp_null_fast;
 
   /* set pointer to EKT data associated with stream */
   str->ekt = stream_template->ekt;
@@ -580,57 +897,249 @@ srtp_stream_clone(const srtp_stream_ctx_t *stream_template,
   str->enc_xtn_hdr = stream_template->enc_xtn_hdr;
   str->enc_xtn_hdr_count = stream_template->enc_xtn_hdr_count;
 
+  /* no rekey in flight on a fresh clone */
+  str->prev_session_keys = NULL;
+  str->prev_num_master_keys = 0;
+  str->rekey_watermark = 0;
+
+  /* counters start from zero */
+  memset(&str->stats, 0, sizeof(str->stats));
+
+  /* the prefetch cache is per-stream state; clones start without one */
+  str->keystream_cache = NULL;
+
+  /* likewise the per-thread cipher pool */
+  str->thread_keys = NULL;
+  str->thread_keys_count = 0;
+
+  /* clones share the template's offload key handle without owning it
+   * (they share the session keys it was opened for) */
+  str->offload_caps = stream_template->offload_caps;
+  str->offload_key_handle = stream_template->offload_key_handle;
+  str->offload_owns_handle = 0;
+
   /* defensive coding */
   str->next = NULL;
+  str->next_hash = NULL;
   return srtp_err_status_ok;
 }
 
-
 /*
- * key derivation functions, internal to libSRTP
- *
- * srtp_kdf_t is a key derivation context
- *
- * srtp_kdf_init(&kdf, cipher_id, k, keylen) initializes kdf to use cipher
- * described by cipher_id, with the master key k with length in octets keylen.
- * 
- * srtp_kdf_generate(&kdf, l, kl, keylen) derives the key
- * corresponding to label l and puts it into kl; the length
- * of the key in octets is provided as keylen.  this function
- * should be called once for each subkey that is derived.
+ * srtp_session_stream_clone(ctx, ssrc, str_ptr) provides a stream
+ * cloned from the session's template, reusing a context from the
+ * session free list when one is available
  *
- * srtp_kdf_clear(&kdf) zeroizes and deallocates the kdf state
+ * streams on the free list were cloned from the current template (the
+ * list is flushed whenever the template changes), so their
+ * allocations - the context itself, the session key array, the mki
+ * ids and the replay bitvector - and their key material are all still
+ * valid; only the cheap per-SSRC state has to be redone
  */
+static srtp_err_status_t
+srtp_session_stream_clone(srtp_t ctx, uint32_t ssrc,
+                          srtp_stream_ctx_t **str_ptr) {
+  srtp_stream_ctx_t *str = ctx->stream_free_list;
+  srtp_stream_ctx_t *stream_template = ctx->stream_template;
 
-typedef enum {
-  label_rtp_encryption  = 0x00,
-  label_rtp_msg_auth    = 0x01,
-  label_rtp_salt        = 0x02,
-  label_rtcp_encryption = 0x03,
-  label_rtcp_msg_auth   = 0x04,
-  label_rtcp_salt       = 0x05,
-  label_rtp_header_encryption = 0x06,
-  label_rtp_header_salt = 0x07
-} srtp_prf_label;
-
-#define MAX_SRTP_KEY_LEN 256
-
-#if defined(OPENSSL) && defined(OPENSSL_KDF)
-#define MAX_SRTP_AESKEY_LEN 32
-#define MAX_SRTP_SALT_LEN 14 
+  /*
+   * enforce the template's stream-creation budget, so that an SSRC
+   * flood cannot drive unbounded stream creation
+   */
+  if (ctx->max_template_streams > 0 &&
+      ctx->template_stream_count >= ctx->max_template_streams)
+    return srtp_err_status_no_ctx;
 
-/*
- * srtp_kdf_t represents a key derivation function.  The SRTP
- * default KDF is the only one implemented at present.
- */
-typedef struct { 
-    uint8_t master_key[MAX_SRTP_AESKEY_LEN];
-    uint8_t master_salt[MAX_SRTP_SALT_LEN];
-    const EVP_CIPHER *evp;
-} srtp_kdf_t;
+  if (str == NULL) {
+    srtp_err_status_t status;
 
+    /*
+     * in deterministic-latency mode the packet path may not allocate
+     * or derive keys; a clone can only be put into service if one was
+     * stocked on the free list at setup time (see srtp_create_ex)
+     */
+    if (ctx->deterministic_latency)
+      return srtp_err_status_no_ctx;
 
-static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf, const uint8_t *key, int key_len, int salt_len) 
+    /*
+     * cloning a fresh stream is the one allocation allowed inside
+     * the guarded packet-processing sections (it is stream setup,
+     * not steady-state processing)
+     */
+    srtp_crypto_alloc_guard_suspend();
+    status = srtp_stream_clone(stream_template, ssrc, str_ptr);
+    srtp_crypto_alloc_guard_resume();
+    return status;
+  }
+
+  debug_print(mod_srtp, "reusing recycled stream (SSRC: 0x%08x)", ntohl(ssrc));
+  ctx->stream_free_list = str->next;
+
+  /* reset replay databases (a recycled adaptive window keeps its size) */
+  srtp_index_init(&str->rtp_rdbx.index);
+  bitvector_set_to_zero(&str->rtp_rdbx.bitmask);
+  str->rtp_rdbx.window_offset = 0;
+  str->rtp_rdbx.reorder_depth = 0;
+  str->rtp_rdbx.adapt_count = 0;
+  srtp_rdb_init(&str->rtcp_rdb);
+
+  /* set ssrc to that provided, and reset pending ROC and MKI cache */
+  str->ssrc = ssrc;
+  str->pending_roc = 0;
+  str->last_mki_index = 0;
+  str->prev_session_keys = NULL;
+  str->prev_num_master_keys = 0;
+  str->rekey_watermark = 0;
+  memset(&str->stats, 0, sizeof(str->stats));
+
+  /* refresh the state shared with the template */
+  str->allow_repeat_tx = stream_template->allow_repeat_tx;
+  str->direction     = stream_template->direction;
+  str->rtp_services  = stream_template->rtp_services;
+  str->rtcp_services = stream_template->rtcp_services;
+  str->rtp_null_fast = stream_template->rtp_null_fast;
+  str->ekt = stream_template->ekt;
+  str->enc_xtn_hdr = stream_template->enc_xtn_hdr;
+  str->enc_xtn_hdr_count = stream_template->enc_xtn_hdr_count;
+  str->offload_caps = stream_template->offload_caps;
+  str->offload_key_handle = stream_template->offload_key_handle;
+  str->offload_owns_handle = 0;
+
+  str->next = NULL;
+  str->next_hash = NULL;
+  *str_ptr = str;
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_recycle(ctx, stream) places a template-cloned stream
+ * (already unlinked from the stream list) on the session free list
+ * for reuse by a later clone
+ */
+static void
+srtp_stream_recycle(srtp_t ctx, srtp_stream_ctx_t *stream) {
+  /* the cipher pool is bound to the SSRC's service life, not the
+     context's, so it does not survive recycling */
+  (void) srtp_stream_free_thread_pool(stream);
+  stream->next = ctx->stream_free_list;
+  ctx->stream_free_list = stream;
+}
+
+/*
+ * the slot this thread uses to pick its replica out of a stream's
+ * per-thread cipher pool; zero (the default) selects the stream's own
+ * contexts.  without compiler support for thread-local storage the
+ * slot degenerates to a process-wide setting, which still selects the
+ * right contexts for single-threaded use
+ */
+#if defined(_MSC_VER)
+#define SRTP_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define SRTP_THREAD_LOCAL __thread
+#else
+#define SRTP_THREAD_LOCAL
+#endif
+
+static SRTP_THREAD_LOCAL unsigned int srtp_thread_cipher_slot = 0;
+
+void
+srtp_set_thread_cipher_slot(unsigned int slot) {
+  srtp_thread_cipher_slot = slot;
+}
+
+/*
+ * srtp_stream_thread_keys(stream, session_keys) returns this thread's
+ * replica of the stream's first-master-key contexts when a pool is
+ * attached and the thread has claimed a slot within it; retiring
+ * (rekey) keys and MKI-selected keys are never swapped, since the
+ * pool replicates only the current first master key
+ */
+static srtp_session_keys_t *
+srtp_stream_thread_keys(srtp_stream_ctx_t *stream,
+                        srtp_session_keys_t *session_keys) {
+  if (stream->thread_keys != NULL && srtp_thread_cipher_slot > 0 &&
+      srtp_thread_cipher_slot <= stream->thread_keys_count &&
+      session_keys == &stream->session_keys[0]) {
+    return &stream->thread_keys[srtp_thread_cipher_slot - 1];
+  }
+  return session_keys;
+}
+
+/*
+ * srtp_stream_rekey_expire(stream) retires the keys parked by
+ * srtp_rekey_stream() once the replay window has moved wholly past
+ * the rekey watermark, i.e. once no in-flight packet can still
+ * legitimately select them
+ */
+static void
+srtp_stream_rekey_expire(srtp_stream_ctx_t *stream) {
+  if (stream->rtp_rdbx.index >=
+      stream->rekey_watermark +
+      (srtp_xtd_seq_num_t)srtp_rdbx_get_window_size(&stream->rtp_rdbx)) {
+    srtp_session_keys_retire(stream->prev_session_keys,
+                             stream->prev_num_master_keys);
+    stream->prev_session_keys = NULL;
+    stream->prev_num_master_keys = 0;
+  }
+}
+
+
+/*
+ * key derivation functions, internal to libSRTP
+ *
+ * srtp_kdf_t is a key derivation context
+ *
+ * srtp_kdf_init(&kdf, cipher_id, k, keylen) initializes kdf to use cipher
+ * described by cipher_id, with the master key k with length in octets keylen.
+ * 
+ * srtp_kdf_generate(&kdf, l, kl, keylen) derives the key
+ * corresponding to label l and puts it into kl; the length
+ * of the key in octets is provided as keylen.  this function
+ * should be called once for each subkey that is derived.
+ *
+ * srtp_kdf_clear(&kdf) zeroizes and deallocates the kdf state
+ */
+
+typedef enum {
+  label_rtp_encryption  = 0x00,
+  label_rtp_msg_auth    = 0x01,
+  label_rtp_salt        = 0x02,
+  label_rtcp_encryption = 0x03,
+  label_rtcp_msg_auth   = 0x04,
+  label_rtcp_salt       = 0x05,
+  label_rtp_header_encryption = 0x06,
+  label_rtp_header_salt = 0x07
+} srtp_prf_label;
+
+#define MAX_SRTP_KEY_LEN 256
+
+/*
+ * srtp_kdf_span_t names one subkey to derive: the label, where the
+ * subkey is written, and how many octets are needed.  an array of
+ * spans describes all of the key material a stream needs, so that
+ * srtp_kdf_generate_set() can derive it in a single batched pass
+ */
+typedef struct {
+  srtp_prf_label label;         /* KDF label to derive         */
+  uint8_t *key;                 /* where the subkey is written */
+  unsigned int length;          /* octets to derive            */
+} srtp_kdf_span_t;
+
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+#define MAX_SRTP_AESKEY_LEN 32
+#define MAX_SRTP_SALT_LEN 14 
+
+/*
+ * srtp_kdf_t represents a key derivation function.  The SRTP
+ * default KDF is the only one implemented at present.
+ */
+typedef struct { 
+    uint8_t master_key[MAX_SRTP_AESKEY_LEN];
+    uint8_t master_salt[MAX_SRTP_SALT_LEN];
+    const EVP_CIPHER *evp;
+} srtp_kdf_t;
+
+
+static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf, const uint8_t *key, int key_len, int salt_len) 
 {
     memset(kdf, 0x0, sizeof(srtp_kdf_t));
 
@@ -680,6 +1189,19 @@ static srtp_err_status_t srtp_kdf_generate(srtp_kdf_t *kdf, srtp_prf_label label
     return srtp_err_status_ok;
 }
 
+static srtp_err_status_t srtp_kdf_generate_set(srtp_kdf_t *kdf, const srtp_kdf_span_t *span, int num_spans)
+{
+    srtp_err_status_t status;
+    int i;
+
+    /* the OpenSSL KDF derives each label with its own call */
+    for (i = 0; i < num_spans; i++) {
+        status = srtp_kdf_generate(kdf, span[i].label, span[i].key, span[i].length);
+        if (status) return status;
+    }
+    return srtp_err_status_ok;
+}
+
 static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf) {
     octet_string_set_to_zero(kdf->master_key, MAX_SRTP_AESKEY_LEN);
     octet_string_set_to_zero(kdf->master_salt, MAX_SRTP_SALT_LEN);
@@ -694,11 +1216,24 @@ static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf) {
  * srtp_kdf_t represents a key derivation function.  The SRTP
  * default KDF is the only one implemented at present.
  */
-typedef struct { 
-    srtp_cipher_t *cipher;    /* cipher used for key derivation  */  
+typedef struct {
+    srtp_cipher_t *cipher;    /* cipher used for key derivation  */
+    srtp_cipher_t cipher_ctx;           /* placed cipher context ...       */
+    srtp_aes_icm_ctx_t cipher_state;    /* ... and its state; both live in
+                                         * the kdf itself, so a stack kdf
+                                         * performs no allocation at all   */
 } srtp_kdf_t;
 
-static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf, const uint8_t *key, int key_len)
+static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf);
+
+/*
+ * session_keys, when non-NULL, carries the cached AES key schedule
+ * for the master key: a hit skips the key expansion, a miss expands
+ * and refreshes the cache, so each master key is expanded only once
+ * across the initial, deferred and template-cloned derivations
+ */
+static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf, const uint8_t *key, int key_len,
+                                       srtp_session_keys_t *session_keys)
 {
     srtp_cipher_type_id_t cipher_id;
     switch (key_len) {
@@ -717,14 +1252,49 @@ static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf, const uint8_t *key, int
     }
 
     srtp_err_status_t stat;
-    stat = srtp_crypto_kernel_alloc_cipher(cipher_id, &kdf->cipher, key_len, 0);
-    if (stat) return stat;
+    stat = srtp_crypto_kernel_place_cipher(cipher_id, &kdf->cipher_ctx,
+                                           &kdf->cipher_state,
+                                           sizeof(kdf->cipher_state),
+                                           key_len, 0);
+    if (stat == srtp_err_status_ok) {
+        kdf->cipher = &kdf->cipher_ctx;
+    } else {
+        /* the cipher type backing the KDF cannot be placed (e.g. an
+         * externally loaded replacement), so fall back to the heap */
+        stat = srtp_crypto_kernel_alloc_cipher(cipher_id, &kdf->cipher, key_len, 0);
+        if (stat) return stat;
+    }
+
+#ifndef OPENSSL
+    if (kdf->cipher == &kdf->cipher_ctx && session_keys != NULL) {
+        if (session_keys->kdf_schedule_key_len == key_len &&
+            !octet_string_is_eq(session_keys->kdf_schedule_key, (uint8_t *)key, key_len)) {
+            /* cache hit: reuse the expanded schedule for this master key */
+            stat = srtp_aes_icm_context_init_from_schedule(&kdf->cipher_state, key,
+                                                           &session_keys->kdf_schedule);
+            if (stat) {
+                srtp_kdf_clear(kdf);
+                return stat;
+            }
+            return srtp_err_status_ok;
+        }
+    }
+#endif
 
     stat = srtp_cipher_init(kdf->cipher, key);
     if (stat) {
-        srtp_cipher_dealloc(kdf->cipher);
+        srtp_kdf_clear(kdf);
         return stat;
     }
+
+#ifndef OPENSSL
+    if (kdf->cipher == &kdf->cipher_ctx && session_keys != NULL) {
+        memcpy(&session_keys->kdf_schedule, &kdf->cipher_state.expanded_key,
+               sizeof(session_keys->kdf_schedule));
+        memcpy(session_keys->kdf_schedule_key, key, key_len);
+        session_keys->kdf_schedule_key_len = key_len;
+    }
+#endif
     return srtp_err_status_ok;
 }
 
@@ -748,12 +1318,90 @@ static srtp_err_status_t srtp_kdf_generate(srtp_kdf_t *kdf, srtp_prf_label label
     return srtp_err_status_ok;
 }
 
+/*
+ * srtp_kdf_generate_set(kdf, span, num_spans) derives all of the
+ * subkeys named by span[0..num_spans-1].  when the KDF rides on the
+ * placed ICM context, the counter blocks for every label are laid out
+ * up front and pushed through the block cipher four at a time, so a
+ * whole stream's key material costs a single trip through the AES
+ * pipeline instead of one set_iv/encrypt round per label.  falls back
+ * to per-label generation when the backing cipher type has been
+ * replaced or the batch does not fit
+ */
+#define SRTP_KDF_MAX_BLOCKS 16
+
+static srtp_err_status_t srtp_kdf_generate_set(srtp_kdf_t *kdf, const srtp_kdf_span_t *span, int num_spans)
+{
+    srtp_err_status_t status;
+    int i;
+
+#ifndef OPENSSL
+    if (kdf->cipher == &kdf->cipher_ctx) {
+        v128_t blocks[SRTP_KDF_MAX_BLOCKS];
+        int num_blocks = 0;
+        int b;
+
+        for (i = 0; i < num_spans; i++) {
+            num_blocks += (span[i].length + 15) / 16;
+        }
+        if (num_blocks <= SRTP_KDF_MAX_BLOCKS) {
+            /*
+             * build the counter blocks for every label: block b of
+             * label l is the master salt with l folded into octet
+             * seven and b in the trailing 16-bit block counter -
+             * exactly the sequence that set_iv/encrypt clocks through
+             * one label at a time
+             */
+            num_blocks = 0;
+            for (i = 0; i < num_spans; i++) {
+                unsigned int span_blocks = (span[i].length + 15) / 16;
+                unsigned int j;
+                for (j = 0; j < span_blocks; j++) {
+                    v128_copy(&blocks[num_blocks], &kdf->cipher_state.offset);
+                    blocks[num_blocks].v8[7] ^= (uint8_t)span[i].label;
+                    blocks[num_blocks].v8[14] = (uint8_t)(j >> 8);
+                    blocks[num_blocks].v8[15] = (uint8_t)j;
+                    num_blocks++;
+                }
+            }
+            for (b = num_blocks; b < ((num_blocks + 3) & ~3); b++) {
+                v128_set_to_zero(&blocks[b]);
+            }
+
+            for (b = 0; b < num_blocks; b += 4) {
+                srtp_aes_encrypt_ct4(&blocks[b], &kdf->cipher_state.expanded_key);
+            }
+
+            /* scatter the keystream out to the requested subkeys */
+            num_blocks = 0;
+            for (i = 0; i < num_spans; i++) {
+                memcpy(span[i].key, &blocks[num_blocks], span[i].length);
+                num_blocks += (span[i].length + 15) / 16;
+            }
+
+            octet_string_set_to_zero((uint8_t *)blocks, sizeof(blocks));
+            return srtp_err_status_ok;
+        }
+    }
+#endif
+
+    for (i = 0; i < num_spans; i++) {
+        status = srtp_kdf_generate(kdf, span[i].label, span[i].key, span[i].length);
+        if (status) return status;
+    }
+    return srtp_err_status_ok;
+}
+
 static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf) {
     srtp_err_status_t status;
-    status = srtp_cipher_dealloc(kdf->cipher);
+    if (kdf->cipher == &kdf->cipher_ctx) {
+        status = srtp_cipher_clear_placed(kdf->cipher);
+    } else {
+        status = srtp_cipher_dealloc(kdf->cipher);
+    }
     if (status) return status;
     kdf->cipher = NULL;
-    return srtp_err_status_ok;  
+    return srtp_err_status_ok;
 }
 #endif /* else OPENSSL_KDF */
 
@@ -878,9 +1526,11 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
   srtp_err_status_t stat;
   srtp_kdf_t kdf;
   uint8_t tmp_key[MAX_SRTP_KEY_LEN];
+  uint8_t tmp_auth_key[MAX_SRTP_KEY_LEN];
+  srtp_kdf_span_t spans[3];
+  int num_spans = 0;
   int kdf_keylen = 30, rtp_keylen, rtcp_keylen;
   int rtp_base_key_len, rtp_salt_len;
-  int rtcp_base_key_len, rtcp_salt_len;
   srtp_session_keys_t *session_keys = NULL;
   unsigned char *key = master_key->key;
 
@@ -916,7 +1566,8 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
   session_keys->mki_size = master_key->mki_size;
 
   rtp_keylen = srtp_cipher_get_key_length(session_keys->rtp_cipher);
-  rtcp_keylen = srtp_cipher_get_key_length(session_keys->rtcp_cipher);
+  rtcp_keylen = session_keys->rtcp_cipher ?
+    srtp_cipher_get_key_length(session_keys->rtcp_cipher) : 0;
   rtp_base_key_len = base_key_length(session_keys->rtp_cipher->type, rtp_keylen);
   rtp_salt_len = rtp_keylen - rtp_base_key_len;
 
@@ -942,11 +1593,18 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
   memset(tmp_key, 0x0, MAX_SRTP_KEY_LEN);
   memcpy(tmp_key, key, (rtp_base_key_len + rtp_salt_len));
 
+  /*
+   * retain the (zero-padded) master key for the deferred SRTCP and
+   * header-extension derivations; it is zeroized when the last of
+   * those completes
+   */
+  memcpy(session_keys->master_key, tmp_key, sizeof(session_keys->master_key));
+
   /* initialize KDF state     */
 #if defined(OPENSSL) && defined(OPENSSL_KDF)
   stat = srtp_kdf_init(&kdf, (const uint8_t *)tmp_key, rtp_base_key_len, rtp_salt_len); 
 #else
-  stat = srtp_kdf_init(&kdf, (const uint8_t *)tmp_key, kdf_keylen);
+  stat = srtp_kdf_init(&kdf, (const uint8_t *)tmp_key, kdf_keylen, session_keys);
 #endif
   if (stat) {
     /* zeroize temp buffer */
@@ -954,35 +1612,39 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
     return srtp_err_status_init_fail;
   }
   
-  /* generate encryption key  */
-  stat = srtp_kdf_generate(&kdf, label_rtp_encryption, 
-			   tmp_key, rtp_base_key_len);
+  /*
+   * derive the encryption key, salt and authentication key in a
+   * single batched pass over the KDF cipher
+   */
+  spans[num_spans].label = label_rtp_encryption;
+  spans[num_spans].key = tmp_key;
+  spans[num_spans].length = rtp_base_key_len;
+  num_spans++;
+  if (rtp_salt_len > 0) {
+    debug_print(mod_srtp, "found rtp_salt_len > 0, generating salt", NULL);
+    spans[num_spans].label = label_rtp_salt;
+    spans[num_spans].key = tmp_key + rtp_base_key_len;
+    spans[num_spans].length = rtp_salt_len;
+    num_spans++;
+  }
+  spans[num_spans].label = label_rtp_msg_auth;
+  spans[num_spans].key = tmp_auth_key;
+  spans[num_spans].length = srtp_auth_get_key_length(session_keys->rtp_auth);
+  num_spans++;
+
+  stat = srtp_kdf_generate_set(&kdf, spans, num_spans);
   if (stat) {
-    /* zeroize temp buffer */
+    /* zeroize temp buffers */
     octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+    octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
     return srtp_err_status_init_fail;
   }
-  debug_print(mod_srtp, "cipher key: %s", 
+  debug_print(mod_srtp, "cipher key: %s",
 	      srtp_octet_string_hex_string(tmp_key, rtp_base_key_len));
 
-  /* 
-   * if the cipher in the srtp context uses a salt, then we need
-   * to generate the salt value
-   */
   if (rtp_salt_len > 0) {
-    debug_print(mod_srtp, "found rtp_salt_len > 0, generating salt", NULL);
-
-    /* generate encryption salt, put after encryption key */
-    stat = srtp_kdf_generate(&kdf, label_rtp_salt, 
-			     tmp_key + rtp_base_key_len, rtp_salt_len);
-    if (stat) {
-      /* zeroize temp buffer */
-      octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-      return srtp_err_status_init_fail;
-    }
     memcpy(session_keys->salt, tmp_key + rtp_base_key_len, SRTP_AEAD_SALT_LEN);
-  }
-  if (rtp_salt_len > 0) {
+    session_keys->aead_iv_valid = 0;    /* salt changed; rebuild template */
     debug_print(mod_srtp, "cipher salt: %s",
 		srtp_octet_string_hex_string(tmp_key + rtp_base_key_len, rtp_salt_len));
   }
@@ -990,171 +1652,139 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
   /* initialize cipher */
   stat = srtp_cipher_init(session_keys->rtp_cipher, tmp_key);
   if (stat) {
-    /* zeroize temp buffer */
+    /* zeroize temp buffers */
     octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+    octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
     return srtp_err_status_init_fail;
   }
 
-  if (session_keys->rtp_xtn_hdr_cipher) {
-    /* generate extensions header encryption key  */
-    int rtp_xtn_hdr_keylen;
-    int rtp_xtn_hdr_base_key_len;
-    int rtp_xtn_hdr_salt_len;
-    srtp_kdf_t tmp_kdf;
-    srtp_kdf_t *xtn_hdr_kdf;
-
-    if (session_keys->rtp_xtn_hdr_cipher->type != session_keys->rtp_cipher->type) {
-      /* With GCM ciphers, the header extensions are still encrypted using the corresponding ICM cipher. */
-      /* See https://tools.ietf.org/html/rfc7714#section-8.3 */
-      uint8_t tmp_xtn_hdr_key[MAX_SRTP_KEY_LEN];
-      rtp_xtn_hdr_keylen = srtp_cipher_get_key_length(session_keys->rtp_xtn_hdr_cipher);
-      rtp_xtn_hdr_base_key_len = base_key_length(session_keys->rtp_xtn_hdr_cipher->type,
-                                                 rtp_xtn_hdr_keylen);
-      rtp_xtn_hdr_salt_len = rtp_xtn_hdr_keylen - rtp_xtn_hdr_base_key_len;
-      if (rtp_xtn_hdr_salt_len > rtp_salt_len) {
-        switch (session_keys->rtp_cipher->type->id) {
-        case SRTP_AES_GCM_128:
-        case SRTP_AES_GCM_256:
-          /* The shorter GCM salt is padded to the required ICM salt length. */
-          rtp_xtn_hdr_salt_len = rtp_salt_len;
-          break;
-        default:
-          /* zeroize temp buffer */
-          octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-          return srtp_err_status_bad_param;
-        }
-      }
-      memset(tmp_xtn_hdr_key, 0x0, MAX_SRTP_KEY_LEN);
-      memcpy(tmp_xtn_hdr_key, key, (rtp_xtn_hdr_base_key_len + rtp_xtn_hdr_salt_len));
-      xtn_hdr_kdf = &tmp_kdf;
-
-      /* initialize KDF state     */
-#if defined(OPENSSL) && defined(OPENSSL_KDF)
-      stat = srtp_kdf_init(xtn_hdr_kdf, (const uint8_t *)tmp_xtn_hdr_key, rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len);
-#else
-      stat = srtp_kdf_init(xtn_hdr_kdf, (const uint8_t *)tmp_xtn_hdr_key, kdf_keylen);
-#endif
-      octet_string_set_to_zero(tmp_xtn_hdr_key, MAX_SRTP_KEY_LEN);
-      if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
-      }
-    } else {
-      /* Reuse main KDF. */
-      rtp_xtn_hdr_keylen = rtp_keylen;
-      rtp_xtn_hdr_base_key_len = rtp_base_key_len;
-      rtp_xtn_hdr_salt_len = rtp_salt_len;
-      xtn_hdr_kdf = &kdf;
-    }
-
-    stat = srtp_kdf_generate(xtn_hdr_kdf, label_rtp_header_encryption,
-           tmp_key, rtp_xtn_hdr_base_key_len);
-    if (stat) {
-      /* zeroize temp buffer */
-      octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-      return srtp_err_status_init_fail;
-    }
-    debug_print(mod_srtp, "extensions cipher key: %s",
-          srtp_octet_string_hex_string(tmp_key, rtp_xtn_hdr_base_key_len));
-
-    /*
-     * if the cipher in the srtp context uses a salt, then we need
-     * to generate the salt value
-     */
-    if (rtp_xtn_hdr_salt_len > 0) {
-      debug_print(mod_srtp, "found rtp_xtn_hdr_salt_len > 0, generating salt", NULL);
-
-      /* generate encryption salt, put after encryption key */
-      stat = srtp_kdf_generate(xtn_hdr_kdf, label_rtp_header_salt,
-             tmp_key + rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len);
-      if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
-      }
-    }
-    if (rtp_xtn_hdr_salt_len > 0) {
-      debug_print(mod_srtp, "extensions cipher salt: %s",
-      srtp_octet_string_hex_string(tmp_key + rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len));
-    }
-
-    /* initialize extensions header cipher */
-    stat = srtp_cipher_init(session_keys->rtp_xtn_hdr_cipher, tmp_key);
-    if (stat) {
-      /* zeroize temp buffer */
-      octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-      return srtp_err_status_init_fail;
-    }
-
-    if (xtn_hdr_kdf != &kdf) {
-      /* release memory for custom header extension encryption kdf */
-      stat = srtp_kdf_clear(xtn_hdr_kdf);
-      if (stat) {
-        /* zeroize temp buffer */
-        octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-        return srtp_err_status_init_fail;
-      }
-    }
-  }
-
-  /* generate authentication key */
-  stat = srtp_kdf_generate(&kdf, label_rtp_msg_auth,
-			   tmp_key, srtp_auth_get_key_length(session_keys->rtp_auth));
-  if (stat) {
-    /* zeroize temp buffer */
-    octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-    return srtp_err_status_init_fail;
-  }
   debug_print(mod_srtp, "auth key:   %s",
-	      srtp_octet_string_hex_string(tmp_key, 
-				      srtp_auth_get_key_length(session_keys->rtp_auth))); 
+	      srtp_octet_string_hex_string(tmp_auth_key,
+				      srtp_auth_get_key_length(session_keys->rtp_auth)));
 
   /* initialize auth function */
-  stat = srtp_auth_init(session_keys->rtp_auth, tmp_key);
+  stat = srtp_auth_init(session_keys->rtp_auth, tmp_auth_key);
   if (stat) {
-    /* zeroize temp buffer */
+    /* zeroize temp buffers */
     octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+    octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
     return srtp_err_status_init_fail;
   }
 
   /*
-   * ...now initialize SRTCP keys
+   * the SRTCP and header-extension keys are derived lazily, by
+   * srtp_stream_derive_rtcp_keys() and
+   * srtp_stream_derive_xtn_hdr_keys(), when the first packet that
+   * needs them arrives; each KDF label is generated independently,
+   * so the deferred derivations produce exactly the keys that the
+   * former eager derivation did
    */
+  session_keys->deferred_rtcp_keys = (session_keys->rtcp_cipher != NULL);
+  session_keys->deferred_xtn_hdr_keys =
+    (session_keys->rtp_xtn_hdr_cipher != NULL);
+
+  /* clear memory then return */
+  stat = srtp_kdf_clear(&kdf);
+  octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+  octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
+  if (stat)
+    return srtp_err_status_init_fail;
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_session_kdf_keylen(session_keys) returns the master key length
+ * that selects the KDF cipher, computed exactly as in
+ * srtp_stream_init_keys()
+ */
+static int
+srtp_session_kdf_keylen(const srtp_session_keys_t *session_keys) {
+  int kdf_keylen = 30;
+
+  if (srtp_cipher_get_key_length(session_keys->rtp_cipher) > kdf_keylen)
+    kdf_keylen = 46;  /* AES-CTR mode is always used for KDF */
+  if (session_keys->rtcp_cipher &&
+      srtp_cipher_get_key_length(session_keys->rtcp_cipher) > kdf_keylen)
+    kdf_keylen = 46;
+
+  return kdf_keylen;
+}
+
+/*
+ * srtp_stream_derive_rtcp_keys(session_keys) performs the SRTCP key
+ * derivation that srtp_stream_init_keys() deferred; it runs when the
+ * first RTCP packet for these session keys is processed.  key
+ * derivation is stream setup, so the allocation guard is suspended
+ * around the KDF instantiation
+ */
+static srtp_err_status_t
+srtp_stream_derive_rtcp_keys(srtp_session_keys_t *session_keys) {
+  srtp_err_status_t stat;
+  srtp_kdf_t kdf;
+  uint8_t tmp_key[MAX_SRTP_KEY_LEN];
+  uint8_t tmp_auth_key[MAX_SRTP_KEY_LEN];
+  srtp_kdf_span_t spans[3];
+  int num_spans = 0;
+  int rtcp_keylen, rtcp_base_key_len, rtcp_salt_len;
 
+  rtcp_keylen = srtp_cipher_get_key_length(session_keys->rtcp_cipher);
   rtcp_base_key_len = base_key_length(session_keys->rtcp_cipher->type, rtcp_keylen);
   rtcp_salt_len = rtcp_keylen - rtcp_base_key_len;
   debug_print(mod_srtp, "rtcp salt len: %d", rtcp_salt_len);
-  
-  /* generate encryption key  */
-  stat = srtp_kdf_generate(&kdf, label_rtcp_encryption, 
-			   tmp_key, rtcp_base_key_len);
-  if (stat) {
-    /* zeroize temp buffer */
-    octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-    return srtp_err_status_init_fail;
+
+  /* initialize KDF state from the retained master key */
+  srtp_crypto_alloc_guard_suspend();
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+  {
+    int rtp_keylen = srtp_cipher_get_key_length(session_keys->rtp_cipher);
+    int rtp_base_key_len = base_key_length(session_keys->rtp_cipher->type,
+                                           rtp_keylen);
+    stat = srtp_kdf_init(&kdf, (const uint8_t *)session_keys->master_key,
+                         rtp_base_key_len, rtp_keylen - rtp_base_key_len);
   }
+#else
+  stat = srtp_kdf_init(&kdf, (const uint8_t *)session_keys->master_key,
+                       srtp_session_kdf_keylen(session_keys), session_keys);
+#endif
+  srtp_crypto_alloc_guard_resume();
+  if (stat)
+    return srtp_err_status_init_fail;
 
-  /* 
-   * if the cipher in the srtp context uses a salt, then we need
-   * to generate the salt value
+  /*
+   * derive the SRTCP encryption key, salt and authentication key in a
+   * single batched pass over the KDF cipher
    */
+  spans[num_spans].label = label_rtcp_encryption;
+  spans[num_spans].key = tmp_key;
+  spans[num_spans].length = rtcp_base_key_len;
+  num_spans++;
   if (rtcp_salt_len > 0) {
     debug_print(mod_srtp, "found rtcp_salt_len > 0, generating rtcp salt",
 		NULL);
+    spans[num_spans].label = label_rtcp_salt;
+    spans[num_spans].key = tmp_key + rtcp_base_key_len;
+    spans[num_spans].length = rtcp_salt_len;
+    num_spans++;
+  }
+  spans[num_spans].label = label_rtcp_msg_auth;
+  spans[num_spans].key = tmp_auth_key;
+  spans[num_spans].length = srtp_auth_get_key_length(session_keys->rtcp_auth);
+  num_spans++;
 
-    /* generate encryption salt, put after encryption key */
-    stat = srtp_kdf_generate(&kdf, label_rtcp_salt, 
-			     tmp_key + rtcp_base_key_len, rtcp_salt_len);
-    if (stat) {
-      /* zeroize temp buffer */
-      octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
-      return srtp_err_status_init_fail;
-    }
+  stat = srtp_kdf_generate_set(&kdf, spans, num_spans);
+  if (stat) {
+    /* zeroize temp buffers */
+    octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+    octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
+    return srtp_err_status_init_fail;
+  }
+
+  if (rtcp_salt_len > 0) {
     memcpy(session_keys->c_salt, tmp_key + rtcp_base_key_len, SRTP_AEAD_SALT_LEN);
   }
-  debug_print(mod_srtp, "rtcp cipher key: %s", 
-	      srtp_octet_string_hex_string(tmp_key, rtcp_base_key_len));  
+  debug_print(mod_srtp, "rtcp cipher key: %s",
+	      srtp_octet_string_hex_string(tmp_key, rtcp_base_key_len));
   if (rtcp_salt_len > 0) {
     debug_print(mod_srtp, "rtcp cipher salt: %s",
 		srtp_octet_string_hex_string(tmp_key + rtcp_base_key_len, rtcp_salt_len));
@@ -1163,26 +1793,155 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
   /* initialize cipher */
   stat = srtp_cipher_init(session_keys->rtcp_cipher, tmp_key);
   if (stat) {
-    /* zeroize temp buffer */
+    /* zeroize temp buffers */
     octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+    octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
     return srtp_err_status_init_fail;
   }
 
-  /* generate authentication key */
-  stat = srtp_kdf_generate(&kdf, label_rtcp_msg_auth,
-			   tmp_key, srtp_auth_get_key_length(session_keys->rtcp_auth));
+  debug_print(mod_srtp, "rtcp auth key:   %s",
+	      srtp_octet_string_hex_string(tmp_auth_key,
+		     srtp_auth_get_key_length(session_keys->rtcp_auth)));
+
+  /* initialize auth function */
+  stat = srtp_auth_init(session_keys->rtcp_auth, tmp_auth_key);
   if (stat) {
-    /* zeroize temp buffer */
+    /* zeroize temp buffers */
     octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+    octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
     return srtp_err_status_init_fail;
   }
 
-  debug_print(mod_srtp, "rtcp auth key:   %s",
-	      srtp_octet_string_hex_string(tmp_key, 
-		     srtp_auth_get_key_length(session_keys->rtcp_auth))); 
+  /* clear memory then return */
+  stat = srtp_kdf_clear(&kdf);
+  octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+  octet_string_set_to_zero(tmp_auth_key, MAX_SRTP_KEY_LEN);
+  if (stat)
+    return srtp_err_status_init_fail;
 
-  /* initialize auth function */
-  stat = srtp_auth_init(session_keys->rtcp_auth, tmp_key);
+  session_keys->deferred_rtcp_keys = 0;
+  if (!session_keys->deferred_xtn_hdr_keys) {
+    octet_string_set_to_zero(session_keys->master_key,
+                             sizeof(session_keys->master_key));
+    srtp_session_keys_clear_kdf_cache(session_keys);
+  }
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_derive_xtn_hdr_keys(session_keys) performs the deferred
+ * header-extension key derivation; it runs when the first packet
+ * carrying an encrypted header extension is processed
+ */
+static srtp_err_status_t
+srtp_stream_derive_xtn_hdr_keys(srtp_session_keys_t *session_keys) {
+  srtp_err_status_t stat;
+  srtp_kdf_t kdf;
+  uint8_t tmp_key[MAX_SRTP_KEY_LEN];
+  int rtp_keylen, rtp_base_key_len, rtp_salt_len;
+  int rtp_xtn_hdr_keylen;
+  int rtp_xtn_hdr_base_key_len;
+  int rtp_xtn_hdr_salt_len;
+
+  /*
+   * zeroize the key buffer up front: when the GCM salt is shorter
+   * than the ICM salt the extension cipher expects, the derived salt
+   * is zero-padded to the full length (RFC 7714, section 8.3)
+   */
+  memset(tmp_key, 0x0, MAX_SRTP_KEY_LEN);
+
+  rtp_keylen = srtp_cipher_get_key_length(session_keys->rtp_cipher);
+  rtp_base_key_len = base_key_length(session_keys->rtp_cipher->type, rtp_keylen);
+  rtp_salt_len = rtp_keylen - rtp_base_key_len;
+
+  if (session_keys->rtp_xtn_hdr_cipher->type != session_keys->rtp_cipher->type) {
+    /* With GCM ciphers, the header extensions are still encrypted using the corresponding ICM cipher. */
+    /* See https://tools.ietf.org/html/rfc7714#section-8.3 */
+    uint8_t tmp_xtn_hdr_key[MAX_SRTP_KEY_LEN];
+    rtp_xtn_hdr_keylen = srtp_cipher_get_key_length(session_keys->rtp_xtn_hdr_cipher);
+    rtp_xtn_hdr_base_key_len = base_key_length(session_keys->rtp_xtn_hdr_cipher->type,
+                                               rtp_xtn_hdr_keylen);
+    rtp_xtn_hdr_salt_len = rtp_xtn_hdr_keylen - rtp_xtn_hdr_base_key_len;
+    if (rtp_xtn_hdr_salt_len > rtp_salt_len) {
+      switch (session_keys->rtp_cipher->type->id) {
+      case SRTP_AES_GCM_128:
+      case SRTP_AES_GCM_256:
+        /* The shorter GCM salt is padded to the required ICM salt length. */
+        rtp_xtn_hdr_salt_len = rtp_salt_len;
+        break;
+      default:
+        return srtp_err_status_bad_param;
+      }
+    }
+    memset(tmp_xtn_hdr_key, 0x0, MAX_SRTP_KEY_LEN);
+    memcpy(tmp_xtn_hdr_key, session_keys->master_key,
+           (rtp_xtn_hdr_base_key_len + rtp_xtn_hdr_salt_len));
+
+    /* initialize KDF state     */
+    srtp_crypto_alloc_guard_suspend();
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+    stat = srtp_kdf_init(&kdf, (const uint8_t *)tmp_xtn_hdr_key, rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len);
+#else
+    stat = srtp_kdf_init(&kdf, (const uint8_t *)tmp_xtn_hdr_key,
+                         srtp_session_kdf_keylen(session_keys), session_keys);
+#endif
+    srtp_crypto_alloc_guard_resume();
+    octet_string_set_to_zero(tmp_xtn_hdr_key, MAX_SRTP_KEY_LEN);
+    if (stat)
+      return srtp_err_status_init_fail;
+  } else {
+    /* Same cipher family as RTP; key the KDF as the main KDF was keyed. */
+    rtp_xtn_hdr_keylen = rtp_keylen;
+    rtp_xtn_hdr_base_key_len = rtp_base_key_len;
+    rtp_xtn_hdr_salt_len = rtp_salt_len;
+
+    srtp_crypto_alloc_guard_suspend();
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+    stat = srtp_kdf_init(&kdf, (const uint8_t *)session_keys->master_key,
+                         rtp_base_key_len, rtp_salt_len);
+#else
+    stat = srtp_kdf_init(&kdf, (const uint8_t *)session_keys->master_key,
+                         srtp_session_kdf_keylen(session_keys), session_keys);
+#endif
+    srtp_crypto_alloc_guard_resume();
+    if (stat)
+      return srtp_err_status_init_fail;
+  }
+
+  /* derive the extension key and salt in one batched pass */
+  {
+    srtp_kdf_span_t spans[2];
+    int num_spans = 0;
+
+    spans[num_spans].label = label_rtp_header_encryption;
+    spans[num_spans].key = tmp_key;
+    spans[num_spans].length = rtp_xtn_hdr_base_key_len;
+    num_spans++;
+    if (rtp_xtn_hdr_salt_len > 0) {
+      debug_print(mod_srtp, "found rtp_xtn_hdr_salt_len > 0, generating salt", NULL);
+      spans[num_spans].label = label_rtp_header_salt;
+      spans[num_spans].key = tmp_key + rtp_xtn_hdr_base_key_len;
+      spans[num_spans].length = rtp_xtn_hdr_salt_len;
+      num_spans++;
+    }
+
+    stat = srtp_kdf_generate_set(&kdf, spans, num_spans);
+    if (stat) {
+      /* zeroize temp buffer */
+      octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
+      return srtp_err_status_init_fail;
+    }
+  }
+  debug_print(mod_srtp, "extensions cipher key: %s",
+        srtp_octet_string_hex_string(tmp_key, rtp_xtn_hdr_base_key_len));
+  if (rtp_xtn_hdr_salt_len > 0) {
+    debug_print(mod_srtp, "extensions cipher salt: %s",
+    srtp_octet_string_hex_string(tmp_key + rtp_xtn_hdr_base_key_len, rtp_xtn_hdr_salt_len));
+  }
+
+  /* initialize extensions header cipher */
+  stat = srtp_cipher_init(session_keys->rtp_xtn_hdr_cipher, tmp_key);
   if (stat) {
     /* zeroize temp buffer */
     octet_string_set_to_zero(tmp_key, MAX_SRTP_KEY_LEN);
@@ -1195,9 +1954,35 @@ srtp_stream_init_keys(srtp_stream_ctx_t *srtp, srtp_master_key_t *master_key,
   if (stat)
     return srtp_err_status_init_fail;
 
+  session_keys->deferred_xtn_hdr_keys = 0;
+  if (!session_keys->deferred_rtcp_keys) {
+    octet_string_set_to_zero(session_keys->master_key,
+                             sizeof(session_keys->master_key));
+    srtp_session_keys_clear_kdf_cache(session_keys);
+  }
+
   return srtp_err_status_ok;
 }
 
+/*
+ * srtp_stream_update_null_fast_path(srtp) records whether both RTP
+ * transforms of the stream are null; when they are, the packet
+ * functions take a short path that does only header validation and
+ * replay/ROC bookkeeping, since key limits, IV loading and the
+ * cipher/auth dispatch have no observable effect under null crypto.
+ * the flag is conservative: multiple master keys, header-extension
+ * encryption or an in-flight rekey all force the full path
+ */
+static void
+srtp_stream_update_null_fast_path(srtp_stream_ctx_t *srtp) {
+  srtp->rtp_null_fast =
+    (srtp->num_master_keys == 1 &&
+     srtp->prev_session_keys == NULL &&
+     srtp->session_keys[0].rtp_xtn_hdr_cipher == NULL &&
+     srtp->session_keys[0].rtp_cipher->type->id == SRTP_NULL_CIPHER &&
+     srtp->session_keys[0].rtp_auth->type->id == SRTP_NULL_AUTH);
+}
+
 srtp_err_status_t
 srtp_stream_init(srtp_stream_ctx_t *srtp, 
 		  const srtp_policy_t *p) {
@@ -1231,11 +2016,26 @@ srtp_stream_init(srtp_stream_ctx_t *srtp,
    srtp->rtcp_services = p->rtcp.sec_serv;
 
    /*
-    * set direction to unknown - this flag gets checked in srtp_protect(),
-    * srtp_unprotect(), srtp_protect_rtcp(), and srtp_unprotect_rtcp(), and 
-    * gets set appropriately if it is set to unknown.
+    * set the direction from the policy - this flag gets checked in
+    * srtp_protect(), srtp_unprotect(), srtp_protect_rtcp(), and
+    * srtp_unprotect_rtcp(), and gets set appropriately if it is set to
+    * unknown.  a policy that declares the direction up front gets SSRC
+    * collision detection from the first packet on
     */
-   srtp->direction = dir_unknown;
+   switch (p->stream_direction) {
+   case srtp_stream_direction_any:
+     srtp->direction = dir_unknown;
+     break;
+   case srtp_stream_direction_sender:
+     srtp->direction = dir_srtp_sender;
+     break;
+   case srtp_stream_direction_receiver:
+     srtp->direction = dir_srtp_receiver;
+     break;
+   default:
+     srtp_rdbx_dealloc(&srtp->rtp_rdbx);
+     return srtp_err_status_bad_param;
+   }
 
    /* initialize SRTCP replay database */
    srtp_rdb_init(&srtp->rtcp_rdb);
@@ -1261,13 +2061,18 @@ srtp_stream_init(srtp_stream_ctx_t *srtp,
     * if EKT is in use, then initialize the EKT data associated with
     * the stream
     */
-   err = srtp_ekt_stream_init_from_policy(srtp->ekt, p->ekt);
-   if (err) {
-     srtp_rdbx_dealloc(&srtp->rtp_rdbx);
-     return err;
+   if (srtp->ekt != NULL) {
+     err = srtp_ekt_stream_init_from_policy(srtp->ekt, p->ekt, p->key);
+     if (err) {
+       srtp_rdbx_dealloc(&srtp->rtp_rdbx);
+       return err;
+     }
    }
 
-   return srtp_err_status_ok;  
+   /* detect the null/null configuration for the recording fast path */
+   srtp_stream_update_null_fast_path(srtp);
+
+   return srtp_err_status_ok;
  }
 
 
@@ -1354,14 +2159,17 @@ srtp_protect_extension_header(srtp_stream_ctx_t *stream, int id) {
 
 /*
  * extensions header encryption RFC 6904
+ *
+ * srtp_process_header_encryption_element_wise() is the fallback for
+ * extension blocks too large for the batched keystream buffer below;
+ * it invokes the cipher once per extension element
  */
 static srtp_err_status_t
-srtp_process_header_encryption(srtp_stream_ctx_t *stream,
-                               srtp_hdr_xtnd_t *xtn_hdr,
-                               srtp_session_keys_t *session_keys) {
+srtp_process_header_encryption_element_wise(srtp_stream_ctx_t *stream,
+                                            srtp_hdr_xtnd_t *xtn_hdr,
+                                            srtp_session_keys_t *session_keys) {
   srtp_err_status_t status;
   uint8_t keystream[257];  /* Maximum 2 bytes header + 255 bytes data. */
-  int keystream_pos;
   uint8_t* xtn_hdr_data = ((uint8_t *)xtn_hdr) + octets_in_rtp_extn_hdr;
   uint8_t* xtn_hdr_end = xtn_hdr_data + (ntohs(xtn_hdr->length) * sizeof(uint32_t));
 
@@ -1387,15 +2195,9 @@ srtp_process_header_encryption(srtp_stream_ctx_t *stream,
         return srtp_err_status_cipher_fail;
 
       if (srtp_protect_extension_header(stream, xid)) {
-        keystream_pos = 1;
-        while (xlen > 0) {
-          *xtn_hdr_data ^= keystream[keystream_pos++];
-          xtn_hdr_data++;
-          xlen--;
-        }
-      } else {
-        xtn_hdr_data += xlen;
+        srtp_octet_string_xor(xtn_hdr_data, keystream + 1, xlen);
       }
+      xtn_hdr_data += xlen;
 
       /* skip padding bytes. */
       while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
@@ -1419,15 +2221,100 @@ srtp_process_header_encryption(srtp_stream_ctx_t *stream,
         return srtp_err_status_cipher_fail;
 
       if (xlen > 0 && srtp_protect_extension_header(stream, xid)) {
-        keystream_pos = 2;
-        while (xlen > 0) {
-          *xtn_hdr_data ^= keystream[keystream_pos++];
-          xtn_hdr_data++;
-          xlen--;
-        }
-      } else {
-        xtn_hdr_data += xlen;
+        srtp_octet_string_xor(xtn_hdr_data, keystream + 2, xlen);
+      }
+      xtn_hdr_data += xlen;
+
+      /* skip padding bytes. */
+      while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
+        xtn_hdr_data++;
+      }
+    }
+  } else {
+    /* unsupported extension header format. */
+    return srtp_err_status_parse_err;
+  }
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_process_header_encryption() generates the keystream for the
+ * whole extension block with a single cipher call and xors each
+ * element marked for encryption against its slice of it, instead of
+ * invoking the cipher once per element.  the per-element keystream
+ * offsets are unchanged: every element consumes its header-plus-data
+ * length and padding consumes nothing, so the bytes produced are
+ * identical to those of the element-wise path
+ */
+static srtp_err_status_t
+srtp_process_header_encryption(srtp_stream_ctx_t *stream,
+                               srtp_hdr_xtnd_t *xtn_hdr,
+                               srtp_session_keys_t *session_keys) {
+  srtp_err_status_t status;
+  uint8_t keystream[1456];  /* the extension block of an MTU-sized packet */
+  unsigned int keystream_len;
+  unsigned int keystream_base = 0;
+  uint8_t* xtn_hdr_data = ((uint8_t *)xtn_hdr) + octets_in_rtp_extn_hdr;
+  uint8_t* xtn_hdr_end = xtn_hdr_data + (ntohs(xtn_hdr->length) * sizeof(uint32_t));
+
+  /*
+   * each element consumes at most its footprint in the block, so the
+   * block length bounds the keystream we can need; blocks too big for
+   * the scratch buffer take the element-wise path
+   */
+  keystream_len = (unsigned int)(xtn_hdr_end - xtn_hdr_data);
+  if (keystream_len > sizeof(keystream))
+    return srtp_process_header_encryption_element_wise(stream, xtn_hdr,
+                                                       session_keys);
+  status = srtp_cipher_output(session_keys->rtp_xtn_hdr_cipher,
+                              keystream, &keystream_len);
+  if (status)
+    return srtp_err_status_cipher_fail;
+
+  if (ntohs(xtn_hdr->profile_specific) == 0xbede) {
+    /* RFC 5285, section 4.2. One-Byte Header */
+    while (xtn_hdr_data < xtn_hdr_end) {
+      uint8_t xid = (*xtn_hdr_data & 0xf0) >> 4;
+      unsigned int xlen = (*xtn_hdr_data & 0x0f) + 1;
+      xtn_hdr_data++;
+
+      if (xtn_hdr_data + xlen > xtn_hdr_end)
+        return srtp_err_status_parse_err;
+
+      if (xid == 15) {
+        /* found header 15, stop further processing. */
+        break;
+      }
+
+      if (srtp_protect_extension_header(stream, xid)) {
+        srtp_octet_string_xor(xtn_hdr_data, keystream + keystream_base + 1,
+                              xlen);
+      }
+      keystream_base += 1 + xlen;
+      xtn_hdr_data += xlen;
+
+      /* skip padding bytes. */
+      while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
+        xtn_hdr_data++;
+      }
+    }
+  } else if ((ntohs(xtn_hdr->profile_specific) & 0x1fff) == 0x100) {
+    /* RFC 5285, section 4.3. Two-Byte Header */
+    while (xtn_hdr_data + 1 < xtn_hdr_end) {
+      uint8_t xid = *xtn_hdr_data;
+      unsigned int xlen = *(xtn_hdr_data+1);
+      xtn_hdr_data += 2;
+
+      if (xtn_hdr_data + xlen > xtn_hdr_end)
+        return srtp_err_status_parse_err;
+
+      if (xlen > 0 && srtp_protect_extension_header(stream, xid)) {
+        srtp_octet_string_xor(xtn_hdr_data, keystream + keystream_base + 2,
+                              xlen);
       }
+      keystream_base += 2 + xlen;
+      xtn_hdr_data += xlen;
 
       /* skip padding bytes. */
       while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
@@ -1475,41 +2362,52 @@ srtp_process_header_encryption(srtp_stream_ctx_t *stream,
 static void srtp_calc_aead_iv(srtp_session_keys_t *session_keys, v128_t *iv,
                               srtp_xtd_seq_num_t *seq, srtp_hdr_t *hdr)
 {
-    v128_t	in;
-    v128_t	salt;
+    uint32_t local_roc;
+    uint16_t local_seq;
 
 #ifdef NO_64BIT_MATH
-    uint32_t local_roc = ((high32(*seq) << 16) |
-                         (low32(*seq) >> 16));
-    uint16_t local_seq = (uint16_t) (low32(*seq));
+    local_roc = ((high32(*seq) << 16) | (low32(*seq) >> 16));
+    local_seq = (uint16_t) (low32(*seq));
 #else
-    uint32_t local_roc = (uint32_t)(*seq >> 16);
-    uint16_t local_seq = (uint16_t) *seq;
+    local_roc = (uint32_t)(*seq >> 16);
+    local_seq = (uint16_t) *seq;
 #endif
 
-    memset(&in, 0, sizeof(v128_t));
-    memset(&salt, 0, sizeof(v128_t));
-
-    in.v16[5] = htons(local_seq);
-    local_roc = htonl(local_roc);
-    memcpy(&in.v16[3], &local_roc, sizeof(local_roc));
-
     /*
-     * Copy in the RTP SSRC value
-     */
-    memcpy(&in.v8[2], &hdr->ssrc, 4);
-    debug_print(mod_srtp, "Pre-salted RTP IV = %s\n", v128_hex_string(&in));
-
-    /*
-     * Get the SALT value from the context
+     * the salt and SSRC are invariant for the stream lifetime, so
+     * their xor is cached as a template the first time this SSRC is
+     * seen; the template is rebuilt if the SSRC changes, since
+     * session keys may be shared between streams
      */
-    memcpy(salt.v8, session_keys->salt, SRTP_AEAD_SALT_LEN);
-    debug_print(mod_srtp, "RTP SALT = %s\n", v128_hex_string(&salt));
+    if (!session_keys->aead_iv_valid ||
+        session_keys->aead_iv_ssrc != hdr->ssrc) {
+        v128_t *tmpl = &session_keys->aead_iv_tmpl;
+
+        memset(tmpl, 0, sizeof(v128_t));
+        memcpy(tmpl->v8, session_keys->salt, SRTP_AEAD_SALT_LEN);
+        tmpl->v8[2] ^= ((uint8_t *)&hdr->ssrc)[0];
+        tmpl->v8[3] ^= ((uint8_t *)&hdr->ssrc)[1];
+        tmpl->v8[4] ^= ((uint8_t *)&hdr->ssrc)[2];
+        tmpl->v8[5] ^= ((uint8_t *)&hdr->ssrc)[3];
+        session_keys->aead_iv_ssrc = hdr->ssrc;
+        session_keys->aead_iv_valid = 1;
+    }
 
     /*
-     * Finally, apply tyhe SALT to the input
+     * per-packet work is just folding the ROC and SEQ into the
+     * cached salt-xor-SSRC template
      */
-    v128_xor(iv, &in, &salt);
+    *iv = session_keys->aead_iv_tmpl;
+    local_roc = htonl(local_roc);
+    iv->v8[6] ^= ((uint8_t *)&local_roc)[0];
+    iv->v8[7] ^= ((uint8_t *)&local_roc)[1];
+    iv->v8[8] ^= ((uint8_t *)&local_roc)[2];
+    iv->v8[9] ^= ((uint8_t *)&local_roc)[3];
+    local_seq = htons(local_seq);
+    iv->v8[10] ^= ((uint8_t *)&local_seq)[0];
+    iv->v8[11] ^= ((uint8_t *)&local_seq)[1];
+
+    debug_print(mod_srtp, "RTP IV = %s\n", v128_hex_string(iv));
 }
 
 
@@ -1521,6 +2419,7 @@ srtp_get_session_keys(srtp_stream_ctx_t *stream, uint8_t* hdr,
   unsigned int mki_start_location = 0;
   unsigned int tag_len = 0;
   unsigned int i = 0;
+  unsigned int n = 0;
 
   // Determine the authentication tag size
   if (stream->session_keys[0].rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
@@ -1537,13 +2436,21 @@ srtp_get_session_keys(srtp_stream_ctx_t *stream, uint8_t* hdr,
 
   base_mki_start_location -= tag_len;
 
-  for (i = 0; i < stream->num_master_keys; i++) {
+  /*
+   * start the scan at the most recently matched master key -
+   * consecutive packets almost always carry the same MKI, so the
+   * common case is a single comparison regardless of how many keys
+   * the stream rotates through
+   */
+  for (n = 0; n < stream->num_master_keys; n++) {
+      i = (stream->last_mki_index + n) % stream->num_master_keys;
       if (stream->session_keys[i].mki_size != 0) {
           *mki_size = stream->session_keys[i].mki_size;
           mki_start_location = base_mki_start_location - *mki_size;
 
           if ( mki_start_location >= *mki_size &&
               memcmp(hdr + mki_start_location, stream->session_keys[i].mki_id, *mki_size) == 0 ) {
+              stream->last_mki_index = i;
               return &stream->session_keys[i];
 	  }
       }
@@ -1679,6 +2586,7 @@ srtp_protect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
     srtp_hdr_xtnd_t *xtn_hdr = NULL;
     unsigned int mki_size = 0;
     uint8_t *mki_location = NULL;
+    srtp_rtp_hdr_parse_t parse;
 
     debug_print(mod_srtp, "function srtp_protect_aead", NULL);
 
@@ -1687,7 +2595,7 @@ srtp_protect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
      * didn't just hit either the soft limit or the hard limit, and call
      * the event handler if we hit either.
      */
-    switch (srtp_key_limit_update(session_keys->limit)) {
+    switch (srtp_key_limit_update_batched(session_keys->limit)) {
     case srtp_key_event_normal:
         break;
     case srtp_key_event_hard_limit:
@@ -1708,30 +2616,38 @@ srtp_protect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
      * extension, if present; otherwise, it starts after the last csrc,
      * if any are present
      */
-     enc_start = (uint32_t*)hdr + uint32s_in_rtp_header + hdr->cc;
-     if (hdr->x == 1) {
-         xtn_hdr = (srtp_hdr_xtnd_t*)enc_start;
-         enc_start += (ntohs(xtn_hdr->length) + 1);
-     }
-     /* note: the passed size is without the auth tag */
-     if (!((uint8_t*)enc_start <= (uint8_t*)hdr + *pkt_octet_len))
+     status = srtp_parse_rtp_header(hdr, (int)*pkt_octet_len, &parse);
+     if (status)
          return srtp_err_status_parse_err;
-     enc_octet_len = (int)(*pkt_octet_len -
-                                    ((uint8_t*)enc_start - (uint8_t*)hdr));
-     if (enc_octet_len < 0) return srtp_err_status_parse_err;
+     enc_start = (uint32_t *)((uint8_t *)hdr + parse.header_len);
+     if (parse.xtn_hdr_offset)
+         xtn_hdr = (srtp_hdr_xtnd_t *)((uint8_t *)hdr + parse.xtn_hdr_offset);
+     /* note: the passed size is without the auth tag */
+     enc_octet_len = (int)(*pkt_octet_len - parse.header_len);
 
     /*
      * estimate the packet index using the start of the replay window
-     * and the sequence number from the header
+     * and the sequence number from the header; on the sending side
+     * the sequence number almost always increments by exactly one,
+     * in which case the index is known without running the estimator
+     * and the replay check cannot fail
      */
-    delta = srtp_rdbx_estimate_index(&stream->rtp_rdbx, &est, ntohs(hdr->seq));
-    status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
-    if (status) {
-	if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx) {
-	    return status;  /* we've been asked to reuse an index */
-	}
+    if (stream->direction == dir_srtp_sender &&
+        srtp_rdbx_advance_sender(&stream->rtp_rdbx,
+                                 ntohs(hdr->seq)) == srtp_err_status_ok) {
+        est = srtp_rdbx_get_packet_index(&stream->rtp_rdbx);
+        delta = 1;
     } else {
-	srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+        delta = srtp_rdbx_estimate_index(&stream->rtp_rdbx, &est, ntohs(hdr->seq));
+        status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+        if (status) {
+            if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx) {
+                stream->stats.replay_drops++;
+                return status;  /* we've been asked to reuse an index */
+            }
+        } else {
+            srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+        }
     }
 
 #ifdef NO_64BIT_MATH
@@ -1754,23 +2670,21 @@ srtp_protect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
     est = be64_to_cpu(est << 16);
 #endif
 
-    status = srtp_cipher_set_iv(session_keys->rtp_cipher,
-                                (uint8_t*)&iv, srtp_direction_encrypt);
-    if (!status && session_keys->rtp_xtn_hdr_cipher) {
-      iv.v32[0] = 0;
-      iv.v32[1] = hdr->ssrc;
-      iv.v64[1] = est;
-      status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
-                                  (uint8_t*)&iv, srtp_direction_encrypt);
-    }
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
-
     if (xtn_hdr && session_keys->rtp_xtn_hdr_cipher) {
       /*
-       * extensions header encryption RFC 6904
+       * extensions header encryption RFC 6904; the extension cipher's
+       * IV is only loaded when the packet actually carries extensions
        */
+      v128_t xtn_iv;
+
+      xtn_iv.v32[0] = 0;
+      xtn_iv.v32[1] = hdr->ssrc;
+      xtn_iv.v64[1] = est;
+      status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
+                                  (uint8_t*)&xtn_iv, srtp_direction_encrypt);
+      if (status) {
+        return srtp_err_status_cipher_fail;
+      }
 	status = srtp_process_header_encryption(stream, xtn_hdr, session_keys);
       if (status) {
         return status;
@@ -1778,29 +2692,17 @@ srtp_protect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
     }
 
     /*
-     * Set the AAD over the RTP header 
+     * run the whole AEAD operation - IV load, RTP header as AAD,
+     * payload encryption and the appended tag - in one cipher call
      */
     aad_len = (uint8_t *)enc_start - (uint8_t *)hdr;
-    status = srtp_cipher_set_aad(session_keys->rtp_cipher, (uint8_t*)hdr, aad_len);
-    if (status) {
-        return ( srtp_err_status_cipher_fail);
-    }
-
-    /* Encrypt the payload  */
-    status = srtp_cipher_encrypt(session_keys->rtp_cipher,
-                            (uint8_t*)enc_start, (unsigned int *)&enc_octet_len);
+    status = srtp_cipher_aead(session_keys->rtp_cipher, (uint8_t*)&iv,
+                              srtp_direction_encrypt, (uint8_t*)hdr, aad_len,
+                              (uint8_t*)enc_start,
+                              (unsigned int *)&enc_octet_len);
     if (status) {
         return srtp_err_status_cipher_fail;
     }
-    /*
-     * If we're doing GCM, we need to get the tag
-     * and append that to the output
-     */
-    status = srtp_cipher_get_tag(session_keys->rtp_cipher, 
-                            (uint8_t*)enc_start+enc_octet_len, &tag_len);
-    if (status) {
-	return ( srtp_err_status_cipher_fail);
-    }
 
     mki_location = (uint8_t *)hdr + *pkt_octet_len + tag_len;
     mki_size = srtp_inject_mki(mki_location, session_keys, use_mki);
@@ -1811,6 +2713,9 @@ srtp_protect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
     /* increase the packet length by the length of the mki_size */
     *pkt_octet_len += mki_size;
 
+    stream->stats.packets_protected++;
+    stream->stats.octets_protected += (uint64_t)*pkt_octet_len;
+
     return srtp_err_status_ok;
 }
 
@@ -1835,6 +2740,7 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
     int tag_len;
     unsigned int aad_len;
     srtp_hdr_xtnd_t *xtn_hdr = NULL;
+    srtp_rtp_hdr_parse_t parse;
 
     debug_print(mod_srtp, "function srtp_unprotect_aead", NULL);
 
@@ -1851,22 +2757,6 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
      * AEAD uses a new IV formation method 
      */
     srtp_calc_aead_iv(session_keys, &iv, &est, hdr);
-    status = srtp_cipher_set_iv(session_keys->rtp_cipher,
-                                (uint8_t*)&iv, srtp_direction_decrypt);
-    if (!status && session_keys->rtp_xtn_hdr_cipher) {
-      iv.v32[0] = 0;
-      iv.v32[1] = hdr->ssrc;
-#ifdef NO_64BIT_MATH
-      iv.v64[1] = be64_to_cpu(make64((high32(est) << 16) | (low32(est) >> 16),
-                  low32(est) << 16));
-#else
-      iv.v64[1] = be64_to_cpu(est << 16);
-#endif
-      status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
-    }
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
 
     /*
      * find starting point for decryption and length of data to be
@@ -1874,18 +2764,19 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
      * extension, if present; otherwise, it starts after the last csrc,
      * if any are present
      */
-    enc_start = (uint32_t*)hdr + uint32s_in_rtp_header + hdr->cc;
-    if (hdr->x == 1) {
-        xtn_hdr = (srtp_hdr_xtnd_t*)enc_start;
-        enc_start += (ntohs(xtn_hdr->length) + 1);
-    }
+    status = srtp_parse_rtp_header(hdr, (int)*pkt_octet_len, &parse);
+    if (status)
+        return srtp_err_status_parse_err;
+    enc_start = (uint32_t *)((uint8_t *)hdr + parse.header_len);
+    if (parse.xtn_hdr_offset)
+        xtn_hdr = (srtp_hdr_xtnd_t *)((uint8_t *)hdr + parse.xtn_hdr_offset);
     if (!((uint8_t*)enc_start <= (uint8_t*)hdr + (*pkt_octet_len - tag_len - mki_size)))
         return srtp_err_status_parse_err;
     /*
-     * We pass the tag down to the cipher when doing GCM mode 
+     * We pass the tag down to the cipher when doing GCM mode
      */
     enc_octet_len = (unsigned int)(*pkt_octet_len - mki_size -
-                                   ((uint8_t*)enc_start - (uint8_t*)hdr));
+                                   parse.header_len);
 
     /*
      * Sanity check the encrypted payload length against
@@ -1901,7 +2792,7 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
      * didn't just hit either the soft limit or the hard limit, and call
      * the event handler if we hit either.
      */
-    switch (srtp_key_limit_update(session_keys->limit)) {
+    switch (srtp_key_limit_update_batched(session_keys->limit)) {
     case srtp_key_event_normal:
         break;
     case srtp_key_event_soft_limit:
@@ -1915,26 +2806,39 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
     }
 
     /*
-     * Set the AAD for AES-GCM, which is the RTP header
+     * run the whole AEAD operation - IV load, RTP header as AAD,
+     * payload decryption and the tag check - in one cipher call
      */
     aad_len = (uint8_t *)enc_start - (uint8_t *)hdr;
-    status = srtp_cipher_set_aad(session_keys->rtp_cipher, (uint8_t*)hdr, aad_len);
-    if (status) {
-        return ( srtp_err_status_cipher_fail);
-    }
-
-    /* Decrypt the ciphertext.  This also checks the auth tag based
-     * on the AAD we just specified above */
-    status = srtp_cipher_decrypt(session_keys->rtp_cipher,
-                                 (uint8_t*)enc_start, &enc_octet_len);
+    status = srtp_cipher_aead(session_keys->rtp_cipher, (uint8_t*)&iv,
+                              srtp_direction_decrypt, (uint8_t*)hdr, aad_len,
+                              (uint8_t*)enc_start, &enc_octet_len);
     if (status) {
+        stream->stats.auth_failures++;
+        srtp_err_event_log(srtp_err_level_warning, status, ntohl(hdr->ssrc),
+                           est);
         return status;
     }
 
     if (xtn_hdr && session_keys->rtp_xtn_hdr_cipher) {
       /*
-       * extensions header encryption RFC 6904
+       * extensions header encryption RFC 6904; the extension cipher's
+       * IV is only loaded when the packet actually carries extensions
        */
+      v128_t xtn_iv;
+
+      xtn_iv.v32[0] = 0;
+      xtn_iv.v32[1] = hdr->ssrc;
+#ifdef NO_64BIT_MATH
+      xtn_iv.v64[1] = be64_to_cpu(make64((high32(est) << 16) | (low32(est) >> 16),
+                  low32(est) << 16));
+#else
+      xtn_iv.v64[1] = be64_to_cpu(est << 16);
+#endif
+      status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher, (uint8_t*)&xtn_iv, srtp_direction_encrypt);
+      if (status) {
+        return srtp_err_status_cipher_fail;
+      }
       status = srtp_process_header_encryption(stream, xtn_hdr, session_keys);
       if (status) {
         return status;
@@ -1974,14 +2878,13 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
          * stream, and some implementations will want to not return
          * failure here
          */
-        status = srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
+        status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream);
         if (status) {
             return status;
         }
 
         /* add new stream to the head of the stream_list */
-        new_stream->next = ctx->stream_list;
-        ctx->stream_list = new_stream;
+        srtp_stream_list_insert(ctx, new_stream);
 
         /* set stream (the pointer used in this function) */
         stream = new_stream;
@@ -1999,41 +2902,120 @@ srtp_unprotect_aead (srtp_ctx_t *ctx, srtp_stream_ctx_t *stream, int delta,
     /* decrease the packet length by the length of the mki_size */
     *pkt_octet_len -= mki_size;
 
+    stream->stats.packets_unprotected++;
+    stream->stats.octets_unprotected += (uint64_t)*pkt_octet_len;
+
     return srtp_err_status_ok;
 }
 
 
  srtp_err_status_t
  srtp_protect(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len) {
-   return srtp_protect_mki(ctx, rtp_hdr, pkt_octet_len, 0, 0);
- }
+   srtp_err_status_t status;
 
-srtp_err_status_t
-srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
-                 unsigned int use_mki, unsigned int mki_index ) {
-   srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr;
-   uint32_t *enc_start;        /* pointer to start of encrypted portion  */
-   uint32_t *auth_start;       /* pointer to start of auth. portion      */
-   int enc_octet_len = 0; /* number of octets in encrypted portion  */
-   srtp_xtd_seq_num_t est;          /* estimated xtd_seq_num_t of *hdr        */
-   int delta;                  /* delta of local pkt idx and that in hdr */
-   uint8_t *auth_tag = NULL;   /* location of auth_tag within packet     */
-   srtp_err_status_t status;   
-   int tag_len;
-   srtp_stream_ctx_t *stream;
-   uint32_t prefix_len;
-   srtp_hdr_xtnd_t *xtn_hdr = NULL;
-   unsigned int mki_size = 0;
-   srtp_session_keys_t *session_keys = NULL;
-   uint8_t* mki_location = NULL;
-   int advance_packet_index = 0;
+   srtp_crypto_alloc_guard_begin();
+   status = srtp_protect_mki(ctx, rtp_hdr, pkt_octet_len, 0, 0);
+   srtp_crypto_alloc_guard_end();
+
+   return status;
+ }
+
+
+/*
+ * the fused encrypt+authenticate pass works the payload in chunks of
+ * this many octets, sized to sit comfortably in L1 alongside the
+ * cipher and auth state; the value is a common multiple of the AES
+ * and SHA-1 block sizes, so neither primitive ever straddles a chunk
+ * boundary mid-block
+ */
+#define SRTP_FUSED_PASS_CHUNK_OCTETS 512
+
+/* payloads smaller than this take the classic two-pass path, whose
+ * single auth_update over the whole packet is cheaper than the fused
+ * pipeline's extra call boundaries */
+#define SRTP_FUSED_PASS_MIN_OCTETS 256
+
+/*
+ * srtp_protect_fused_pass() encrypts the payload and computes the
+ * packet authentication tag in a single pass: each chunk is encrypted
+ * and immediately folded into the running HMAC while its octets are
+ * still cache-resident, instead of streaming the whole payload
+ * through memory once for the cipher and again for the hash.  chunk
+ * boundaries are invisible to both primitives, so the output is
+ * bit-identical to the two-pass path
+ */
+static srtp_err_status_t
+srtp_protect_fused_pass(srtp_session_keys_t *session_keys,
+                        uint8_t *auth_start, uint8_t *enc_start,
+                        unsigned int enc_octet_len,
+                        srtp_xtd_seq_num_t est, uint8_t *auth_tag) {
+  srtp_err_status_t status;
+  unsigned int chunk;
+
+  status = srtp_auth_start_fast(session_keys->rtp_auth);
+  if (status)
+    return status;
+
+  /* the header (and any extension) precedes the ciphertext */
+  status = srtp_auth_update_fast(session_keys->rtp_auth, auth_start,
+                                 (int)(enc_start - auth_start));
+  if (status)
+    return status;
+
+  while (enc_octet_len > 0) {
+    chunk = (enc_octet_len < SRTP_FUSED_PASS_CHUNK_OCTETS)
+                ? enc_octet_len
+                : SRTP_FUSED_PASS_CHUNK_OCTETS;
+    status = srtp_cipher_encrypt_fast(session_keys->rtp_cipher, enc_start,
+                                      &chunk);
+    if (status)
+      return srtp_err_status_cipher_fail;
+    status = srtp_auth_update_fast(session_keys->rtp_auth, enc_start, chunk);
+    if (status)
+      return status;
+    enc_start += chunk;
+    enc_octet_len -= chunk;
+  }
+
+  /* run auth func over ROC, put result into auth_tag */
+  status = srtp_auth_compute_fast(session_keys->rtp_auth, (uint8_t *)&est, 4,
+                                  auth_tag);
+  if (status)
+    return srtp_err_status_auth_fail;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
+                 unsigned int use_mki, unsigned int mki_index ) {
+   use_mki = SRTP_USE_MKI(use_mki);
+   srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr;
+   uint32_t *enc_start;        /* pointer to start of encrypted portion  */
+   uint32_t *auth_start;       /* pointer to start of auth. portion      */
+   int enc_octet_len = 0; /* number of octets in encrypted portion  */
+   srtp_xtd_seq_num_t est;          /* estimated xtd_seq_num_t of *hdr        */
+   int delta;                  /* delta of local pkt idx and that in hdr */
+   uint8_t *auth_tag = NULL;   /* location of auth_tag within packet     */
+   srtp_err_status_t status;   
+   int tag_len;
+   srtp_stream_ctx_t *stream;
+   uint32_t prefix_len;
+   srtp_hdr_xtnd_t *xtn_hdr = NULL;
+   unsigned int mki_size = 0;
+   srtp_session_keys_t *session_keys = NULL;
+   uint8_t* mki_location = NULL;
+   int advance_packet_index = 0;
+   srtp_rtp_hdr_parse_t parse;
+   uint8_t *ks_cached = NULL;  /* prefetched keystream, when available */
+   v128_t xtn_iv;              /* extension cipher IV, loaded lazily */
 
    debug_print(mod_srtp, "function srtp_protect", NULL);
 
   /* we assume the hdr is 32-bit aligned to start */
 
   /* Verify RTP header */
-  status = srtp_validate_rtp_header(rtp_hdr, pkt_octet_len);
+  status = srtp_parse_rtp_header(rtp_hdr, *pkt_octet_len, &parse);
   if (status)
     return status;
 
@@ -2054,14 +3036,12 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
        srtp_stream_ctx_t *new_stream;
 
        /* allocate and initialize a new stream */
-       status = srtp_stream_clone(ctx->stream_template, 
-				  hdr->ssrc, &new_stream); 
+       status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream); 
        if (status)
 	 return status;
 
        /* add new stream to the head of the stream_list */
-       new_stream->next = ctx->stream_list;
-       ctx->stream_list = new_stream;
+       srtp_stream_list_insert(ctx, new_stream);
 
        /* set direction to outbound */
        new_stream->direction = dir_srtp_sender;
@@ -2074,6 +3054,8 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
      } 
    }
 
+   srtp_trace(protect_lookup_done, hdr->ssrc, *pkt_octet_len);
+
    /* 
     * verify that stream is for sending traffic - this check will
     * detect SSRC collisions, since a stream that appears in both
@@ -2089,12 +3071,68 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
      }
   }
 
+  /*
+   * null-crypto recording fast path: when both RTP transforms are
+   * null the packet is transmitted unchanged, so all that protect
+   * has to do is keep the replay/ROC state moving; skip the session
+   * key selection, key-limit update, IV load and transform dispatch
+   */
+  if (stream->rtp_null_fast && !use_mki &&
+      stream->prev_session_keys == NULL) {
+    status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+    if (status && (status != srtp_err_status_pkt_idx_adv))
+      return status;
+
+    if (status == srtp_err_status_pkt_idx_adv) {
+      srtp_rdbx_set_roc_seq(&stream->rtp_rdbx,
+                            (uint32_t)(est >> 16),
+                            (uint16_t)(est & 0xFFFF));
+      stream->pending_roc = 0;
+      srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+      status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+      if (status) {
+        if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx) {
+          stream->stats.replay_drops++;
+          return status; /* we've been asked to reuse an index */
+        }
+      }
+      srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+    }
+
+    srtp_trace(protect_replay_checked, hdr->ssrc, *pkt_octet_len);
+
+    /* no auth tag and no MKI, so the packet length is unchanged */
+    stream->stats.packets_protected++;
+    stream->stats.octets_protected += (uint64_t)*pkt_octet_len;
+    return srtp_err_status_ok;
+  }
+
   session_keys = srtp_get_session_keys_with_mki_index(stream, use_mki, mki_index);
 
-   /*
-    * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-    * the request to our AEAD handler.
-    */
+  /*
+   * an outbound stream protects under the new keys from the rekey
+   * watermark on; retire the old ones once the window has drained
+   */
+  if (stream->prev_session_keys) {
+    srtp_stream_rekey_expire(stream);
+  }
+
+  /*
+   * derive the header-extension keys on first use; this must happen
+   * before the per-packet IV is loaded into the extension cipher,
+   * since keying the cipher resets its state
+   */
+  if (session_keys->deferred_xtn_hdr_keys) {
+    status = srtp_stream_derive_xtn_hdr_keys(session_keys);
+    if (status)
+      return status;
+  }
+
+  /*
+   * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
+   * the request to our AEAD handler.
+   */
   if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
       session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
       return srtp_protect_aead(ctx, stream, rtp_hdr,
@@ -2107,7 +3145,7 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
    * didn't just hit either the soft limit or the hard limit, and call
    * the event handler if we hit either.
    */
-  switch(srtp_key_limit_update(session_keys->limit)) {
+  switch(srtp_key_limit_update_batched(session_keys->limit)) {
   case srtp_key_event_normal:
     break;
   case srtp_key_event_soft_limit: 
@@ -2132,17 +3170,12 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
     * if we're not providing confidentiality, set enc_start to NULL
     */
    if (stream->rtp_services & sec_serv_conf) {
-     enc_start = (uint32_t *)hdr + uint32s_in_rtp_header + hdr->cc;  
-     if (hdr->x == 1) {
-       xtn_hdr = (srtp_hdr_xtnd_t *)enc_start;
-       enc_start += (ntohs(xtn_hdr->length) + 1);
-     }
-     /* note: the passed size is without the auth tag */
-     if (!((uint8_t*)enc_start <= (uint8_t*)hdr + *pkt_octet_len))
-       return srtp_err_status_parse_err;
-     enc_octet_len = (int)(*pkt_octet_len -
-                                    ((uint8_t*)enc_start - (uint8_t*)hdr));
-     if (enc_octet_len < 0) return srtp_err_status_parse_err;
+     enc_start = (uint32_t *)((uint8_t *)hdr + parse.header_len);
+     if (parse.xtn_hdr_offset)
+       xtn_hdr = (srtp_hdr_xtnd_t *)((uint8_t *)hdr + parse.xtn_hdr_offset);
+     /* note: the passed size is without the auth tag; the parse
+        routine has already verified that the header fits within it */
+     enc_octet_len = *pkt_octet_len - parse.header_len;
    } else {
      enc_start = NULL;
    }
@@ -2165,34 +3198,48 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
 
   /*
    * estimate the packet index using the start of the replay window
-   * and the sequence number from the header
+   * and the sequence number from the header; on the sending side the
+   * sequence number almost always increments by exactly one, in which
+   * case the index is known without running the estimator and the
+   * replay check cannot fail
    */
-  status = srtp_get_est_pkt_index(hdr,
-                                  stream,
-                                  &est,
-                                  &delta);
+  if (stream->direction == dir_srtp_sender && !stream->pending_roc &&
+      srtp_rdbx_advance_sender(&stream->rtp_rdbx,
+                               ntohs(hdr->seq)) == srtp_err_status_ok) {
+    est = srtp_rdbx_get_packet_index(&stream->rtp_rdbx);
+    delta = 1;
+  } else {
+    status = srtp_get_est_pkt_index(hdr,
+                                    stream,
+                                    &est,
+                                    &delta);
 
-  if (status && (status != srtp_err_status_pkt_idx_adv))
-    return status;
+    if (status && (status != srtp_err_status_pkt_idx_adv))
+      return status;
 
-  if (status == srtp_err_status_pkt_idx_adv)
-    advance_packet_index = 1;
+    if (status == srtp_err_status_pkt_idx_adv)
+      advance_packet_index = 1;
 
-  if (advance_packet_index) {
-    srtp_rdbx_set_roc_seq(&stream->rtp_rdbx,
-                          (uint32_t)(est >> 16),
-                          (uint16_t)(est & 0xFFFF));
-    stream->pending_roc = 0;
-    srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
-  } else {
-    status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
-    if (status) {
-      if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx)
-        return status; /* we've been asked to reuse an index */
+    if (advance_packet_index) {
+      srtp_rdbx_set_roc_seq(&stream->rtp_rdbx,
+                            (uint32_t)(est >> 16),
+                            (uint16_t)(est & 0xFFFF));
+      stream->pending_roc = 0;
+      srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+      status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+      if (status) {
+        if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx) {
+          stream->stats.replay_drops++;
+          return status; /* we've been asked to reuse an index */
+        }
+      }
+      srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
-    srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
   }
 
+  srtp_trace(protect_replay_checked, hdr->ssrc, *pkt_octet_len);
+
 #ifdef NO_64BIT_MATH
    debug_print2(mod_srtp, "estimated packet index: %08x%08x", 
 		high32(est),low32(est));
@@ -2215,15 +3262,23 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
 								 low32(est) << 16));
 #else
      iv.v64[1] = be64_to_cpu(est << 16);
+
+     /* check the prefetch cache for keystream computed ahead of time */
+     if (stream->keystream_cache && !use_mki &&
+         session_keys == &stream->session_keys[0]) {
+       ks_cached = srtp_keystream_cache_take(stream->keystream_cache, &iv, est);
+       stream->keystream_cache->next_index = est + 1;
+     }
 #endif
-     status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
-     if (!status && session_keys->rtp_xtn_hdr_cipher) {
-       status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
+     status = srtp_cipher_set_iv_fast(session_keys->rtp_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
+     if (session_keys->rtp_xtn_hdr_cipher) {
+       /* the extension cipher shares this IV; it is loaded lazily below */
+       xtn_iv = iv;
      }
-   } else {  
+   } else {
      v128_t iv;
 
-     /* otherwise, set the index to est */  
+     /* otherwise, set the index to est */
 #ifdef NO_64BIT_MATH
      iv.v32[0] = 0;
      iv.v32[1] = 0;
@@ -2231,14 +3286,16 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
      iv.v64[0] = 0;
 #endif
      iv.v64[1] = be64_to_cpu(est);
-     status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
-     if (!status && session_keys->rtp_xtn_hdr_cipher) {
-       status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
+     status = srtp_cipher_set_iv_fast(session_keys->rtp_cipher, (uint8_t*)&iv, srtp_direction_encrypt);
+     if (session_keys->rtp_xtn_hdr_cipher) {
+       xtn_iv = iv;
      }
    }
    if (status)
      return srtp_err_status_cipher_fail;
 
+   srtp_trace(protect_iv_set, hdr->ssrc, *pkt_octet_len);
+
    /* shift est, put into network byte order */
 #ifdef NO_64BIT_MATH
    est = be64_to_cpu(make64((high32(est) << 16) |
@@ -2266,40 +3323,73 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
 
   if (xtn_hdr && session_keys->rtp_xtn_hdr_cipher) {
     /*
-     * extensions header encryption RFC 6904
+     * extensions header encryption RFC 6904; the extension cipher's
+     * IV (saved from the payload cipher's index math above) is only
+     * loaded now that the packet is known to carry extensions
      */
+    status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
+                                (uint8_t *)&xtn_iv, srtp_direction_encrypt);
+    if (status) {
+      return srtp_err_status_cipher_fail;
+    }
       status = srtp_process_header_encryption(stream, xtn_hdr, session_keys);
     if (status) {
       return status;
     }
   }
 
+  /*
+   * when the packet is both encrypted and authenticated and no
+   * precomputed keystream is on hand, encrypt and hash the payload
+   * in one interleaved pass; see srtp_protect_fused_pass()
+   */
+  if (enc_start && auth_start && !ks_cached &&
+      enc_octet_len >= SRTP_FUSED_PASS_MIN_OCTETS) {
+    status = srtp_protect_fused_pass(session_keys, (uint8_t *)auth_start,
+                                     (uint8_t *)enc_start, enc_octet_len,
+                                     est, auth_tag);
+    if (status)
+      return status;
+    srtp_trace(protect_cipher_done, hdr->ssrc, *pkt_octet_len);
+    srtp_trace(protect_auth_done, hdr->ssrc, *pkt_octet_len);
+  } else {
+
   /* if we're encrypting, exor keystream into the message */
   if (enc_start) {
-    status = srtp_cipher_encrypt(session_keys->rtp_cipher, 
+    if (ks_cached &&
+        enc_octet_len <= stream->keystream_cache->entry_octets) {
+      /* the keystream was precomputed for this index */
+      int ks_i;
+      for (ks_i = 0; ks_i < enc_octet_len; ks_i++)
+        ((uint8_t *)enc_start)[ks_i] ^= ks_cached[ks_i];
+    } else {
+      status = srtp_cipher_encrypt_fast(session_keys->rtp_cipher,
 			        (uint8_t *)enc_start, (unsigned int *)&enc_octet_len);
-    if (status)
-      return srtp_err_status_cipher_fail;
+      if (status)
+        return srtp_err_status_cipher_fail;
+    }
   }
 
+  srtp_trace(protect_cipher_done, hdr->ssrc, *pkt_octet_len);
+
   /*
    *  if we're authenticating, run authentication function and put result
-   *  into the auth_tag 
+   *  into the auth_tag
    */
-  if (auth_start) {        
+  if (auth_start) {
 
     /* initialize auth func context */
-    status = srtp_auth_start(session_keys->rtp_auth);
+    status = srtp_auth_start_fast(session_keys->rtp_auth);
     if (status) return status;
 
     /* run auth func over packet */
-    status = srtp_auth_update(session_keys->rtp_auth,
+    status = srtp_auth_update_fast(session_keys->rtp_auth,
 			 (uint8_t *)auth_start, *pkt_octet_len);
     if (status) return status;
-    
+
     /* run auth func over ROC, put result into auth_tag */
     debug_print(mod_srtp, "estimated packet index: %016llx", est);
-    status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4, auth_tag);
+    status = srtp_auth_compute_fast(session_keys->rtp_auth, (uint8_t *)&est, 4, auth_tag);
     debug_print(mod_srtp, "srtp auth tag:    %s", 
 		srtp_octet_string_hex_string(auth_tag, tag_len));
     if (status)
@@ -2307,6 +3397,10 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
 
   }
 
+  srtp_trace(protect_auth_done, hdr->ssrc, *pkt_octet_len);
+
+  }
+
   if (auth_tag) {
 
     /* increase the packet length by the length of the auth tag */
@@ -2318,18 +3412,112 @@ srtp_protect_mki(srtp_ctx_t *ctx, void *rtp_hdr, int *pkt_octet_len,
     *pkt_octet_len += mki_size;
   }
 
-  return srtp_err_status_ok;  
+  stream->stats.packets_protected++;
+  stream->stats.octets_protected += (uint64_t)*pkt_octet_len;
+
+  return srtp_err_status_ok;
 }
 
 
 srtp_err_status_t
 srtp_unprotect(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len) {
-    return srtp_unprotect_mki(ctx, srtp_hdr, pkt_octet_len, 0);
+    srtp_err_status_t status;
+
+    srtp_crypto_alloc_guard_begin();
+    status = srtp_unprotect_mki(ctx, srtp_hdr, pkt_octet_len, 0);
+    srtp_crypto_alloc_guard_end();
+
+    return status;
 }
 
-srtp_err_status_t
-srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
-                   unsigned int use_mki) {
+/*
+ * srtp_unprotect_info_fill() records the processing details of one
+ * successfully unprotected packet, so callers do not have to re-parse
+ * the header or shadow the rollover counter themselves
+ */
+static void
+srtp_unprotect_info_fill(srtp_unprotect_info_t *info, srtp_xtd_seq_num_t index,
+                         const srtp_rtp_hdr_parse_t *parse, int pkt_octet_len,
+                         unsigned int mki_index, int stream_created) {
+#ifdef NO_64BIT_MATH
+  info->roc = (high32(index) << 16) | (low32(index) >> 16);
+#else
+  info->roc = (uint32_t)(index >> 16);
+#endif
+  info->rtp_packet_index = index;
+  info->payload_offset = (unsigned int)parse->header_len;
+  info->payload_length = (unsigned int)(pkt_octet_len - parse->header_len);
+  info->mki_index = mki_index;
+  info->stream_created = stream_created;
+}
+
+/*
+ * srtp_unprotect_recover_roc(session_keys, auth_start, auth_len,
+ * tag_len, auth_tag, window, roc) searches for the rollover counter of
+ * a sender that this receiver joined mid-stream.  the first packet
+ * from an unknown SSRC is estimated at ROC zero, so a sender that is
+ * already past its first rollover fails authentication even though
+ * the keys are right.
+ *
+ * the authentication function is run over the packet body once; for
+ * auth types with flat state (state_octets nonzero) the partial state
+ * is snapshotted, and each candidate ROC then costs only the 4-octet
+ * trailer computation and a tag compare.  opaque auth types fall back
+ * to a full recompute per candidate.  a match is exactly as strong as
+ * an ordinary tag check; the discovered ROC is returned so the caller
+ * can re-key the packet index and record it in the replay database
+ */
+static srtp_err_status_t
+srtp_unprotect_recover_roc(srtp_session_keys_t *session_keys,
+                           uint8_t *auth_start, int auth_len,
+                           uint32_t tag_len, const uint8_t *auth_tag,
+                           uint32_t window, uint32_t *roc) {
+  srtp_auth_t *auth = session_keys->rtp_auth;
+  uint8_t state_snap[512];
+  uint8_t tag_trial[SRTP_MAX_TAG_LEN];
+  size_t state_octets = auth->type->state_octets;
+  int flat = (state_octets != 0 && state_octets <= sizeof(state_snap));
+  srtp_err_status_t status;
+  uint32_t r;
+
+  status = srtp_auth_start_fast(auth);
+  if (status) return status;
+  status = srtp_auth_update_fast(auth, auth_start, auth_len);
+  if (status) return status;
+  if (flat)
+    memcpy(state_snap, auth->state, state_octets);
+
+  for (r = 1; r <= window; r++) {
+    uint32_t roc_trailer = htonl(r);
+
+    if (flat) {
+      memcpy(auth->state, state_snap, state_octets);
+    } else {
+      /* opaque auth state: recompute over the whole packet */
+      status = srtp_auth_start_fast(auth);
+      if (status) break;
+      status = srtp_auth_update_fast(auth, auth_start, auth_len);
+      if (status) break;
+    }
+    status = srtp_auth_compute_fast(auth, (uint8_t *)&roc_trailer, 4,
+                                    tag_trial);
+    if (status) break;
+
+    if (!octet_string_is_eq(tag_trial, (uint8_t *)auth_tag, tag_len)) {
+      octet_string_set_to_zero(state_snap, sizeof(state_snap));
+      *roc = r;
+      return srtp_err_status_ok;
+    }
+  }
+
+  octet_string_set_to_zero(state_snap, sizeof(state_snap));
+  return status ? status : srtp_err_status_auth_fail;
+}
+
+static srtp_err_status_t
+srtp_unprotect_impl(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
+                    unsigned int use_mki, srtp_unprotect_info_t *info) {
+  use_mki = SRTP_USE_MKI(use_mki);
   srtp_hdr_t *hdr = (srtp_hdr_t *)srtp_hdr;
   uint32_t *enc_start;      /* pointer to start of encrypted portion  */
   uint32_t *auth_start;     /* pointer to start of auth. portion      */
@@ -2344,17 +3532,24 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
   uint32_t tag_len, prefix_len;
   srtp_hdr_xtnd_t *xtn_hdr = NULL;
   unsigned int mki_size = 0;
+  unsigned int mki_idx = 0; /* which master key matched, for the info */
+  int stream_created = 0;   /* set when this packet creates the stream */
   srtp_session_keys_t *session_keys = NULL;
   int advance_packet_index = 0;
   uint32_t roc_to_set = 0;
   uint16_t seq_to_set = 0;
+  srtp_rtp_hdr_parse_t parse;
+  uint8_t *ks_cached = NULL;  /* prefetched keystream, when available */
+  v128_t xtn_iv;              /* extension cipher IV, loaded lazily */
+  srtp_xtd_seq_num_t pkt_index; /* copy of est for the event log, since
+                                 * est is shifted in place below       */
 
   debug_print(mod_srtp, "function srtp_unprotect", NULL);
 
   /* we assume the hdr is 32-bit aligned to start */
 
   /* Verify RTP header */
-  status = srtp_validate_rtp_header(srtp_hdr, pkt_octet_len);
+  status = srtp_parse_rtp_header(srtp_hdr, *pkt_octet_len, &parse);
   if (status)
     return status;
 
@@ -2363,7 +3558,16 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
     return srtp_err_status_bad_param;
 
   /*
-   * look up ssrc in srtp_stream list, and process the packet with 
+   * when the session has no template, the SSRC filter definitively
+   * rejects traffic for unknown SSRCs before the stream lookup, so
+   * that flood traffic costs only a pair of table probes
+   */
+  if (ctx->stream_template == NULL &&
+      !srtp_ssrc_filter_test(ctx, hdr->ssrc))
+    return srtp_err_status_no_ctx;
+
+  /*
+   * look up ssrc in srtp_stream list, and process the packet with
    * the appropriate stream.  if we haven't seen this stream before,
    * there's only one key for this srtp_session, and the cipher
    * supports key-sharing, then we assume that a new stream using
@@ -2372,11 +3576,20 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
   stream = srtp_get_stream(ctx, hdr->ssrc);
   if (stream == NULL) {
     if (ctx->stream_template != NULL) {
+      /*
+       * in deterministic-latency mode a provisional stream can only
+       * be put into service from a clone stocked at setup time, so
+       * reject the packet up front when none is available, before
+       * any of it is authenticated or decrypted
+       */
+      if (ctx->deterministic_latency && ctx->stream_free_list == NULL)
+        return srtp_err_status_no_ctx;
+
       stream = ctx->stream_template;
       debug_print(mod_srtp, "using provisional stream (SSRC: 0x%08x)",
 		  ntohl(hdr->ssrc));
-      
-      /* 
+
+      /*
        * set estimated packet index to sequence number from header,
        * and set delta equal to the same value
        */
@@ -2388,7 +3601,7 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
       delta = (int)est;
 #endif
     } else {
-      
+
       /*
        * no stream corresponding to SSRC found, and we don't do
        * key-sharing, so return an error
@@ -2413,9 +3626,56 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
     /* check replay database */
     if (!advance_packet_index) {
       status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
-      if (status)
+      if (status) {
+        stream->stats.replay_drops++;
+        srtp_err_event_log(srtp_err_level_warning, status, ntohl(hdr->ssrc),
+                           est);
         return status;
+      }
+    }
+  }
+
+  srtp_trace(unprotect_lookup_done, hdr->ssrc, *pkt_octet_len);
+  srtp_trace(unprotect_replay_checked, hdr->ssrc, *pkt_octet_len);
+
+  /*
+   * null-crypto recording fast path: nothing to verify and nothing to
+   * decrypt, so commit the replay/ROC state and return the packet
+   * unchanged.  a provisional (template) stream still takes the full
+   * path, which is what clones and commits the per-SSRC stream
+   */
+  if (stream->rtp_null_fast && !use_mki && stream != ctx->stream_template &&
+      stream->prev_session_keys == NULL) {
+    /*
+     * verify that stream is for received traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one
+     * of those functions
+     */
+    if (stream->direction != dir_srtp_receiver) {
+      if (stream->direction == dir_unknown) {
+        stream->direction = dir_srtp_receiver;
+      } else {
+        srtp_handle_event(ctx, stream, event_ssrc_collision);
+      }
+    }
+
+    if (advance_packet_index) {
+      srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, roc_to_set, seq_to_set);
+      stream->pending_roc = 0;
+      srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+      srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
+
+    /* no auth tag and no MKI, so the packet length is unchanged */
+    stream->stats.packets_unprotected++;
+    stream->stats.octets_unprotected += (uint64_t)*pkt_octet_len;
+
+    if (info != NULL)
+      srtp_unprotect_info_fill(info, est, &parse, *pkt_octet_len, 0, 0);
+
+    return srtp_err_status_ok;
   }
 
 #ifdef NO_64BIT_MATH
@@ -2432,21 +3692,54 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
                                            (const unsigned int*)pkt_octet_len,
                                            &mki_size);
 
-      if (session_keys == NULL) 
+      if (session_keys == NULL)
          return srtp_err_status_bad_mki;
+      mki_idx = (unsigned int)(session_keys - stream->session_keys);
   } else {
       session_keys = &stream->session_keys[0];
   }
 
+  /*
+   * during a rekey, in-flight packets from below the watermark are
+   * still processed under the retiring keys; packets at or above it
+   * opportunistically retire those keys once the replay window has
+   * drained past the watermark
+   */
+  if (stream->prev_session_keys) {
+    if (!use_mki && est < stream->rekey_watermark) {
+      session_keys = &stream->prev_session_keys[0];
+    } else {
+      srtp_stream_rekey_expire(stream);
+    }
+  }
+
+  /* switch to this thread's cipher replicas, if the stream has a pool */
+  session_keys = srtp_stream_thread_keys(stream, session_keys);
+
+  /*
+   * derive the header-extension keys on first use; this must happen
+   * before the per-packet IV is loaded into the extension cipher,
+   * since keying the cipher resets its state
+   */
+  if (session_keys->deferred_xtn_hdr_keys) {
+    status = srtp_stream_derive_xtn_hdr_keys(session_keys);
+    if (status)
+      return status;
+  }
+
   /*
    * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
    * the request to our AEAD handler.
    */
   if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
       session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-      return srtp_unprotect_aead(ctx, stream, delta, est, srtp_hdr,
-                                 (unsigned int*)pkt_octet_len, session_keys,
-                                 mki_size);
+      status = srtp_unprotect_aead(ctx, stream, delta, est, srtp_hdr,
+                                   (unsigned int*)pkt_octet_len, session_keys,
+                                   mki_size);
+      if (status == srtp_err_status_ok && info != NULL)
+        srtp_unprotect_info_fill(info, est, &parse, *pkt_octet_len, mki_idx,
+                                 stream == ctx->stream_template);
+      return status;
   }
 
   /* get tag length from stream */
@@ -2467,16 +3760,23 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
 			         low32(est) << 16));
 #else
     iv.v64[1] = be64_to_cpu(est << 16);
+
+    /* check the prefetch cache for keystream computed ahead of time */
+    if (stream->keystream_cache && !use_mki &&
+        session_keys == &stream->session_keys[0]) {
+      ks_cached = srtp_keystream_cache_take(stream->keystream_cache, &iv, est);
+      stream->keystream_cache->next_index = est + 1;
+    }
 #endif
-    status = srtp_cipher_set_iv(session_keys->rtp_cipher,
+    status = srtp_cipher_set_iv_fast(session_keys->rtp_cipher,
                                 (uint8_t*)&iv, srtp_direction_decrypt);
-    if (!status && session_keys->rtp_xtn_hdr_cipher) {
-      status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
-                                  (uint8_t*)&iv, srtp_direction_decrypt);
+    if (session_keys->rtp_xtn_hdr_cipher) {
+      /* the extension cipher shares this IV; it is loaded lazily below */
+      xtn_iv = iv;
     }
-  } else {  
-    
-    /* no particular format - set the iv to the pakcet index */  
+  } else {
+
+    /* no particular format - set the iv to the pakcet index */
 #ifdef NO_64BIT_MATH
     iv.v32[0] = 0;
     iv.v32[1] = 0;
@@ -2484,14 +3784,18 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
     iv.v64[0] = 0;
 #endif
     iv.v64[1] = be64_to_cpu(est);
-    status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t*)&iv, srtp_direction_decrypt);
-    if (!status && session_keys->rtp_xtn_hdr_cipher) {
-      status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher, (uint8_t*)&iv, srtp_direction_decrypt);
+    status = srtp_cipher_set_iv_fast(session_keys->rtp_cipher, (uint8_t*)&iv, srtp_direction_decrypt);
+    if (session_keys->rtp_xtn_hdr_cipher) {
+      xtn_iv = iv;
     }
   }
   if (status)
     return srtp_err_status_cipher_fail;
 
+  srtp_trace(unprotect_iv_set, hdr->ssrc, *pkt_octet_len);
+
+  pkt_index = est;
+
   /* shift est, put into network byte order */
 #ifdef NO_64BIT_MATH
   est = be64_to_cpu(make64((high32(est) << 16) |
@@ -2510,15 +3814,13 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
    * if we're not providing confidentiality, set enc_start to NULL
    */
   if (stream->rtp_services & sec_serv_conf) {
-    enc_start = (uint32_t *)hdr + uint32s_in_rtp_header + hdr->cc;  
-    if (hdr->x == 1) {
-      xtn_hdr = (srtp_hdr_xtnd_t *)enc_start;
-      enc_start += (ntohs(xtn_hdr->length) + 1);
-    }  
+    enc_start = (uint32_t *)((uint8_t *)hdr + parse.header_len);
+    if (parse.xtn_hdr_offset)
+      xtn_hdr = (srtp_hdr_xtnd_t *)((uint8_t *)hdr + parse.xtn_hdr_offset);
     if (!((uint8_t*)enc_start <= (uint8_t*)hdr + (*pkt_octet_len - tag_len - mki_size)))
       return srtp_err_status_parse_err;
     enc_octet_len = (uint32_t)(*pkt_octet_len - tag_len - mki_size -
-                               ((uint8_t*)enc_start - (uint8_t*)hdr));
+                               parse.header_len);
   } else {
     enc_start = NULL;
   }
@@ -2560,49 +3862,131 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
     } 
 
     /* initialize auth func context */
-    status = srtp_auth_start(session_keys->rtp_auth);
+    status = srtp_auth_start_fast(session_keys->rtp_auth);
     if (status) return status;
- 
+
     /* now compute auth function over packet */
-    status = srtp_auth_update(session_keys->rtp_auth, (uint8_t *)auth_start,
+    status = srtp_auth_update_fast(session_keys->rtp_auth, (uint8_t *)auth_start,
 			 *pkt_octet_len - tag_len - mki_size);
 
     /* run auth func over ROC, then write tmp tag */
-    status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4, tmp_tag);
+    status = srtp_auth_compute_fast(session_keys->rtp_auth, (uint8_t *)&est, 4, tmp_tag);
 
     debug_print(mod_srtp, "computed auth tag:    %s", 
 		srtp_octet_string_hex_string(tmp_tag, tag_len));
     debug_print(mod_srtp, "packet auth tag:      %s", 
 		srtp_octet_string_hex_string(auth_tag, tag_len));
-    if (status)
-      return srtp_err_status_auth_fail;   
-
-    if (octet_string_is_eq(tmp_tag, auth_tag, tag_len))
+    if (status) {
+      stream->stats.auth_failures++;
+      srtp_err_event_log(srtp_err_level_warning, srtp_err_status_auth_fail,
+                         ntohl(hdr->ssrc), pkt_index);
       return srtp_err_status_auth_fail;
-  }
+    }
 
-  /* 
-   * update the key usage limit, and check it to make sure that we
-   * didn't just hit either the soft limit or the hard limit, and call
-   * the event handler if we hit either.
-   */
-  switch(srtp_key_limit_update(session_keys->limit)) {
-  case srtp_key_event_normal:
-    break;
-  case srtp_key_event_soft_limit: 
-    srtp_handle_event(ctx, stream, event_key_soft_limit);
-    break; 
-  case srtp_key_event_hard_limit:
-    srtp_handle_event(ctx, stream, event_key_hard_limit);
-    return srtp_err_status_key_expired;
-  default:
-    break;
+    if (octet_string_is_eq(tmp_tag, auth_tag, tag_len)) {
+      uint32_t recovered_roc = 0;
+
+      /*
+       * a receiver that joins mid-stream estimates the first packet
+       * of a new SSRC at ROC zero, so a sender already past its first
+       * rollover fails authentication here with the right keys; when
+       * ROC recovery is enabled, search a small window of candidate
+       * rollover counters before declaring the packet bad
+       */
+      if (ctx->roc_recovery_window == 0 || stream != ctx->stream_template ||
+          advance_packet_index ||
+          srtp_unprotect_recover_roc(session_keys, (uint8_t *)auth_start,
+                                     *pkt_octet_len - tag_len - mki_size,
+                                     tag_len, auth_tag,
+                                     ctx->roc_recovery_window,
+                                     &recovered_roc) != srtp_err_status_ok) {
+        stream->stats.auth_failures++;
+        srtp_err_event_log(srtp_err_level_warning, srtp_err_status_auth_fail,
+                           ntohl(hdr->ssrc), pkt_index);
+        return srtp_err_status_auth_fail;
+      }
+
+      /*
+       * found the sender's ROC: re-key the packet index, reload the
+       * cipher IV, and let the commit path below record the recovered
+       * ROC in the new stream's replay database
+       */
+      advance_packet_index = 1;
+      roc_to_set = recovered_roc;
+      seq_to_set = ntohs(hdr->seq);
+#ifdef NO_64BIT_MATH
+      pkt_index = make64(recovered_roc >> 16,
+                         (recovered_roc << 16) | seq_to_set);
+#else
+      pkt_index = (((uint64_t)recovered_roc) << 16) | seq_to_set;
+#endif
+      ks_cached = NULL;
+      if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
+          session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
+          session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+        iv.v32[0] = 0;
+        iv.v32[1] = hdr->ssrc;  /* still in network order */
+#ifdef NO_64BIT_MATH
+        iv.v64[1] = be64_to_cpu(make64((high32(pkt_index) << 16) |
+                                       (low32(pkt_index) >> 16),
+                                       low32(pkt_index) << 16));
+#else
+        iv.v64[1] = be64_to_cpu(pkt_index << 16);
+#endif
+      } else {
+#ifdef NO_64BIT_MATH
+        iv.v32[0] = 0;
+        iv.v32[1] = 0;
+#else
+        iv.v64[0] = 0;
+#endif
+        iv.v64[1] = be64_to_cpu(pkt_index);
+      }
+      status = srtp_cipher_set_iv_fast(session_keys->rtp_cipher,
+                                       (uint8_t *)&iv,
+                                       srtp_direction_decrypt);
+      if (status)
+        return srtp_err_status_cipher_fail;
+      if (session_keys->rtp_xtn_hdr_cipher) {
+        /* the recovered index replaces the saved extension IV as well */
+        xtn_iv = iv;
+      }
+    }
+  }
+
+  srtp_trace(unprotect_auth_done, hdr->ssrc, *pkt_octet_len);
+
+  /*
+   * update the key usage limit, and check it to make sure that we
+   * didn't just hit either the soft limit or the hard limit, and call
+   * the event handler if we hit either.
+   */
+  switch(srtp_key_limit_update_batched(session_keys->limit)) {
+  case srtp_key_event_normal:
+    break;
+  case srtp_key_event_soft_limit:
+    srtp_handle_event(ctx, stream, event_key_soft_limit);
+    break;
+  case srtp_key_event_hard_limit:
+    srtp_handle_event(ctx, stream, event_key_hard_limit);
+    srtp_err_event_log(srtp_err_level_error, srtp_err_status_key_expired,
+                       ntohl(hdr->ssrc), pkt_index);
+    return srtp_err_status_key_expired;
+  default:
+    break;
   }
 
   if (xtn_hdr && session_keys->rtp_xtn_hdr_cipher) {
     /*
-     * extensions header encryption RFC 6904
+     * extensions header encryption RFC 6904; the extension cipher's
+     * IV (saved from the payload cipher's index math above) is only
+     * loaded now that the packet is known to carry extensions
      */
+    status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
+                                (uint8_t *)&xtn_iv, srtp_direction_decrypt);
+    if (status) {
+      return srtp_err_status_cipher_fail;
+    }
       status = srtp_process_header_encryption(stream, xtn_hdr, session_keys);
     if (status) {
       return status;
@@ -2611,13 +3995,23 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
 
   /* if we're decrypting, add keystream into ciphertext */
   if (enc_start) {
-    status = srtp_cipher_decrypt(session_keys->rtp_cipher,
+    if (ks_cached &&
+        enc_octet_len <= (unsigned int)stream->keystream_cache->entry_octets) {
+      /* the keystream was precomputed for this index */
+      unsigned int ks_i;
+      for (ks_i = 0; ks_i < enc_octet_len; ks_i++)
+        ((uint8_t *)enc_start)[ks_i] ^= ks_cached[ks_i];
+    } else {
+      status = srtp_cipher_decrypt_fast(session_keys->rtp_cipher,
                                  (uint8_t *)enc_start, &enc_octet_len);
-    if (status)
-      return srtp_err_status_cipher_fail;
+      if (status)
+        return srtp_err_status_cipher_fail;
+    }
   }
 
-  /* 
+  srtp_trace(unprotect_cipher_done, hdr->ssrc, *pkt_octet_len);
+
+  /*
    * verify that stream is for received traffic - this check will
    * detect SSRC collisions, since a stream that appears in both
    * srtp_protect() and srtp_unprotect() will fail this test in one of
@@ -2650,16 +4044,16 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
      * stream, and some implementations will want to not return
      * failure here
      */
-    status = srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream); 
+    status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream); 
     if (status)
       return status;
     
     /* add new stream to the head of the stream_list */
-    new_stream->next = ctx->stream_list;
-    ctx->stream_list = new_stream;
+    srtp_stream_list_insert(ctx, new_stream);
     
     /* set stream (the pointer used in this function) */
     stream = new_stream;
+    stream_created = 1;
   }
 
   /* 
@@ -2682,433 +4076,2944 @@ srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
   /* decrease the packet length by the mki size */
   *pkt_octet_len -= mki_size;
 
-  return srtp_err_status_ok;  
+  stream->stats.packets_unprotected++;
+  stream->stats.octets_unprotected += (uint64_t)*pkt_octet_len;
+
+  if (info != NULL)
+    srtp_unprotect_info_fill(info, pkt_index, &parse, *pkt_octet_len, mki_idx,
+                             stream_created);
+
+  return srtp_err_status_ok;
 }
 
 srtp_err_status_t
-srtp_init() {
-  srtp_err_status_t status;
+srtp_unprotect_mki(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
+                   unsigned int use_mki) {
+  return srtp_unprotect_impl(ctx, srtp_hdr, pkt_octet_len, use_mki, NULL);
+}
 
-  /* initialize crypto kernel */
-  status = srtp_crypto_kernel_init();
-  if (status) 
-    return status;
+srtp_err_status_t
+srtp_unprotect_ex(srtp_ctx_t *ctx, void *srtp_hdr, int *pkt_octet_len,
+                  unsigned int use_mki, srtp_unprotect_info_t *info) {
+  srtp_err_status_t status;
 
-  /* load srtp debug module into the kernel */
-  status = srtp_crypto_kernel_load_debug_module(&mod_srtp);
-  if (status)
-    return status;
+  srtp_crypto_alloc_guard_begin();
+  status = srtp_unprotect_impl(ctx, srtp_hdr, pkt_octet_len, use_mki, info);
+  srtp_crypto_alloc_guard_end();
 
-  return srtp_err_status_ok;
+  return status;
 }
 
+/*
+ * the ciphers in this tree only transform in place, so the
+ * out-of-place unprotect stages the ciphertext into the caller's
+ * output buffer and decrypts there; the single copy it performs is
+ * the one that callers retaining the ciphertext had to make
+ * defensively anyway, and a backend with a native out-of-place mode
+ * can later drop it behind this same interface
+ */
 srtp_err_status_t
-srtp_shutdown() {
+srtp_unprotect_copy(srtp_t ctx, const void *srtp_hdr, int srtp_len,
+                    void *rtp_hdr, int *rtp_len_ptr) {
   srtp_err_status_t status;
 
-  /* shut down crypto kernel */
-  status = srtp_crypto_kernel_shutdown();
-  if (status) 
-    return status;
+  if (srtp_hdr == NULL || rtp_hdr == NULL || rtp_len_ptr == NULL ||
+      srtp_len < 0)
+    return srtp_err_status_bad_param;
+  if (*rtp_len_ptr < srtp_len)
+    return srtp_err_status_bad_param;
 
-  /* shutting down crypto kernel frees the srtp debug module as well */
+  memcpy(rtp_hdr, srtp_hdr, srtp_len);
+  *rtp_len_ptr = srtp_len;
 
-  return srtp_err_status_ok;
+  srtp_crypto_alloc_guard_begin();
+  status = srtp_unprotect_impl(ctx, rtp_hdr, rtp_len_ptr, 0, NULL);
+  srtp_crypto_alloc_guard_end();
+
+  return status;
 }
 
+/*
+ * batch variants of srtp_protect() and srtp_unprotect()
+ *
+ * these amortize the per-call entry cost over an array of packets
+ * (typically the packets returned by one recvmmsg() call) and report
+ * a status code for each packet, so a single replay or auth failure
+ * does not abort the rest of the batch
+ */
+
+srtp_err_status_t
+srtp_protect_batch(srtp_t ctx, void **rtp_hdr, int *len_ptr,
+                   srtp_err_status_t *status, int num_pkts) {
+  srtp_err_status_t result = srtp_err_status_ok;
+  int i;
 
-/* 
- * The following code is under consideration for removal.  See
- * SRTP_MAX_TRAILER_LEN 
+  if (ctx == NULL || rtp_hdr == NULL || len_ptr == NULL ||
+      status == NULL || num_pkts < 0)
+    return srtp_err_status_bad_param;
+
+  for (i = 0; i < num_pkts; i++) {
+    status[i] = srtp_protect(ctx, rtp_hdr[i], &len_ptr[i]);
+    if (status[i] != srtp_err_status_ok)
+      result = srtp_err_status_fail;
+  }
+
+  return result;
+}
+
+srtp_err_status_t
+srtp_unprotect_batch(srtp_t ctx, void **srtp_hdr, int *len_ptr,
+                     srtp_err_status_t *status, int num_pkts) {
+  srtp_err_status_t result = srtp_err_status_ok;
+  int i;
+
+  if (ctx == NULL || srtp_hdr == NULL || len_ptr == NULL ||
+      status == NULL || num_pkts < 0)
+    return srtp_err_status_bad_param;
+
+  for (i = 0; i < num_pkts; i++) {
+    status[i] = srtp_unprotect(ctx, srtp_hdr[i], &len_ptr[i]);
+    if (status[i] != srtp_err_status_ok)
+      result = srtp_err_status_fail;
+  }
+
+  return result;
+}
+
+/*
+ * hardware offload (see srtp_offload.h)
+ *
+ * the library keeps all SRTP-layer bookkeeping - stream lookup,
+ * replay and rollover state, key-usage limits, IV formation - and
+ * hands the provider bare AEAD transform descriptors; everything the
+ * provider cannot take runs in software, so attaching a provider is
+ * purely a question of where the cipher work executes
  */
-#if 0
+
+/* descriptors submitted and polled per pump iteration */
+#define SRTP_OFFLOAD_PUMP 32
 
 /*
- * srtp_get_trailer_length(&a) returns the number of octets that will
- * be added to an RTP packet by the SRTP processing.  This value
- * is constant for a given srtp_stream_t (i.e. between initializations).
+ * srtp_stream_offload_key(session_keys, key, key_len) re-derives the
+ * RTP encryption key from the retained master key, for programming
+ * into an offload backend.  the master key is only retained while a
+ * deferred derivation is pending (see srtp_stream_init_keys()); once
+ * it has been zeroized the key can no longer be exported and the
+ * stream stays in software
  */
+static srtp_err_status_t
+srtp_stream_offload_key(srtp_session_keys_t *session_keys,
+                        uint8_t *key, int *key_len) {
+  srtp_err_status_t stat;
+  srtp_kdf_t kdf;
+  srtp_kdf_span_t span;
+  int rtp_keylen, rtp_base_key_len;
 
-int
-srtp_get_trailer_length(const srtp_stream_t s) {
-  return srtp_auth_get_tag_length(s->rtp_auth);
-}
+  if (!session_keys->deferred_rtcp_keys &&
+      !session_keys->deferred_xtn_hdr_keys)
+    return srtp_err_status_no_such_op;
+
+  rtp_keylen = srtp_cipher_get_key_length(session_keys->rtp_cipher);
+  rtp_base_key_len = base_key_length(session_keys->rtp_cipher->type,
+                                     rtp_keylen);
 
+  srtp_crypto_alloc_guard_suspend();
+#if defined(OPENSSL) && defined(OPENSSL_KDF)
+  stat = srtp_kdf_init(&kdf, (const uint8_t *)session_keys->master_key,
+                       rtp_base_key_len, rtp_keylen - rtp_base_key_len);
+#else
+  stat = srtp_kdf_init(&kdf, (const uint8_t *)session_keys->master_key,
+                       srtp_session_kdf_keylen(session_keys), session_keys);
 #endif
+  srtp_crypto_alloc_guard_resume();
+  if (stat)
+    return srtp_err_status_init_fail;
+
+  span.label = label_rtp_encryption;
+  span.key = key;
+  span.length = rtp_base_key_len;
+  stat = srtp_kdf_generate_set(&kdf, &span, 1);
+  srtp_kdf_clear(&kdf);
+  if (stat)
+    return srtp_err_status_init_fail;
+
+  *key_len = rtp_base_key_len;
+  return srtp_err_status_ok;
+}
 
 /*
- * srtp_get_stream(ssrc) returns a pointer to the stream corresponding
- * to ssrc, or NULL if no stream exists for that ssrc
- *
- * this is an internal function 
+ * srtp_stream_offload_open(ctx, stream) asks the session's provider
+ * for a key handle covering the stream's RTP transform.  offload
+ * covers AEAD streams with a single master key and no EKT or
+ * header-extension encryption; everything else - and any stream
+ * whose derived key can no longer be exported - stays in software,
+ * which is never an error
  */
+static void
+srtp_stream_offload_open(srtp_ctx_t *ctx, srtp_stream_ctx_t *stream) {
+  const srtp_offload_provider_t *provider = ctx->offload;
+  srtp_session_keys_t *session_keys = &stream->session_keys[0];
+  uint8_t key[MAX_SRTP_KEY_LEN];
+  int key_len;
+  uint32_t caps;
+  uint64_t handle;
+  srtp_err_status_t status;
 
-srtp_stream_ctx_t *
-srtp_get_stream(srtp_t srtp, uint32_t ssrc) {
+  stream->offload_caps = 0;
+  stream->offload_owns_handle = 0;
+
+  if (stream->num_master_keys != 1 || stream->ekt != NULL ||
+      session_keys->rtp_xtn_hdr_cipher != NULL)
+    return;
+  if (session_keys->rtp_cipher->algorithm != SRTP_AES_GCM_128 &&
+      session_keys->rtp_cipher->algorithm != SRTP_AES_GCM_256)
+    return;
+
+  caps = provider->capabilities(provider->data,
+                                session_keys->rtp_cipher->type->id,
+                                srtp_cipher_get_key_length(
+                                    session_keys->rtp_cipher));
+  if (caps == 0)
+    return;
+
+  status = srtp_stream_offload_key(session_keys, key, &key_len);
+  if (status)
+    return;
+
+  status = provider->session_open(provider->data,
+                                  session_keys->rtp_cipher->type->id,
+                                  key, key_len,
+                                  session_keys->salt, SRTP_AEAD_SALT_LEN,
+                                  &handle);
+  octet_string_set_to_zero(key, sizeof(key));
+  if (status)
+    return;
+
+  stream->offload_caps = caps;
+  stream->offload_key_handle = handle;
+  stream->offload_owns_handle = 1;
+}
+
+static void
+srtp_stream_offload_close(const srtp_offload_provider_t *provider,
+                          srtp_stream_ctx_t *stream) {
+  if (stream->offload_owns_handle)
+    provider->session_close(provider->data, stream->offload_key_handle);
+  stream->offload_caps = 0;
+  stream->offload_owns_handle = 0;
+}
+
+srtp_err_status_t
+srtp_offload_attach(srtp_t session, const srtp_offload_provider_t *provider) {
   srtp_stream_ctx_t *stream;
 
-  /* walk down list until ssrc is found */
-  stream = srtp->stream_list;
-  while (stream != NULL) {
-    if (stream->ssrc == ssrc)
-      return stream;
-    stream = stream->next;
-  }
-  
-  /* we haven't found our ssrc, so return a null */
-  return NULL;
+  if (session == NULL || provider == NULL ||
+      provider->capabilities == NULL || provider->session_open == NULL ||
+      provider->session_close == NULL || provider->submit == NULL ||
+      provider->poll == NULL)
+    return srtp_err_status_bad_param;
+  if (session->offload != NULL)
+    return srtp_err_status_bad_param;  /* detach the current provider first */
+
+  session->offload = provider;
+  /* a group's shared template is not keyed here: member sessions come
+   * and go independently of each other's providers */
+  if (session->stream_template != NULL && session->group == NULL)
+    srtp_stream_offload_open(session, session->stream_template);
+  for (stream = session->stream_list; stream != NULL; stream = stream->next)
+    srtp_stream_offload_open(session, stream);
+
+  return srtp_err_status_ok;
 }
 
 srtp_err_status_t
-srtp_dealloc(srtp_t session) {
+srtp_offload_detach(srtp_t session) {
+  const srtp_offload_provider_t *provider;
   srtp_stream_ctx_t *stream;
+
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+  provider = session->offload;
+  if (provider == NULL)
+    return srtp_err_status_no_such_op;
+
+  if (session->stream_template != NULL)
+    srtp_stream_offload_close(provider, session->stream_template);
+  for (stream = session->stream_list; stream != NULL; stream = stream->next)
+    srtp_stream_offload_close(provider, stream);
+  /* recycled clones hold (unowned) copies of the template's handle */
+  for (stream = session->stream_free_list; stream != NULL;
+       stream = stream->next)
+    srtp_stream_offload_close(provider, stream);
+
+  session->offload = NULL;
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_offload_desc_software(stream, desc) executes a descriptor on
+ * the stream's own cipher; it is the per-packet software fallback for
+ * descriptors the provider refused
+ */
+static void
+srtp_offload_desc_software(srtp_stream_ctx_t *stream,
+                           srtp_offload_desc_t *desc) {
+  unsigned int octets = desc->body_octets;
+
+  desc->status = srtp_cipher_aead(stream->session_keys[0].rtp_cipher,
+                                  desc->iv,
+                                  desc->encrypt ? srtp_direction_encrypt
+                                                : srtp_direction_decrypt,
+                                  (const uint8_t *)desc->packet,
+                                  desc->aad_octets,
+                                  (uint8_t *)desc->packet + desc->aad_octets,
+                                  &octets);
+  desc->body_octets = octets;
+}
+
+/*
+ * srtp_offload_prepare_protect() performs the sender-side bookkeeping
+ * of srtp_protect() - index update, key limit, IV formation - and
+ * fills in the transform descriptor; the cipher work itself is left
+ * to the provider
+ */
+static srtp_err_status_t
+srtp_offload_prepare_protect(srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
+                             srtp_hdr_t *hdr, int len,
+                             srtp_offload_desc_t *desc) {
+  srtp_session_keys_t *session_keys = &stream->session_keys[0];
+  srtp_rtp_hdr_parse_t parse;
+  srtp_xtd_seq_num_t est;
+  int delta;
+  v128_t iv;
   srtp_err_status_t status;
 
-  /*
-   * we take a conservative deallocation strategy - if we encounter an
-   * error deallocating a stream, then we stop trying to deallocate
-   * memory and just return an error
-   */
+  status = srtp_parse_rtp_header(hdr, len, &parse);
+  if (status)
+    return srtp_err_status_parse_err;
 
-  /* walk list of streams, deallocating as we go */
-  stream = session->stream_list;
-  while (stream != NULL) {
-    srtp_stream_t next = stream->next;
-    status = srtp_stream_dealloc(stream, session->stream_template);
-    if (status)
+  /* index bookkeeping, as in srtp_protect() */
+  if (stream->direction == dir_srtp_sender && !stream->pending_roc &&
+      srtp_rdbx_advance_sender(&stream->rtp_rdbx,
+                               ntohs(hdr->seq)) == srtp_err_status_ok) {
+    est = srtp_rdbx_get_packet_index(&stream->rtp_rdbx);
+  } else {
+    status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+    if (status && (status != srtp_err_status_pkt_idx_adv))
       return status;
-    stream = next;
+    if (status == srtp_err_status_pkt_idx_adv) {
+      srtp_rdbx_set_roc_seq(&stream->rtp_rdbx,
+                            (uint32_t)(est >> 16),
+                            (uint16_t)(est & 0xFFFF));
+      stream->pending_roc = 0;
+      srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+      status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+      if (status) {
+        if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx) {
+          stream->stats.replay_drops++;
+          return status;
+        }
+      }
+      srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+    }
   }
-  
-  /* deallocate stream template, if there is one */
-  if (session->stream_template != NULL) {
-    status = srtp_stream_dealloc(session->stream_template, NULL);
-    if (status)
-      return status;
+
+  switch (srtp_key_limit_update_batched(session_keys->limit)) {
+  case srtp_key_event_normal:
+    break;
+  case srtp_key_event_soft_limit:
+    srtp_handle_event(ctx, stream, event_key_soft_limit);
+    break;
+  case srtp_key_event_hard_limit:
+    srtp_handle_event(ctx, stream, event_key_hard_limit);
+    return srtp_err_status_key_expired;
+  default:
+    break;
   }
 
-  /* deallocate session context */
-  srtp_crypto_free(session);
+  srtp_calc_aead_iv(session_keys, &iv, &est, hdr);
 
+  desc->key_handle = stream->offload_key_handle;
+  desc->encrypt = 1;
+  memcpy(desc->iv, &iv, sizeof(desc->iv));
+  desc->packet = hdr;
+  desc->aad_octets = (unsigned int)parse.header_len;
+  desc->body_octets = (unsigned int)(len - parse.header_len);
+  desc->status = srtp_err_status_ok;
   return srtp_err_status_ok;
 }
 
-
-srtp_err_status_t
-srtp_add_stream(srtp_t session, 
-		const srtp_policy_t *policy)  {
+/*
+ * srtp_offload_prepare_unprotect() performs the receiver-side checks
+ * of srtp_unprotect() up to the cipher call; the replay window is
+ * only committed at completion, once the provider has verified the
+ * tag.  a packet that would advance the index (a pre-set ROC) is
+ * reported with srtp_err_status_pkt_idx_adv so the pump can route it
+ * through the full software path
+ */
+static srtp_err_status_t
+srtp_offload_prepare_unprotect(srtp_ctx_t *ctx, srtp_stream_ctx_t *stream,
+                               srtp_hdr_t *hdr, int len,
+                               srtp_offload_desc_t *desc,
+                               srtp_xtd_seq_num_t *est_ptr) {
+  srtp_session_keys_t *session_keys = &stream->session_keys[0];
+  srtp_rtp_hdr_parse_t parse;
+  srtp_xtd_seq_num_t est;
+  int delta;
+  uint32_t tag_len;
+  v128_t iv;
   srtp_err_status_t status;
-  srtp_stream_t tmp;
 
-  /* sanity check arguments */
-  if ((session == NULL) || (policy == NULL) || (!srtp_validate_policy_master_keys(policy)))
+  status = srtp_parse_rtp_header(hdr, len, &parse);
+  if (status)
+    return srtp_err_status_parse_err;
+  tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+  if (len < parse.header_len + (int)tag_len)
     return srtp_err_status_bad_param;
 
-  /* allocate stream  */
-  status = srtp_stream_alloc(&tmp, policy);
-  if (status) {
-    return status;
-  }
-  
-  /* initialize stream  */
-  status = srtp_stream_init(tmp, policy);
+  status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+  if (status)
+    return status;    /* pkt_idx_adv falls back to the software path */
+
+  status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
   if (status) {
-    srtp_crypto_free(tmp);
+    stream->stats.replay_drops++;
     return status;
   }
-  
-  /* 
-   * set the head of the stream list or the template to point to the
-   * stream that we've just alloced and init'ed, depending on whether
-   * or not it has a wildcard SSRC value or not
-   *
+
+  switch (srtp_key_limit_update_batched(session_keys->limit)) {
+  case srtp_key_event_normal:
+    break;
+  case srtp_key_event_soft_limit:
+    srtp_handle_event(ctx, stream, event_key_soft_limit);
+    break;
+  case srtp_key_event_hard_limit:
+    srtp_handle_event(ctx, stream, event_key_hard_limit);
+    srtp_err_event_log(srtp_err_level_error, srtp_err_status_key_expired,
+                       ntohl(hdr->ssrc), est);
+    return srtp_err_status_key_expired;
+  default:
+    break;
+  }
+
+  srtp_calc_aead_iv(session_keys, &iv, &est, hdr);
+
+  desc->key_handle = stream->offload_key_handle;
+  desc->encrypt = 0;
+  memcpy(desc->iv, &iv, sizeof(desc->iv));
+  desc->packet = hdr;
+  desc->aad_octets = (unsigned int)parse.header_len;
+  desc->body_octets = (unsigned int)(len - parse.header_len);
+  desc->status = srtp_err_status_ok;
+  *est_ptr = est;
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_offload_pump(ctx, queued, ...) pushes a chunk of prepared
+ * descriptors through the provider and blocks until all of them have
+ * completed; descriptors the provider refuses at submission run on
+ * the stream's own cipher.  a negative poll return is a provider
+ * failure, and every descriptor still outstanding is failed
+ */
+static void
+srtp_offload_pump(srtp_ctx_t *ctx, srtp_offload_desc_t *desc,
+                  srtp_stream_ctx_t **pend_stream, int queued) {
+  const srtp_offload_provider_t *provider = ctx->offload;
+  srtp_offload_desc_t *order[SRTP_OFFLOAD_PUMP];
+  srtp_offload_desc_t *done[SRTP_OFFLOAD_PUMP];
+  int outstanding[SRTP_OFFLOAD_PUMP];
+  int i, accepted, completed;
+
+  for (i = 0; i < queued; i++) {
+    order[i] = &desc[i];
+    outstanding[i] = 0;
+  }
+
+  accepted = provider->submit(provider->data, order, queued);
+  if (accepted < 0)
+    accepted = 0;
+  if (accepted > queued)
+    accepted = queued;
+  for (i = 0; i < accepted; i++)
+    outstanding[i] = 1;
+
+  /* the provider's leftovers run on the stream's own cipher */
+  for (i = accepted; i < queued; i++)
+    srtp_offload_desc_software(pend_stream[i], &desc[i]);
+
+  completed = 0;
+  while (completed < accepted) {
+    int got = provider->poll(provider->data, done, SRTP_OFFLOAD_PUMP);
+
+    if (got < 0) {
+      for (i = 0; i < queued; i++) {
+        if (outstanding[i]) {
+          desc[i].status = srtp_err_status_algo_fail;
+          outstanding[i] = 0;
+        }
+      }
+      break;
+    }
+    for (i = 0; i < got; i++) {
+      int idx = (int)(done[i] - desc);
+
+      if (idx >= 0 && idx < queued && outstanding[idx]) {
+        outstanding[idx] = 0;
+        completed++;
+      }
+    }
+  }
+}
+
+srtp_err_status_t
+srtp_offload_protect_batch(srtp_t ctx, void **rtp_hdr, int *len_ptr,
+                           srtp_err_status_t *status, int num_pkts) {
+  srtp_offload_desc_t desc[SRTP_OFFLOAD_PUMP];
+  srtp_stream_ctx_t *pend_stream[SRTP_OFFLOAD_PUMP];
+  int pend_slot[SRTP_OFFLOAD_PUMP];
+  srtp_err_status_t result = srtp_err_status_ok;
+  int i, base;
+
+  if (ctx == NULL || rtp_hdr == NULL || len_ptr == NULL ||
+      status == NULL || num_pkts < 0)
+    return srtp_err_status_bad_param;
+
+  for (base = 0; base < num_pkts; base += SRTP_OFFLOAD_PUMP) {
+    int chunk = num_pkts - base;
+    int queued = 0;
+
+    if (chunk > SRTP_OFFLOAD_PUMP)
+      chunk = SRTP_OFFLOAD_PUMP;
+
+    for (i = 0; i < chunk; i++) {
+      int slot = base + i;
+      srtp_hdr_t *hdr = (srtp_hdr_t *)rtp_hdr[slot];
+      srtp_stream_ctx_t *stream = NULL;
+
+      if (ctx->offload != NULL && len_ptr[slot] >= octets_in_rtp_header)
+        stream = srtp_get_stream(ctx, hdr->ssrc);
+
+      /*
+       * anything the provider cannot serve goes through the plain
+       * software path: unknown streams (the first packet of a
+       * template clone), streams without a protect capability, and
+       * streams with a rekey in flight
+       */
+      if (stream == NULL ||
+          !(stream->offload_caps & SRTP_OFFLOAD_CAP_PROTECT) ||
+          stream->prev_session_keys != NULL || stream->rtp_null_fast) {
+        status[slot] = srtp_protect(ctx, rtp_hdr[slot], &len_ptr[slot]);
+        continue;
+      }
+
+      /* direction check, as in srtp_protect() */
+      if (stream->direction != dir_srtp_sender) {
+        if (stream->direction == dir_unknown)
+          stream->direction = dir_srtp_sender;
+        else
+          srtp_handle_event(ctx, stream, event_ssrc_collision);
+      }
+
+      status[slot] = srtp_offload_prepare_protect(ctx, stream, hdr,
+                                                  len_ptr[slot],
+                                                  &desc[queued]);
+      if (status[slot] != srtp_err_status_ok)
+        continue;
+      pend_stream[queued] = stream;
+      pend_slot[queued] = slot;
+      queued++;
+    }
+
+    if (queued > 0) {
+      srtp_offload_pump(ctx, desc, pend_stream, queued);
+
+      for (i = 0; i < queued; i++) {
+        int slot = pend_slot[i];
+
+        status[slot] = desc[i].status;
+        if (desc[i].status != srtp_err_status_ok)
+          continue;
+        len_ptr[slot] = (int)(desc[i].aad_octets + desc[i].body_octets);
+        pend_stream[i]->stats.packets_protected++;
+        pend_stream[i]->stats.octets_protected += (uint64_t)len_ptr[slot];
+      }
+    }
+  }
+
+  for (i = 0; i < num_pkts; i++)
+    if (status[i] != srtp_err_status_ok)
+      result = srtp_err_status_fail;
+
+  return result;
+}
+
+srtp_err_status_t
+srtp_offload_unprotect_batch(srtp_t ctx, void **srtp_hdr, int *len_ptr,
+                             srtp_err_status_t *status, int num_pkts) {
+  srtp_offload_desc_t desc[SRTP_OFFLOAD_PUMP];
+  srtp_stream_ctx_t *pend_stream[SRTP_OFFLOAD_PUMP];
+  int pend_slot[SRTP_OFFLOAD_PUMP];
+  srtp_xtd_seq_num_t pend_est[SRTP_OFFLOAD_PUMP];
+  srtp_err_status_t result = srtp_err_status_ok;
+  int i, base;
+
+  if (ctx == NULL || srtp_hdr == NULL || len_ptr == NULL ||
+      status == NULL || num_pkts < 0)
+    return srtp_err_status_bad_param;
+
+  for (base = 0; base < num_pkts; base += SRTP_OFFLOAD_PUMP) {
+    int chunk = num_pkts - base;
+    int queued = 0;
+
+    if (chunk > SRTP_OFFLOAD_PUMP)
+      chunk = SRTP_OFFLOAD_PUMP;
+
+    for (i = 0; i < chunk; i++) {
+      int slot = base + i;
+      srtp_hdr_t *hdr = (srtp_hdr_t *)srtp_hdr[slot];
+      srtp_stream_ctx_t *stream = NULL;
+      srtp_err_status_t prep;
+
+      if (ctx->offload != NULL && len_ptr[slot] >= octets_in_rtp_header)
+        stream = srtp_get_stream(ctx, hdr->ssrc);
+
+      if (stream == NULL ||
+          !(stream->offload_caps & SRTP_OFFLOAD_CAP_UNPROTECT) ||
+          stream->prev_session_keys != NULL || stream->rtp_null_fast) {
+        status[slot] = srtp_unprotect(ctx, srtp_hdr[slot], &len_ptr[slot]);
+        continue;
+      }
+
+      /* direction check, as in srtp_unprotect() */
+      if (stream->direction != dir_srtp_receiver) {
+        if (stream->direction == dir_unknown)
+          stream->direction = dir_srtp_receiver;
+        else
+          srtp_handle_event(ctx, stream, event_ssrc_collision);
+      }
+
+      prep = srtp_offload_prepare_unprotect(ctx, stream, hdr, len_ptr[slot],
+                                            &desc[queued], &pend_est[queued]);
+      if (prep == srtp_err_status_pkt_idx_adv) {
+        /* a pre-set ROC needs the full software path */
+        status[slot] = srtp_unprotect(ctx, srtp_hdr[slot], &len_ptr[slot]);
+        continue;
+      }
+      status[slot] = prep;
+      if (prep != srtp_err_status_ok)
+        continue;
+      pend_stream[queued] = stream;
+      pend_slot[queued] = slot;
+      queued++;
+    }
+
+    if (queued > 0) {
+      srtp_offload_pump(ctx, desc, pend_stream, queued);
+
+      for (i = 0; i < queued; i++) {
+        int slot = pend_slot[i];
+        srtp_stream_ctx_t *stream = pend_stream[i];
+        srtp_hdr_t *hdr = (srtp_hdr_t *)srtp_hdr[slot];
+        srtp_xtd_seq_num_t est;
+        int delta;
+        srtp_err_status_t commit;
+
+        status[slot] = desc[i].status;
+        if (desc[i].status != srtp_err_status_ok) {
+          if (desc[i].status == srtp_err_status_auth_fail) {
+            stream->stats.auth_failures++;
+            srtp_err_event_log(srtp_err_level_warning, desc[i].status,
+                               ntohl(hdr->ssrc), pend_est[i]);
+          }
+          continue;
+        }
+
+        /*
+         * the tag verified; commit the replay window.  the delta
+         * estimated at preparation time goes stale as earlier packets
+         * in the chunk commit, so it is recomputed here - which also
+         * catches a duplicate index submitted twice in one batch
+         */
+        delta = srtp_rdbx_estimate_index(&stream->rtp_rdbx, &est,
+                                         ntohs(hdr->seq));
+        commit = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+        if (commit == srtp_err_status_ok && est != pend_est[i])
+          commit = srtp_err_status_replay_fail;
+        if (commit != srtp_err_status_ok) {
+          stream->stats.replay_drops++;
+          status[slot] = commit;
+          continue;
+        }
+        srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+        len_ptr[slot] = (int)(desc[i].aad_octets + desc[i].body_octets);
+        stream->stats.packets_unprotected++;
+        stream->stats.octets_unprotected += (uint64_t)len_ptr[slot];
+      }
+    }
+  }
+
+  for (i = 0; i < num_pkts; i++)
+    if (status[i] != srtp_err_status_ok)
+      result = srtp_err_status_fail;
+
+  return result;
+}
+
+/*
+ * scatter-gather variants of srtp_protect() and srtp_unprotect()
+ *
+ * these run the cipher and authentication function segment by segment
+ * over a packet scattered across several buffers, so packets held in
+ * a zero-copy pool need not be gathered into a staging buffer; the
+ * counter-mode ciphers and HMAC keep their keystream and hash state
+ * across calls, which is what makes the per-segment passes equivalent
+ * to one pass over the gathered packet
+ *
+ * policies that rearrange the packet around the payload (MKI, AEAD,
+ * RFC 6904 header-extension encryption) are not supported here and
+ * are rejected up front
+ */
+
+/*
+ * check the segment layout and sum the lengths; the first segment
+ * must hold the complete RTP header (so *enc_offset octets, covering
+ * the fixed header, CSRCs, and any extension, are all in iov[0])
+ */
+static srtp_err_status_t
+srtp_iov_parse(const srtp_iovec_t *iov, int iov_count,
+               int *total_len, int *enc_offset) {
+  const srtp_hdr_t *hdr;
+  int total = 0;
+  int offset;
+  int i;
+
+  if (iov == NULL || iov_count < 1 || iov[0].iov_base == NULL)
+    return srtp_err_status_bad_param;
+  for (i = 0; i < iov_count; i++) {
+    if (iov[i].iov_len < 0 || (iov[i].iov_len > 0 && iov[i].iov_base == NULL))
+      return srtp_err_status_bad_param;
+    total += iov[i].iov_len;
+  }
+  if (iov[0].iov_len < octets_in_rtp_header)
+    return srtp_err_status_bad_param;
+
+  hdr = (const srtp_hdr_t *)iov[0].iov_base;
+  if (hdr->version != 2)
+    return srtp_err_status_bad_param;
+
+  offset = octets_in_rtp_header + 4 * hdr->cc;
+  if (offset > iov[0].iov_len)
+    return srtp_err_status_bad_param;
+  if (hdr->x == 1) {
+    srtp_hdr_xtnd_t *xtn_hdr;
+
+    if (offset + (int)sizeof(srtp_hdr_xtnd_t) > iov[0].iov_len)
+      return srtp_err_status_bad_param;
+    xtn_hdr = (srtp_hdr_xtnd_t *)((uint8_t *)iov[0].iov_base + offset);
+    offset += 4 * (ntohs(xtn_hdr->length) + 1);
+    if (offset > iov[0].iov_len)
+      return srtp_err_status_bad_param;
+  }
+
+  *total_len = total;
+  *enc_offset = offset;
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * run the cipher in place over the octets [enc_offset, enc_end) of
+ * the scattered packet, one segment at a time
+ */
+static srtp_err_status_t
+srtp_iov_crypt(srtp_cipher_t *cipher, srtp_iovec_t *iov, int iov_count,
+               int enc_offset, int enc_end, int forward) {
+  srtp_err_status_t status;
+  int pos = 0;
+  int i;
+
+  for (i = 0; i < iov_count && pos < enc_end; i++) {
+    int seg_start = pos;
+    int seg_end = pos + iov[i].iov_len;
+    int lo = (enc_offset > seg_start) ? enc_offset : seg_start;
+    int hi = (enc_end < seg_end) ? enc_end : seg_end;
+
+    if (lo < hi) {
+      unsigned int n = (unsigned int)(hi - lo);
+
+      if (forward)
+        status = srtp_cipher_encrypt(cipher,
+                                     (uint8_t *)iov[i].iov_base +
+                                     (lo - seg_start), &n);
+      else
+        status = srtp_cipher_decrypt(cipher,
+                                     (uint8_t *)iov[i].iov_base +
+                                     (lo - seg_start), &n);
+      if (status)
+        return srtp_err_status_cipher_fail;
+    }
+    pos = seg_end;
+  }
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * feed the octets [0, auth_end) of the scattered packet to the
+ * authentication function, one segment at a time
+ */
+static srtp_err_status_t
+srtp_iov_auth_update(srtp_auth_t *auth, const srtp_iovec_t *iov,
+                     int iov_count, int auth_end) {
+  srtp_err_status_t status;
+  int pos = 0;
+  int i;
+
+  for (i = 0; i < iov_count && pos < auth_end; i++) {
+    int n = iov[i].iov_len;
+
+    if (pos + n > auth_end)
+      n = auth_end - pos;
+    if (n > 0) {
+      status = srtp_auth_update(auth, (uint8_t *)iov[i].iov_base, n);
+      if (status)
+        return status;
+    }
+    pos += iov[i].iov_len;
+  }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_protect_iov(srtp_t ctx, srtp_iovec_t *iov, int iov_count,
+                 int *len_ptr, void *trailer) {
+  srtp_hdr_t *hdr;
+  int enc_offset;              /* octet offset of the encrypted portion  */
+  int total_len;
+  srtp_xtd_seq_num_t est;      /* estimated xtd_seq_num_t of *hdr        */
+  int delta;                   /* delta of local pkt idx and that in hdr */
+  uint8_t *auth_tag = NULL;    /* location of auth_tag (in trailer)      */
+  srtp_err_status_t status;
+  int tag_len;
+  srtp_stream_ctx_t *stream;
+  uint32_t prefix_len;
+  srtp_session_keys_t *session_keys;
+  int advance_packet_index = 0;
+  v128_t iv;
+
+  debug_print(mod_srtp, "function srtp_protect_iov", NULL);
+
+  if (ctx == NULL || len_ptr == NULL || trailer == NULL)
+    return srtp_err_status_bad_param;
+
+  status = srtp_iov_parse(iov, iov_count, &total_len, &enc_offset);
+  if (status)
+    return status;
+  if (*len_ptr != total_len)
+    return srtp_err_status_bad_param;
+  hdr = (srtp_hdr_t *)iov[0].iov_base;
+
+  /* look up the stream, instantiating it from the template if need be */
+  stream = srtp_get_stream(ctx, hdr->ssrc);
+  if (stream == NULL) {
+    if (ctx->stream_template != NULL) {
+      srtp_stream_ctx_t *new_stream;
+
+      status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream);
+      if (status)
+        return status;
+      srtp_stream_list_insert(ctx, new_stream);
+      new_stream->direction = dir_srtp_sender;
+      stream = new_stream;
+    } else {
+      return srtp_err_status_no_ctx;
+    }
+  }
+
+  if (stream->direction != dir_srtp_sender) {
+    if (stream->direction == dir_unknown) {
+      stream->direction = dir_srtp_sender;
+    } else {
+      srtp_handle_event(ctx, stream, event_ssrc_collision);
+    }
+  }
+
+  session_keys = &stream->session_keys[0];
+
+  /* the policies this interface does not carry */
+  if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
+      session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256)
+    return srtp_err_status_bad_param;
+  if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher)
+    return srtp_err_status_bad_param;
+
+  switch (srtp_key_limit_update_batched(session_keys->limit)) {
+  case srtp_key_event_normal:
+    break;
+  case srtp_key_event_soft_limit:
+    srtp_handle_event(ctx, stream, event_key_soft_limit);
+    break;
+  case srtp_key_event_hard_limit:
+    srtp_handle_event(ctx, stream, event_key_hard_limit);
+    return srtp_err_status_key_expired;
+  default:
+    break;
+  }
+
+  tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+  if (stream->rtp_services & sec_serv_auth)
+    auth_tag = (uint8_t *)trailer;
+
+  /*
+   * estimate the packet index and update the replay window; a
+   * sequence number incrementing by one skips the estimator, as in
+   * srtp_protect()
+   */
+  if (stream->direction == dir_srtp_sender && !stream->pending_roc &&
+      srtp_rdbx_advance_sender(&stream->rtp_rdbx,
+                               ntohs(hdr->seq)) == srtp_err_status_ok) {
+    est = srtp_rdbx_get_packet_index(&stream->rtp_rdbx);
+    delta = 1;
+  } else {
+    status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+    if (status && (status != srtp_err_status_pkt_idx_adv))
+      return status;
+    if (status == srtp_err_status_pkt_idx_adv)
+      advance_packet_index = 1;
+
+    if (advance_packet_index) {
+      srtp_rdbx_set_roc_seq(&stream->rtp_rdbx,
+                            (uint32_t)(est >> 16),
+                            (uint16_t)(est & 0xFFFF));
+      stream->pending_roc = 0;
+      srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+    } else {
+      status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+      if (status) {
+        if (status != srtp_err_status_replay_fail || !stream->allow_repeat_tx)
+          return status;
+      }
+      srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+    }
+  }
+
+  /* set the cipher IV as srtp_protect() does */
+  if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
+      session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
+      session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+    iv.v32[0] = 0;
+    iv.v32[1] = hdr->ssrc;
+#ifdef NO_64BIT_MATH
+    iv.v64[1] = be64_to_cpu(make64((high32(est) << 16) | (low32(est) >> 16),
+                                   low32(est) << 16));
+#else
+    iv.v64[1] = be64_to_cpu(est << 16);
+#endif
+  } else {
+#ifdef NO_64BIT_MATH
+    iv.v32[0] = 0;
+    iv.v32[1] = 0;
+#else
+    iv.v64[0] = 0;
+#endif
+    iv.v64[1] = be64_to_cpu(est);
+  }
+  status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
+                              srtp_direction_encrypt);
+  if (status)
+    return srtp_err_status_cipher_fail;
+
+  /* shift est, put into network byte order */
+#ifdef NO_64BIT_MATH
+  est = be64_to_cpu(make64((high32(est) << 16) | (low32(est) >> 16),
+                           low32(est) << 16));
+#else
+  est = be64_to_cpu(est << 16);
+#endif
+
+  /* universal-hash keystream prefix, as in srtp_protect() */
+  if (auth_tag) {
+    prefix_len = srtp_auth_get_prefix_length(session_keys->rtp_auth);
+    if (prefix_len) {
+      status = srtp_cipher_output(session_keys->rtp_cipher, auth_tag,
+                                  &prefix_len);
+      if (status)
+        return srtp_err_status_cipher_fail;
+    }
+  }
+
+  /* encrypt the payload, segment by segment */
+  if (stream->rtp_services & sec_serv_conf) {
+    status = srtp_iov_crypt(session_keys->rtp_cipher, iov, iov_count,
+                            enc_offset, total_len, 1);
+    if (status)
+      return status;
+  }
+
+  /* authenticate over the packet and the ROC, tag into the trailer */
+  if (auth_tag) {
+    status = srtp_auth_start(session_keys->rtp_auth);
+    if (status)
+      return status;
+    status = srtp_iov_auth_update(session_keys->rtp_auth, iov, iov_count,
+                                  total_len);
+    if (status)
+      return status;
+    status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4,
+                               auth_tag);
+    if (status)
+      return srtp_err_status_auth_fail;
+
+    *len_ptr += tag_len;
+  }
+
+  stream->stats.packets_protected++;
+  stream->stats.octets_protected += (uint64_t)*len_ptr;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_unprotect_iov(srtp_t ctx, srtp_iovec_t *iov, int iov_count,
+                   int *len_ptr) {
+  srtp_hdr_t *hdr;
+  int enc_offset;              /* octet offset of the encrypted portion  */
+  int total_len;
+  srtp_xtd_seq_num_t est;      /* estimated xtd_seq_num_t of *hdr        */
+  int delta;                   /* delta of local pkt idx and that in hdr */
+  uint8_t *auth_tag = NULL;    /* location of auth_tag within packet     */
+  uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+  srtp_err_status_t status;
+  uint32_t tag_len, prefix_len;
+  srtp_stream_ctx_t *stream;
+  srtp_session_keys_t *session_keys;
+  int advance_packet_index = 0;
+  uint32_t roc_to_set = 0;
+  uint16_t seq_to_set = 0;
+  v128_t iv;
+
+  debug_print(mod_srtp, "function srtp_unprotect_iov", NULL);
+
+  if (ctx == NULL || len_ptr == NULL)
+    return srtp_err_status_bad_param;
+
+  status = srtp_iov_parse(iov, iov_count, &total_len, &enc_offset);
+  if (status)
+    return status;
+  if (*len_ptr != total_len)
+    return srtp_err_status_bad_param;
+  hdr = (srtp_hdr_t *)iov[0].iov_base;
+
+  /* reject unknown SSRCs cheaply when there is no template */
+  if (ctx->stream_template == NULL &&
+      !srtp_ssrc_filter_test(ctx, hdr->ssrc))
+    return srtp_err_status_no_ctx;
+
+  /* look up the stream, or process against the template provisionally */
+  stream = srtp_get_stream(ctx, hdr->ssrc);
+  if (stream == NULL) {
+    if (ctx->stream_template != NULL) {
+      /* deterministic-latency mode: no clone stocked, no slow path */
+      if (ctx->deterministic_latency && ctx->stream_free_list == NULL)
+        return srtp_err_status_no_ctx;
+      stream = ctx->stream_template;
+#ifdef NO_64BIT_MATH
+      est = (srtp_xtd_seq_num_t)make64(0, ntohs(hdr->seq));
+      delta = low32(est);
+#else
+      est = (srtp_xtd_seq_num_t)ntohs(hdr->seq);
+      delta = (int)est;
+#endif
+    } else {
+      return srtp_err_status_no_ctx;
+    }
+  } else {
+    status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+    if (status && (status != srtp_err_status_pkt_idx_adv))
+      return status;
+    if (status == srtp_err_status_pkt_idx_adv) {
+      advance_packet_index = 1;
+      roc_to_set = (uint32_t)(est >> 16);
+      seq_to_set = (uint16_t)(est & 0xFFFF);
+    }
+    if (!advance_packet_index) {
+      status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+      if (status) {
+        stream->stats.replay_drops++;
+        return status;
+      }
+    }
+  }
+
+  session_keys = &stream->session_keys[0];
+
+  /* switch to this thread's cipher replicas, if the stream has a pool */
+  session_keys = srtp_stream_thread_keys(stream, session_keys);
+
+  /* the policies this interface does not carry */
+  if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
+      session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256)
+    return srtp_err_status_bad_param;
+  if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher)
+    return srtp_err_status_bad_param;
+
+  tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+  if (total_len < (int)tag_len + octets_in_rtp_header)
+    return srtp_err_status_bad_param;
+  if (enc_offset > total_len - (int)tag_len)
+    return srtp_err_status_parse_err;
+
+  if (stream->rtp_services & sec_serv_auth) {
+    /* the tag must lie wholly within the final segment */
+    if (iov[iov_count - 1].iov_len < (int)tag_len)
+      return srtp_err_status_bad_param;
+    auth_tag = (uint8_t *)iov[iov_count - 1].iov_base +
+               iov[iov_count - 1].iov_len - tag_len;
+  }
+
+  /* set the cipher IV as srtp_unprotect() does */
+  if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
+      session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
+      session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+    iv.v32[0] = 0;
+    iv.v32[1] = hdr->ssrc;  /* still in network order */
+#ifdef NO_64BIT_MATH
+    iv.v64[1] = be64_to_cpu(make64((high32(est) << 16) | (low32(est) >> 16),
+                                   low32(est) << 16));
+#else
+    iv.v64[1] = be64_to_cpu(est << 16);
+#endif
+  } else {
+#ifdef NO_64BIT_MATH
+    iv.v32[0] = 0;
+    iv.v32[1] = 0;
+#else
+    iv.v64[0] = 0;
+#endif
+    iv.v64[1] = be64_to_cpu(est);
+  }
+  status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
+                              srtp_direction_decrypt);
+  if (status)
+    return srtp_err_status_cipher_fail;
+
+  /* shift est, put into network byte order */
+#ifdef NO_64BIT_MATH
+  est = be64_to_cpu(make64((high32(est) << 16) | (low32(est) >> 16),
+                           low32(est) << 16));
+#else
+  est = be64_to_cpu(est << 16);
+#endif
+
+  /* verify the authentication tag before touching anything */
+  if (auth_tag) {
+    if (session_keys->rtp_auth->prefix_len != 0) {
+      prefix_len = srtp_auth_get_prefix_length(session_keys->rtp_auth);
+      status = srtp_cipher_output(session_keys->rtp_cipher, tmp_tag,
+                                  &prefix_len);
+      if (status)
+        return srtp_err_status_cipher_fail;
+    }
+
+    status = srtp_auth_start(session_keys->rtp_auth);
+    if (status)
+      return status;
+    status = srtp_iov_auth_update(session_keys->rtp_auth, iov, iov_count,
+                                  total_len - tag_len);
+    if (status)
+      return status;
+    status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est, 4,
+                               tmp_tag);
+    if (status) {
+      stream->stats.auth_failures++;
+      return srtp_err_status_auth_fail;
+    }
+
+    if (octet_string_is_eq(tmp_tag, auth_tag, tag_len)) {
+      stream->stats.auth_failures++;
+      return srtp_err_status_auth_fail;
+    }
+  }
+
+  switch (srtp_key_limit_update_batched(session_keys->limit)) {
+  case srtp_key_event_normal:
+    break;
+  case srtp_key_event_soft_limit:
+    srtp_handle_event(ctx, stream, event_key_soft_limit);
+    break;
+  case srtp_key_event_hard_limit:
+    srtp_handle_event(ctx, stream, event_key_hard_limit);
+    return srtp_err_status_key_expired;
+  default:
+    break;
+  }
+
+  /* decrypt the payload, segment by segment */
+  if (stream->rtp_services & sec_serv_conf) {
+    status = srtp_iov_crypt(session_keys->rtp_cipher, iov, iov_count,
+                            enc_offset, total_len - tag_len, 0);
+    if (status)
+      return status;
+  }
+
+  if (stream->direction != dir_srtp_receiver) {
+    if (stream->direction == dir_unknown) {
+      stream->direction = dir_srtp_receiver;
+    } else {
+      srtp_handle_event(ctx, stream, event_ssrc_collision);
+    }
+  }
+
+  /* instantiate a real stream if we processed against the template */
+  if (stream == ctx->stream_template) {
+    srtp_stream_ctx_t *new_stream;
+
+    status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream);
+    if (status)
+      return status;
+    srtp_stream_list_insert(ctx, new_stream);
+    stream = new_stream;
+  }
+
+  /* the authentication passed, so update the replay window */
+  if (advance_packet_index) {
+    srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, roc_to_set, seq_to_set);
+    stream->pending_roc = 0;
+    srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+  } else {
+    srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
+  }
+
+  *len_ptr -= tag_len;
+
+  stream->stats.packets_unprotected++;
+  stream->stats.octets_unprotected += (uint64_t)*len_ptr;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_init() {
+  srtp_err_status_t status;
+
+  /* initialize crypto kernel */
+  status = srtp_crypto_kernel_init();
+  if (status) 
+    return status;
+
+  /* load srtp debug module into the kernel */
+  status = srtp_crypto_kernel_load_debug_module(&mod_srtp);
+  if (status)
+    return status;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_init_deferred() {
+  srtp_err_status_t status;
+
+  /*
+   * leave the known-answer tests for the first allocation of each
+   * cipher/auth type; srtp_crypto_kernel_init() then completes in
+   * microseconds
+   */
+  status = srtp_crypto_kernel_set_self_test_policy(srtp_self_test_deferred);
+  if (status)
+    return status;
+
+  return srtp_init();
+}
+
+srtp_err_status_t
+srtp_shutdown() {
+  srtp_err_status_t status;
+
+  /* shut down crypto kernel */
+  status = srtp_crypto_kernel_shutdown();
+  if (status) 
+    return status;
+
+  /* shutting down crypto kernel frees the srtp debug module as well */
+
+  return srtp_err_status_ok;
+}
+
+
+/* 
+ * The following code is under consideration for removal.  See
+ * SRTP_MAX_TRAILER_LEN 
+ */
+#if 0
+
+/*
+ * srtp_get_trailer_length(&a) returns the number of octets that will
+ * be added to an RTP packet by the SRTP processing.  This value
+ * is constant for a given srtp_stream_t (i.e. between initializations).
+ */
+
+int
+srtp_get_trailer_length(const srtp_stream_t s) {
+  return srtp_auth_get_tag_length(s->rtp_auth);
+}
+
+#endif
+
+/*
+ * the stream hash table indexes the streams in a session by SSRC, so
+ * that srtp_get_stream() runs in constant time rather than walking
+ * the stream list; the table starts out small and doubles in size
+ * whenever the number of streams exceeds twice the bucket count
+ *
+ * the stream list remains the canonical store of the streams in the
+ * session - if a bucket array can't be allocated, lookups simply fall
+ * back to the list walk, so an allocation failure here is not fatal
+ */
+
+#define SRTP_STREAM_HASH_MIN_BUCKETS 16
+
+static inline unsigned int
+srtp_stream_hash_bucket(uint32_t ssrc, unsigned int buckets) {
+  /* multiplicative hash; ssrc is used in network byte order, and
+     buckets is always a power of two */
+  return (unsigned int)(ssrc * 0x9e3779b1UL) & (buckets - 1);
+}
+
+static void
+srtp_stream_hash_grow(srtp_t srtp, unsigned int new_buckets) {
+  srtp_stream_hash_t *new_hash;
+  srtp_stream_ctx_t *stream;
+  unsigned int i;
+
+  /* growing the lookup table is stream setup, exempt from the guard */
+  srtp_crypto_alloc_guard_suspend();
+  new_hash = (srtp_stream_hash_t *)
+    srtp_crypto_alloc(sizeof(srtp_stream_hash_t) +
+                      (new_buckets - 1) * sizeof(srtp_stream_ctx_t *));
+  srtp_crypto_alloc_guard_resume();
+  if (new_hash == NULL)
+    return;  /* keep the old table (or the list walk) - still correct */
+
+  new_hash->buckets = new_buckets;
+  for (i = 0; i < new_buckets; i++)
+    new_hash->bucket[i] = NULL;
+
+  /* rehash every stream on the list into the new bucket array */
+  for (stream = srtp->stream_list; stream != NULL; stream = stream->next) {
+    i = srtp_stream_hash_bucket(stream->ssrc, new_buckets);
+    stream->next_hash = new_hash->bucket[i];
+    new_hash->bucket[i] = stream;
+  }
+
+  /*
+   * publish the new table and retire its predecessor; the old table
+   * cannot be freed here since a concurrent reader may still be
+   * traversing it, so it is kept until the session is deallocated
+   */
+  new_hash->retired = srtp->stream_hash;
+  srtp_store_ptr_release(&srtp->stream_hash, new_hash);
+}
+
+/*
+ * the SSRC filter (see srtp_priv.h) maps each SSRC to two counters
+ * with independent multiplicative hashes; a stream increments both
+ * counters on insertion and decrements them on removal, saturating at
+ * 255, and an SSRC whose counters are not both nonzero is guaranteed
+ * not to belong to any stream in the session
+ */
+
+static inline unsigned int
+srtp_ssrc_filter_slot1(uint32_t ssrc) {
+  return (unsigned int)((ssrc * 0x9e3779b1UL) >> 24) &
+         (SRTP_SSRC_FILTER_SIZE - 1);
+}
+
+static inline unsigned int
+srtp_ssrc_filter_slot2(uint32_t ssrc) {
+  return (unsigned int)((ssrc * 0x85ebca6bUL) >> 16) &
+         (SRTP_SSRC_FILTER_SIZE - 1);
+}
+
+static void
+srtp_ssrc_filter_add(srtp_t srtp, uint32_t ssrc) {
+  unsigned int s1 = srtp_ssrc_filter_slot1(ssrc);
+  unsigned int s2 = srtp_ssrc_filter_slot2(ssrc);
+
+  if (srtp->ssrc_filter[s1] < 255)
+    srtp->ssrc_filter[s1]++;
+  if (srtp->ssrc_filter[s2] < 255)
+    srtp->ssrc_filter[s2]++;
+}
+
+static void
+srtp_ssrc_filter_remove(srtp_t srtp, uint32_t ssrc) {
+  unsigned int s1 = srtp_ssrc_filter_slot1(ssrc);
+  unsigned int s2 = srtp_ssrc_filter_slot2(ssrc);
+
+  /* a saturated counter is left alone, so over-counting is the only
+     possible error and the filter never reports a false negative */
+  if (srtp->ssrc_filter[s1] > 0 && srtp->ssrc_filter[s1] < 255)
+    srtp->ssrc_filter[s1]--;
+  if (srtp->ssrc_filter[s2] > 0 && srtp->ssrc_filter[s2] < 255)
+    srtp->ssrc_filter[s2]--;
+}
+
+static inline int
+srtp_ssrc_filter_test(const srtp_t srtp, uint32_t ssrc) {
+  return srtp->ssrc_filter[srtp_ssrc_filter_slot1(ssrc)] != 0 &&
+         srtp->ssrc_filter[srtp_ssrc_filter_slot2(ssrc)] != 0;
+}
+
+/*
+ * srtp_stream_list_insert(session, stream) adds a stream to the head
+ * of the session's stream list and indexes it in the hash table; all
+ * stream insertions go through this function
+ */
+static void
+srtp_stream_list_insert(srtp_t srtp, srtp_stream_ctx_t *stream) {
+  unsigned int i;
+
+  stream->next = srtp->stream_list;
+  srtp_store_ptr_release(&srtp->stream_list, stream);
+  srtp->stream_count++;
+  srtp_ssrc_filter_add(srtp, stream->ssrc);
+
+  /* account streams cloned from the template against its budget */
+  if (srtp->stream_template != NULL &&
+      stream->session_keys == srtp->stream_template->session_keys)
+    srtp->template_stream_count++;
+
+  /*
+   * index the stream in the current table first - growing afterwards
+   * rebuilds the chains from the stream list, which already holds the
+   * new stream, so indexing after a grow would link it to itself
+   */
+  if (srtp->stream_hash) {
+    i = srtp_stream_hash_bucket(stream->ssrc, srtp->stream_hash->buckets);
+    stream->next_hash = srtp->stream_hash->bucket[i];
+    srtp_store_ptr_release(&srtp->stream_hash->bucket[i], stream);
+  }
+
+  /* grow (or create) the hash table when the load factor exceeds two */
+  if (srtp->stream_count > 2 *
+      (srtp->stream_hash ? srtp->stream_hash->buckets : 0)) {
+    unsigned int new_buckets = srtp->stream_hash ?
+      2 * srtp->stream_hash->buckets : SRTP_STREAM_HASH_MIN_BUCKETS;
+    srtp_stream_hash_grow(srtp, new_buckets);
+  }
+}
+
+/*
+ * srtp_stream_hash_remove(session, stream) removes a stream from the
+ * hash table (but not from the stream list)
+ */
+static void
+srtp_stream_hash_remove(srtp_t srtp, srtp_stream_ctx_t *stream) {
+  srtp_stream_ctx_t **cursor;
+  unsigned int i;
+
+  if (srtp->stream_hash == NULL)
+    return;
+
+  i = srtp_stream_hash_bucket(stream->ssrc, srtp->stream_hash->buckets);
+  for (cursor = &srtp->stream_hash->bucket[i]; *cursor != NULL;
+       cursor = &(*cursor)->next_hash) {
+    if (*cursor == stream) {
+      *cursor = stream->next_hash;
+      stream->next_hash = NULL;
+      return;
+    }
+  }
+}
+
+/*
+ * srtp_get_stream(ssrc) returns a pointer to the stream corresponding
+ * to ssrc, or NULL if no stream exists for that ssrc
+ *
+ * this is an internal function
+ */
+
+srtp_stream_ctx_t *
+srtp_get_stream(srtp_t srtp, uint32_t ssrc) {
+  srtp_stream_hash_t *hash = srtp_load_ptr_acquire(&srtp->stream_hash);
+  srtp_stream_ctx_t *stream;
+
+  if (hash) {
+    /* walk down the (short) hash bucket chain */
+    stream = srtp_load_ptr_acquire(
+        &hash->bucket[srtp_stream_hash_bucket(ssrc, hash->buckets)]);
+    while (stream != NULL) {
+      if (stream->ssrc == ssrc)
+        return stream;
+      stream = stream->next_hash;
+    }
+    /*
+     * a miss in the hash is not authoritative: a concurrent grow may
+     * have rechained the bucket we just walked, so fall through to
+     * the canonical stream list, whose head-insertion order is always
+     * safe to traverse
+     */
+  }
+
+  /* walk down list until ssrc is found */
+  stream = srtp_load_ptr_acquire(&srtp->stream_list);
+  while (stream != NULL) {
+    if (stream->ssrc == ssrc)
+      return stream;
+    stream = stream->next;
+  }
+
+  /* we haven't found our ssrc, so return a null */
+  return NULL;
+}
+
+/* defined with the session-group implementation below */
+static void srtp_group_unlink_session(srtp_group_ctx_t_ *group,
+                                      srtp_ctx_t *session);
+
+srtp_err_status_t
+srtp_dealloc(srtp_t session) {
+  srtp_stream_ctx_t *stream;
+  srtp_err_status_t status;
+
+  /*
+   * we take a conservative deallocation strategy - if we encounter an
+   * error deallocating a stream, then we stop trying to deallocate
+   * memory and just return an error
+   */
+
+  /* close any hardware offload key handles before the keys go away */
+  if (session->offload != NULL)
+    srtp_offload_detach(session);
+
+  /* a group member does not own its template; unlink from the group */
+  if (session->group != NULL)
+    srtp_group_unlink_session(session->group, session);
+
+  /* walk list of streams, deallocating as we go */
+  stream = session->stream_list;
+  while (stream != NULL) {
+    srtp_stream_t next = stream->next;
+    status = srtp_stream_dealloc(stream, session->stream_template);
+    if (status)
+      return status;
+    stream = next;
+  }
+  
+  /* deallocate recycled streams on the free list */
+  stream = session->stream_free_list;
+  while (stream != NULL) {
+    srtp_stream_t next = stream->next;
+    status = srtp_stream_dealloc(stream, session->stream_template);
+    if (status)
+      return status;
+    stream = next;
+  }
+
+  /* deallocate stream template, if this session owns one (a group's
+   * shared template outlives its member sessions) */
+  if (session->stream_template != NULL && session->group == NULL) {
+    status = srtp_stream_dealloc(session->stream_template, NULL);
+    if (status)
+      return status;
+  }
+
+  /* deallocate the stream hash table and any retired predecessors */
+  while (session->stream_hash != NULL) {
+    srtp_stream_hash_t *retired = session->stream_hash->retired;
+    srtp_crypto_free(session->stream_hash);
+    session->stream_hash = retired;
+  }
+
+  /* deallocate session context */
+  srtp_crypto_free(session);
+
+  return srtp_err_status_ok;
+}
+
+
+srtp_err_status_t
+srtp_add_stream(srtp_t session, 
+		const srtp_policy_t *policy)  {
+  srtp_err_status_t status;
+  srtp_stream_t tmp;
+
+  /* sanity check arguments */
+  if ((session == NULL) || (policy == NULL) || (!srtp_validate_policy_master_keys(policy)))
+    return srtp_err_status_bad_param;
+
+  /* allocate stream  */
+  status = srtp_stream_alloc(&tmp, policy);
+  if (status) {
+    return status;
+  }
+  
+  /* initialize stream  */
+  status = srtp_stream_init(tmp, policy);
+  if (status) {
+    srtp_crypto_free(tmp);
+    return status;
+  }
+  
+  /* 
+   * set the head of the stream list or the template to point to the
+   * stream that we've just alloced and init'ed, depending on whether
+   * or not it has a wildcard SSRC value or not
+   *
    * if the template stream has already been set, then the policy is
    * inconsistent, so we return a bad_param error code
    */
-  switch (policy->ssrc.type) {
-  case (ssrc_any_outbound):
-    if (session->stream_template) {
-      return srtp_err_status_bad_param;
+  switch (policy->ssrc.type) {
+  case (ssrc_any_outbound):
+    if (session->stream_template) {
+      return srtp_err_status_bad_param;
+    }
+    session->stream_template = tmp;
+    session->stream_template->direction = dir_srtp_sender;
+    session->max_template_streams = (unsigned int)policy->max_template_streams;
+    break;
+  case (ssrc_any_inbound):
+    if (session->stream_template) {
+      return srtp_err_status_bad_param;
+    }
+    session->stream_template = tmp;
+    session->stream_template->direction = dir_srtp_receiver;
+    session->max_template_streams = (unsigned int)policy->max_template_streams;
+    break;
+  case (ssrc_specific):
+    srtp_stream_list_insert(session, tmp);
+    break;
+  case (ssrc_undefined):
+  default:
+    srtp_crypto_free(tmp);
+    return srtp_err_status_bad_param;
+  }
+
+  /* open an offload key handle for the new stream, if a provider is
+   * attached; a stream the provider cannot serve stays in software */
+  if (session->offload != NULL)
+    srtp_stream_offload_open(session, tmp);
+
+  return srtp_err_status_ok;
+}
+
+
+srtp_err_status_t
+srtp_create(srtp_t *session,               /* handle for session     */ 
+	    const srtp_policy_t *policy) { /* SRTP policy (list)     */
+  srtp_err_status_t stat;
+  srtp_ctx_t *ctx;
+
+  /* sanity check arguments */
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+
+  /* allocate srtp context and set ctx_ptr */
+  ctx = (srtp_ctx_t *) srtp_crypto_alloc(sizeof(srtp_ctx_t));
+  if (ctx == NULL)
+    return srtp_err_status_alloc_fail;
+  *session = ctx;
+
+  /* 
+   * loop over elements in the policy list, allocating and
+   * initializing a stream for each element
+   */
+  ctx->stream_template = NULL;
+  ctx->stream_list = NULL;
+  ctx->user_data = NULL;
+  ctx->stream_hash = NULL;
+  ctx->stream_count = 0;
+  ctx->stream_free_list = NULL;
+  memset(ctx->ssrc_filter, 0, sizeof(ctx->ssrc_filter));
+  ctx->template_stream_count = 0;
+  ctx->max_template_streams = 0;
+  ctx->deterministic_latency = 0;
+  ctx->roc_recovery_window = 0;
+  ctx->offload = NULL;
+  ctx->group = NULL;
+  ctx->group_next = NULL;
+  while (policy != NULL) {
+
+    stat = srtp_add_stream(ctx, policy);
+    if (stat) {
+      /* clean up everything */
+      srtp_dealloc(*session);
+      *session = NULL;
+      return stat;
+    }    
+
+    /* set policy to next item in list  */
+    policy = policy->next;
+  }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_create_ex(srtp_t *session, const srtp_policy_t *policy,
+               unsigned int expected_streams) {
+  srtp_err_status_t stat;
+  srtp_ctx_t *ctx;
+  unsigned int buckets, i;
+
+  stat = srtp_create(session, policy);
+  if (stat)
+    return stat;
+  if (expected_streams == 0)
+    return srtp_err_status_ok;
+  ctx = *session;
+
+  /*
+   * build the SSRC lookup table at its final size up front, so the
+   * join storm does not trigger a cascade of rehashes
+   */
+  buckets = SRTP_STREAM_HASH_MIN_BUCKETS;
+  while (buckets < expected_streams)
+    buckets *= 2;
+  if (ctx->stream_hash == NULL || ctx->stream_hash->buckets < buckets)
+    srtp_stream_hash_grow(ctx, buckets);
+
+  /*
+   * when the session holds a wildcard template, prefill the free list
+   * with clones of it; their allocations are done and their session
+   * keys (shared with the template) are already derived, so the
+   * per-packet clone path reduces to recycling a context.  the SSRC
+   * placed here is irrelevant - it is overwritten when the clone is
+   * put into service
+   */
+  if (ctx->stream_template != NULL) {
+    for (i = 0; i < expected_streams; i++) {
+      srtp_stream_ctx_t *str;
+
+      stat = srtp_stream_clone(ctx->stream_template, 0, &str);
+      if (stat) {
+        srtp_dealloc(*session);
+        *session = NULL;
+        return stat;
+      }
+      srtp_stream_recycle(ctx, str);
+    }
+  }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_set_deterministic_latency(srtp_t session, int enable) {
+
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+
+  session->deterministic_latency = enable ? 1 : 0;
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_set_roc_recovery_window(srtp_t session, uint32_t window) {
+
+  if (session == NULL || window > 0xffff)
+    return srtp_err_status_bad_param;
+
+  session->roc_recovery_window = window;
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_set_adaptive_replay_window(srtp_t session, unsigned long max_window_size) {
+  srtp_stream_ctx_t *stream;
+  srtp_err_status_t status;
+
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+  if (max_window_size != 0 &&
+      (max_window_size < SRTP_RDBX_ADAPTIVE_START_WINDOW ||
+       max_window_size >= 0x8000))
+    return srtp_err_status_bad_param;
+
+  /*
+   * convert every stream's replay window, including the template's;
+   * streams cloned from the template later inherit its limit and
+   * start small again
+   */
+  if (session->stream_template != NULL) {
+    status = srtp_rdbx_set_adaptive(&session->stream_template->rtp_rdbx,
+                                    max_window_size);
+    if (status)
+      return status;
+  }
+  for (stream = session->stream_list; stream != NULL; stream = stream->next) {
+    status = srtp_rdbx_set_adaptive(&stream->rtp_rdbx, max_window_size);
+    if (status)
+      return status;
+  }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_stream_set_thread_cipher_pool(srtp_t session, uint32_t ssrc,
+                                   unsigned int count) {
+  srtp_stream_ctx_t *stream;
+  srtp_session_keys_t *base;
+  srtp_err_status_t status;
+  unsigned int i;
+
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+
+  stream = srtp_get_stream(session, ssrc);
+  if (stream == NULL)
+    return srtp_err_status_no_ctx;
+
+  /* the pool replicates the first master key only */
+  if (stream->num_master_keys != 1)
+    return srtp_err_status_bad_param;
+
+  /* replace (or, for a count of zero, simply remove) any existing pool */
+  status = srtp_stream_free_thread_pool(stream);
+  if (status)
+    return status;
+  if (count == 0)
+    return srtp_err_status_ok;
+
+  stream->thread_keys = (srtp_session_keys_t *)
+      srtp_crypto_alloc(sizeof(srtp_session_keys_t) * count);
+  if (stream->thread_keys == NULL)
+    return srtp_err_status_alloc_fail;
+
+  base = &stream->session_keys[0];
+  for (i = 0; i < count; i++) {
+    srtp_session_keys_t *session_keys = &stream->thread_keys[i];
+
+    /*
+     * start from a structure copy - the salts, the deferred-derivation
+     * state and the shared key-limit and mki pointers carry over -
+     * then replace the cipher and auth contexts with private replicas
+     */
+    *session_keys = *base;
+    session_keys->rtp_cipher = NULL;
+    session_keys->rtp_auth = NULL;
+    session_keys->rtp_xtn_hdr_cipher = NULL;
+    session_keys->rtcp_cipher = NULL;
+    session_keys->rtcp_auth = NULL;
+
+    status = srtp_cipher_clone(base->rtp_cipher, &session_keys->rtp_cipher);
+    if (status == srtp_err_status_ok)
+      status = srtp_auth_clone(base->rtp_auth, &session_keys->rtp_auth);
+    if (status == srtp_err_status_ok && base->rtp_xtn_hdr_cipher != NULL)
+      status = srtp_cipher_clone(base->rtp_xtn_hdr_cipher,
+                                 &session_keys->rtp_xtn_hdr_cipher);
+    if (status == srtp_err_status_ok)
+      status = srtp_cipher_clone(base->rtcp_cipher,
+                                 &session_keys->rtcp_cipher);
+    if (status == srtp_err_status_ok)
+      status = srtp_auth_clone(base->rtcp_auth, &session_keys->rtcp_auth);
+
+    if (status) {
+      /* free the partial entry, then the complete ones below it */
+      if (session_keys->rtp_cipher)
+        (void) srtp_cipher_dealloc(session_keys->rtp_cipher);
+      if (session_keys->rtp_auth)
+        (void) srtp_auth_dealloc(session_keys->rtp_auth);
+      if (session_keys->rtp_xtn_hdr_cipher)
+        (void) srtp_cipher_dealloc(session_keys->rtp_xtn_hdr_cipher);
+      if (session_keys->rtcp_cipher)
+        (void) srtp_cipher_dealloc(session_keys->rtcp_cipher);
+      (void) srtp_stream_free_thread_pool(stream);
+      return status;
+    }
+    stream->thread_keys_count = i + 1;
+  }
+
+  return srtp_err_status_ok;
+}
+
+
+srtp_err_status_t
+srtp_remove_stream(srtp_t session, uint32_t ssrc) {
+  srtp_stream_ctx_t *stream, *last_stream;
+  srtp_err_status_t status;
+
+  /* sanity check arguments */
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+  
+  /* find stream in list; complain if not found */
+  last_stream = stream = session->stream_list;
+  while ((stream != NULL) && (ssrc != stream->ssrc)) {
+    last_stream = stream;
+    stream = stream->next;
+  }
+  if (stream == NULL)
+    return srtp_err_status_no_ctx;
+
+  /* remove stream from the list */
+  if (last_stream == stream)
+    /* stream was first in list */
+    session->stream_list = stream->next;
+  else
+    last_stream->next = stream->next;
+  session->stream_count--;
+
+  /* remove stream from the hash table as well */
+  srtp_stream_hash_remove(session, stream);
+  srtp_ssrc_filter_remove(session, stream->ssrc);
+
+  /* release the template budget held by a template-derived stream */
+  if (session->stream_template != NULL &&
+      stream->session_keys == session->stream_template->session_keys &&
+      session->template_stream_count > 0)
+    session->template_stream_count--;
+
+  /*
+   * recycle clones of the session template so that a later clone can
+   * reuse their allocations; deallocate everything else
+   */
+  if (session->stream_template
+      && stream->num_master_keys == session->stream_template->num_master_keys
+      && stream->session_keys[0].rtp_cipher ==
+         session->stream_template->session_keys[0].rtp_cipher) {
+    srtp_stream_recycle(session, stream);
+  } else {
+    status = srtp_stream_dealloc(stream, session->stream_template);
+    if (status)
+      return status;
+  }
+
+  return srtp_err_status_ok;
+}
+
+
+srtp_err_status_t
+srtp_update(srtp_t session, const srtp_policy_t *policy) {
+  srtp_err_status_t stat;
+
+  /* sanity check arguments */
+  if ((session == NULL) || (policy == NULL) || (!srtp_validate_policy_master_keys(policy))) {
+    return srtp_err_status_bad_param;
+  }
+
+  while (policy != NULL) {
+    stat = srtp_update_stream(session, policy);
+    if (stat) {
+      return stat;
+    }
+
+    /* set policy to next item in list  */
+    policy = policy->next;
+  }
+  return srtp_err_status_ok;
+}
+
+
+static srtp_err_status_t
+update_template_streams(srtp_t session, const srtp_policy_t *policy) {
+  srtp_err_status_t status;
+  srtp_stream_t new_stream_template;
+  srtp_stream_t new_stream_list = NULL;
+
+  if (session->stream_template == NULL) {
+    return srtp_err_status_bad_param;
+  }
+
+  /* allocate new template stream  */
+  status = srtp_stream_alloc(&new_stream_template, policy);
+  if (status) {
+    return status;
+  }
+
+  /* initialize new template stream  */
+  status = srtp_stream_init(new_stream_template, policy);
+  if (status) {
+    srtp_crypto_free(new_stream_template);
+    return status;
+  }
+
+  /* for all old templated streams */
+  for (;;) {
+    srtp_stream_t stream;
+    uint32_t ssrc;
+    srtp_xtd_seq_num_t old_index;
+    srtp_rdb_t old_rtcp_rdb;
+
+    stream = session->stream_list;
+    while ((stream != NULL) &&
+           (stream->session_keys[0].rtp_auth !=
+            session->stream_template->session_keys[0].rtp_auth)) {
+      stream = stream->next;
+    }
+    if (stream == NULL) {
+      /* no more templated streams */
+      break;
+    }
+
+    /* save old extendard seq */
+    ssrc = stream->ssrc;
+    old_index = stream->rtp_rdbx.index;
+    old_rtcp_rdb = stream->rtcp_rdb;
+
+    /* remove stream */
+    status = srtp_remove_stream(session, ssrc);
+    if (status) {
+      /* free new allocations */
+      while (new_stream_list != NULL) {
+        srtp_stream_t next = new_stream_list->next;
+        srtp_stream_dealloc(new_stream_list, new_stream_template);
+        new_stream_list = next;
+      }
+      srtp_stream_dealloc(new_stream_template, NULL);
+      return status;
+    }
+
+    /* allocate and initialize a new stream */
+    status = srtp_stream_clone(new_stream_template, ssrc, &stream);
+    if (status) {
+      /* free new allocations */
+      while (new_stream_list != NULL) {
+        srtp_stream_t next = new_stream_list->next;
+        srtp_stream_dealloc(new_stream_list, new_stream_template);
+        new_stream_list = next;
+      }
+      srtp_stream_dealloc(new_stream_template, NULL);
+      return status;
+    }
+
+    /* add new stream to the head of the new_stream_list */
+    stream->next = new_stream_list;
+    new_stream_list = stream;
+
+    /* restore old extended seq */
+    stream->rtp_rdbx.index = old_index;
+    stream->rtcp_rdb = old_rtcp_rdb;
+  }
+  /*
+   * the free list holds clones of the old template; flush it before
+   * the template is replaced
+   */
+  while (session->stream_free_list != NULL) {
+    srtp_stream_t next = session->stream_free_list->next;
+    srtp_stream_dealloc(session->stream_free_list, session->stream_template);
+    session->stream_free_list = next;
+  }
+  /* dealloc old template */
+  srtp_stream_dealloc(session->stream_template, NULL);
+  /* set new template */
+  session->stream_template = new_stream_template;
+  session->max_template_streams = (unsigned int)policy->max_template_streams;
+  /* add new list */
+  while (new_stream_list) {
+    srtp_stream_t next = new_stream_list->next;
+    srtp_stream_list_insert(session, new_stream_list);
+    new_stream_list = next;
+  }
+  return status;
+}
+
+
+static srtp_err_status_t
+update_stream(srtp_t session, const srtp_policy_t *policy) {
+  srtp_err_status_t status;
+  srtp_xtd_seq_num_t old_index;
+  srtp_rdb_t old_rtcp_rdb;
+  srtp_stream_t stream;
+
+  stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+  if (stream == NULL) {
+    return srtp_err_status_bad_param;
+  }
+
+  /* save old extendard seq */
+  old_index = stream->rtp_rdbx.index;
+  old_rtcp_rdb = stream->rtcp_rdb;
+
+  status = srtp_remove_stream(session, htonl(policy->ssrc.value));
+  if (status) {
+    return status;
+  }
+
+  status = srtp_add_stream(session, policy);
+  if (status) {
+    return status;
+  }
+
+  stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+  if (stream == NULL) {
+    return srtp_err_status_fail;
+  }
+
+  /* restore old extended seq */
+  stream->rtp_rdbx.index = old_index;
+  stream->rtcp_rdb = old_rtcp_rdb;
+
+  return srtp_err_status_ok;
+}
+
+
+srtp_err_status_t
+srtp_update_stream(srtp_t session, const srtp_policy_t *policy) {
+  srtp_err_status_t status;
+
+  /* sanity check arguments */
+  if ((session == NULL) || (policy == NULL) || (!srtp_validate_policy_master_keys(policy)))
+    return srtp_err_status_bad_param;
+
+  switch (policy->ssrc.type) {
+  case (ssrc_any_outbound):
+  case (ssrc_any_inbound):
+    status = update_template_streams(session, policy);
+    break;
+  case (ssrc_specific):
+    status = update_stream(session, policy);
+    break;
+  case (ssrc_undefined):
+  default:
+    return srtp_err_status_bad_param;
+  }
+
+  return status;
+}
+
+
+/*
+ * session groups (see the SessionGroups section of srtp.h)
+ *
+ * a group owns one template stream; member sessions point their
+ * stream_template at it and never own it, so the ordinary
+ * template-sharing machinery (srtp_stream_clone() and the template
+ * checks in srtp_stream_dealloc()) keeps working unchanged inside
+ * each member
+ */
+
+static void srtp_stream_stats_accumulate(srtp_session_stats_t *sum,
+                                         const srtp_stream_ctx_t *stream);
+
+static void
+srtp_group_unlink_session(srtp_group_ctx_t_ *group, srtp_ctx_t *session) {
+  srtp_ctx_t **cursor = &group->sessions;
+
+  while (*cursor != NULL) {
+    if (*cursor == session) {
+      *cursor = session->group_next;
+      group->num_sessions--;
+      return;
+    }
+    cursor = &(*cursor)->group_next;
+  }
+}
+
+/*
+ * srtp_group_alloc_template(policy, template_ptr, octets_ptr) builds
+ * a group's shared template from a single wildcard policy element and
+ * measures its heap footprint for the group's memory accounting
+ */
+static srtp_err_status_t
+srtp_group_alloc_template(const srtp_policy_t *policy,
+                          srtp_stream_ctx_t **template_ptr,
+                          size_t *octets_ptr) {
+  srtp_err_status_t status;
+  srtp_stream_ctx_t *tmpl;
+  size_t before;
+
+  if (policy->next != NULL ||
+      (policy->ssrc.type != ssrc_any_inbound &&
+       policy->ssrc.type != ssrc_any_outbound))
+    return srtp_err_status_bad_param;
+
+  before = srtp_crypto_alloc_octets_outstanding();
+
+  status = srtp_stream_alloc(&tmpl, policy);
+  if (status)
+    return status;
+  status = srtp_stream_init(tmpl, policy);
+  if (status) {
+    srtp_crypto_free(tmpl);
+    return status;
+  }
+  tmpl->direction = (policy->ssrc.type == ssrc_any_outbound)
+                        ? dir_srtp_sender : dir_srtp_receiver;
+
+  *template_ptr = tmpl;
+  *octets_ptr = srtp_crypto_alloc_octets_outstanding() - before;
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_group_create(srtp_group_t *group, const srtp_policy_t *policy) {
+  srtp_err_status_t status;
+  srtp_group_ctx_t_ *g;
+
+  if (group == NULL || policy == NULL ||
+      !srtp_validate_policy_master_keys(policy))
+    return srtp_err_status_bad_param;
+
+  g = (srtp_group_ctx_t_ *)srtp_crypto_alloc(sizeof(srtp_group_ctx_t_));
+  if (g == NULL)
+    return srtp_err_status_alloc_fail;
+
+  status = srtp_group_alloc_template(policy, &g->stream_template,
+                                     &g->template_octets);
+  if (status) {
+    srtp_crypto_free(g);
+    return status;
+  }
+  g->sessions = NULL;
+  g->num_sessions = 0;
+  g->max_template_streams = (unsigned int)policy->max_template_streams;
+
+  *group = g;
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_group_add_session(srtp_group_t group, srtp_t *session) {
+  srtp_err_status_t status;
+
+  if (group == NULL || session == NULL)
+    return srtp_err_status_bad_param;
+
+  status = srtp_create(session, NULL);
+  if (status)
+    return status;
+
+  (*session)->stream_template = group->stream_template;
+  (*session)->max_template_streams = group->max_template_streams;
+  (*session)->group = group;
+  (*session)->group_next = group->sessions;
+  group->sessions = *session;
+  group->num_sessions++;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_group_remove_session(srtp_group_t group, srtp_t session) {
+  if (group == NULL || session == NULL || session->group != group)
+    return srtp_err_status_bad_param;
+
+  /* srtp_dealloc() unlinks the member and leaves the template alone */
+  return srtp_dealloc(session);
+}
+
+srtp_err_status_t
+srtp_group_update(srtp_group_t group, const srtp_policy_t *policy) {
+  srtp_err_status_t status;
+  srtp_stream_ctx_t *new_template;
+  srtp_stream_ctx_t *old_template;
+  srtp_stream_ctx_t **pending;
+  size_t new_octets;
+  srtp_ctx_t *session;
+  srtp_stream_ctx_t *stream;
+  unsigned int i;
+
+  if (group == NULL || policy == NULL ||
+      !srtp_validate_policy_master_keys(policy))
+    return srtp_err_status_bad_param;
+
+  status = srtp_group_alloc_template(policy, &new_template, &new_octets);
+  if (status)
+    return status;
+
+  old_template = group->stream_template;
+
+  /*
+   * phase one: clone a replacement for every templated stream of
+   * every member session, without touching the sessions yet; an
+   * allocation failure here leaves the whole group unchanged
+   */
+  pending = (srtp_stream_ctx_t **)srtp_crypto_alloc(
+      (group->num_sessions ? group->num_sessions : 1) *
+      sizeof(srtp_stream_ctx_t *));
+  if (pending == NULL) {
+    srtp_stream_dealloc(new_template, NULL);
+    return srtp_err_status_alloc_fail;
+  }
+  for (i = 0; i < group->num_sessions; i++)
+    pending[i] = NULL;
+
+  for (session = group->sessions, i = 0; session != NULL;
+       session = session->group_next, i++) {
+    for (stream = session->stream_list; stream != NULL;
+         stream = stream->next) {
+      srtp_stream_ctx_t *new_stream;
+
+      if (stream->session_keys[0].rtp_auth !=
+          old_template->session_keys[0].rtp_auth)
+        continue;  /* not derived from the shared template */
+
+      status = srtp_stream_clone(new_template, stream->ssrc, &new_stream);
+      if (status) {
+        /* free everything cloned so far; the group is untouched */
+        for (i = 0; i < group->num_sessions; i++) {
+          while (pending[i] != NULL) {
+            srtp_stream_ctx_t *next = pending[i]->next;
+            srtp_stream_dealloc(pending[i], new_template);
+            pending[i] = next;
+          }
+        }
+        srtp_stream_dealloc(new_template, NULL);
+        srtp_crypto_free(pending);
+        return status;
+      }
+
+      /* preserve the stream's packet index and replay state */
+      new_stream->rtp_rdbx.index = stream->rtp_rdbx.index;
+      new_stream->rtcp_rdb = stream->rtcp_rdb;
+
+      new_stream->next = pending[i];
+      pending[i] = new_stream;
+    }
+  }
+
+  /*
+   * phase two: swap each member over to the new template, replacing
+   * its templated streams with the prepared clones
+   */
+  for (session = group->sessions, i = 0; session != NULL;
+       session = session->group_next, i++) {
+    while (pending[i] != NULL) {
+      srtp_stream_ctx_t *new_stream = pending[i];
+
+      pending[i] = new_stream->next;
+      status = srtp_remove_stream(session, new_stream->ssrc);
+      if (status) {
+        srtp_stream_dealloc(new_stream, new_template);
+        srtp_crypto_free(pending);
+        return status;
+      }
+      srtp_stream_list_insert(session, new_stream);
+      session->template_stream_count++;
     }
-    session->stream_template = tmp;
-    session->stream_template->direction = dir_srtp_sender;
-    break;
-  case (ssrc_any_inbound):
-    if (session->stream_template) {
-      return srtp_err_status_bad_param;
+    /* the free list holds recycled clones of the old template */
+    while (session->stream_free_list != NULL) {
+      srtp_stream_ctx_t *next = session->stream_free_list->next;
+
+      srtp_stream_dealloc(session->stream_free_list, old_template);
+      session->stream_free_list = next;
     }
-    session->stream_template = tmp;
-    session->stream_template->direction = dir_srtp_receiver;
-    break;
-  case (ssrc_specific):
-    tmp->next = session->stream_list;
-    session->stream_list = tmp;
-    break;
-  case (ssrc_undefined):
-  default:
-    srtp_crypto_free(tmp);
-    return srtp_err_status_bad_param;
+    session->stream_template = new_template;
+    session->max_template_streams = (unsigned int)policy->max_template_streams;
   }
-    
+
+  srtp_crypto_free(pending);
+
+  status = srtp_stream_dealloc(old_template, NULL);
+  if (status)
+    return status;
+
+  group->stream_template = new_template;
+  group->template_octets = new_octets;
+  group->max_template_streams = (unsigned int)policy->max_template_streams;
   return srtp_err_status_ok;
 }
 
+srtp_err_status_t
+srtp_group_get_stats(srtp_group_t group, srtp_group_stats_t *stats) {
+  srtp_ctx_t *session;
+  srtp_stream_ctx_t *stream;
+
+  if (group == NULL || stats == NULL)
+    return srtp_err_status_bad_param;
+
+  memset(stats, 0, sizeof(*stats));
+
+  /* the shared template is counted exactly once */
+  srtp_stream_stats_accumulate(&stats->totals, group->stream_template);
+
+  for (session = group->sessions; session != NULL;
+       session = session->group_next) {
+    stats->num_sessions++;
+    for (stream = srtp_load_ptr_acquire(&session->stream_list);
+         stream != NULL; stream = stream->next) {
+      srtp_stream_stats_accumulate(&stats->totals, stream);
+      stats->totals.stream_count++;
+    }
+  }
+
+  stats->template_octets = group->template_octets;
+  if (stats->num_sessions > 1)
+    stats->octets_saved = (stats->num_sessions - 1) * group->template_octets;
+
+  return srtp_err_status_ok;
+}
 
 srtp_err_status_t
-srtp_create(srtp_t *session,               /* handle for session     */ 
-	    const srtp_policy_t *policy) { /* SRTP policy (list)     */
-  srtp_err_status_t stat;
-  srtp_ctx_t *ctx;
+srtp_group_dealloc(srtp_group_t group) {
+  srtp_err_status_t status;
+
+  if (group == NULL)
+    return srtp_err_status_bad_param;
+
+  /* deallocate any member sessions still in the group */
+  while (group->sessions != NULL) {
+    status = srtp_dealloc(group->sessions);
+    if (status)
+      return status;
+  }
+
+  status = srtp_stream_dealloc(group->stream_template, NULL);
+  if (status)
+    return status;
+
+  srtp_crypto_free(group);
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_rekey_stream_install(session, policy, watermark) implements
+ * the double-buffered rekey: the new session keys are built with the
+ * normal stream setup path, published in place of the old ones, and
+ * the old ones are parked on the stream until the replay window
+ * drains past the watermark
+ */
+static srtp_err_status_t
+srtp_rekey_stream_install(srtp_t session, const srtp_policy_t *policy,
+                          srtp_xtd_seq_num_t watermark) {
+  srtp_err_status_t status;
+  srtp_stream_t stream;
+  srtp_stream_t holder;
 
   /* sanity check arguments */
-  if (session == NULL)
+  if ((session == NULL) || (policy == NULL) ||
+      (!srtp_validate_policy_master_keys(policy)))
     return srtp_err_status_bad_param;
 
-  /* allocate srtp context and set ctx_ptr */
-  ctx = (srtp_ctx_t *) srtp_crypto_alloc(sizeof(srtp_ctx_t));
-  if (ctx == NULL)
-    return srtp_err_status_alloc_fail;
-  *session = ctx;
+  /*
+   * the watermark selects between exactly two single-key arrays;
+   * streams carrying an MKI already select keys per packet by MKI
+   */
+  if (policy->ssrc.type != ssrc_specific || policy->key == NULL)
+    return srtp_err_status_bad_param;
 
-  /* 
-   * loop over elements in the policy list, allocating and
-   * initializing a stream for each element
+  stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+  if (stream == NULL || stream->num_master_keys != 1)
+    return srtp_err_status_bad_param;
+
+  /*
+   * streams cloned from the wildcard template share their key array
+   * with the template; retiring it here would pull the keys out from
+   * under every other clone
    */
-  ctx->stream_template = NULL;
-  ctx->stream_list = NULL;
-  ctx->user_data = NULL;
-  while (policy != NULL) {    
+  if (session->stream_template != NULL &&
+      stream->session_keys == session->stream_template->session_keys)
+    return srtp_err_status_bad_param;
 
-    stat = srtp_add_stream(ctx, policy);
-    if (stat) {
-      /* clean up everything */
-      srtp_dealloc(*session);
-      *session = NULL;
-      return stat;
-    }    
+  /* only one rekey may be in flight per stream */
+  if (stream->prev_session_keys != NULL)
+    return srtp_err_status_bad_param;
 
-    /* set policy to next item in list  */
-    policy = policy->next;
+  /* build the fully keyed replacement with the normal setup path */
+  status = srtp_stream_alloc(&holder, policy);
+  if (status)
+    return status;
+  status = srtp_stream_init(holder, policy);
+  if (status) {
+    srtp_stream_free(holder);
+    return status;
   }
 
-  return srtp_err_status_ok;
+  /* park the old keys and publish the new ones */
+  stream->prev_session_keys = stream->session_keys;
+  stream->prev_num_master_keys = stream->num_master_keys;
+  stream->rekey_watermark = watermark;
+
+  stream->num_master_keys = holder->num_master_keys;
+  srtp_store_ptr_release(&stream->session_keys, holder->session_keys);
+
+  /* any prefetched keystream belongs to the old keys */
+  if (stream->keystream_cache)
+    srtp_keystream_cache_flush(stream->keystream_cache);
+
+  /* free the holder shell, keeping the session keys it built */
+  holder->session_keys = NULL;
+  holder->num_master_keys = 0;
+  return srtp_stream_dealloc(holder, NULL);
 }
 
+srtp_err_status_t
+srtp_rekey_stream(srtp_t session, const srtp_policy_t *policy) {
+  if ((session == NULL) || (policy == NULL))
+    return srtp_err_status_bad_param;
+
+  {
+    srtp_stream_t stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+
+    if (stream == NULL)
+      return srtp_err_status_bad_param;
+
+    /* switch over at the next packet index */
+    return srtp_rekey_stream_install(session, policy,
+                                     stream->rtp_rdbx.index + 1);
+  }
+}
 
 srtp_err_status_t
-srtp_remove_stream(srtp_t session, uint32_t ssrc) {
-  srtp_stream_ctx_t *stream, *last_stream;
-  srtp_err_status_t status;
+srtp_rekey_stream_at(srtp_t session, const srtp_policy_t *policy,
+                     uint32_t roc, uint16_t seq) {
+  srtp_xtd_seq_num_t watermark =
+    ((srtp_xtd_seq_num_t)roc << 16) | (srtp_xtd_seq_num_t)seq;
+
+  return srtp_rekey_stream_install(session, policy, watermark);
+}
+
+srtp_err_status_t
+srtp_rekey_stream_complete(srtp_t session, uint32_t ssrc) {
+  srtp_stream_t stream;
 
-  /* sanity check arguments */
   if (session == NULL)
     return srtp_err_status_bad_param;
-  
-  /* find stream in list; complain if not found */
-  last_stream = stream = session->stream_list;
-  while ((stream != NULL) && (ssrc != stream->ssrc)) {
-    last_stream = stream;
-    stream = stream->next;
+
+  stream = srtp_get_stream(session, htonl(ssrc));
+  if (stream == NULL)
+    return srtp_err_status_bad_param;
+
+  if (stream->prev_session_keys) {
+    srtp_session_keys_retire(stream->prev_session_keys,
+                             stream->prev_num_master_keys);
+    stream->prev_session_keys = NULL;
+    stream->prev_num_master_keys = 0;
   }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_stream_set_keystream_prefetch(srtp_t session, uint32_t ssrc,
+                                   int depth, int max_payload_octets) {
+  srtp_stream_t stream;
+  srtp_keystream_cache_t *cache;
+
+  if (session == NULL)
+    return srtp_err_status_bad_param;
+
+  stream = srtp_get_stream(session, htonl(ssrc));
   if (stream == NULL)
     return srtp_err_status_no_ctx;
 
-  /* remove stream from the list */
-  if (last_stream == stream)
-    /* stream was first in list */
-    session->stream_list = stream->next;
-  else
-    last_stream->next = stream->next;
+  /* re-enabling replaces any existing cache */
+  if (stream->keystream_cache) {
+    srtp_keystream_cache_free(stream->keystream_cache);
+    stream->keystream_cache = NULL;
+  }
+  if (depth == 0)
+    return srtp_err_status_ok;
 
-  /* deallocate the stream */
-  status = srtp_stream_dealloc(stream, session->stream_template);
-  if (status)
-    return status;
+  if (depth < 0 || max_payload_octets <= 0)
+    return srtp_err_status_bad_param;
+
+  /* the cache covers the plain AES-ICM transforms only */
+  switch (stream->session_keys[0].rtp_cipher->type->id) {
+  case SRTP_AES_ICM_128:
+  case SRTP_AES_ICM_192:
+  case SRTP_AES_ICM_256:
+    break;
+  default:
+    return srtp_err_status_bad_param;
+  }
+
+  cache = (srtp_keystream_cache_t *)
+    srtp_crypto_alloc(sizeof(srtp_keystream_cache_t));
+  if (cache == NULL)
+    return srtp_err_status_alloc_fail;
+  memset(cache, 0, sizeof(srtp_keystream_cache_t));
+
+  cache->depth = depth;
+  cache->entry_octets = max_payload_octets;
+  cache->slot_iv = (v128_t *)srtp_crypto_alloc(depth * sizeof(v128_t));
+  cache->slot_valid = (uint8_t *)srtp_crypto_alloc(depth);
+  cache->keystream =
+    (uint8_t *)srtp_crypto_alloc((size_t)depth * max_payload_octets);
+  if (cache->slot_iv == NULL || cache->slot_valid == NULL ||
+      cache->keystream == NULL) {
+    srtp_keystream_cache_free(cache);
+    return srtp_err_status_alloc_fail;
+  }
+  memset(cache->slot_valid, 0, (size_t)depth);
+
+#ifndef NO_64BIT_MATH
+  /* start predicting from the next index after the current one */
+  cache->next_index = srtp_rdbx_get_packet_index(&stream->rtp_rdbx) + 1;
+#endif
 
+  stream->keystream_cache = cache;
   return srtp_err_status_ok;
 }
 
-
 srtp_err_status_t
-srtp_update(srtp_t session, const srtp_policy_t *policy) {
-  srtp_err_status_t stat;
+srtp_stream_prefetch_keystream(srtp_t session, uint32_t ssrc,
+                               int max_packets) {
+#ifdef NO_64BIT_MATH
+  /* the predicted-index arithmetic requires native 64-bit math */
+  (void)session;
+  (void)ssrc;
+  (void)max_packets;
+  return srtp_err_status_fail;
+#else
+  srtp_stream_t stream;
+  srtp_keystream_cache_t *cache;
+  srtp_session_keys_t *session_keys;
+  srtp_err_status_t status;
+  v128_t iv;
+  int n;
 
-  /* sanity check arguments */
-  if ((session == NULL) || (policy == NULL) || (!srtp_validate_policy_master_keys(policy))) {
+  if (session == NULL)
     return srtp_err_status_bad_param;
-  }
 
-  while (policy != NULL) {
-    stat = srtp_update_stream(session, policy);
-    if (stat) {
-      return stat;
+  stream = srtp_get_stream(session, htonl(ssrc));
+  if (stream == NULL)
+    return srtp_err_status_no_ctx;
+
+  cache = stream->keystream_cache;
+  if (cache == NULL)
+    return srtp_err_status_bad_param;
+
+  session_keys = &stream->session_keys[0];
+
+  if (max_packets > cache->depth)
+    max_packets = cache->depth;
+
+  for (n = 0; n < max_packets; n++) {
+    srtp_xtd_seq_num_t est = cache->next_index;
+    int slot = (int)(est % (srtp_xtd_seq_num_t)cache->depth);
+    uint32_t out_len = (uint32_t)cache->entry_octets;
+
+    /* build the per-packet IV exactly as the packet path does */
+    iv.v32[0] = 0;
+    iv.v32[1] = stream->ssrc;  /* already in network order */
+    iv.v64[1] = be64_to_cpu(est << 16);
+
+    if (cache->slot_valid[slot] && v128_is_eq(&cache->slot_iv[slot], &iv)) {
+      cache->next_index = est + 1;
+      continue;  /* already precomputed */
     }
 
-    /* set policy to next item in list  */
-    policy = policy->next;
+    status = srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
+                                srtp_direction_encrypt);
+    if (status)
+      return srtp_err_status_cipher_fail;
+    status = srtp_cipher_output(session_keys->rtp_cipher,
+                                cache->keystream +
+                                  (size_t)slot * cache->entry_octets,
+                                &out_len);
+    if (status)
+      return srtp_err_status_cipher_fail;
+
+    v128_copy(&cache->slot_iv[slot], &iv);
+    cache->slot_valid[slot] = 1;
+    cache->next_index = est + 1;
   }
+
   return srtp_err_status_ok;
+#endif
 }
 
+/*
+ * srtp_stream_stats_accumulate(sum, stream) folds one stream's
+ * counter block into the aggregate
+ */
+static void
+srtp_stream_stats_accumulate(srtp_session_stats_t *sum,
+                             const srtp_stream_ctx_t *stream) {
+  sum->packets_protected        += stream->stats.packets_protected;
+  sum->octets_protected         += stream->stats.octets_protected;
+  sum->packets_unprotected      += stream->stats.packets_unprotected;
+  sum->octets_unprotected       += stream->stats.octets_unprotected;
+  sum->rtcp_packets_protected   += stream->stats.rtcp_packets_protected;
+  sum->rtcp_packets_unprotected += stream->stats.rtcp_packets_unprotected;
+  sum->auth_failures            += stream->stats.auth_failures;
+  sum->replay_drops             += stream->stats.replay_drops;
+}
 
-static srtp_err_status_t
-update_template_streams(srtp_t session, const srtp_policy_t *policy) {
-  srtp_err_status_t status;
-  srtp_stream_t new_stream_template;
-  srtp_stream_t new_stream_list = NULL;
+srtp_err_status_t
+srtp_get_session_stats(srtp_t session, srtp_session_stats_t *stats) {
+  srtp_stream_ctx_t *stream;
 
-  if (session->stream_template == NULL) {
+  if (session == NULL || stats == NULL)
     return srtp_err_status_bad_param;
-  }
 
-  /* allocate new template stream  */
-  status = srtp_stream_alloc(&new_stream_template, policy);
-  if (status) {
-    return status;
+  memset(stats, 0, sizeof(*stats));
+
+  /*
+   * the template accumulates the provisional processing done before
+   * a stream is instantiated, so it is included in the sum
+   */
+  if (session->stream_template != NULL)
+    srtp_stream_stats_accumulate(stats, session->stream_template);
+
+  for (stream = srtp_load_ptr_acquire(&session->stream_list);
+       stream != NULL; stream = stream->next) {
+    srtp_stream_stats_accumulate(stats, stream);
+    stats->stream_count++;
   }
 
-  /* initialize new template stream  */
-  status = srtp_stream_init(new_stream_template, policy);
-  if (status) {
-    srtp_crypto_free(new_stream_template);
-    return status;
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_info_fill(info, stream) captures one stream's exported
+ * state; all fields are plain reads, so a snapshot taken concurrently
+ * with packet processing is approximate but never torn in a way that
+ * matters for metrics
+ */
+static void
+srtp_stream_info_fill(srtp_stream_info_t *info,
+                      const srtp_stream_ctx_t *stream) {
+  srtp_xtd_seq_num_t index = srtp_rdbx_get_packet_index(&stream->rtp_rdbx);
+
+  info->ssrc = ntohl(stream->ssrc);
+#ifdef NO_64BIT_MATH
+  info->roc = (high32(index) << 16) | (low32(index) >> 16);
+#else
+  info->roc = (uint32_t)(index >> 16);
+#endif
+  info->rtp_packet_index = index;
+  info->key_usage_remaining = stream->session_keys[0].limit->num_left;
+}
+
+srtp_err_status_t
+srtp_session_foreach_stream(srtp_t session,
+                            srtp_stream_visitor_func_t visitor, void *data) {
+  srtp_stream_ctx_t *stream;
+  srtp_stream_info_t info;
+
+  if (session == NULL || visitor == NULL)
+    return srtp_err_status_bad_param;
+
+  for (stream = srtp_load_ptr_acquire(&session->stream_list);
+       stream != NULL; stream = stream->next) {
+    srtp_stream_info_fill(&info, stream);
+    if (visitor(data, &info))
+      break;
   }
 
-  /* for all old templated streams */
-  for (;;) {
-    srtp_stream_t stream;
-    uint32_t ssrc;
-    srtp_xtd_seq_num_t old_index;
-    srtp_rdb_t old_rtcp_rdb;
+  return srtp_err_status_ok;
+}
 
-    stream = session->stream_list;
-    while ((stream != NULL) &&
-           (stream->session_keys[0].rtp_auth !=
-            session->stream_template->session_keys[0].rtp_auth)) {
-      stream = stream->next;
-    }
-    if (stream == NULL) {
-      /* no more templated streams */
-      break;
-    }
+srtp_err_status_t
+srtp_session_get_stream_info(srtp_t session, srtp_stream_info_t *info,
+                             unsigned int max_streams,
+                             unsigned int *num_streams) {
+  srtp_stream_ctx_t *stream;
+  unsigned int count = 0;
 
-    /* save old extendard seq */
-    ssrc = stream->ssrc;
-    old_index = stream->rtp_rdbx.index;
-    old_rtcp_rdb = stream->rtcp_rdb;
+  if (session == NULL || info == NULL || num_streams == NULL)
+    return srtp_err_status_bad_param;
 
-    /* remove stream */
-    status = srtp_remove_stream(session, ssrc);
-    if (status) {
-      /* free new allocations */
-      while (new_stream_list != NULL) {
-        srtp_stream_t next = new_stream_list->next;
-        srtp_stream_dealloc(new_stream_list, new_stream_template);
-        new_stream_list = next;
-      }
-      srtp_stream_dealloc(new_stream_template, NULL);
-      return status;
-    }
+  for (stream = srtp_load_ptr_acquire(&session->stream_list);
+       stream != NULL && count < max_streams; stream = stream->next)
+    srtp_stream_info_fill(&info[count++], stream);
+  *num_streams = count;
 
-    /* allocate and initialize a new stream */
-    status = srtp_stream_clone(new_stream_template, ssrc, &stream);
-    if (status) {
-      /* free new allocations */
-      while (new_stream_list != NULL) {
-        srtp_stream_t next = new_stream_list->next;
-        srtp_stream_dealloc(new_stream_list, new_stream_template);
-        new_stream_list = next;
-      }
-      srtp_stream_dealloc(new_stream_template, NULL);
-      return status;
-    }
+  return srtp_err_status_ok;
+}
 
-    /* add new stream to the head of the new_stream_list */
-    stream->next = new_stream_list;
-    new_stream_list = stream;
+/*
+ * session state snapshot/restore
+ *
+ * the snapshot captures the state a standby cannot re-derive from the
+ * policy: per-stream packet indices (ROC and sequence), the RTP and
+ * RTCP replay windows, and the pending ROC.  key material is NOT
+ * serialized - the standby is expected to hold the same policy and
+ * master keys, and derives identical session keys from them - so a
+ * snapshot is not key-sensitive and stays compact enough to ship to a
+ * standby every second.
+ *
+ * all multi-octet fields are big-endian; SSRCs are stored in network
+ * byte order as they appear on the wire.  the format is versioned so
+ * later revisions can extend the per-stream record.
+ */
 
-    /* restore old extended seq */
-    stream->rtp_rdbx.index = old_index;
-    stream->rtcp_rdb = old_rtcp_rdb;
-  }
-  /* dealloc old template */
-  srtp_stream_dealloc(session->stream_template, NULL);
-  /* set new template */
-  session->stream_template = new_stream_template;
-  /* add new list */
-  if (new_stream_list) {
-    srtp_stream_t tail = new_stream_list;
-    while (tail->next) {
-      tail = tail->next;
-    }
-    tail->next = session->stream_list;
-    session->stream_list = new_stream_list;
-  }
-  return status;
+#define SRTP_SNAPSHOT_VERSION 1
+
+/* serialized sizes: the fixed header and the fixed part of a stream */
+#define SRTP_SNAPSHOT_HDR_LEN    12
+#define SRTP_SNAPSHOT_STREAM_LEN (4 + 1 + 1 + 2 + 4 + 8 + 4 + 4 + 4 + 16)
+
+static uint8_t *
+srtp_snapshot_put32(uint8_t *p, uint32_t v) {
+  *p++ = (uint8_t)(v >> 24);
+  *p++ = (uint8_t)(v >> 16);
+  *p++ = (uint8_t)(v >> 8);
+  *p++ = (uint8_t)v;
+  return p;
 }
 
+static const uint8_t *
+srtp_snapshot_get32(const uint8_t *p, uint32_t *v) {
+  *v = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+  return p + 4;
+}
 
-static srtp_err_status_t
-update_stream(srtp_t session, const srtp_policy_t *policy) {
-  srtp_err_status_t status;
-  srtp_xtd_seq_num_t old_index;
-  srtp_rdb_t old_rtcp_rdb;
-  srtp_stream_t stream;
+/*
+ * the serialized size of one stream: the fixed record plus the rdbx
+ * window bitmask (stored word by word, big-endian)
+ */
+static unsigned int
+srtp_snapshot_stream_length(const srtp_stream_ctx_t *stream) {
+  return SRTP_SNAPSHOT_STREAM_LEN +
+         4 * ((bitvector_get_length(&stream->rtp_rdbx.bitmask) + 31) / 32);
+}
 
-  stream = srtp_get_stream(session, htonl(policy->ssrc.value));
-  if (stream == NULL) {
-    return srtp_err_status_bad_param;
-  }
+static uint8_t *
+srtp_snapshot_write_stream(uint8_t *p, const srtp_stream_ctx_t *stream) {
+  const srtp_rdbx_t *rdbx = &stream->rtp_rdbx;
+  uint32_t words = (bitvector_get_length(&rdbx->bitmask) + 31) / 32;
+  uint32_t i;
+
+  memcpy(p, &stream->ssrc, 4);   /* already in network byte order */
+  p += 4;
+  *p++ = (uint8_t)stream->direction;
+  *p++ = (uint8_t)stream->num_master_keys;
+  *p++ = 0;                      /* reserved */
+  *p++ = 0;
+  p = srtp_snapshot_put32(p, stream->pending_roc);
+#ifdef NO_64BIT_MATH
+  p = srtp_snapshot_put32(p, high32(rdbx->index));
+  p = srtp_snapshot_put32(p, low32(rdbx->index));
+#else
+  p = srtp_snapshot_put32(p, (uint32_t)(rdbx->index >> 32));
+  p = srtp_snapshot_put32(p, (uint32_t)rdbx->index);
+#endif
+  p = srtp_snapshot_put32(p, bitvector_get_length(&rdbx->bitmask));
+  p = srtp_snapshot_put32(p, rdbx->window_offset);
+  for (i = 0; i < words; i++)
+    p = srtp_snapshot_put32(p, rdbx->bitmask.word[i]);
+  p = srtp_snapshot_put32(p, stream->rtcp_rdb.window_start);
+  for (i = 0; i < 4; i++)
+    p = srtp_snapshot_put32(p, stream->rtcp_rdb.bitmask.v32[i]);
+  return p;
+}
 
-  /* save old extendard seq */
-  old_index = stream->rtp_rdbx.index;
-  old_rtcp_rdb = stream->rtcp_rdb;
+srtp_err_status_t
+srtp_session_serialize(srtp_t session, uint8_t *buffer, unsigned int *length) {
+  srtp_stream_ctx_t *stream;
+  unsigned int needed = SRTP_SNAPSHOT_HDR_LEN;
+  uint32_t stream_count = 0;
+  uint8_t *p;
 
-  status = srtp_remove_stream(session, htonl(policy->ssrc.value));
-  if (status) {
-    return status;
-  }
+  if (session == NULL || length == NULL)
+    return srtp_err_status_bad_param;
 
-  status = srtp_add_stream(session, policy);
-  if (status) {
-    return status;
+  /*
+   * the template itself carries no traffic state, so only the
+   * instantiated streams are captured
+   */
+  for (stream = session->stream_list; stream != NULL; stream = stream->next) {
+    needed += srtp_snapshot_stream_length(stream);
+    stream_count++;
   }
 
-  stream = srtp_get_stream(session, htonl(policy->ssrc.value));
-  if (stream == NULL) {
-    return srtp_err_status_fail;
+  if (buffer == NULL || *length < needed) {
+    *length = needed;
+    return buffer == NULL ? srtp_err_status_ok : srtp_err_status_bad_param;
   }
 
-  /* restore old extended seq */
-  stream->rtp_rdbx.index = old_index;
-  stream->rtcp_rdb = old_rtcp_rdb;
-
+  p = buffer;
+  *p++ = 'S';
+  *p++ = 'R';
+  *p++ = 'T';
+  *p++ = 'P';
+  p = srtp_snapshot_put32(p, SRTP_SNAPSHOT_VERSION);
+  p = srtp_snapshot_put32(p, stream_count);
+  for (stream = session->stream_list; stream != NULL; stream = stream->next)
+    p = srtp_snapshot_write_stream(p, stream);
+
+  *length = (unsigned int)(p - buffer);
   return srtp_err_status_ok;
 }
 
-
 srtp_err_status_t
-srtp_update_stream(srtp_t session, const srtp_policy_t *policy) {
+srtp_session_deserialize(srtp_t session, const uint8_t *buffer,
+                         unsigned int length) {
+  const uint8_t *p, *end;
+  srtp_stream_ctx_t *stream;
   srtp_err_status_t status;
+  uint32_t version, stream_count, n;
 
-  /* sanity check arguments */
-  if ((session == NULL) || (policy == NULL) || (!srtp_validate_policy_master_keys(policy)))
+  if (session == NULL || buffer == NULL ||
+      length < SRTP_SNAPSHOT_HDR_LEN)
     return srtp_err_status_bad_param;
 
-  switch (policy->ssrc.type) {
-  case (ssrc_any_outbound):
-  case (ssrc_any_inbound):
-    status = update_template_streams(session, policy);
-    break;
-  case (ssrc_specific):
-    status = update_stream(session, policy);
-    break;
-  case (ssrc_undefined):
-  default:
-    return srtp_err_status_bad_param;
+  p = buffer;
+  end = buffer + length;
+  if (p[0] != 'S' || p[1] != 'R' || p[2] != 'T' || p[3] != 'P')
+    return srtp_err_status_parse_err;
+  p = srtp_snapshot_get32(p + 4, &version);
+  if (version != SRTP_SNAPSHOT_VERSION)
+    return srtp_err_status_parse_err;
+  p = srtp_snapshot_get32(p, &stream_count);
+
+  for (n = 0; n < stream_count; n++) {
+    uint32_t ssrc, pending_roc, index_hi, index_lo;
+    uint32_t window_bits, window_offset, words, i;
+    uint8_t direction, num_master_keys;
+
+    if (p + SRTP_SNAPSHOT_STREAM_LEN > end)
+      return srtp_err_status_parse_err;
+    memcpy(&ssrc, p, 4);
+    p += 4;
+    direction = *p++;
+    num_master_keys = *p++;
+    p += 2;                       /* reserved */
+    p = srtp_snapshot_get32(p, &pending_roc);
+    p = srtp_snapshot_get32(p, &index_hi);
+    p = srtp_snapshot_get32(p, &index_lo);
+    p = srtp_snapshot_get32(p, &window_bits);
+    p = srtp_snapshot_get32(p, &window_offset);
+    words = (window_bits + 31) / 32;
+    if (p + 4 * words + 20 > end)
+      return srtp_err_status_parse_err;
+
+    /*
+     * the offset indexes into the replay window, so it must lie
+     * within it; a larger value from a corrupted snapshot would send
+     * every subsequent replay check past the end of the bitvector
+     */
+    if (window_offset >= window_bits)
+      return srtp_err_status_parse_err;
+
+    /* look the stream up, instantiating it from the template if need be */
+    stream = srtp_get_stream(session, ssrc);
+    if (stream == NULL) {
+      if (session->stream_template == NULL)
+        return srtp_err_status_no_ctx;
+      status = srtp_session_stream_clone(session, ssrc, &stream);
+      if (status)
+        return status;
+      srtp_stream_list_insert(session, stream);
+      stream->direction = (direction_t)direction;
+    }
+
+    /*
+     * the stream must have been built from the same policy: the
+     * replay window and key count are set by the policy, so a
+     * mismatch means the snapshot belongs to a different setup
+     */
+    if (window_bits != bitvector_get_length(&stream->rtp_rdbx.bitmask) ||
+        num_master_keys != stream->num_master_keys)
+      return srtp_err_status_bad_param;
+
+    stream->pending_roc = pending_roc;
+#ifdef NO_64BIT_MATH
+    stream->rtp_rdbx.index = make64(index_hi, index_lo);
+#else
+    stream->rtp_rdbx.index = ((uint64_t)index_hi << 32) | index_lo;
+#endif
+    stream->rtp_rdbx.window_offset = window_offset;
+    for (i = 0; i < words; i++)
+      p = srtp_snapshot_get32(p, &stream->rtp_rdbx.bitmask.word[i]);
+    p = srtp_snapshot_get32(p, &stream->rtcp_rdb.window_start);
+    for (i = 0; i < 4; i++)
+      p = srtp_snapshot_get32(p, &stream->rtcp_rdb.bitmask.v32[i]);
   }
 
-  return status;
+  if (p != end)
+    return srtp_err_status_parse_err;
+
+  return srtp_err_status_ok;
 }
 
 
@@ -3317,6 +7222,14 @@ srtp_crypto_policy_set_aes_cm_192_null_auth (srtp_crypto_policy_t *p)
     p->sec_serv        = sec_serv_conf;
 }
 
+#endif
+
+/*
+ * The GCM policy setters are also available to non-OpenSSL builds with
+ * 64-bit math, where the native GCM engine backs the cipher types.
+ */
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+
 /*
  * AES-128 GCM mode with 8 octet auth tag. 
  */
@@ -3628,6 +7541,8 @@ srtp_protect_rtcp_aead (srtp_t ctx, srtp_stream_ctx_t *stream,
     /* increase the packet by the mki_size */
     *pkt_octet_len += mki_size;
 
+    stream->stats.rtcp_packets_protected++;
+
     return srtp_err_status_ok;
 }
 
@@ -3697,6 +7612,7 @@ srtp_unprotect_rtcp_aead (srtp_t ctx, srtp_stream_ctx_t *stream,
     debug_print(mod_srtp, "srtcp index: %x", seq_num);
     status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
     if (status) {
+        stream->stats.replay_drops++;
         return status;
     }
 
@@ -3754,6 +7670,7 @@ srtp_unprotect_rtcp_aead (srtp_t ctx, srtp_stream_ctx_t *stream,
     if (enc_start) {
         status = srtp_cipher_decrypt(session_keys->rtcp_cipher, (uint8_t*)enc_start, &enc_octet_len);
         if (status) {
+            stream->stats.auth_failures++;
             return status;
         }
     } else {
@@ -3763,6 +7680,7 @@ srtp_unprotect_rtcp_aead (srtp_t ctx, srtp_stream_ctx_t *stream,
         tmp_len = tag_len;
         status = srtp_cipher_decrypt(session_keys->rtcp_cipher, (uint8_t*)auth_tag, &tmp_len);
         if (status) {
+            stream->stats.auth_failures++;
             return status;
         }
     }
@@ -3803,14 +7721,13 @@ srtp_unprotect_rtcp_aead (srtp_t ctx, srtp_stream_ctx_t *stream,
          * stream, and some implementations will want to not return
          * failure here
          */
-        status = srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
+        status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream);
         if (status) {
             return status;
         }
 
         /* add new stream to the head of the stream_list */
-        new_stream->next = ctx->stream_list;
-        ctx->stream_list = new_stream;
+        srtp_stream_list_insert(ctx, new_stream);
 
         /* set stream (the pointer used in this function) */
         stream = new_stream;
@@ -3819,17 +7736,26 @@ srtp_unprotect_rtcp_aead (srtp_t ctx, srtp_stream_ctx_t *stream,
     /* we've passed the authentication check, so add seq_num to the rdb */
     srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
 
+    stream->stats.rtcp_packets_unprotected++;
+
     return srtp_err_status_ok;
 }
 
 srtp_err_status_t 
 srtp_protect_rtcp(srtp_t ctx, void *rtcp_hdr, int *pkt_octet_len) {
-  return srtp_protect_rtcp_mki(ctx, rtcp_hdr, pkt_octet_len, 0, 0);
+  srtp_err_status_t status;
+
+  srtp_crypto_alloc_guard_begin();
+  status = srtp_protect_rtcp_mki(ctx, rtcp_hdr, pkt_octet_len, 0, 0);
+  srtp_crypto_alloc_guard_end();
+
+  return status;
 }
 
 srtp_err_status_t 
 srtp_protect_rtcp_mki(srtp_t ctx, void *rtcp_hdr, int *pkt_octet_len,
                       unsigned int use_mki, unsigned int mki_index) {
+  use_mki = SRTP_USE_MKI(use_mki);
   srtcp_hdr_t *hdr = (srtcp_hdr_t *)rtcp_hdr;
   uint32_t *enc_start;      /* pointer to start of encrypted portion  */
   uint32_t *auth_start;     /* pointer to start of auth. portion      */
@@ -3863,14 +7789,12 @@ srtp_protect_rtcp_mki(srtp_t ctx, void *rtcp_hdr, int *pkt_octet_len,
       srtp_stream_ctx_t *new_stream;
       
       /* allocate and initialize a new stream */
-      status = srtp_stream_clone(ctx->stream_template,
-				 hdr->ssrc, &new_stream); 
+      status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream); 
       if (status)
 	return status;
       
       /* add new stream to the head of the stream_list */
-      new_stream->next = ctx->stream_list;
-      ctx->stream_list = new_stream;
+      srtp_stream_list_insert(ctx, new_stream);
       
       /* set stream (the pointer used in this function) */
       stream = new_stream;
@@ -3896,6 +7820,17 @@ srtp_protect_rtcp_mki(srtp_t ctx, void *rtcp_hdr, int *pkt_octet_len,
 
   session_keys = srtp_get_session_keys_with_mki_index(stream, use_mki, mki_index);
 
+  /* streams created with an rtp_only policy carry no SRTCP contexts */
+  if (session_keys->rtcp_cipher == NULL)
+    return srtp_err_status_no_ctx;
+
+  /* derive the SRTCP keys on first use */
+  if (session_keys->deferred_rtcp_keys) {
+    status = srtp_stream_derive_rtcp_keys(session_keys);
+    if (status)
+      return status;
+  }
+
   /*
    * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
    * the request to our AEAD handler.
@@ -3944,11 +7879,7 @@ srtp_protect_rtcp_mki(srtp_t ctx, void *rtcp_hdr, int *pkt_octet_len,
   auth_start = (uint32_t *)hdr;
   auth_tag = (uint8_t *)hdr + *pkt_octet_len + sizeof(srtcp_trailer_t) + mki_size; 
 
-  /* perform EKT processing if needed */
-  srtp_ekt_write_data(stream->ekt, auth_tag, tag_len, pkt_octet_len, 
-		      srtp_rdbx_get_packet_index(&stream->rtp_rdbx));
-
-  /* 
+  /*
    * check sequence number for overruns, and copy it into the packet
    * if its value isn't too big
    */
@@ -4026,29 +7957,45 @@ srtp_protect_rtcp_mki(srtp_t ctx, void *rtcp_hdr, int *pkt_octet_len,
 			(uint8_t *)auth_start, 
 			(*pkt_octet_len) + sizeof(srtcp_trailer_t), 
 			auth_tag);
-  debug_print(mod_srtp, "srtcp auth tag:    %s", 
+  debug_print(mod_srtp, "srtcp auth tag:    %s",
 	      srtp_octet_string_hex_string(auth_tag, tag_len));
   if (status)
-    return srtp_err_status_auth_fail;   
-    
+    return srtp_err_status_auth_fail;
+
+  /*
+   * perform EKT processing if needed: append the cached encrypted
+   * master key and the ROC/ISN/SPI fields after the base tag
+   */
+  srtp_ekt_write_data(stream->ekt, auth_tag, tag_len, pkt_octet_len,
+		      srtp_rdbx_get_packet_index(&stream->rtp_rdbx));
+
   /* increase the packet length by the length of the auth tag and seq_num*/
   *pkt_octet_len += (tag_len + sizeof(srtcp_trailer_t));
 
   /* increase the packet by the mki_size */
   *pkt_octet_len += mki_size;
-    
+
+  stream->stats.rtcp_packets_protected++;
+
   return srtp_err_status_ok;  
 }
 
 
 srtp_err_status_t 
 srtp_unprotect_rtcp(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len) {
-    return srtp_unprotect_rtcp_mki(ctx, srtcp_hdr, pkt_octet_len, 0);
+    srtp_err_status_t status;
+
+    srtp_crypto_alloc_guard_begin();
+    status = srtp_unprotect_rtcp_mki(ctx, srtcp_hdr, pkt_octet_len, 0);
+    srtp_crypto_alloc_guard_end();
+
+    return status;
 }
 
 srtp_err_status_t
 srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
                         unsigned int use_mki) {
+  use_mki = SRTP_USE_MKI(use_mki);
   srtcp_hdr_t *hdr = (srtcp_hdr_t *)srtcp_hdr;
   uint32_t *enc_start;      /* pointer to start of encrypted portion  */
   uint32_t *auth_start;     /* pointer to start of auth. portion      */
@@ -4056,10 +8003,10 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
   unsigned int enc_octet_len = 0;/* number of octets in encrypted portion */
   uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
   uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
-  uint8_t tag_copy[SRTP_MAX_TAG_LEN];
-  srtp_err_status_t status;   
+  srtp_err_status_t status;
   unsigned int auth_len;
   int tag_len;
+  unsigned int ekt_octets;  /* octets of EKT data after the base tag  */
   srtp_stream_ctx_t *stream;
   uint32_t prefix_len;
   uint32_t seq_num;
@@ -4076,8 +8023,13 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
   if (*pkt_octet_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t))
     return srtp_err_status_bad_param;
 
+  /* reject unknown SSRCs cheaply when there is no template */
+  if (ctx->stream_template == NULL &&
+      !srtp_ssrc_filter_test(ctx, hdr->ssrc))
+    return srtp_err_status_no_ctx;
+
   /*
-   * look up ssrc in srtp_stream list, and process the packet with 
+   * look up ssrc in srtp_stream list, and process the packet with
    * the appropriate stream.  if we haven't seen this stream before,
    * there's only one key for this srtp_session, and the cipher
    * supports key-sharing, then we assume that a new stream using
@@ -4086,9 +8038,17 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
   stream = srtp_get_stream(ctx, hdr->ssrc);
   if (stream == NULL) {
     if (ctx->stream_template != NULL) {
+      /*
+       * in deterministic-latency mode a provisional stream can only
+       * be put into service from a clone stocked at setup time, so
+       * reject the packet before any of it is processed
+       */
+      if (ctx->deterministic_latency && ctx->stream_free_list == NULL)
+        return srtp_err_status_no_ctx;
+
       stream = ctx->stream_template;
 
-      /* 
+      /*
        * check to see if stream_template has an EKT data structure, in
        * which case we initialize the template using the EKT policy
        * referenced by that data (which consists of decrypting the
@@ -4124,16 +8084,33 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
          return srtp_err_status_bad_mki;
   } else {
       session_keys = &stream->session_keys[0];
-  }  
+  }
+
+  /* streams created with an rtp_only policy carry no SRTCP contexts */
+  if (session_keys->rtcp_cipher == NULL)
+    return srtp_err_status_no_ctx;
 
+  /* derive the SRTCP keys on first use */
+  if (session_keys->deferred_rtcp_keys) {
+    status = srtp_stream_derive_rtcp_keys(session_keys);
+    if (status)
+      return status;
+  }
 
   /* get tag length from stream context */
   tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
 
+  /*
+   * if EKT is in use, the packet ends with the EKT fields (encrypted
+   * master key, ROC, ISN, SPI) after the base authentication tag;
+   * these are excluded from the authenticated and encrypted regions
+   */
+  ekt_octets = srtp_ekt_octets_after_base_tag(stream->ekt);
+
   /* check the packet length - it must contain at least a full RTCP
      header, an auth tag (if applicable), and the SRTCP encrypted flag
      and 31-bit index value */
-  if (*pkt_octet_len < (int) (octets_in_rtcp_header + tag_len + mki_size + sizeof(srtcp_trailer_t))) {
+  if (*pkt_octet_len < (int) (octets_in_rtcp_header + tag_len + mki_size + sizeof(srtcp_trailer_t) + ekt_octets)) {
     return srtp_err_status_bad_param;
   }
 
@@ -4154,8 +8131,8 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
   /*
    * set encryption start, encryption length, and trailer
    */
-  enc_octet_len = *pkt_octet_len - 
-                  (octets_in_rtcp_header + tag_len + mki_size + sizeof(srtcp_trailer_t));
+  enc_octet_len = *pkt_octet_len -
+                  (octets_in_rtcp_header + tag_len + mki_size + sizeof(srtcp_trailer_t) + ekt_octets);
   /* index & E (encryption) bit follow normal data.  hdr->len
 	 is the number of words (32-bit) in the normal packet minus 1 */
   /* This should point trailer to the word past the end of the
@@ -4166,7 +8143,7 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
    *	 multiples of 32-bits (RFC 3550 6.1)
    */
   trailer = (uint32_t *) ((char *) hdr +
-      *pkt_octet_len -(tag_len + mki_size + sizeof(srtcp_trailer_t)));
+      *pkt_octet_len -(tag_len + mki_size + sizeof(srtcp_trailer_t) + ekt_octets));
   e_bit_in_packet =
       (*((unsigned char *) trailer) & SRTCP_E_BYTE_BIT) == SRTCP_E_BYTE_BIT;
   if (e_bit_in_packet != sec_serv_confidentiality) {
@@ -4190,24 +8167,9 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
    * could be present.  The data needed to calculate the Auth tag
    * must not include the MKI
    */
-  auth_len = *pkt_octet_len - tag_len - mki_size;
+  auth_len = *pkt_octet_len - tag_len - mki_size - ekt_octets;
   auth_tag = (uint8_t *)hdr + auth_len + mki_size;
 
-  /* 
-   * if EKT is in use, then we make a copy of the tag from the packet,
-   * and then zeroize the location of the base tag
-   *
-   * we first re-position the auth_tag pointer so that it points to
-   * the base tag
-   */
-  if (stream->ekt) {
-    auth_tag -= srtp_ekt_octets_after_base_tag(stream->ekt);
-    memcpy(tag_copy, auth_tag, tag_len);
-    octet_string_set_to_zero(auth_tag, tag_len);
-    auth_tag = tag_copy;
-    auth_len += tag_len;
-  }
-
   /* 
    * check the sequence number for replays
    */
@@ -4215,8 +8177,10 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
   seq_num = ntohl(*trailer) & SRTCP_INDEX_MASK;
   debug_print(mod_srtp, "srtcp index: %x", seq_num);
   status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
-  if (status)
+  if (status) {
+    stream->stats.replay_drops++;
     return status;
+  }
 
   /* 
    * if we're using aes counter mode, set nonce and seq 
@@ -4256,14 +8220,18 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
 			auth_len, tmp_tag);
   debug_print(mod_srtp, "srtcp computed tag:       %s", 
 	      srtp_octet_string_hex_string(tmp_tag, tag_len));
-  if (status)
-    return srtp_err_status_auth_fail;   
-  
+  if (status) {
+    stream->stats.auth_failures++;
+    return srtp_err_status_auth_fail;
+  }
+
   /* compare the tag just computed with the one in the packet */
-  debug_print(mod_srtp, "srtcp tag from packet:    %s", 
-	      srtp_octet_string_hex_string(auth_tag, tag_len));  
-  if (octet_string_is_eq(tmp_tag, auth_tag, tag_len))
+  debug_print(mod_srtp, "srtcp tag from packet:    %s",
+	      srtp_octet_string_hex_string(auth_tag, tag_len));
+  if (octet_string_is_eq(tmp_tag, auth_tag, tag_len)) {
+    stream->stats.auth_failures++;
     return srtp_err_status_auth_fail;
+  }
 
   /* 
    * if we're authenticating using a universal hash, put the keystream
@@ -4296,7 +8264,7 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
    * if EKT is in effect, subtract the EKT data out of the packet
    * length
    */
-  *pkt_octet_len -= srtp_ekt_octets_after_base_tag(stream->ekt);
+  *pkt_octet_len -= ekt_octets;
 
   /* 
    * verify that stream is for received traffic - this check will
@@ -4331,13 +8299,12 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
      * stream, and some implementations will want to not return
      * failure here
      */
-    status = srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream); 
+    status = srtp_session_stream_clone(ctx, hdr->ssrc, &new_stream); 
     if (status)
       return status;
     
     /* add new stream to the head of the stream_list */
-    new_stream->next = ctx->stream_list;
-    ctx->stream_list = new_stream;
+    srtp_stream_list_insert(ctx, new_stream);
     
     /* set stream (the pointer used in this function) */
     stream = new_stream;
@@ -4345,9 +8312,61 @@ srtp_unprotect_rtcp_mki(srtp_t ctx, void *srtcp_hdr, int *pkt_octet_len,
 
   /* we've passed the authentication check, so add seq_num to the rdb */
   srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
-    
-    
-  return srtp_err_status_ok;  
+
+  stream->stats.rtcp_packets_unprotected++;
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * batch variants of srtp_protect_rtcp() and srtp_unprotect_rtcp()
+ *
+ * an SFU's report timer emits compound RTCP for every stream it
+ * serves in one burst; these amortize the per-call entry cost over
+ * that burst and report a status code for each packet, so one
+ * failing packet does not abort the rest of the batch
+ */
+
+srtp_err_status_t
+srtp_protect_rtcp_batch(srtp_t ctx, void **rtcp_hdr, int *len_ptr,
+                        srtp_err_status_t *status, int num_pkts) {
+  srtp_err_status_t result = srtp_err_status_ok;
+  int i;
+
+  if (ctx == NULL || rtcp_hdr == NULL || len_ptr == NULL ||
+      status == NULL || num_pkts < 0)
+    return srtp_err_status_bad_param;
+
+  srtp_crypto_alloc_guard_begin();
+  for (i = 0; i < num_pkts; i++) {
+    status[i] = srtp_protect_rtcp_mki(ctx, rtcp_hdr[i], &len_ptr[i], 0, 0);
+    if (status[i] != srtp_err_status_ok)
+      result = srtp_err_status_fail;
+  }
+  srtp_crypto_alloc_guard_end();
+
+  return result;
+}
+
+srtp_err_status_t
+srtp_unprotect_rtcp_batch(srtp_t ctx, void **srtcp_hdr, int *len_ptr,
+                          srtp_err_status_t *status, int num_pkts) {
+  srtp_err_status_t result = srtp_err_status_ok;
+  int i;
+
+  if (ctx == NULL || srtcp_hdr == NULL || len_ptr == NULL ||
+      status == NULL || num_pkts < 0)
+    return srtp_err_status_bad_param;
+
+  srtp_crypto_alloc_guard_begin();
+  for (i = 0; i < num_pkts; i++) {
+    status[i] = srtp_unprotect_rtcp_mki(ctx, srtcp_hdr[i], &len_ptr[i], 0);
+    if (status[i] != srtp_err_status_ok)
+      result = srtp_err_status_fail;
+  }
+  srtp_crypto_alloc_guard_end();
+
+  return result;
 }
 
 
@@ -4385,7 +8404,7 @@ srtp_crypto_policy_set_from_profile_for_rtp(srtp_crypto_policy_t *policy,
   case srtp_profile_null_sha1_80:
     srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
     break;
-#if defined(OPENSSL)
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
   case srtp_profile_aead_aes_128_gcm:
     srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
     break;
@@ -4419,7 +8438,7 @@ srtp_crypto_policy_set_from_profile_for_rtcp(srtp_crypto_policy_t *policy,
   case srtp_profile_null_sha1_80:
     srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
     break;
-#if defined(OPENSSL)
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
   case srtp_profile_aead_aes_128_gcm:
     srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
     break;
@@ -4555,6 +8574,10 @@ srtp_get_protect_rtcp_trailer_length(srtp_t session,
         return srtp_err_status_bad_param;
     }
 
+    /* streams created with an rtp_only policy carry no SRTCP contexts */
+    if (stream->session_keys[0].rtcp_auth == NULL)
+        return srtp_err_status_no_ctx;
+
     if (use_mki) {
        if (mki_index > stream->num_master_keys)
            return srtp_err_status_bad_mki;
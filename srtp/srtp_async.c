@@ -0,0 +1,310 @@
+/*
+ * srtp_async.c
+ *
+ * worker-pool packet processing engine for libSRTP
+ *
+ * Packets are sharded onto a fixed set of worker threads by SSRC, so
+ * each stream is owned by exactly one worker and the per-stream
+ * single-writer discipline documented in srtp.h holds by
+ * construction; the sharding also preserves per-stream submission
+ * order without any reordering logic above the API.
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Leave this as the top level import. Ensures the existence of defines
+#include "config.h"
+
+#include <pthread.h>
+
+#include "srtp_async.h"
+#include "srtp_priv.h"
+#include "alloc.h"
+
+/* the number of packets a worker will hold before submission fails */
+#define SRTP_ASYNC_QUEUE_DEPTH 256
+
+typedef enum {
+  srtp_async_op_protect   = 0,
+  srtp_async_op_unprotect = 1
+} srtp_async_op_t;
+
+typedef struct {
+  void *pkt;
+  int len;
+  srtp_async_op_t op;
+  srtp_async_complete_func_t complete;
+  void *user_data;
+} srtp_async_job_t;
+
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t nonempty;            /* signaled when a job is queued   */
+  pthread_cond_t idle;                /* signaled when pending hits zero */
+  srtp_async_job_t queue[SRTP_ASYNC_QUEUE_DEPTH];
+  unsigned int head;
+  unsigned int tail;
+  unsigned int queued;                /* jobs waiting in the queue       */
+  unsigned int pending;               /* jobs queued or in flight        */
+  int running;
+  struct srtp_async_engine_t_ *engine;
+} srtp_async_worker_t;
+
+typedef struct srtp_async_engine_t_ {
+  srtp_t session;
+  unsigned int num_workers;
+  pthread_mutex_t add_lock;           /* serializes stream creation      */
+  srtp_async_worker_t *worker;
+} srtp_async_engine_ctx_t;
+
+/*
+ * map an SSRC to its owning worker; the multiplicative hash matches
+ * the one used by the session's stream lookup, so related SSRCs do
+ * not clump onto one worker
+ */
+static unsigned int
+srtp_async_shard(srtp_async_engine_t engine, uint32_t ssrc) {
+  return (unsigned int)((ssrc * 0x9e3779b1UL) % engine->num_workers);
+}
+
+static void
+srtp_async_process(srtp_async_engine_t engine, srtp_async_job_t *job) {
+  srtp_err_status_t status;
+  uint32_t ssrc = ((srtp_hdr_t *)job->pkt)->ssrc;
+  int new_stream;
+
+  /*
+   * a packet from an unknown SSRC may instantiate a stream from the
+   * wildcard template; the session permits only one concurrent
+   * addition, so take the engine's add lock for that case (a benign
+   * race on the lookup just means the lock is taken needlessly)
+   */
+  new_stream = (srtp_get_stream(engine->session, ssrc) == NULL);
+  if (new_stream)
+    pthread_mutex_lock(&engine->add_lock);
+
+  if (job->op == srtp_async_op_protect)
+    status = srtp_protect(engine->session, job->pkt, &job->len);
+  else
+    status = srtp_unprotect(engine->session, job->pkt, &job->len);
+
+  if (new_stream)
+    pthread_mutex_unlock(&engine->add_lock);
+
+  job->complete(job->pkt, job->len, status, job->user_data);
+}
+
+static void *
+srtp_async_worker_run(void *arg) {
+  srtp_async_worker_t *worker = (srtp_async_worker_t *)arg;
+  srtp_async_job_t job;
+
+  pthread_mutex_lock(&worker->lock);
+  for (;;) {
+    while (worker->queued == 0 && worker->running)
+      pthread_cond_wait(&worker->nonempty, &worker->lock);
+    if (worker->queued == 0 && !worker->running)
+      break;
+
+    job = worker->queue[worker->head];
+    worker->head = (worker->head + 1) % SRTP_ASYNC_QUEUE_DEPTH;
+    worker->queued--;
+    pthread_mutex_unlock(&worker->lock);
+
+    srtp_async_process(worker->engine, &job);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->pending--;
+    if (worker->pending == 0)
+      pthread_cond_signal(&worker->idle);
+  }
+  pthread_mutex_unlock(&worker->lock);
+
+  return NULL;
+}
+
+static srtp_err_status_t
+srtp_async_submit(srtp_async_engine_t engine, void *pkt, int len,
+                  srtp_async_op_t op,
+                  srtp_async_complete_func_t complete, void *user_data) {
+  srtp_async_worker_t *worker;
+  srtp_async_job_t *job;
+
+  if (engine == NULL || pkt == NULL || complete == NULL)
+    return srtp_err_status_bad_param;
+
+  /* the shard lookup (and the worker later) read the RTP header, so
+     refuse anything too short to hold one before touching it */
+  if (len < (int)sizeof(srtp_hdr_t))
+    return srtp_err_status_bad_param;
+
+  worker = &engine->worker[srtp_async_shard(engine,
+                                            ((srtp_hdr_t *)pkt)->ssrc)];
+
+  pthread_mutex_lock(&worker->lock);
+  if (worker->queued == SRTP_ASYNC_QUEUE_DEPTH) {
+    pthread_mutex_unlock(&worker->lock);
+    return srtp_err_status_alloc_fail;
+  }
+  job = &worker->queue[worker->tail];
+  worker->tail = (worker->tail + 1) % SRTP_ASYNC_QUEUE_DEPTH;
+  job->pkt = pkt;
+  job->len = len;
+  job->op = op;
+  job->complete = complete;
+  job->user_data = user_data;
+  worker->queued++;
+  worker->pending++;
+  pthread_cond_signal(&worker->nonempty);
+  pthread_mutex_unlock(&worker->lock);
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_async_protect(srtp_async_engine_t engine, void *rtp_hdr, int len,
+                   srtp_async_complete_func_t complete, void *user_data) {
+  return srtp_async_submit(engine, rtp_hdr, len, srtp_async_op_protect,
+                           complete, user_data);
+}
+
+srtp_err_status_t
+srtp_async_unprotect(srtp_async_engine_t engine, void *srtp_hdr, int len,
+                     srtp_async_complete_func_t complete, void *user_data) {
+  return srtp_async_submit(engine, srtp_hdr, len, srtp_async_op_unprotect,
+                           complete, user_data);
+}
+
+srtp_err_status_t
+srtp_async_drain(srtp_async_engine_t engine) {
+  unsigned int i;
+
+  if (engine == NULL)
+    return srtp_err_status_bad_param;
+
+  for (i = 0; i < engine->num_workers; i++) {
+    srtp_async_worker_t *worker = &engine->worker[i];
+
+    pthread_mutex_lock(&worker->lock);
+    while (worker->pending > 0)
+      pthread_cond_wait(&worker->idle, &worker->lock);
+    pthread_mutex_unlock(&worker->lock);
+  }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_async_create(srtp_async_engine_t *engine, srtp_t session,
+                  unsigned int num_workers) {
+  srtp_async_engine_t e;
+  unsigned int i;
+
+  if (engine == NULL || session == NULL || num_workers == 0)
+    return srtp_err_status_bad_param;
+
+  e = (srtp_async_engine_t)srtp_crypto_alloc(sizeof(srtp_async_engine_ctx_t));
+  if (e == NULL)
+    return srtp_err_status_alloc_fail;
+  e->worker = (srtp_async_worker_t *)
+    srtp_crypto_alloc(num_workers * sizeof(srtp_async_worker_t));
+  if (e->worker == NULL) {
+    srtp_crypto_free(e);
+    return srtp_err_status_alloc_fail;
+  }
+
+  e->session = session;
+  e->num_workers = num_workers;
+  pthread_mutex_init(&e->add_lock, NULL);
+
+  for (i = 0; i < num_workers; i++) {
+    srtp_async_worker_t *worker = &e->worker[i];
+
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->nonempty, NULL);
+    pthread_cond_init(&worker->idle, NULL);
+    worker->head = worker->tail = 0;
+    worker->queued = worker->pending = 0;
+    worker->running = 1;
+    worker->engine = e;
+    if (pthread_create(&worker->thread, NULL,
+                       srtp_async_worker_run, worker) != 0) {
+      /* stop the workers already started and bail out */
+      unsigned int j;
+      for (j = 0; j < i; j++) {
+        pthread_mutex_lock(&e->worker[j].lock);
+        e->worker[j].running = 0;
+        pthread_cond_signal(&e->worker[j].nonempty);
+        pthread_mutex_unlock(&e->worker[j].lock);
+        pthread_join(e->worker[j].thread, NULL);
+      }
+      srtp_crypto_free(e->worker);
+      srtp_crypto_free(e);
+      return srtp_err_status_init_fail;
+    }
+  }
+
+  *engine = e;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_async_destroy(srtp_async_engine_t engine) {
+  unsigned int i;
+
+  if (engine == NULL)
+    return srtp_err_status_bad_param;
+
+  for (i = 0; i < engine->num_workers; i++) {
+    srtp_async_worker_t *worker = &engine->worker[i];
+
+    pthread_mutex_lock(&worker->lock);
+    worker->running = 0;
+    pthread_cond_signal(&worker->nonempty);
+    pthread_mutex_unlock(&worker->lock);
+    pthread_join(worker->thread, NULL);
+    pthread_mutex_destroy(&worker->lock);
+    pthread_cond_destroy(&worker->nonempty);
+    pthread_cond_destroy(&worker->idle);
+  }
+  pthread_mutex_destroy(&engine->add_lock);
+  srtp_crypto_free(engine->worker);
+  srtp_crypto_free(engine);
+
+  return srtp_err_status_ok;
+}
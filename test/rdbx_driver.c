@@ -58,9 +58,15 @@
 
 #include "ut_sim.h"
 
-srtp_err_status_t 
+srtp_err_status_t
 test_replay_dbx(int num_trials, unsigned long ws);
 
+srtp_err_status_t
+test_adaptive_window(void);
+
+srtp_err_status_t
+test_advance_sender(void);
+
 double
 rdbx_check_adds_per_second(int num_trials, unsigned long ws);
 
@@ -120,6 +126,24 @@ main (int argc, char *argv[]) {
       exit(1);
     }
     printf("passed\n");
+
+    printf("testing adaptive window sizing...");
+
+    status = test_adaptive_window();
+    if (status) {
+      printf("failed\n");
+      exit(1);
+    }
+    printf("passed\n");
+
+    printf("testing sender fast advance...");
+
+    status = test_advance_sender();
+    if (status) {
+      printf("failed\n");
+      exit(1);
+    }
+    printf("passed\n");
   }
 
   if (do_timing_test) {
@@ -324,6 +348,167 @@ test_replay_dbx(int num_trials, unsigned long ws) {
   return srtp_err_status_ok;
 }
 
+/*
+ * test_adaptive_window() checks that an adaptive window starts at the
+ * start size, grows when deep reorder is observed, keeps rejecting
+ * replays while doing so, and shrinks back after a long run of
+ * in-order traffic
+ */
+srtp_err_status_t
+test_adaptive_window(void) {
+  srtp_rdbx_t rdbx;
+  srtp_err_status_t status;
+  uint32_t idx;
+
+  status = srtp_rdbx_init(&rdbx, 128);
+  if (status) {
+    printf("replay_init failed with error code %d\n", status);
+    return status;
+  }
+  status = srtp_rdbx_set_adaptive(&rdbx, 1024);
+  if (status) {
+    printf("set_adaptive failed with error code %d\n", status);
+    return status;
+  }
+  if (srtp_rdbx_get_window_size(&rdbx) != SRTP_RDBX_ADAPTIVE_START_WINDOW) {
+    printf("adaptive window did not start at the start size\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  /* in-order traffic must leave the window at the start size */
+  for (idx = 0; idx < 100; idx++) {
+    status = rdbx_check_add(&rdbx, idx);
+    if (status)
+      return status;
+  }
+  if (srtp_rdbx_get_window_size(&rdbx) != SRTP_RDBX_ADAPTIVE_START_WINDOW) {
+    printf("adaptive window grew on in-order traffic\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  /* reorder deeper than half the window must make it grow */
+  status = rdbx_check_add(&rdbx, 250);
+  if (status)
+    return status;
+  status = rdbx_check_add(&rdbx, 160);    /* depth 90 of 128 */
+  if (status)
+    return status;
+  if (srtp_rdbx_get_window_size(&rdbx) != 256) {
+    printf("adaptive window did not grow on deep reorder\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  /* the entries must survive the resize */
+  status = rdbx_check_expect_failure(&rdbx, 250);
+  if (status)
+    return status;
+  status = rdbx_check_expect_failure(&rdbx, 160);
+  if (status)
+    return status;
+
+  /* an index that had slid off the old window stays rejected after
+     the grow: the newly exposed region is marked as already seen */
+  status = rdbx_check_expect_failure(&rdbx, 60);
+  if (status)
+    return status;
+
+  /* still deeper reorder grows it again */
+  status = rdbx_check_add(&rdbx, 350);
+  if (status)
+    return status;
+  status = rdbx_check_add(&rdbx, 170);    /* depth 180 of 256 */
+  if (status)
+    return status;
+  if (srtp_rdbx_get_window_size(&rdbx) != 512) {
+    printf("adaptive window did not grow a second time\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  /* a long run of in-order traffic shrinks it back down */
+  for (idx = 351; idx < 351 + 3 * 4096; idx++) {
+    status = rdbx_check_add(&rdbx, idx);
+    if (status)
+      return status;
+  }
+  if (srtp_rdbx_get_window_size(&rdbx) != SRTP_RDBX_ADAPTIVE_START_WINDOW) {
+    printf("adaptive window did not shrink back (size %lu)\n",
+           srtp_rdbx_get_window_size(&rdbx));
+    return srtp_err_status_algo_fail;
+  }
+
+  /* and replay detection still holds at the shrunken size */
+  status = rdbx_check_expect_failure(&rdbx, (uint32_t)(351 + 3 * 4096 - 1));
+  if (status)
+    return status;
+
+  srtp_rdbx_dealloc(&rdbx);
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * test_advance_sender() checks the sender fast path: consecutive
+ * sequence numbers advance the index directly, anything else is
+ * refused so the caller falls back to the estimator, and the window
+ * state stays exact across the two paths
+ */
+srtp_err_status_t
+test_advance_sender(void) {
+  srtp_rdbx_t rdbx;
+  srtp_err_status_t status;
+  uint32_t idx;
+
+  status = srtp_rdbx_init(&rdbx, 128);
+  if (status) {
+    printf("replay_init failed with error code %d\n", status);
+    return status;
+  }
+
+  /* consecutive sequence numbers take the fast path */
+  for (idx = 1; idx <= 1000; idx++) {
+    status = srtp_rdbx_advance_sender(&rdbx, (uint16_t)idx);
+    if (status) {
+      printf("fast advance refused index %u\n", idx);
+      return status;
+    }
+  }
+  if (srtp_rdbx_get_packet_index(&rdbx) != 1000) {
+    printf("fast advance lost track of the index\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  /* anything but the next sequence number is refused ... */
+  if (srtp_rdbx_advance_sender(&rdbx, 1000) != srtp_err_status_fail ||
+      srtp_rdbx_advance_sender(&rdbx, 1003) != srtp_err_status_fail) {
+    printf("fast advance accepted a non-consecutive index\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  /* ... and the window is exact for the fallback machinery: the
+   * indices recorded on the fast path read as replays */
+  status = rdbx_check_expect_failure(&rdbx, 1000);
+  if (status)
+    return status;
+  status = rdbx_check_add(&rdbx, 1003);
+  if (status)
+    return status;
+
+  /* the fast path picks up again after a fallback jump */
+  status = srtp_rdbx_advance_sender(&rdbx, 1004);
+  if (status) {
+    printf("fast advance refused to resume after a jump\n");
+    return status;
+  }
+  if (srtp_rdbx_get_packet_index(&rdbx) != 1004) {
+    printf("index wrong after resuming the fast path\n");
+    return srtp_err_status_algo_fail;
+  }
+
+  srtp_rdbx_dealloc(&rdbx);
+
+  return srtp_err_status_ok;
+}
+
 
 
 #include <time.h>       /* for clock()  */
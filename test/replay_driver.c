@@ -62,6 +62,9 @@ unsigned num_trials = 1 << 16;
 srtp_err_status_t
 test_rdb_db(void);
 
+srtp_err_status_t
+test_rdb_bulk(void);
+
 double
 rdb_check_adds_per_second(void);
 
@@ -77,6 +80,14 @@ main (void) {
   }
   printf("done\n");
 
+  printf("testing srtp_rdb_check_add_bulk()...\n");
+  err = test_rdb_bulk();
+  if (err) {
+    printf("failed\n");
+    exit(1);
+  }
+  printf("done\n");
+
   printf("rdb_check/rdb_adds per second: %e\n",
 	 rdb_check_adds_per_second());
   
@@ -246,6 +257,81 @@ test_rdb_db() {
   return srtp_err_status_ok;
 }
 
+/*
+ * test_rdb_bulk checks srtp_rdb_check_add_bulk() against the scalar
+ * check/add functions: a sorted run containing consecutive indices,
+ * gaps, and duplicates is fed to the bulk interface on one database
+ * and to srtp_rdb_check()/srtp_rdb_add_index() on another, and the
+ * per-index verdicts and final database states must agree
+ */
+
+#define BULK_RUN_LEN 32
+
+srtp_err_status_t
+test_rdb_bulk() {
+  srtp_rdb_t rdb_bulk, rdb_ref;
+  uint32_t run[BULK_RUN_LEN];
+  srtp_err_status_t status[BULK_RUN_LEN];
+  srtp_err_status_t err, ref;
+  uint32_t idx, trial;
+  int i;
+
+  if (srtp_rdb_init(&rdb_bulk) != srtp_err_status_ok ||
+      srtp_rdb_init(&rdb_ref) != srtp_err_status_ok) {
+    printf("rdb_init failed\n");
+    return srtp_err_status_init_fail;
+  }
+
+  for (trial=0, idx=0; trial < num_trials / BULK_RUN_LEN; trial++) {
+
+    /* build a sorted run: mostly consecutive, with occasional gaps
+       (including window-sized ones) and occasional duplicates */
+    for (i=0; i < BULK_RUN_LEN; i++) {
+      switch (rand() % 8) {
+      case 0:
+	idx += 1 << (rand() % 10);     /* gap */
+	break;
+      case 1:
+	break;                         /* duplicate of previous index */
+      default:
+	idx++;
+	break;
+      }
+      run[i] = idx;
+    }
+
+    err = srtp_rdb_check_add_bulk(&rdb_bulk, run, status, BULK_RUN_LEN);
+
+    for (i=0; i < BULK_RUN_LEN; i++) {
+      ref = srtp_rdb_check(&rdb_ref, run[i]);
+      if (status[i] != ref) {
+	printf("bulk verdict disagrees with rdb_check at index %u\n", run[i]);
+	return srtp_err_status_fail;
+      }
+      if (ref == srtp_err_status_ok &&
+	  srtp_rdb_add_index(&rdb_ref, run[i]) != srtp_err_status_ok) {
+	printf("rdb_add_index failed at index %u\n", run[i]);
+	return srtp_err_status_fail;
+      }
+      if (status[i] != srtp_err_status_ok && err == srtp_err_status_ok) {
+	printf("bulk return value did not flag a failed index\n");
+	return srtp_err_status_fail;
+      }
+    }
+
+    if (rdb_bulk.window_start != rdb_ref.window_start ||
+	rdb_bulk.bitmask.v64[0] != rdb_ref.bitmask.v64[0] ||
+	rdb_bulk.bitmask.v64[1] != rdb_ref.bitmask.v64[1]) {
+      printf("bulk database state diverged from reference\n");
+      print_rdb(&rdb_bulk);
+      print_rdb(&rdb_ref);
+      return srtp_err_status_fail;
+    }
+  }
+
+  return srtp_err_status_ok;
+}
+
 #include <time.h>       /* for clock()  */
 #include <stdlib.h>     /* for random() */
 
@@ -64,6 +64,9 @@
 srtp_err_status_t
 roc_test(int num_trials);
 
+srtp_err_status_t
+roc_boundary_test(void);
+
 int
 main (void) {
   srtp_err_status_t status;
@@ -71,7 +74,7 @@ main (void) {
   printf("rollover counter test driver\n"
 	 "David A. McGrew\n"
 	 "Cisco Systems, Inc.\n");
-  
+
   printf("testing index functions...");
   status = roc_test(1 << 18);
   if (status) {
@@ -79,6 +82,14 @@ main (void) {
     exit(status);
   }
   printf("passed\n");
+
+  printf("testing index guess wrap boundaries...");
+  status = roc_boundary_test();
+  if (status) {
+    printf("failed\n");
+    exit(status);
+  }
+  printf("passed\n");
   return 0;
 }
 
@@ -165,7 +176,7 @@ roc_test(int num_trials) {
   }
   failure_rate = (double) num_bad_est / num_trials;
   if (failure_rate > 0.01) {
-    printf("error: failure rate too high (%d bad estimates in %d trials)\n", 
+    printf("error: failure rate too high (%d bad estimates in %d trials)\n",
 	   num_bad_est, num_trials);
     return srtp_err_status_algo_fail;
   }
@@ -173,3 +184,46 @@ roc_test(int num_trials) {
 
   return srtp_err_status_ok;
 }
+
+/*
+ * roc_boundary_test() checks srtp_index_guess() at the exact edges of
+ * the wrap regions - a difference of exactly +/- seq_num_median stays
+ * in the current rollover epoch, while one more in either direction
+ * crosses into the previous or next epoch
+ */
+srtp_err_status_t
+roc_boundary_test(void) {
+  struct {
+    uint32_t local_roc;
+    uint16_t local_seq;
+    uint16_t s;
+    uint32_t guess_roc;
+    int delta;
+  } cases[] = {
+    { 1, 0x1234, 0x1235, 1, 1       },  /* in-order packet            */
+    { 1, 0xffff, 0x0000, 2, 1       },  /* wrap to the next epoch     */
+    { 1, 0x0000, 0xffff, 0, -1      },  /* straggler from last epoch  */
+    { 1, 0x0000, 0x8000, 1, 0x8000  },  /* exactly median ahead       */
+    { 1, 0x8000, 0x0000, 1, -0x8000 },  /* exactly median behind      */
+    { 1, 0x0000, 0x8001, 0, -0x7fff },  /* one past median - wraps    */
+    { 1, 0x8001, 0x0000, 2, 0x7fff  },  /* one past median - wraps    */
+  };
+  srtp_xtd_seq_num_t local, est;
+  int delta;
+  unsigned i;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    local = (((srtp_xtd_seq_num_t) cases[i].local_roc) << 16)
+          | cases[i].local_seq;
+    delta = srtp_index_guess(&local, &est, cases[i].s);
+    if (est >> 16 != cases[i].guess_roc || (uint16_t) est != cases[i].s
+        || delta != cases[i].delta) {
+      printf("\n *bad guess*: local %llx, s %x -> est %llx, delta %d\n",
+	     (unsigned long long)local, cases[i].s,
+	     (unsigned long long)est, delta);
+      return srtp_err_status_algo_fail;
+    }
+  }
+
+  return srtp_err_status_ok;
+}
@@ -43,6 +43,12 @@
  *
  */
 
+#ifdef __linux__
+# ifndef _GNU_SOURCE
+#  define _GNU_SOURCE       /* for sendmmsg()/recvmmsg() */
+# endif
+#endif
+
 #include "rtp.h"
 
 #include <stdio.h>
@@ -53,6 +59,10 @@
 # include <sys/socket.h>
 #endif
 
+#if defined(__linux__) && defined(HAVE_SYS_SOCKET_H)
+# define RTP_HAVE_MMSG 1
+#endif
+
 #define PRINT_DEBUG    0    /* set to 1 to print out debugging data */
 #define VERBOSE_DEBUG  0    /* set to 1 to print out more data      */
 
@@ -138,8 +148,177 @@ rtp_recvfrom(rtp_receiver_t receiver, void *msg, int *len) {
   return octets_recvd;
 }
 
+/*
+ * batched I/O
+ *
+ * the batch scratch buffers are allocated on first use and freed with
+ * the context, so the single-packet paths stay allocation free
+ */
+
+static rtp_msg_t *
+rtp_batch_buffer(rtp_msg_t **batch) {
+  if (*batch == NULL)
+    *batch = (rtp_msg_t *)malloc(RTP_BATCH_SIZE * sizeof(rtp_msg_t));
+  return *batch;
+}
+
+int
+rtp_sendto_batch(rtp_sender_t sender, const void **msgs, const int *lens,
+                 int num_msgs) {
+  void *pkts[RTP_BATCH_SIZE];
+  int pkt_lens[RTP_BATCH_SIZE];
+  srtp_err_status_t status[RTP_BATCH_SIZE];
+  srtp_err_status_t stat;
+  rtp_msg_t *batch;
+  int i, sent = 0;
+
+  if (num_msgs > RTP_BATCH_SIZE)
+    num_msgs = RTP_BATCH_SIZE;
+  batch = rtp_batch_buffer(&sender->batch);
+  if (batch == NULL)
+    return -1;
+
+  /* marshal the batch, advancing seq and ts once per packet */
+  for (i = 0; i < num_msgs; i++) {
+    sender->message.header.seq = ntohs(sender->message.header.seq) + 1;
+    sender->message.header.seq = htons(sender->message.header.seq);
+    sender->message.header.ts = ntohl(sender->message.header.ts) + 1;
+    sender->message.header.ts = htonl(sender->message.header.ts);
+
+    batch[i].header = sender->message.header;
+    strncpy(batch[i].body, msgs[i], lens[i]);
+    pkts[i] = &batch[i].header;
+    pkt_lens[i] = lens[i] + RTP_HEADER_LEN;
+  }
+
+  /*
+   * apply srtp to the whole batch; a result other than bad_param just
+   * reflects per-packet failures, which the status array reports
+   */
+  stat = srtp_protect_batch(sender->srtp_ctx, pkts, pkt_lens, status,
+                            num_msgs);
+  if (stat == srtp_err_status_bad_param)
+    return -1;
+  for (i = 0; i < num_msgs; i++) {
+    if (status[i]) {
+#if PRINT_DEBUG
+      fprintf(stderr, "error: srtp protection of packet %d failed "
+              "with code %d\n", i, status[i]);
+#endif
+      return -1;
+    }
+  }
+
+#ifdef RTP_HAVE_MMSG
+  {
+    struct mmsghdr mmsg[RTP_BATCH_SIZE];
+    struct iovec iov[RTP_BATCH_SIZE];
+    int n;
+
+    memset(mmsg, 0, num_msgs * sizeof(struct mmsghdr));
+    for (i = 0; i < num_msgs; i++) {
+      iov[i].iov_base = pkts[i];
+      iov[i].iov_len = pkt_lens[i];
+      mmsg[i].msg_hdr.msg_name = &sender->addr;
+      mmsg[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+      mmsg[i].msg_hdr.msg_iov = &iov[i];
+      mmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < num_msgs) {
+      n = sendmmsg(sender->socket, mmsg + sent, num_msgs - sent, 0);
+      if (n < 0)
+        return sent > 0 ? sent : -1;
+      sent += n;
+    }
+  }
+#else
+  for (i = 0; i < num_msgs; i++) {
+    if (sendto(sender->socket, pkts[i], pkt_lens[i], 0,
+               (struct sockaddr *)&sender->addr,
+               sizeof(struct sockaddr_in)) != pkt_lens[i])
+      return sent > 0 ? sent : -1;
+    sent++;
+  }
+#endif
+
+  return sent;
+}
+
+int
+rtp_recvfrom_batch(rtp_receiver_t receiver, void **msgs, int *lens,
+                   int num_msgs) {
+  void *pkts[RTP_BATCH_SIZE];
+  int pkt_lens[RTP_BATCH_SIZE];
+  srtp_err_status_t status[RTP_BATCH_SIZE];
+  srtp_err_status_t stat;
+  rtp_msg_t *batch;
+  int i, n;
+
+  if (num_msgs > RTP_BATCH_SIZE)
+    num_msgs = RTP_BATCH_SIZE;
+  batch = rtp_batch_buffer(&receiver->batch);
+  if (batch == NULL)
+    return -1;
+
+#ifdef RTP_HAVE_MMSG
+  {
+    struct mmsghdr mmsg[RTP_BATCH_SIZE];
+    struct iovec iov[RTP_BATCH_SIZE];
+
+    memset(mmsg, 0, num_msgs * sizeof(struct mmsghdr));
+    for (i = 0; i < num_msgs; i++) {
+      iov[i].iov_base = &batch[i];
+      iov[i].iov_len = sizeof(rtp_msg_t);
+      mmsg[i].msg_hdr.msg_iov = &iov[i];
+      mmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+    /* block for the first packet, take whatever else is queued */
+    n = recvmmsg(receiver->socket, mmsg, num_msgs, MSG_WAITFORONE, NULL);
+    if (n <= 0)
+      return -1;
+    for (i = 0; i < n; i++)
+      pkt_lens[i] = mmsg[i].msg_len;
+  }
+#else
+  pkt_lens[0] = recvfrom(receiver->socket, (void *)&batch[0],
+                         sizeof(rtp_msg_t), 0, (struct sockaddr *)NULL, 0);
+  if (pkt_lens[0] == -1)
+    return -1;
+  n = 1;
+#endif
+
+  for (i = 0; i < n; i++) {
+    pkts[i] = &batch[i].header;
+    /* a non-rtp packet is left for srtp to reject */
+    if (batch[i].header.version != 2)
+      pkt_lens[i] = 0;
+  }
+
+  /* apply srtp to the whole batch; individual packets may fail */
+  stat = srtp_unprotect_batch(receiver->srtp_ctx, pkts, pkt_lens, status, n);
+  if (stat == srtp_err_status_bad_param)
+    return -1;
+
+  for (i = 0; i < n; i++) {
+    if (status[i]) {
+      fprintf(stderr,
+              "error: srtp unprotection failed with code %d%s\n", status[i],
+              status[i] == srtp_err_status_replay_fail ?
+                  " (replay check failed)" :
+              status[i] == srtp_err_status_auth_fail ?
+                  " (auth check failed)" : "");
+      lens[i] = 0;
+      continue;
+    }
+    strncpy(msgs[i], batch[i].body, pkt_lens[i] - RTP_HEADER_LEN);
+    lens[i] = pkt_lens[i] - RTP_HEADER_LEN;
+  }
+
+  return n;
+}
+
 int
-rtp_sender_init(rtp_sender_t sender, 
+rtp_sender_init(rtp_sender_t sender,
 		int sock, 
 		struct sockaddr_in addr,
 		unsigned int ssrc) {
@@ -158,6 +337,7 @@ rtp_sender_init(rtp_sender_t sender,
   /* set other stuff */
   sender->socket = sock;
   sender->addr = addr;
+  sender->batch = NULL;
 
   return 0;
 }
@@ -182,6 +362,7 @@ rtp_receiver_init(rtp_receiver_t rcvr,
   /* set other stuff */
   rcvr->socket = sock;
   rcvr->addr = addr;
+  rcvr->batch = NULL;
 
   return 0;
 }
@@ -213,6 +394,7 @@ rtp_sender_alloc(void) {
 
 void
 rtp_sender_dealloc(rtp_sender_t rtp_ctx) {
+  free(rtp_ctx->batch);
   free(rtp_ctx);
 }
 
@@ -223,5 +405,6 @@ rtp_receiver_alloc(void) {
 
 void
 rtp_receiver_dealloc(rtp_receiver_t rtp_ctx) {
+  free(rtp_ctx->batch);
   free(rtp_ctx);
 }
@@ -71,11 +71,17 @@ extern "C" {
  */
 #define RTP_HEADER_LEN   12
 
-/* 
+/*
  * RTP_MAX_BUF_LEN defines the largest RTP packet in the rtp.c implementation
  */
 #define RTP_MAX_BUF_LEN  16384
 
+/*
+ * RTP_BATCH_SIZE is the most packets one rtp_sendto_batch() or
+ * rtp_recvfrom_batch() call will carry
+ */
+#define RTP_BATCH_SIZE   32
+
 
 typedef srtp_hdr_t rtp_hdr_t;
 
@@ -85,10 +91,11 @@ typedef struct {
 } rtp_msg_t;
 
 typedef struct rtp_sender_ctx_t {
-  rtp_msg_t message;         
+  rtp_msg_t message;
   int socket;
   srtp_ctx_t *srtp_ctx;
   struct sockaddr_in addr;   /* reciever's address */
+  rtp_msg_t *batch;          /* scratch for batched I/O, see rtp_sendto_batch */
 } rtp_sender_ctx_t;
 
 typedef struct rtp_receiver_ctx_t {
@@ -96,6 +103,7 @@ typedef struct rtp_receiver_ctx_t {
   int socket;
   srtp_ctx_t *srtp_ctx;
   struct sockaddr_in addr;   /* receiver's address */
+  rtp_msg_t *batch;          /* scratch for batched I/O */
 } rtp_receiver_ctx_t;
 
 
@@ -109,6 +117,28 @@ rtp_sendto(rtp_sender_t sender, const void* msg, int len);
 int
 rtp_recvfrom(rtp_receiver_t receiver, void *msg, int *len);
 
+/*
+ * rtp_sendto_batch(sender, msgs, lens, num_msgs) protects up to
+ * RTP_BATCH_SIZE messages with srtp_protect_batch() and hands them to
+ * the kernel in one sendmmsg() call where the platform has it (one
+ * sendto() per packet elsewhere); returns the number of packets sent
+ */
+int
+rtp_sendto_batch(rtp_sender_t sender, const void **msgs, const int *lens,
+                 int num_msgs);
+
+/*
+ * rtp_recvfrom_batch(receiver, msgs, lens, num_msgs) receives up to
+ * num_msgs packets with one recvmmsg() call (returning as soon as at
+ * least one is available) and runs them through
+ * srtp_unprotect_batch(); each message slot gets the decrypted body,
+ * with lens[i] set to its length, or 0 for a packet that failed
+ * unprotection.  returns the number of packets received, or -1
+ */
+int
+rtp_recvfrom_batch(rtp_receiver_t receiver, void **msgs, int *lens,
+                   int num_msgs);
+
 int
 rtp_receiver_init(rtp_receiver_t rcvr, int sock, 
 		  struct sockaddr_in addr, unsigned int ssrc);
@@ -60,6 +60,12 @@
 #include "getopt_s.h"       /* for local getopt()  */
 #include <assert.h>         /* for assert()  */
 
+#include <fcntl.h>          /* for open()  */
+#include <sys/mman.h>       /* for mmap()  */
+#include <sys/stat.h>       /* for fstat()  */
+#include <time.h>           /* for clock_gettime()  */
+#include <unistd.h>         /* for close()  */
+
 #include <pcap.h>
 #include "rtp_decoder.h"
 #include "util.h"
@@ -108,6 +114,7 @@ main (int argc, char *argv[]) {
   int len;
   int expected_len;
   int do_list_mods = 0;
+  char *bench_file = NULL;
 
   fprintf(stderr, "Using %s [0x%x]\n", srtp_get_version_string(), srtp_get_version());
 
@@ -120,7 +127,7 @@ main (int argc, char *argv[]) {
 
   /* check args */
   while (1) {
-    c = getopt_s(argc, argv, "b:k:gt:ae:ld:f:s:");
+    c = getopt_s(argc, argv, "b:k:gt:ae:ld:f:s:B:");
     if (c == -1) {
       break;
     }
@@ -168,6 +175,9 @@ main (int argc, char *argv[]) {
     case 'l':
       do_list_mods = 1;
       break;
+    case 'B':
+      bench_file = optarg_s;
+      break;
     case 's':
       for (i_scsp = &srtp_crypto_suites[0]; i_scsp->can_name != NULL; i_scsp++) {
         if (strcasecmp(i_scsp->can_name, optarg_s) == 0) {
@@ -364,6 +374,28 @@ main (int argc, char *argv[]) {
       exit(1);
   }
 
+  if (bench_file != NULL) {
+    /* benchmark mode: replay the capture, no per-packet output */
+    dec = rtp_decoder_alloc();
+    if (dec == NULL) {
+      fprintf(stderr, "error: malloc() failed\n");
+      exit(1);
+    }
+    rtp_decoder_init(dec, policy);
+    if (rtp_decoder_benchmark(dec, bench_file) != 0) {
+      exit(1);
+    }
+    rtp_decoder_deinit_srtp(dec);
+    rtp_decoder_dealloc(dec);
+
+    status = srtp_shutdown();
+    if (status) {
+      fprintf(stderr, "error: srtp shutdown failed with error code %d\n", status);
+      exit(1);
+    }
+    return 0;
+  }
+
 	pcap_handle = pcap_open_offline("-", errbuf);
 
 	if (!pcap_handle) {
@@ -419,7 +451,9 @@ usage(char *string) {
 	 "       -f \"<pcap filter>\" to filter only the desired SRTP packets\n"
 	 "       -d <debug> turn on debugging for module <debug>\n"
 	 "       -s \"<srtp-crypto-suite>\" to set both key and tag size based\n"
-	 "          on RFC4568-style crypto suite specification\n",
+	 "          on RFC4568-style crypto suite specification\n"
+	 "       -B <pcap file> benchmark mode: mmap the capture, replay it\n"
+	 "          through srtp_unprotect() with no output, report throughput\n",
 	 string, string);
   exit(1);
 
@@ -521,6 +555,256 @@ rtp_decoder_handle_pkt(u_char *arg, const struct pcap_pkthdr *hdr,
   hexdump(&dcdr->message, octets_recvd);
 }
 
+/*
+ * benchmark mode
+ *
+ * the capture file is mmap()ed and its records walked directly - the
+ * libpcap dispatch machinery and all per-packet printing are off the
+ * path, so the numbers reflect srtp_unprotect() plus one memcpy per
+ * packet (unprotect works in place, so the mapped record has to be
+ * copied out before each call)
+ */
+
+/* classic pcap file format, handled in both byte orders */
+#define BENCH_PCAP_MAGIC         0xa1b2c3d4
+#define BENCH_PCAP_MAGIC_SWAPPED 0xd4c3b2a1
+#define BENCH_PCAP_MAGIC_NSEC         0xa1b23c4d
+#define BENCH_PCAP_MAGIC_NSEC_SWAPPED 0x4d3cb2a1
+
+struct bench_pcap_file_hdr {
+  uint32_t magic;
+  uint16_t version_major;
+  uint16_t version_minor;
+  uint32_t thiszone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+};
+
+struct bench_pcap_rec_hdr {
+  uint32_t ts_sec;
+  uint32_t ts_usec;
+  uint32_t caplen;
+  uint32_t len;
+};
+
+static uint32_t
+bench_swap32(uint32_t v) {
+  return (v << 24) | ((v << 8) & 0x00ff0000) |
+         ((v >> 8) & 0x0000ff00) | (v >> 24);
+}
+
+/* cycle counter, as in test/srtp_bench.c */
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_TICK_UNIT "cycles"
+static inline uint64_t bench_ticks(void) {
+  uint32_t lo, hi;
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+}
+#elif defined(__aarch64__)
+#define BENCH_TICK_UNIT "cycles"
+static inline uint64_t bench_ticks(void) {
+  uint64_t v;
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+}
+#else
+#define BENCH_TICK_UNIT "nanoseconds"
+static inline uint64_t bench_ticks(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/* per-SSRC tally, open-addressed on the SSRC value */
+#define BENCH_SSRC_SLOTS 1024   /* must be a power of two */
+
+struct bench_ssrc_stats {
+  uint32_t ssrc;       /* network byte order, 0 = empty slot */
+  uint64_t pkts;
+  uint64_t ok;
+  uint64_t auth_fail;
+  uint64_t replay_fail;
+  uint64_t other_fail;
+  uint64_t cycles;
+};
+
+static struct bench_ssrc_stats *
+bench_ssrc_slot(struct bench_ssrc_stats *table, uint32_t ssrc) {
+  uint32_t i = (ssrc * 0x9e3779b1) & (BENCH_SSRC_SLOTS - 1);
+  uint32_t probes;
+
+  for (probes = 0; probes < BENCH_SSRC_SLOTS; probes++) {
+    if (table[i].ssrc == ssrc || table[i].ssrc == 0) {
+      table[i].ssrc = ssrc;
+      return &table[i];
+    }
+    i = (i + 1) & (BENCH_SSRC_SLOTS - 1);
+  }
+  /* table full: fold the overflow into the last probed slot */
+  return &table[i];
+}
+
+int
+rtp_decoder_benchmark(rtp_decoder_t dcdr, const char *path) {
+  struct bench_pcap_file_hdr file_hdr;
+  struct bench_pcap_rec_hdr rec;
+  struct bench_ssrc_stats *table, *slot;
+  const uint8_t *base, *p, *end;
+  struct stat st;
+  srtp_err_status_t status;
+  uint64_t t0, t1, total_cycles = 0;
+  uint64_t pkts = 0, ok = 0, skipped = 0, failed = 0;
+  double wall, wall0;
+  struct timespec ts;
+  int fd, swapped, octets, i;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "error: could not open %s\n", path);
+    return -1;
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(file_hdr)) {
+    fprintf(stderr, "error: %s is not a capture file\n", path);
+    close(fd);
+    return -1;
+  }
+  base = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                               fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "error: mmap of %s failed\n", path);
+    return -1;
+  }
+
+  memcpy(&file_hdr, base, sizeof(file_hdr));
+  switch (file_hdr.magic) {
+  case BENCH_PCAP_MAGIC:
+  case BENCH_PCAP_MAGIC_NSEC:
+    swapped = 0;
+    break;
+  case BENCH_PCAP_MAGIC_SWAPPED:
+  case BENCH_PCAP_MAGIC_NSEC_SWAPPED:
+    swapped = 1;
+    break;
+  default:
+    fprintf(stderr, "error: %s has no pcap magic\n", path);
+    munmap((void *)base, st.st_size);
+    return -1;
+  }
+
+  table = calloc(BENCH_SSRC_SLOTS, sizeof(*table));
+  if (table == NULL) {
+    fprintf(stderr, "error: malloc() failed\n");
+    munmap((void *)base, st.st_size);
+    return -1;
+  }
+
+  /* one session handles every SSRC in the capture */
+  dcdr->policy.ssrc.type = ssrc_any_inbound;
+  dcdr->policy.ssrc.value = 0;
+  status = srtp_create(&dcdr->srtp_ctx, &dcdr->policy);
+  if (status) {
+    fprintf(stderr, "error: srtp_create() failed with code %d\n", status);
+    free(table);
+    munmap((void *)base, st.st_size);
+    return -1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  wall0 = (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+
+  p = base + sizeof(file_hdr);
+  end = base + st.st_size;
+  while (p + sizeof(rec) <= end) {
+    memcpy(&rec, p, sizeof(rec));
+    p += sizeof(rec);
+    if (swapped) {
+      rec.caplen = bench_swap32(rec.caplen);
+    }
+    if (p + rec.caplen > end) {
+      break;                    /* truncated record */
+    }
+
+    if (rec.caplen < dcdr->rtp_offset + sizeof(srtp_hdr_t) ||
+        rec.caplen - dcdr->rtp_offset > sizeof(dcdr->message)) {
+      skipped++;
+      p += rec.caplen;
+      continue;
+    }
+    octets = rec.caplen - dcdr->rtp_offset;
+    memcpy(&dcdr->message, p + dcdr->rtp_offset, octets);
+    p += rec.caplen;
+
+    if (dcdr->message.header.version != 2) {
+      skipped++;
+      continue;
+    }
+    slot = bench_ssrc_slot(table, dcdr->message.header.ssrc);
+
+    t0 = bench_ticks();
+    status = srtp_unprotect(dcdr->srtp_ctx, &dcdr->message, &octets);
+    t1 = bench_ticks();
+
+    pkts++;
+    total_cycles += t1 - t0;
+    slot->pkts++;
+    slot->cycles += t1 - t0;
+    switch (status) {
+    case srtp_err_status_ok:
+      ok++;
+      slot->ok++;
+      break;
+    case srtp_err_status_auth_fail:
+      failed++;
+      slot->auth_fail++;
+      break;
+    case srtp_err_status_replay_fail:
+    case srtp_err_status_replay_old:
+      failed++;
+      slot->replay_fail++;
+      break;
+    default:
+      failed++;
+      slot->other_fail++;
+      break;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  wall = (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9 - wall0;
+
+  fprintf(stdout, "packets:      %llu (%llu ok, %llu failed, %llu skipped)\n",
+          (unsigned long long)pkts, (unsigned long long)ok,
+          (unsigned long long)failed, (unsigned long long)skipped);
+  fprintf(stdout, "elapsed:      %.3f s (%.0f packets/sec)\n",
+          wall, wall > 0.0 ? (double)pkts / wall : 0.0);
+  fprintf(stdout, "per packet:   %.0f %s\n",
+          pkts > 0 ? (double)total_cycles / (double)pkts : 0.0,
+          BENCH_TICK_UNIT);
+  fprintf(stdout, "%-10s %10s %10s %10s %10s %10s %12s\n", "ssrc", "pkts",
+          "ok", "auth", "replay", "other", BENCH_TICK_UNIT "/pkt");
+  for (i = 0; i < BENCH_SSRC_SLOTS; i++) {
+    if (table[i].ssrc == 0) {
+      continue;
+    }
+    fprintf(stdout, "0x%08x %10llu %10llu %10llu %10llu %10llu %12.0f\n",
+            ntohl(table[i].ssrc),
+            (unsigned long long)table[i].pkts,
+            (unsigned long long)table[i].ok,
+            (unsigned long long)table[i].auth_fail,
+            (unsigned long long)table[i].replay_fail,
+            (unsigned long long)table[i].other_fail,
+            (double)table[i].cycles / (double)table[i].pkts);
+  }
+
+  free(table);
+  munmap((void *)base, st.st_size);
+  return 0;
+}
+
 void rtp_print_error(srtp_err_status_t status, char *message) {
     fprintf(stderr,
             "error: %s %d%s\n", message, status,
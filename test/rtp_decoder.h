@@ -101,4 +101,11 @@ srtp_err_status_t rtp_decoder_init_srtp(rtp_decoder_t decoder, unsigned int ssrc
 int
 rtp_decoder_deinit_srtp(rtp_decoder_t decoder);
 
+/*
+ * benchmark mode: mmap()s the capture at path and replays it through
+ * srtp_unprotect() as fast as possible with no per-packet output,
+ * then prints packets/sec, cycles/packet and a per-SSRC breakdown
+ */
+int rtp_decoder_benchmark(rtp_decoder_t dcdr, const char *path);
+
 #endif /* RTP_DECODER_H */
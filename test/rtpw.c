@@ -169,6 +169,7 @@ main (int argc, char *argv[]) {
   int len;
   int expected_len;
   int do_list_mods = 0;
+  int batch_mode = 0;
   uint32_t ssrc = 0xdeadbeef; /* ssrc value hardcoded for now */
 #ifdef RTPW_USE_WINSOCK2
   WORD wVersionRequested = MAKEWORD(2, 0);
@@ -198,7 +199,7 @@ main (int argc, char *argv[]) {
 
   /* check args */
   while (1) {
-    c = getopt_s(argc, argv, "b:k:rsgt:ae:ld:");
+    c = getopt_s(argc, argv, "b:k:rsgt:ae:ld:m");
     if (c == -1) {
       break;
     }
@@ -247,6 +248,9 @@ main (int argc, char *argv[]) {
     case 'l':
       do_list_mods = 1;
       break;
+    case 'm':
+      batch_mode = 1;
+      break;
     default:
       usage(argv[0]);
     }
@@ -543,10 +547,43 @@ main (int argc, char *argv[]) {
     }
           
     /* read words from dictionary, then send them off */
-    while (!interrupted && fgets(word, MAX_WORD_LEN, dict) != NULL) { 
+    if (batch_mode) {
+      /* gather words into batches and send each with one call */
+      char batch_words[RTP_BATCH_SIZE][MAX_WORD_LEN];
+      const void *batch_msgs[RTP_BATCH_SIZE];
+      int batch_lens[RTP_BATCH_SIZE];
+      int num_words = 0;
+      int i, eof = 0;
+
+      while (!interrupted && !eof) {
+	eof = (fgets(batch_words[num_words], MAX_WORD_LEN, dict) == NULL);
+	if (!eof) {
+	  len = strlen(batch_words[num_words]) + 1; /* plus one for null */
+	  if (len > MAX_WORD_LEN) {
+	    printf("error: word %s too large to send\n",
+		   batch_words[num_words]);
+	    continue;
+	  }
+	  batch_msgs[num_words] = batch_words[num_words];
+	  batch_lens[num_words] = len;
+	  num_words++;
+	}
+	if (num_words == RTP_BATCH_SIZE || (eof && num_words > 0)) {
+	  if (rtp_sendto_batch(snd, batch_msgs, batch_lens,
+			       num_words) != num_words)
+	    printf("error: batched send failed\n");
+	  else
+	    for (i = 0; i < num_words; i++)
+	      printf("sending word: %s", batch_words[i]);
+	  num_words = 0;
+	  usleep(USEC_RATE);
+	}
+      }
+    } else {
+    while (!interrupted && fgets(word, MAX_WORD_LEN, dict) != NULL) {
       len = strlen(word) + 1;  /* plus one for null */
-      
-      if (len > MAX_WORD_LEN) 
+
+      if (len > MAX_WORD_LEN)
 	printf("error: word %s too large to send\n", word);
       else {
 	rtp_sendto(snd, word, len);
@@ -554,6 +591,7 @@ main (int argc, char *argv[]) {
       }
       usleep(USEC_RATE);
     }
+    }
 
     rtp_sender_deinit_srtp(snd);
     rtp_sender_dealloc(snd);
@@ -587,11 +625,28 @@ main (int argc, char *argv[]) {
     }
 
     /* get next word and loop */
+    if (batch_mode) {
+      char batch_words[RTP_BATCH_SIZE][MAX_WORD_LEN];
+      void *batch_msgs[RTP_BATCH_SIZE];
+      int batch_lens[RTP_BATCH_SIZE];
+      int i, n;
+
+      for (i = 0; i < RTP_BATCH_SIZE; i++)
+	batch_msgs[i] = batch_words[i];
+      while (!interrupted) {
+	n = rtp_recvfrom_batch(rcvr, batch_msgs, batch_lens,
+			       RTP_BATCH_SIZE);
+	for (i = 0; i < n; i++)
+	  if (batch_lens[i] > 0)
+	    printf("\tword: %s\n", batch_words[i]);
+      }
+    } else {
     while (!interrupted) {
       len = MAX_WORD_LEN;
       if (rtp_recvfrom(rcvr, word, &len) > -1)
 	printf("\tword: %s\n", word);
     }
+    }
       
     rtp_receiver_deinit_srtp(rcvr);
     rtp_receiver_dealloc(rcvr);
@@ -639,6 +694,7 @@ usage(char *string) {
 	 "       -b <key>  sets the srtp master key given in base64\n"
 	 "       -s act as rtp sender\n"
 	 "       -r act as rtp receiver\n"
+	 "       -m use batched I/O (sendmmsg/recvmmsg and the batch srtp api)\n"
 	 "       -l list debug modules\n"
 	 "       -d <debug> turn on debugging for module <debug>\n",
 	 string, string);
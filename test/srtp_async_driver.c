@@ -0,0 +1,258 @@
+/*
+ * srtp_async_driver.c
+ *
+ * a test driver for the worker-pool packet processing engine
+ *
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>   /* for usleep() */
+
+#include "srtp_async.h"
+#include "srtp_priv.h"
+
+#define NUM_SSRCS      8
+#define PKTS_PER_SSRC  64
+#define NUM_PKTS       (NUM_SSRCS * PKTS_PER_SSRC)
+#define PAYLOAD_LEN    64
+#define NUM_WORKERS    4
+
+srtp_err_status_t
+srtp_test_async(void);
+
+uint8_t async_test_key[30] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+    0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+int
+main (void)
+{
+    srtp_err_status_t status;
+
+    status = srtp_init();
+    if (status) {
+        printf("error: srtp init failed with error code %d\n", status);
+        exit(1);
+    }
+
+    printf("testing srtp_async engine...");
+    if (srtp_test_async() == srtp_err_status_ok) {
+        printf("passed\n");
+    } else {
+        printf("failed\n");
+        exit(1);
+    }
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return 0;
+}
+
+/* per-packet results, filled in by the completion callback */
+static srtp_err_status_t results[NUM_PKTS];
+static int out_lengths[NUM_PKTS];
+
+static void
+async_test_complete (void *pkt, int len, srtp_err_status_t status,
+                     void *user_data)
+{
+    int i = (int)(uintptr_t)user_data;
+
+    (void)pkt;
+    results[i] = status;
+    out_lengths[i] = len;
+}
+
+/*
+ * protect NUM_PKTS packets spread over NUM_SSRCS streams through one
+ * engine, then unprotect them through another on a receiver session;
+ * success of every unprotect also shows that per-stream submission
+ * order survived the pool (reordering within a stream would trip the
+ * replay check)
+ */
+srtp_err_status_t
+srtp_test_async (void)
+{
+    srtp_policy_t policy;
+    srtp_t send_session, recv_session;
+    srtp_async_engine_t engine;
+    srtp_err_status_t status;
+    uint8_t *packets[NUM_PKTS];
+    int lengths[NUM_PKTS];
+    srtp_hdr_t *hdr;
+    int i, s, p;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = async_test_key;
+    policy.window_size = 128;
+    policy.allow_repeat_tx = 0;
+    policy.next = NULL;
+
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.ssrc.value = 0;
+    status = srtp_create(&send_session, &policy);
+    if (status) {
+        return status;
+    }
+    policy.ssrc.type = ssrc_any_inbound;
+    status = srtp_create(&recv_session, &policy);
+    if (status) {
+        return status;
+    }
+
+    /* build the packets: NUM_SSRCS streams, in-order sequence numbers */
+    for (i = 0; i < NUM_PKTS; i++) {
+        s = i % NUM_SSRCS;
+        p = i / NUM_SSRCS;
+        packets[i] = (uint8_t *)malloc(sizeof(srtp_hdr_t) + PAYLOAD_LEN +
+                                       SRTP_MAX_TRAILER_LEN);
+        if (packets[i] == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+        hdr = (srtp_hdr_t *)packets[i];
+        hdr->version = 2;
+        hdr->p = 0;
+        hdr->x = 0;
+        hdr->cc = 0;
+        hdr->m = 0;
+        hdr->pt = 0xf;
+        hdr->seq = htons((uint16_t)(p + 1));
+        hdr->ts = htonl(p);
+        hdr->ssrc = htonl(0xcafe0000 + s);
+        memset(packets[i] + sizeof(srtp_hdr_t), 0xab, PAYLOAD_LEN);
+        lengths[i] = sizeof(srtp_hdr_t) + PAYLOAD_LEN;
+        results[i] = srtp_err_status_fail;
+    }
+
+    /* protect everything through the pool */
+    status = srtp_async_create(&engine, send_session, NUM_WORKERS);
+    if (status) {
+        return status;
+    }
+    for (i = 0; i < NUM_PKTS; i++) {
+        /* back off on queue-full until the pool catches up */
+        while ((status = srtp_async_protect(engine, packets[i], lengths[i],
+                                            async_test_complete,
+                                            (void *)(uintptr_t)i))
+               == srtp_err_status_alloc_fail) {
+            usleep(100);
+        }
+        if (status) {
+            return status;
+        }
+    }
+    status = srtp_async_drain(engine);
+    if (status) {
+        return status;
+    }
+    for (i = 0; i < NUM_PKTS; i++) {
+        if (results[i] != srtp_err_status_ok) {
+            printf("\nprotect of packet %d failed with error code %d\n",
+                   i, results[i]);
+            return srtp_err_status_fail;
+        }
+        lengths[i] = out_lengths[i];
+        results[i] = srtp_err_status_fail;
+    }
+    status = srtp_async_destroy(engine);
+    if (status) {
+        return status;
+    }
+
+    /* and unprotect through a second pool on the receiver session */
+    status = srtp_async_create(&engine, recv_session, NUM_WORKERS);
+    if (status) {
+        return status;
+    }
+    for (i = 0; i < NUM_PKTS; i++) {
+        while ((status = srtp_async_unprotect(engine, packets[i], lengths[i],
+                                              async_test_complete,
+                                              (void *)(uintptr_t)i))
+               == srtp_err_status_alloc_fail) {
+            usleep(100);
+        }
+        if (status) {
+            return status;
+        }
+    }
+    status = srtp_async_drain(engine);
+    if (status) {
+        return status;
+    }
+    for (i = 0; i < NUM_PKTS; i++) {
+        if (results[i] != srtp_err_status_ok) {
+            printf("\nunprotect of packet %d failed with error code %d\n",
+                   i, results[i]);
+            return srtp_err_status_fail;
+        }
+        if (memcmp(packets[i] + sizeof(srtp_hdr_t),
+                   packets[0] + sizeof(srtp_hdr_t), PAYLOAD_LEN) != 0) {
+            printf("\npayload of packet %d corrupted\n", i);
+            return srtp_err_status_fail;
+        }
+    }
+    status = srtp_async_destroy(engine);
+    if (status) {
+        return status;
+    }
+
+    for (i = 0; i < NUM_PKTS; i++) {
+        free(packets[i]);
+    }
+    status = srtp_dealloc(send_session);
+    if (status) {
+        return status;
+    }
+    status = srtp_dealloc(recv_session);
+    if (status) {
+        return status;
+    }
+
+    return srtp_err_status_ok;
+}
@@ -0,0 +1,337 @@
+/*
+ * srtp_bench.c
+ *
+ * cycle-accurate microbenchmark suite for libSRTP
+ *
+ * sweeps cipher suites x packet sizes x stream counts over the
+ * protect, unprotect and MKI paths, measures per-packet cost with the
+ * CPU cycle counter (with warmup and outlier trimming), and emits one
+ * JSON object per configuration so results can be diffed between
+ * releases by machine
+ */
+/*
+ *
+ * Copyright (c) 2001-2017 Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "srtp.h"
+#include "srtp_priv.h"   /* for srtp_hdr_t */
+#include "getopt_s.h"
+
+/*
+ * cycle counter: the TSC on x86, the virtual counter on aarch64, and
+ * a monotonic-nanosecond fallback elsewhere (the statistics are then
+ * in nanoseconds rather than cycles, which the JSON records)
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_TICK_UNIT "cycles"
+static inline uint64_t bench_ticks(void) {
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+#elif defined(__aarch64__)
+#define BENCH_TICK_UNIT "cycles"
+static inline uint64_t bench_ticks(void) {
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+}
+#else
+#define BENCH_TICK_UNIT "nanoseconds"
+static inline uint64_t bench_ticks(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+/* sweep dimensions */
+static const int bench_pkt_sizes[] = { 64, 256, 576, 1400 };
+static const int bench_stream_counts[] = { 1, 16, 256 };
+
+#define BENCH_MAX_STREAMS  256
+#define BENCH_SSRC_BASE    0xbe000000
+#define BENCH_TRIM_PERCENT 5       /* trimmed from each tail */
+
+static int bench_warmup = 200;     /* untimed packets per configuration */
+static int bench_samples = 2000;   /* timed packets per configuration */
+
+uint8_t bench_key[46] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+    0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73,
+    0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35, 0x77, 0x93,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+uint8_t bench_mki_id_1[4] = { 0xe1, 0xf9, 0x7a, 0x0d };
+uint8_t bench_mki_id_2[4] = { 0xf3, 0xa1, 0x46, 0x71 };
+
+srtp_master_key_t bench_master_key_1 = { bench_key, bench_mki_id_1, 4 };
+srtp_master_key_t bench_master_key_2 = { bench_key, bench_mki_id_2, 4 };
+
+srtp_master_key_t *bench_keys[2] = {
+    &bench_master_key_1, &bench_master_key_2
+};
+
+/* one suite of the sweep: a name and a policy initializer */
+typedef struct bench_suite_t {
+    const char *name;
+    void (*set_policy)(srtp_crypto_policy_t *p);
+    int use_mki;
+} bench_suite_t;
+
+static const bench_suite_t bench_suites[] = {
+    { "aes_cm_128_hmac_sha1_80", srtp_crypto_policy_set_rtp_default,     0 },
+    { "aes_cm_256_hmac_sha1_80",
+      srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80,                    0 },
+    { "null_cipher_hmac_sha1_80",
+      srtp_crypto_policy_set_null_cipher_hmac_sha1_80,                   0 },
+    { "aes_cm_128_hmac_sha1_80_mki", srtp_crypto_policy_set_rtp_default, 1 },
+#ifdef OPENSSL
+    { "aes_gcm_128_16_auth",
+      srtp_crypto_policy_set_aes_gcm_128_16_auth,                        0 },
+    { "aes_gcm_256_16_auth",
+      srtp_crypto_policy_set_aes_gcm_256_16_auth,                        0 },
+#endif
+};
+
+static int bench_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * bench_report(op, ...) sorts the samples, trims BENCH_TRIM_PERCENT
+ * from each tail, and prints one JSON object with the trimmed mean,
+ * median and p99
+ */
+static void bench_report(const bench_suite_t *suite, int pkt_octets,
+                         int num_streams, const char *op,
+                         uint64_t *samples, int count) {
+    int trim = (count * BENCH_TRIM_PERCENT) / 100;
+    double mean = 0.0;
+    int i;
+
+    qsort(samples, count, sizeof(uint64_t), bench_cmp_u64);
+    for (i = trim; i < count - trim; i++)
+        mean += (double)samples[i];
+    mean /= (double)(count - 2 * trim);
+
+    printf("{\"suite\": \"%s\", \"mki\": %d, \"pkt_octets\": %d, "
+           "\"streams\": %d, \"op\": \"%s\", \"unit\": \"%s\", "
+           "\"samples\": %d, \"trimmed\": %d, "
+           "\"mean\": %.1f, \"median\": %llu, \"p99\": %llu, "
+           "\"per_octet\": %.3f}\n",
+           suite->name, suite->use_mki, pkt_octets, num_streams, op,
+           BENCH_TICK_UNIT, count, 2 * trim, mean,
+           (unsigned long long)samples[count / 2],
+           (unsigned long long)samples[(count * 99) / 100],
+           mean / (double)pkt_octets);
+}
+
+/* build an RTP packet for stream n with the given sequence number */
+static void bench_fill_packet(uint8_t *buf, int pkt_octets, int stream,
+                              uint16_t seq) {
+    srtp_hdr_t *hdr = (srtp_hdr_t *)buf;
+
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->x = 0;
+    hdr->cc = 0;
+    hdr->m = 0;
+    hdr->pt = 0x60;
+    hdr->seq = htons(seq);
+    hdr->ts = htonl(seq);
+    hdr->ssrc = htonl(BENCH_SSRC_BASE + stream);
+    memset(buf + 12, 0xab, pkt_octets - 12);
+}
+
+/*
+ * bench_config() runs one configuration: num_streams streams of
+ * pkt_octets packets under the given suite, timing protect on the
+ * sender and unprotect on the receiver packet by packet
+ */
+static int bench_config(const bench_suite_t *suite, int pkt_octets,
+                        int num_streams) {
+    srtp_policy_t policy;
+    srtp_t sender, receiver;
+    srtp_err_status_t status;
+    uint16_t seq[BENCH_MAX_STREAMS];
+    uint64_t *prot_samples, *unprot_samples;
+    uint8_t *buf;
+    uint64_t t0, t1;
+    int i, len;
+
+    memset(&policy, 0, sizeof(policy));
+    suite->set_policy(&policy.rtp);
+    suite->set_policy(&policy.rtcp);
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+    if (suite->use_mki) {
+        policy.keys = bench_keys;
+        policy.num_master_keys = 2;
+    } else {
+        policy.key = bench_key;
+    }
+
+    status = srtp_create(&sender, &policy);
+    if (status)
+        return status;
+    policy.ssrc.type = ssrc_any_inbound;
+    status = srtp_create(&receiver, &policy);
+    if (status)
+        return status;
+
+    buf = malloc(pkt_octets + SRTP_MAX_TRAILER_LEN + 8);
+    prot_samples = malloc(bench_samples * sizeof(uint64_t));
+    unprot_samples = malloc(bench_samples * sizeof(uint64_t));
+    if (buf == NULL || prot_samples == NULL || unprot_samples == NULL)
+        return srtp_err_status_alloc_fail;
+    memset(seq, 0, sizeof(seq));
+
+    for (i = -bench_warmup; i < bench_samples; i++) {
+        int stream = ((unsigned)i) % num_streams;
+
+        bench_fill_packet(buf, pkt_octets, stream, ++seq[stream]);
+        len = pkt_octets;
+
+        t0 = bench_ticks();
+        if (suite->use_mki)
+            status = srtp_protect_mki(sender, buf, &len, 1, 1);
+        else
+            status = srtp_protect(sender, buf, &len);
+        t1 = bench_ticks();
+        if (status) {
+            fprintf(stderr, "protect failed (code %d)\n", status);
+            return status;
+        }
+        if (i >= 0)
+            prot_samples[i] = t1 - t0;
+
+        t0 = bench_ticks();
+        if (suite->use_mki)
+            status = srtp_unprotect_mki(receiver, buf, &len, 1);
+        else
+            status = srtp_unprotect(receiver, buf, &len);
+        t1 = bench_ticks();
+        if (status) {
+            fprintf(stderr, "unprotect failed (code %d)\n", status);
+            return status;
+        }
+        if (i >= 0)
+            unprot_samples[i] = t1 - t0;
+    }
+
+    bench_report(suite, pkt_octets, num_streams, "protect",
+                 prot_samples, bench_samples);
+    bench_report(suite, pkt_octets, num_streams, "unprotect",
+                 unprot_samples, bench_samples);
+
+    free(buf);
+    free(prot_samples);
+    free(unprot_samples);
+    status = srtp_dealloc(sender);
+    if (status)
+        return status;
+    return srtp_dealloc(receiver);
+}
+
+static void usage(char *prog_name) {
+    printf("usage: %s [ -s samples ] [ -w warmup_packets ]\n", prog_name);
+    exit(255);
+}
+
+int main(int argc, char *argv[]) {
+    srtp_err_status_t status;
+    unsigned int s, p, n;
+    int q;
+
+    /* process input arguments */
+    while (1) {
+        q = getopt_s(argc, argv, "s:w:");
+        if (q == -1)
+            break;
+        switch (q) {
+        case 's':
+            bench_samples = atoi(optarg_s);
+            if (bench_samples < 100)
+                usage(argv[0]);
+            break;
+        case 'w':
+            bench_warmup = atoi(optarg_s);
+            if (bench_warmup < 0)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    status = srtp_init();
+    if (status) {
+        printf("error: srtp init failed with error code %d\n", status);
+        exit(1);
+    }
+
+    for (s = 0; s < sizeof(bench_suites) / sizeof(bench_suites[0]); s++) {
+        for (p = 0; p < sizeof(bench_pkt_sizes) / sizeof(int); p++) {
+            for (n = 0; n < sizeof(bench_stream_counts) / sizeof(int); n++) {
+                status = bench_config(&bench_suites[s], bench_pkt_sizes[p],
+                                      bench_stream_counts[n]);
+                if (status) {
+                    printf("error: benchmark failed with error code %d\n",
+                           status);
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return 0;
+}
@@ -49,9 +49,14 @@
 #include <time.h>     /* for clock()           */
 #include <stdlib.h>   /* for malloc(), free()  */
 #include <stdio.h>    /* for print(), fflush() */
+#include <stddef.h>   /* for offsetof()        */
 #include "getopt_s.h" /* for local getopt()    */
 
 #include "srtp_priv.h"
+#include "ekt.h"      /* for the EKT transport test */
+#include "alloc.h"    /* for the allocation guard */
+#include "ut_sim.h"   /* for the traffic model test */
+#include "srtp_offload.h" /* for the offload provider test */
 #include "util.h"
 
 #ifdef HAVE_NETINET_IN_H
@@ -65,7 +70,7 @@
 srtp_err_status_t
 srtp_validate(void);
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 srtp_err_status_t
 srtp_validate_gcm(void);
 #endif
@@ -73,7 +78,7 @@ srtp_validate_gcm(void);
 srtp_err_status_t
 srtp_validate_encrypted_extensions_headers(void);
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 srtp_err_status_t
 srtp_validate_encrypted_extensions_headers_gcm(void);
 #endif
@@ -90,7 +95,7 @@ srtp_dealloc_big_policy(srtp_policy_t *list);
 srtp_err_status_t
 srtp_test_empty_payload(void);
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 srtp_err_status_t
 srtp_test_empty_payload_gcm(void);
 #endif
@@ -101,6 +106,66 @@ srtp_test_remove_stream(void);
 srtp_err_status_t
 srtp_test_update(void);
 
+srtp_err_status_t
+srtp_test_protect_batch(void);
+
+srtp_err_status_t
+srtp_test_protect_rtcp_batch(void);
+
+srtp_err_status_t
+srtp_test_rtp_only_stream(void);
+
+srtp_err_status_t
+srtp_test_keystream_prefetch(void);
+
+srtp_err_status_t
+srtp_test_protect_iov(void);
+
+srtp_err_status_t
+srtp_test_alloc_guard(void);
+
+srtp_err_status_t
+srtp_test_alloc_callbacks(void);
+
+srtp_err_status_t
+srtp_test_deterministic_latency(void);
+
+srtp_err_status_t
+srtp_test_thread_cipher_pool(void);
+
+srtp_err_status_t
+srtp_test_rekey(void);
+
+srtp_err_status_t
+srtp_test_key_limit(void);
+
+srtp_err_status_t
+srtp_test_packet_filter(void);
+
+srtp_err_status_t
+srtp_test_session_stats(void);
+
+srtp_err_status_t
+srtp_test_stream_info(void);
+
+srtp_err_status_t
+srtp_test_create_ex(void);
+
+srtp_err_status_t
+srtp_test_fused_pass(void);
+
+srtp_err_status_t
+srtp_test_unprotect_ex(void);
+
+srtp_err_status_t
+srtp_test_snapshot(void);
+
+srtp_err_status_t
+srtp_test_ekt(void);
+
+srtp_err_status_t
+srtp_test_stream_footprint(void);
+
 srtp_err_status_t
 srtp_test_protect_trailer_length(void);
 
@@ -116,6 +181,24 @@ srtp_test_set_receiver_roc(void);
 srtp_err_status_t
 srtp_test_set_sender_roc(void);
 
+srtp_err_status_t
+srtp_test_roc_recovery(void);
+
+srtp_err_status_t
+srtp_test_null_fast_path(void);
+
+srtp_err_status_t
+srtp_test_traffic_model(void);
+
+srtp_err_status_t
+srtp_test_unprotect_copy(void);
+
+srtp_err_status_t
+srtp_test_offload(void);
+
+srtp_err_status_t
+srtp_test_session_group(void);
+
 double
 srtp_bits_per_second(int msg_len_octets, const srtp_policy_t *policy);
 
@@ -434,7 +517,7 @@ main (int argc, char *argv[])
             exit(1);
         }
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
         printf("testing srtp_protect and srtp_unprotect against "
                "reference packet using GCM\n");
         if (srtp_validate_gcm() == srtp_err_status_ok) {
@@ -454,7 +537,7 @@ main (int argc, char *argv[])
             exit(1);
         }
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
         printf("testing srtp_protect and srtp_unprotect against "
                "reference packet with encrypted extension headers (GCM)\n");
         if (srtp_validate_encrypted_extensions_headers_gcm() == srtp_err_status_ok) {
@@ -489,7 +572,7 @@ main (int argc, char *argv[])
             printf("failed\n");
             exit(1);
         }
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
         printf("testing srtp_protect and srtp_unprotect against "
                "packet with empty payload (GCM)\n");
         if (srtp_test_empty_payload_gcm() == srtp_err_status_ok) {
@@ -522,6 +605,170 @@ main (int argc, char *argv[])
             exit(1);
         }
 
+        /*
+         * test the functions srtp_protect_batch() and
+         * srtp_unprotect_batch()
+         */
+        printf("testing srtp_protect_batch()...");
+        if (srtp_test_protect_batch() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect_rtcp_batch()...");
+        if (srtp_test_protect_rtcp_batch() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing rtp_only and declared-direction policies...");
+        if (srtp_test_rtp_only_stream() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing keystream prefetch cache...");
+        if (srtp_test_keystream_prefetch() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_protect_iov and srtp_unprotect_iov...");
+        if (srtp_test_protect_iov() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing allocation guard on packet paths...");
+        if (srtp_test_alloc_guard() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing pluggable allocation callbacks...");
+        if (srtp_test_alloc_callbacks() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing deterministic-latency mode...");
+        if (srtp_test_deterministic_latency() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing per-thread cipher pools...");
+        if (srtp_test_thread_cipher_pool() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_rekey_stream()...");
+        if (srtp_test_rekey() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing batched key usage limit accounting...");
+        if (srtp_test_key_limit() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing pre-crypto packet filters...");
+        if (srtp_test_packet_filter() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_get_session_stats()...");
+        if (srtp_test_session_stats() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing stream enumeration...");
+        if (srtp_test_stream_info() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_create_ex() preallocation...");
+        if (srtp_test_create_ex() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing fused encrypt+authenticate pass...");
+        if (srtp_test_fused_pass() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_unprotect_ex() packet details...");
+        if (srtp_test_unprotect_ex() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing session snapshot/restore...");
+        if (srtp_test_snapshot() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+#ifndef OPENSSL
+        printf("testing EKT key transport...");
+        if (srtp_test_ekt() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+#endif
+
+        printf("measuring per-stream memory footprint:\n");
+        if (srtp_test_stream_footprint() != srtp_err_status_ok) {
+            printf("failed\n");
+            exit(1);
+        }
+
         /*
          * test the functions srtp_get_protect_trailer_length
          * and srtp_get_protect_rtcp_trailer_length
@@ -566,6 +813,54 @@ main (int argc, char *argv[])
             exit(1);
         }
 
+        printf("testing srtp_test_roc_recovery()...");
+        if (srtp_test_roc_recovery() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_null_fast_path()...");
+        if (srtp_test_null_fast_path() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_traffic_model()...");
+        if (srtp_test_traffic_model() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_unprotect_copy()...");
+        if (srtp_test_unprotect_copy() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_offload()...");
+        if (srtp_test_offload() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_session_group()...");
+        if (srtp_test_session_group() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
     }
 
     if (do_timing_test) {
@@ -634,6 +929,22 @@ main (int argc, char *argv[])
         printf("Wideband\t%d\t\t\t%e\n", 640,
                (double)mips_value * (640 * 8) /
                srtp_bits_per_second(640, &policy) / .02 );
+
+        /*
+         * per-packet cost for voice-sized payloads, where the fixed
+         * overheads dominate the crypto; track this number per release
+         */
+        printf("testing srtp per-packet cost for small payloads:\n");
+        printf("length (octets)\t\tsrtp instructions/packet\n");
+        printf("%d\t\t\t%e\n", 20,
+               (double)mips_value * (20 * 8) /
+               srtp_bits_per_second(20, &policy));
+        printf("%d\t\t\t%e\n", 40,
+               (double)mips_value * (40 * 8) /
+               srtp_bits_per_second(40, &policy));
+        printf("%d\t\t\t%e\n", 160,
+               (double)mips_value * (160 * 8) /
+               srtp_bits_per_second(160, &policy));
     }
 
     status = srtp_shutdown();
@@ -1800,7 +2111,7 @@ srtp_validate ()
     return srtp_err_status_ok;
 }
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 /*
  * srtp_validate_gcm() verifies the correctness of libsrtp by comparing
  * an computed packet against the known ciphertext for the plaintext.
@@ -2088,7 +2399,7 @@ srtp_validate_encrypted_extensions_headers() {
 }
 
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 
 /*
  * Headers of test vectors taken from RFC 6904, Appendix A
@@ -2449,7 +2760,7 @@ srtp_test_empty_payload()
     return srtp_err_status_ok;
 }
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 srtp_err_status_t
 srtp_test_empty_payload_gcm()
 {
@@ -2525,7 +2836,7 @@ srtp_test_empty_payload_gcm()
 
     return srtp_err_status_ok;
 }
-#endif  // OPENSSL
+#endif  // GCM
 
 srtp_err_status_t
 srtp_test_remove_stream ()
@@ -2793,17 +3104,29 @@ srtp_test_update() {
   return srtp_err_status_ok;
 }
 
+/*
+ * srtp_test_protect_batch() verifies that the batch variants produce
+ * the same results as per-packet srtp_protect()/srtp_unprotect() and
+ * that a failing packet is reported in the per-packet status array
+ * without aborting the rest of the batch.
+ */
+
+#define BATCH_TEST_NUM_PKTS 8
+
 srtp_err_status_t
-srtp_test_setup_protect_trailer_streams(srtp_t *srtp_send, srtp_t *srtp_send_mki,
-                                        srtp_t *srtp_send_aes_gcm, srtp_t *srtp_send_aes_gcm_mki) {
+srtp_test_protect_batch() {
 
   srtp_err_status_t status;
+  srtp_err_status_t pkt_status[BATCH_TEST_NUM_PKTS];
+  uint32_t ssrc = 0x24242424;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg[BATCH_TEST_NUM_PKTS];
+  void *pkts[BATCH_TEST_NUM_PKTS];
+  int pkt_len[BATCH_TEST_NUM_PKTS];
+  srtp_t srtp_snd, srtp_recv;
   srtp_policy_t policy;
-  srtp_policy_t policy_mki;
-#ifdef OPENSSL
-  srtp_policy_t policy_aes_gcm;
-  srtp_policy_t policy_aes_gcm_mki;
-#endif // OPENSSL
+  int orig_len;
+  int i;
 
   memset(&policy, 0, sizeof(policy));
   srtp_crypto_policy_set_rtp_default(&policy.rtp);
@@ -2815,260 +3138,2910 @@ srtp_test_setup_protect_trailer_streams(srtp_t *srtp_send, srtp_t *srtp_send_mki
   policy.ssrc.type  = ssrc_any_outbound;
   policy.key = test_key;
 
-  memset(&policy_mki, 0, sizeof(policy_mki));
-  srtp_crypto_policy_set_rtp_default(&policy_mki.rtp);
-  srtp_crypto_policy_set_rtcp_default(&policy_mki.rtcp);
-  policy_mki.ekt = NULL;
-  policy_mki.window_size = 128;
-  policy_mki.allow_repeat_tx = 0;
-  policy_mki.next = NULL;
-  policy_mki.ssrc.type  = ssrc_any_outbound;
-  policy_mki.key = NULL;
-  policy_mki.keys = test_keys;
-  policy_mki.num_master_keys = 2;
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
 
-#ifdef OPENSSL
-  memset(&policy_aes_gcm, 0, sizeof(policy_aes_gcm));
-  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm.rtp);
-  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm.rtcp);
-  policy_aes_gcm.ekt = NULL;
-  policy_aes_gcm.window_size = 128;
-  policy_aes_gcm.allow_repeat_tx = 0;
-  policy_aes_gcm.next = NULL;
-  policy_aes_gcm.ssrc.type  = ssrc_any_outbound;
-  policy_aes_gcm.key = test_key;
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
 
-  memset(&policy_aes_gcm_mki, 0, sizeof(policy_aes_gcm_mki));
-  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm_mki.rtp);
-  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm_mki.rtcp);
-  policy_aes_gcm_mki.ekt = NULL;
-  policy_aes_gcm_mki.window_size = 128;
-  policy_aes_gcm_mki.allow_repeat_tx = 0;
-  policy_aes_gcm_mki.next = NULL;
-  policy_aes_gcm_mki.ssrc.type  = ssrc_any_outbound;
-  policy_aes_gcm_mki.key = NULL;
-  policy_aes_gcm_mki.keys = test_keys;
-  policy_aes_gcm_mki.num_master_keys = 2;
+  /* build a batch of packets with consecutive sequence numbers */
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    msg[i] = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                              (uint16_t)(i + 1), 0, &pkt_len[i]);
+    if (msg[i] == NULL)
+      return srtp_err_status_alloc_fail;
+    pkts[i] = msg[i];
+  }
+  orig_len = pkt_len[0];
 
-#endif
+  status = srtp_protect_batch(srtp_snd, pkts, pkt_len, pkt_status,
+                              BATCH_TEST_NUM_PKTS);
+  if (status)
+    return srtp_err_status_fail;
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++)
+    if (pkt_status[i] != srtp_err_status_ok)
+      return srtp_err_status_fail;
 
-  /* create a send ctx with defualt profile and test_key */
-  status = srtp_create(srtp_send, &policy);
+  status = srtp_unprotect_batch(srtp_recv, pkts, pkt_len, pkt_status,
+                                BATCH_TEST_NUM_PKTS);
   if (status)
-    return status;
+    return srtp_err_status_fail;
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    if (pkt_status[i] != srtp_err_status_ok)
+      return srtp_err_status_fail;
+    if (pkt_len[i] != orig_len)
+      return srtp_err_status_fail;
+  }
 
-  status = srtp_create(srtp_send_mki, &policy_mki);
+  /* build and protect a second batch, then corrupt one packet; its
+     failure must be reported individually and must not abort the batch */
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    free(msg[i]);
+    msg[i] = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                              (uint16_t)(BATCH_TEST_NUM_PKTS + i + 1),
+                                              0, &pkt_len[i]);
+    if (msg[i] == NULL)
+      return srtp_err_status_alloc_fail;
+    pkts[i] = msg[i];
+  }
+
+  status = srtp_protect_batch(srtp_snd, pkts, pkt_len, pkt_status,
+                              BATCH_TEST_NUM_PKTS);
   if (status)
-    return status;
+    return srtp_err_status_fail;
 
-#ifdef OPENSSL
-  status = srtp_create(srtp_send_aes_gcm, &policy_aes_gcm);
+  ((uint8_t *)pkts[2])[msg_len_octets - 1] ^= 0xff;  /* corrupt the payload */
+
+  status = srtp_unprotect_batch(srtp_recv, pkts, pkt_len, pkt_status,
+                                BATCH_TEST_NUM_PKTS);
+  if (status != srtp_err_status_fail)
+    return srtp_err_status_fail;
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    if (i == 2) {
+      if (pkt_status[i] == srtp_err_status_ok)
+        return srtp_err_status_fail;
+    } else if (pkt_status[i] != srtp_err_status_ok) {
+      return srtp_err_status_fail;
+    }
+  }
+
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++)
+    free(msg[i]);
+
+  status = srtp_dealloc(srtp_snd);
   if (status)
     return status;
 
-  status = srtp_create(srtp_send_aes_gcm_mki, &policy_aes_gcm_mki);
+  status = srtp_dealloc(srtp_recv);
   if (status)
     return status;
-#endif //OPENSSL
 
   return srtp_err_status_ok;
 }
 
+/*
+ * srtp_test_protect_rtcp_batch() verifies that the RTCP batch
+ * variants produce the same results as per-packet
+ * srtp_protect_rtcp()/srtp_unprotect_rtcp() and that a failing packet
+ * is reported individually without aborting the batch.
+ */
+
 srtp_err_status_t
-srtp_test_protect_trailer_length() {
+srtp_test_protect_rtcp_batch() {
 
-  srtp_t srtp_send;
-  srtp_t srtp_send_mki;
-  srtp_t srtp_send_aes_gcm;
-  srtp_t srtp_send_aes_gcm_mki;
-  uint32_t length = 0;
   srtp_err_status_t status;
+  srtp_err_status_t pkt_status[BATCH_TEST_NUM_PKTS];
+  uint32_t ssrc = 0x42424242;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg[BATCH_TEST_NUM_PKTS];
+  void *pkts[BATCH_TEST_NUM_PKTS];
+  int pkt_len[BATCH_TEST_NUM_PKTS];
+  srtp_t srtcp_snd, srtcp_recv;
+  srtp_policy_t policy;
+  int orig_len;
+  int i;
 
-  srtp_test_setup_protect_trailer_streams(&srtp_send, &srtp_send_mki,
-					  &srtp_send_aes_gcm, &srtp_send_aes_gcm_mki);
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type  = ssrc_any_outbound;
+  policy.key = test_key;
 
-  status = srtp_get_protect_trailer_length(srtp_send, 0, 0, &length);
+  status = srtp_create(&srtcp_snd, &policy);
   if (status)
     return status;
 
-  /*  TAG Length: 10 bytes */
-  if (length != 10)
-    return srtp_err_status_fail;
-
-  status = srtp_get_protect_trailer_length(srtp_send_mki, 1, 1, &length);
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtcp_recv, &policy);
   if (status)
     return status;
 
-  /*  TAG Length: 10 bytes + MKI length: 4 bytes*/
-  if (length != 14)
+  /* build a batch of compound packets */
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    msg[i] = srtp_create_test_packet(msg_len_octets, ssrc, &pkt_len[i]);
+    if (msg[i] == NULL)
+      return srtp_err_status_alloc_fail;
+    pkts[i] = msg[i];
+  }
+  orig_len = pkt_len[0];
+
+  status = srtp_protect_rtcp_batch(srtcp_snd, pkts, pkt_len, pkt_status,
+                                   BATCH_TEST_NUM_PKTS);
+  if (status)
     return srtp_err_status_fail;
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++)
+    if (pkt_status[i] != srtp_err_status_ok)
+      return srtp_err_status_fail;
 
-#ifdef OPENSSL
-  status = srtp_get_protect_trailer_length(srtp_send_aes_gcm, 0, 0, &length);
+  status = srtp_unprotect_rtcp_batch(srtcp_recv, pkts, pkt_len, pkt_status,
+                                     BATCH_TEST_NUM_PKTS);
   if (status)
-    return status;
+    return srtp_err_status_fail;
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    if (pkt_status[i] != srtp_err_status_ok)
+      return srtp_err_status_fail;
+    if (pkt_len[i] != orig_len)
+      return srtp_err_status_fail;
+  }
 
-  /*  TAG Length: 16 bytes */
-  if (length != 16)
+  /* protect a second batch, corrupt one packet, and verify that only
+     that packet is reported as failing */
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    free(msg[i]);
+    msg[i] = srtp_create_test_packet(msg_len_octets, ssrc, &pkt_len[i]);
+    if (msg[i] == NULL)
+      return srtp_err_status_alloc_fail;
+    pkts[i] = msg[i];
+  }
+
+  status = srtp_protect_rtcp_batch(srtcp_snd, pkts, pkt_len, pkt_status,
+                                   BATCH_TEST_NUM_PKTS);
+  if (status)
     return srtp_err_status_fail;
 
+  ((uint8_t *)pkts[2])[msg_len_octets - 1] ^= 0xff;  /* corrupt the payload */
 
-  status = srtp_get_protect_trailer_length(srtp_send_aes_gcm_mki, 1, 1, &length);
+  status = srtp_unprotect_rtcp_batch(srtcp_recv, pkts, pkt_len, pkt_status,
+                                     BATCH_TEST_NUM_PKTS);
+  if (status != srtp_err_status_fail)
+    return srtp_err_status_fail;
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++) {
+    if (i == 2) {
+      if (pkt_status[i] == srtp_err_status_ok)
+        return srtp_err_status_fail;
+    } else if (pkt_status[i] != srtp_err_status_ok) {
+      return srtp_err_status_fail;
+    }
+  }
+
+  for (i = 0; i < BATCH_TEST_NUM_PKTS; i++)
+    free(msg[i]);
+
+  status = srtp_dealloc(srtcp_snd);
   if (status)
     return status;
 
-  /*  TAG Length: 16 bytes + MKI length: 4 bytes*/
-  if (length != 20)
-    return srtp_err_status_fail;
+  status = srtp_dealloc(srtcp_recv);
+  if (status)
+    return status;
 
-#endif //OPENSSL
   return srtp_err_status_ok;
 }
 
+/*
+ * srtp_test_rtp_only_stream() verifies that a policy with rtp_only set
+ * and a declared stream direction round-trips RTP normally, and that
+ * the RTCP calls on such a stream fail with srtp_err_status_no_ctx
+ * instead of touching the unallocated SRTCP contexts.
+ */
+
 srtp_err_status_t
-srtp_test_protect_rtcp_trailer_length() {
+srtp_test_rtp_only_stream() {
 
-  srtp_t srtp_send;
-  srtp_t srtp_send_mki;
-  srtp_t srtp_send_aes_gcm;
-  srtp_t srtp_send_aes_gcm_mki;
-  uint32_t length = 0;
   srtp_err_status_t status;
+  uint32_t ssrc = 0x57575757;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len;
+  uint32_t trailer_len;
+  srtp_t snd, recv;
+  srtp_policy_t policy;
 
-  srtp_test_setup_protect_trailer_streams(&srtp_send, &srtp_send_mki,
-					  &srtp_send_aes_gcm, &srtp_send_aes_gcm_mki);
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+  policy.rtp_only = 1;
+  policy.stream_direction = srtp_stream_direction_sender;
 
-  status = srtp_get_protect_rtcp_trailer_length(srtp_send, 0, 0, &length);
+  status = srtp_create(&snd, &policy);
   if (status)
     return status;
 
-  /*  TAG Length: 10 bytes + SRTCP Trailer 4 bytes*/
-  if (length != 14)
-    return srtp_err_status_fail;
-
-  status = srtp_get_protect_rtcp_trailer_length(srtp_send_mki, 1, 1, &length);
+  policy.stream_direction = srtp_stream_direction_receiver;
+  status = srtp_create(&recv, &policy);
   if (status)
     return status;
 
-  /*  TAG Length: 10 bytes + SRTCP Trailer 4 bytes + MKI 4 bytes*/
-  if (length != 18)
+  msg = srtp_create_test_packet(msg_len_octets, ssrc, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+
+  status = srtp_protect(snd, msg, &len);
+  if (status) {
+    free(msg);
     return srtp_err_status_fail;
+  }
 
-#ifdef OPENSSL
-  status = srtp_get_protect_rtcp_trailer_length(srtp_send_aes_gcm, 0, 0, &length);
-  if (status)
-    return status;
+  status = srtp_unprotect(recv, msg, &len);
+  if (status) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
 
-  /*  TAG Length: 16 bytes + SRTCP Trailer 4 bytes*/
-  if (length != 20)
+  /*
+   * the RTCP calls must fail cleanly; place the SSRC where the RTCP
+   * header carries it so that the stream lookup succeeds and the
+   * missing-context check itself is what fires
+   */
+  ((uint32_t *)msg)[1] = ((uint32_t *)msg)[2];
+  status = srtp_protect_rtcp(snd, msg, &len);
+  if (status != srtp_err_status_no_ctx) {
+    free(msg);
     return srtp_err_status_fail;
+  }
+  if (srtp_get_protect_rtcp_trailer_length(snd, 0, 0, &trailer_len) !=
+      srtp_err_status_no_ctx) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
 
+  free(msg);
 
-  status = srtp_get_protect_rtcp_trailer_length(srtp_send_aes_gcm_mki, 1, 1, &length);
+  status = srtp_dealloc(snd);
   if (status)
     return status;
 
-  /*  TAG Length: 16 bytes + SRTCP Trailer 4 bytes + MKI 4 bytes*/
-  if (length != 24)
-    return srtp_err_status_fail;
+  status = srtp_dealloc(recv);
+  if (status)
+    return status;
 
-#endif //OPENSSL
   return srtp_err_status_ok;
 }
 
+/*
+ * srtp_test_keystream_prefetch() verifies that packets whose AES-ICM
+ * keystream was precomputed by srtp_stream_prefetch_keystream()
+ * round-trip identically to the normal path: the protect side and the
+ * unprotect side both run with prefetch enabled, and the recovered
+ * payload is compared byte for byte.
+ */
+
 srtp_err_status_t
-srtp_test_get_roc() {
+srtp_test_keystream_prefetch() {
+
   srtp_err_status_t status;
+  uint32_t ssrc = 0x31415926;
+  int msg_len_octets = 64;
+  srtp_hdr_t *msg;
+  int len;
+  srtp_t snd, recv;
   srtp_policy_t policy;
-  srtp_t session;
-  srtp_hdr_t *pkt;
-  uint32_t i;
-  uint32_t roc;
-  uint32_t ts;
-  uint16_t seq;
-
-  int msg_len_octets = 32;
-  int protected_msg_len_octets;
+  int i, j;
 
   memset(&policy, 0, sizeof(policy));
   srtp_crypto_policy_set_rtp_default(&policy.rtp);
   srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
-  policy.ssrc.type  = ssrc_specific;
-  policy.ssrc.value = 0xcafebabe;
-  policy.key = test_key;
+  policy.ekt = NULL;
   policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
 
-  /* Create a sender session */
-  status = srtp_create(&session, &policy);
-  if (status) {
+  status = srtp_create(&snd, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&recv, &policy);
+  if (status)
     return status;
-  }
 
-  /* Set start sequence so we roll over */
-  seq = 65535;
-  ts = 0;
+  /* a missing stream must be reported */
+  if (srtp_stream_set_keystream_prefetch(snd, ssrc + 1, 8, 256) !=
+      srtp_err_status_no_ctx)
+    return srtp_err_status_fail;
 
-  for (i = 0; i < 2; i++) {
-    pkt = srtp_create_test_packet_extended(msg_len_octets, policy.ssrc.value, seq, ts, &protected_msg_len_octets);
-    status = srtp_protect(session, pkt, &protected_msg_len_octets);
-    free(pkt);
+  status = srtp_stream_set_keystream_prefetch(snd, ssrc, 8, 256);
+  if (status)
+    return status;
+  status = srtp_stream_set_keystream_prefetch(recv, ssrc, 8, 256);
+  if (status)
+    return status;
+
+  for (i = 0; i < 16; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)(1000 + i), 0xdecafbad,
+                                           &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+
+    status = srtp_protect(snd, msg, &len);
     if (status) {
-      return status;
+      free(msg);
+      return srtp_err_status_fail;
     }
 
-    status = srtp_get_stream_roc(session, policy.ssrc.value, &roc);
+    status = srtp_unprotect(recv, msg, &len);
     if (status) {
-      return status;
+      free(msg);
+      return srtp_err_status_fail;
     }
 
-    if (roc != i) {
+    /* the recovered payload must match what the creator filled in */
+    if (len != msg_len_octets + 12)
       return srtp_err_status_fail;
+    for (j = 0; j < msg_len_octets; j++) {
+      if (((uint8_t *)msg)[12 + j] != 0xab) {
+        free(msg);
+        return srtp_err_status_fail;
+      }
     }
+    free(msg);
 
-    seq++;
-    ts++;
+    /* refill the caches for the predicted next indices */
+    status = srtp_stream_prefetch_keystream(snd, ssrc, 8);
+    if (status)
+      return status;
+    status = srtp_stream_prefetch_keystream(recv, ssrc, 8);
+    if (status)
+      return status;
   }
 
-  /* Cleanup */
-  status = srtp_dealloc(session);
-  if (status) {
+  /* disabling releases the cache */
+  status = srtp_stream_set_keystream_prefetch(snd, ssrc, 0, 0);
+  if (status)
+    return status;
+  if (srtp_stream_prefetch_keystream(snd, ssrc, 8) !=
+      srtp_err_status_bad_param)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(snd);
+  if (status)
+    return status;
+  status = srtp_dealloc(recv);
+  if (status)
     return status;
-  }
 
   return srtp_err_status_ok;
 }
 
-static srtp_err_status_t
-test_set_receiver_roc(uint32_t packets, uint32_t roc_to_set)
-{
-  srtp_err_status_t status;
-
-  srtp_policy_t sender_policy;
-  srtp_t sender_session;
+/*
+ * srtp_test_protect_iov() verifies that the scatter-gather variants
+ * produce exactly the ciphertext and tag of the contiguous API, and
+ * that srtp_unprotect_iov() recovers the plaintext from the scattered
+ * segments.
+ */
 
-  srtp_policy_t receiver_policy;
-  srtp_t receiver_session;
+srtp_err_status_t
+srtp_test_protect_iov() {
 
-  srtp_hdr_t *pkt_1;
-  unsigned char *recv_pkt_1;
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x25252525;
+  int msg_len_octets = 64;
+  srtp_hdr_t *ref_pkt;
+  srtp_hdr_t *iov_pkt;
+  uint8_t trailer[SRTP_MAX_TRAILER_LEN];
+  srtp_iovec_t iov[3];
+  uint8_t seg1[40], seg2[64];
+  int ref_len, iov_len, orig_len, split;
+  srtp_t srtp_snd, srtp_snd_iov, srtp_recv;
+  srtp_policy_t policy;
 
-  srtp_hdr_t *pkt_2;
-  unsigned char *recv_pkt_2;
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type  = ssrc_any_outbound;
+  policy.key = test_key;
 
-  uint32_t i;
-  uint32_t ts;
-  uint16_t seq;
+  /* two identically keyed senders, so the same packet can be
+     protected once through each API and the outputs compared */
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
 
-  int msg_len_octets = 32;
-  int protected_msg_len_octets_1;
-  int protected_msg_len_octets_2;
+  status = srtp_create(&srtp_snd_iov, &policy);
+  if (status)
+    return status;
 
-  /* Create sender */
-  memset(&sender_policy, 0, sizeof(sender_policy));
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  /* protect one packet through the contiguous API as the reference */
+  ref_pkt = srtp_create_test_packet(msg_len_octets, ssrc, &ref_len);
+  if (ref_pkt == NULL)
+    return srtp_err_status_alloc_fail;
+  orig_len = ref_len;
+  status = srtp_protect(srtp_snd, ref_pkt, &ref_len);
+  if (status)
+    return status;
+
+  /* scatter an identical packet over header + two payload segments */
+  iov_pkt = srtp_create_test_packet(msg_len_octets, ssrc, &iov_len);
+  if (iov_pkt == NULL)
+    return srtp_err_status_alloc_fail;
+  split = 24;
+  memcpy(seg1, (uint8_t *)iov_pkt + 12, split - 12);
+  memcpy(seg2, (uint8_t *)iov_pkt + split, iov_len - split);
+  iov[0].iov_base = iov_pkt;           /* the RTP header      */
+  iov[0].iov_len = 12;
+  iov[1].iov_base = seg1;              /* first payload piece */
+  iov[1].iov_len = split - 12;
+  iov[2].iov_base = seg2;              /* second piece        */
+  iov[2].iov_len = iov_len - split;
+
+  status = srtp_protect_iov(srtp_snd_iov, iov, 3, &iov_len, trailer);
+  if (status)
+    return status;
+
+  /* the scattered ciphertext and tag must match the reference */
+  if (iov_len != ref_len)
+    return srtp_err_status_fail;
+  if (memcmp(iov[0].iov_base, ref_pkt, 12) ||
+      memcmp(iov[1].iov_base, (uint8_t *)ref_pkt + 12, split - 12) ||
+      memcmp(iov[2].iov_base, (uint8_t *)ref_pkt + split,
+             orig_len - split) ||
+      memcmp(trailer, (uint8_t *)ref_pkt + orig_len, ref_len - orig_len))
+    return srtp_err_status_fail;
+
+  /* hand the scattered packet (tag appended to the last segment) to
+     srtp_unprotect_iov() and check the recovered plaintext */
+  memcpy(seg2 + orig_len - split, trailer, ref_len - orig_len);
+  iov[2].iov_len = orig_len - split + (ref_len - orig_len);
+
+  status = srtp_unprotect_iov(srtp_recv, iov, 3, &iov_len);
+  if (status)
+    return status;
+  if (iov_len != orig_len)
+    return srtp_err_status_fail;
+  if (memcmp(iov[1].iov_base, (uint8_t *)iov_pkt + 12, split - 12) ||
+      memcmp(iov[2].iov_base, (uint8_t *)iov_pkt + split,
+             orig_len - split))
+    return srtp_err_status_fail;
+
+  free(ref_pkt);
+  free(iov_pkt);
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  status = srtp_dealloc(srtp_snd_iov);
+  if (status)
+    return status;
+
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_test_setup_protect_trailer_streams(srtp_t *srtp_send, srtp_t *srtp_send_mki,
+                                        srtp_t *srtp_send_aes_gcm, srtp_t *srtp_send_aes_gcm_mki) {
+
+  srtp_err_status_t status;
+  srtp_policy_t policy;
+  srtp_policy_t policy_mki;
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  srtp_policy_t policy_aes_gcm;
+  srtp_policy_t policy_aes_gcm_mki;
+#endif // GCM
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type  = ssrc_any_outbound;
+  policy.key = test_key;
+
+  memset(&policy_mki, 0, sizeof(policy_mki));
+  srtp_crypto_policy_set_rtp_default(&policy_mki.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy_mki.rtcp);
+  policy_mki.ekt = NULL;
+  policy_mki.window_size = 128;
+  policy_mki.allow_repeat_tx = 0;
+  policy_mki.next = NULL;
+  policy_mki.ssrc.type  = ssrc_any_outbound;
+  policy_mki.key = NULL;
+  policy_mki.keys = test_keys;
+  policy_mki.num_master_keys = 2;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  memset(&policy_aes_gcm, 0, sizeof(policy_aes_gcm));
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm.rtp);
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm.rtcp);
+  policy_aes_gcm.ekt = NULL;
+  policy_aes_gcm.window_size = 128;
+  policy_aes_gcm.allow_repeat_tx = 0;
+  policy_aes_gcm.next = NULL;
+  policy_aes_gcm.ssrc.type  = ssrc_any_outbound;
+  policy_aes_gcm.key = test_key;
+
+  memset(&policy_aes_gcm_mki, 0, sizeof(policy_aes_gcm_mki));
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm_mki.rtp);
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy_aes_gcm_mki.rtcp);
+  policy_aes_gcm_mki.ekt = NULL;
+  policy_aes_gcm_mki.window_size = 128;
+  policy_aes_gcm_mki.allow_repeat_tx = 0;
+  policy_aes_gcm_mki.next = NULL;
+  policy_aes_gcm_mki.ssrc.type  = ssrc_any_outbound;
+  policy_aes_gcm_mki.key = NULL;
+  policy_aes_gcm_mki.keys = test_keys;
+  policy_aes_gcm_mki.num_master_keys = 2;
+
+#endif
+
+  /* create a send ctx with defualt profile and test_key */
+  status = srtp_create(srtp_send, &policy);
+  if (status)
+    return status;
+
+  status = srtp_create(srtp_send_mki, &policy_mki);
+  if (status)
+    return status;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  status = srtp_create(srtp_send_aes_gcm, &policy_aes_gcm);
+  if (status)
+    return status;
+
+  status = srtp_create(srtp_send_aes_gcm_mki, &policy_aes_gcm_mki);
+  if (status)
+    return status;
+#endif // GCM
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_alloc_guard() verifies the zero-allocation contract on
+ * the packet processing paths: protecting and unprotecting a run of
+ * packets (including the first packet of a wildcard stream, which is
+ * allowed to allocate its stream context) must not raise the
+ * allocation guard violation count, while a stray srtp_crypto_alloc()
+ * inside a guarded section must.
+ */
+
+srtp_err_status_t
+srtp_test_alloc_guard() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x26262626;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len, orig_len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  uint32_t violations;
+  void *ptr;
+  int i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type  = ssrc_any_outbound;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  violations = srtp_crypto_alloc_guard_violations();
+
+  for (i = 0; i < 4; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)(i + 1), 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    orig_len = len;
+
+    status = srtp_protect(srtp_snd, msg, &len);
+    if (status) {
+      free(msg);
+      return status;
+    }
+    status = srtp_unprotect(srtp_recv, msg, &len);
+    free(msg);
+    if (status)
+      return status;
+    if (len != orig_len)
+      return srtp_err_status_fail;
+  }
+
+  if (srtp_crypto_alloc_guard_violations() != violations)
+    return srtp_err_status_fail;
+
+#ifndef SRTP_ALLOC_GUARD_ABORT
+  /* a stray allocation inside a guarded section must be counted */
+  srtp_crypto_alloc_guard_begin();
+  ptr = srtp_crypto_alloc(64);
+  srtp_crypto_alloc_guard_end();
+  if (ptr == NULL)
+    return srtp_err_status_alloc_fail;
+  srtp_crypto_free(ptr);
+  if (srtp_crypto_alloc_guard_violations() != violations + 1)
+    return srtp_err_status_fail;
+#else
+  (void)ptr;
+#endif
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+/*
+ * counting arena for srtp_test_alloc_callbacks(); the callbacks
+ * forward to malloc()/free() and tally how many blocks each arena
+ * has handed out and taken back
+ */
+
+typedef struct {
+  int allocs;
+  int frees;
+} test_arena_t;
+
+static void *
+test_alloc_callback(void *arena, size_t size) {
+  ((test_arena_t *)arena)->allocs++;
+  return malloc(size);
+}
+
+static void
+test_dealloc_callback(void *arena, void *ptr, size_t size) {
+  (void)size;
+  ((test_arena_t *)arena)->frees++;
+  free(ptr);
+}
+
+/*
+ * srtp_test_alloc_callbacks() verifies the pluggable allocation
+ * callbacks: a session created while an arena is current draws all of
+ * its memory from that arena and releases it there on deallocation,
+ * even if the current arena has changed in between; a half-installed
+ * callback pair is rejected; and uninstalling the callbacks restores
+ * the built-in allocator.
+ */
+
+srtp_err_status_t
+srtp_test_alloc_callbacks() {
+
+  srtp_err_status_t status;
+  test_arena_t arena_a = { 0, 0 };
+  test_arena_t arena_b = { 0, 0 };
+  srtp_t session;
+  srtp_policy_t policy;
+  void *ptr;
+
+  /* the callbacks come and go as a pair */
+  status = srtp_install_alloc_callbacks(test_alloc_callback, NULL, &arena_a);
+  if (status != srtp_err_status_bad_param)
+    return srtp_err_status_fail;
+
+  status = srtp_install_alloc_callbacks(test_alloc_callback,
+                                        test_dealloc_callback, &arena_a);
+  if (status)
+    return status;
+
+  /* a session created now draws all of its memory from arena a */
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = 0x27272727;
+  policy.key = test_key;
+  policy.window_size = 128;
+  policy.next = NULL;
+
+  status = srtp_create(&session, &policy);
+  if (status)
+    return status;
+  if (arena_a.allocs == 0)
+    return srtp_err_status_fail;
+
+  /*
+   * a block remembers the arena it came from and is released to it,
+   * even after the current arena changes
+   */
+  ptr = srtp_crypto_alloc(64);
+  if (ptr == NULL)
+    return srtp_err_status_alloc_fail;
+  if (srtp_set_alloc_arena(&arena_b) != (void *)&arena_a)
+    return srtp_err_status_fail;
+  srtp_crypto_free(ptr);
+  if (arena_b.frees != 0)
+    return srtp_err_status_fail;
+
+  /* the session's blocks likewise go back to arena a */
+  status = srtp_dealloc(session);
+  if (status)
+    return status;
+  if (arena_a.allocs != arena_a.frees)
+    return srtp_err_status_fail;
+  if (arena_b.allocs != 0 || arena_b.frees != 0)
+    return srtp_err_status_fail;
+
+  /* restore the built-in allocator and check it still works */
+  status = srtp_install_alloc_callbacks(NULL, NULL, NULL);
+  if (status)
+    return status;
+  ptr = srtp_crypto_alloc(64);
+  if (ptr == NULL)
+    return srtp_err_status_alloc_fail;
+  srtp_crypto_free(ptr);
+  if (arena_a.allocs != arena_a.frees)
+    return srtp_err_status_fail;
+
+  return srtp_err_status_ok;
+}
+
+static int
+compare_uint64(const void *a, const void *b) {
+  uint64_t va = *(const uint64_t *)a;
+  uint64_t vb = *(const uint64_t *)b;
+
+  if (va < vb)
+    return -1;
+  if (va > vb)
+    return 1;
+  return 0;
+}
+
+#define LATENCY_TEST_SAMPLES 1500
+
+/*
+ * srtp_test_deterministic_latency() verifies the bounded worst-case
+ * contract of srtp_set_deterministic_latency(): with the mode enabled
+ * and clone contexts stocked at setup time, a gap-heavy packet run
+ * (including reordering gaps larger than the replay window) raises no
+ * allocation guard violations, a packet from an SSRC beyond the
+ * stocked population is rejected with srtp_err_status_no_ctx rather
+ * than served by a slow path, and the per-call srtp_unprotect()
+ * latency distribution is free of slow-path spikes: the 99th
+ * percentile must sit within a small factor of the median.
+ */
+
+srtp_err_status_t
+srtp_test_deterministic_latency() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x10a70000;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len, orig_len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  uint32_t violations;
+  static uint64_t samples[LATENCY_TEST_SAMPLES];
+  uint64_t median, tail;
+  struct timespec before, after;
+  uint16_t seq;
+  int i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.key = test_key;
+
+  status = srtp_create_ex(&srtp_snd, &policy, 2);
+  if (status)
+    return status;
+
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create_ex(&srtp_recv, &policy, 2);
+  if (status)
+    return status;
+
+  status = srtp_set_deterministic_latency(srtp_snd, 1);
+  if (status)
+    return status;
+  status = srtp_set_deterministic_latency(srtp_recv, 1);
+  if (status)
+    return status;
+
+  violations = srtp_crypto_alloc_guard_violations();
+
+  /*
+   * a gap-heavy run on two streams: every 50th packet jumps the
+   * sequence number by 300 (a large in-window shift), and one jump
+   * mid-run exceeds the window, exercising the constant-time clear
+   */
+  seq = 1;
+  for (i = 0; i < LATENCY_TEST_SAMPLES; i++) {
+    if (i > 0 && i % 50 == 0)
+      seq += 300;
+    if (i == LATENCY_TEST_SAMPLES / 2)
+      seq += 1000;
+    seq++;
+
+    msg = srtp_create_test_packet_extended(msg_len_octets,
+                                           ssrc + (uint32_t)(i & 1),
+                                           seq, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    orig_len = len;
+
+    status = srtp_protect(srtp_snd, msg, &len);
+    if (status) {
+      free(msg);
+      return status;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    status = srtp_unprotect(srtp_recv, msg, &len);
+    clock_gettime(CLOCK_MONOTONIC, &after);
+    free(msg);
+    if (status)
+      return status;
+    if (len != orig_len)
+      return srtp_err_status_fail;
+
+    samples[i] = (uint64_t)(after.tv_sec - before.tv_sec) * 1000000000ULL
+      + (uint64_t)(after.tv_nsec - before.tv_nsec);
+  }
+
+  /* the run must not have touched the allocator */
+  if (srtp_crypto_alloc_guard_violations() != violations)
+    return srtp_err_status_fail;
+
+  /*
+   * an SSRC beyond the stocked population must be rejected rather
+   * than trigger allocation and key derivation on the packet path;
+   * once the mode is lifted, the same packet instantiates a stream
+   */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc + 2,
+                                         1, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status != srtp_err_status_no_ctx) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
+  status = srtp_set_deterministic_latency(srtp_snd, 0);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  status = srtp_unprotect(srtp_recv, msg, &len);
+  if (status != srtp_err_status_no_ctx) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
+  status = srtp_set_deterministic_latency(srtp_recv, 0);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  status = srtp_unprotect(srtp_recv, msg, &len);
+  free(msg);
+  if (status)
+    return status;
+
+  /*
+   * latency distribution: with the slow paths gone, the tail of the
+   * per-call time must stay within a small factor of the median; the
+   * factor is generous, to tolerate scheduler noise, while a stray
+   * allocation plus key derivation would far exceed it.  the top
+   * percentile is left out, since it is dominated by interrupts
+   * rather than by the code under test
+   */
+  qsort(samples, LATENCY_TEST_SAMPLES, sizeof(samples[0]), compare_uint64);
+  median = samples[LATENCY_TEST_SAMPLES / 2];
+  tail = samples[LATENCY_TEST_SAMPLES - 1 - LATENCY_TEST_SAMPLES / 100];
+  if (median > 0 && tail > 32 * median)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+/*
+ * helper for srtp_test_thread_cipher_pool(): one protect/unprotect
+ * round trip on the given sessions, unprotecting under the given pool
+ * slot, with the payload verified
+ */
+static srtp_err_status_t
+thread_pool_round_trip(srtp_t srtp_snd, srtp_t srtp_recv, uint32_t ssrc,
+                       uint16_t seq, unsigned int slot) {
+  srtp_err_status_t status;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len, orig_len, i;
+  uint8_t *data;
+
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, seq, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  orig_len = len;
+
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+
+  srtp_set_thread_cipher_slot(slot);
+  status = srtp_unprotect(srtp_recv, msg, &len);
+  srtp_set_thread_cipher_slot(0);
+  if (status) {
+    free(msg);
+    return status;
+  }
+
+  if (len != orig_len) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
+  data = (uint8_t *)msg + 12;
+  for (i = 0; i < msg_len_octets; i++) {
+    if (data[i] != 0xab) {
+      free(msg);
+      return srtp_err_status_fail;
+    }
+  }
+  free(msg);
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_thread_cipher_pool() verifies the per-thread cipher pool:
+ * packets of one stream must unprotect correctly under any pool slot
+ * (each slot runs on its own cipher replicas, so a correct round trip
+ * proves the replicas carry the key schedule), attaching a pool to an
+ * unknown SSRC must fail, and removing the pool must return the
+ * stream to its own contexts.  the slots are exercised from a single
+ * thread here; the replica separation they provide is what makes the
+ * multi-threaded use safe.
+ */
+
+srtp_err_status_t
+srtp_test_thread_cipher_pool() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x700c1e44;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  uint16_t seq = 0x2310;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  /* a pool can only be attached to an existing stream */
+  status = srtp_stream_set_thread_cipher_pool(srtp_recv,
+                                              htonl(ssrc + 1), 2);
+  if (status != srtp_err_status_no_ctx)
+    return srtp_err_status_fail;
+
+  status = srtp_stream_set_thread_cipher_pool(srtp_recv, htonl(ssrc), 2);
+  if (status)
+    return status;
+
+  /* round trips under each slot, including the stream's own slot 0 */
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 1);
+  if (status)
+    return status;
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 2);
+  if (status)
+    return status;
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 0);
+  if (status)
+    return status;
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 1);
+  if (status)
+    return status;
+
+  /* a slot beyond the pool falls back to the stream's own contexts */
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 7);
+  if (status)
+    return status;
+
+  /* removing the pool returns the stream to its own contexts */
+  status = srtp_stream_set_thread_cipher_pool(srtp_recv, htonl(ssrc), 0);
+  if (status)
+    return status;
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 1);
+  if (status)
+    return status;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  /* the same exercise under an AEAD policy */
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtp);
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  status = srtp_stream_set_thread_cipher_pool(srtp_recv, htonl(ssrc), 2);
+  if (status)
+    return status;
+
+  seq = 0x2310;
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 1);
+  if (status)
+    return status;
+  status = thread_pool_round_trip(srtp_snd, srtp_recv, ssrc, seq++, 2);
+  if (status)
+    return status;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+#endif // GCM
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_session_stats() exercises the per-stream hot-path
+ * counters: a run of protected and unprotected packets, one replayed
+ * packet and one corrupted packet must show up in the aggregate
+ * reported by srtp_get_session_stats().
+ */
+
+srtp_err_status_t
+srtp_test_session_stats() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x73737373;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  srtp_session_stats_t stats;
+  int i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  for (i = 1; i <= 4; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)i, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(srtp_snd, msg, &len);
+    if (status) {
+      free(msg);
+      return status;
+    }
+    if (i == 4) {
+      /* corrupt the payload so that authentication fails */
+      ((uint8_t *)msg)[12] ^= 0xff;
+      if (srtp_unprotect(srtp_recv, msg, &len) !=
+          srtp_err_status_auth_fail) {
+        free(msg);
+        return srtp_err_status_fail;
+      }
+    } else {
+      status = srtp_unprotect(srtp_recv, msg, &len);
+    }
+    free(msg);
+    if (status)
+      return status;
+  }
+
+  /* replay: re-deliver a protected packet with an already-seen seq */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, 2, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status == srtp_err_status_replay_fail) {
+    /* expected: the sender refuses to reuse index 2 */
+    status = srtp_err_status_ok;
+  } else if (status == srtp_err_status_ok) {
+    status = srtp_err_status_fail;
+  }
+  free(msg);
+  if (status)
+    return status;
+
+  /* the sender must report four protected packets and a replay drop */
+  status = srtp_get_session_stats(srtp_snd, &stats);
+  if (status)
+    return status;
+  if (stats.packets_protected != 4 || stats.replay_drops != 1 ||
+      stats.octets_protected == 0 || stats.stream_count != 1)
+    return srtp_err_status_fail;
+
+  /* the receiver must report three good packets and the auth failure */
+  status = srtp_get_session_stats(srtp_recv, &stats);
+  if (status)
+    return status;
+  if (stats.packets_unprotected != 3 || stats.auth_failures != 1)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+/*
+ * visitor callbacks for srtp_test_stream_info(): one counts every
+ * stream it is shown, the other stops the enumeration after the first
+ */
+
+static int
+srtp_test_count_stream(void *data, const srtp_stream_info_t *info) {
+  (void)info;
+  (*(int *)data)++;
+  return 0;
+}
+
+static int
+srtp_test_stop_after_first(void *data, const srtp_stream_info_t *info) {
+  (void)info;
+  (*(int *)data)++;
+  return 1;
+}
+
+/*
+ * srtp_test_stream_info() exercises srtp_session_foreach_stream() and
+ * srtp_session_get_stream_info(): after traffic on one of three
+ * streams, the enumeration must show all three SSRCs, and the busy
+ * stream's snapshot must carry its packet index and a decremented
+ * key usage budget.
+ */
+
+srtp_err_status_t
+srtp_test_stream_info() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x620e6f71;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len;
+  srtp_t session;
+  srtp_policy_t policy;
+  srtp_stream_info_t info[8];
+  unsigned int num_streams;
+  unsigned int j, found;
+  int count;
+  int i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&session, &policy);
+  if (status)
+    return status;
+
+  /* two more streams sharing the same policy */
+  policy.ssrc.value = ssrc + 1;
+  status = srtp_add_stream(session, &policy);
+  if (status)
+    return status;
+  policy.ssrc.value = ssrc + 2;
+  status = srtp_add_stream(session, &policy);
+  if (status)
+    return status;
+
+  /* run a few packets through the first stream */
+  for (i = 1; i <= 5; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)i, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(session, msg, &len);
+    free(msg);
+    if (status)
+      return status;
+  }
+
+  /* the callback enumeration must visit all three streams ... */
+  count = 0;
+  status = srtp_session_foreach_stream(session, srtp_test_count_stream,
+                                       &count);
+  if (status)
+    return status;
+  if (count != 3)
+    return srtp_err_status_fail;
+
+  /* ... and honor an early stop */
+  count = 0;
+  status = srtp_session_foreach_stream(session, srtp_test_stop_after_first,
+                                       &count);
+  if (status)
+    return status;
+  if (count != 1)
+    return srtp_err_status_fail;
+
+  /* the bulk snapshot must carry per-stream indices and key budgets */
+  status = srtp_session_get_stream_info(session, info, 8, &num_streams);
+  if (status)
+    return status;
+  if (num_streams != 3)
+    return srtp_err_status_fail;
+  found = 0;
+  for (j = 0; j < num_streams; j++) {
+    if (info[j].ssrc == ssrc) {
+      found = 1;
+      if (info[j].roc != 0)
+        return srtp_err_status_fail;
+#ifndef NO_64BIT_MATH
+      if (info[j].rtp_packet_index != 5)
+        return srtp_err_status_fail;
+      if (info[j].key_usage_remaining == 0)
+        return srtp_err_status_fail;
+#endif
+    }
+  }
+  if (!found)
+    return srtp_err_status_fail;
+
+  /* a too-small array yields a truncated but well-formed snapshot */
+  status = srtp_session_get_stream_info(session, info, 2, &num_streams);
+  if (status)
+    return status;
+  if (num_streams != 2)
+    return srtp_err_status_fail;
+
+  if (srtp_session_get_stream_info(session, NULL, 8, &num_streams) !=
+      srtp_err_status_bad_param)
+    return srtp_err_status_fail;
+
+  return srtp_dealloc(session);
+}
+
+/*
+ * srtp_test_create_ex() exercises the preallocated-capacity creation
+ * path: the clone free list must hold the requested number of
+ * template clones, the SSRC hash must be built up front, and a burst
+ * of first packets from new SSRCs must be served from the free list.
+ */
+
+srtp_err_status_t
+srtp_test_create_ex() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x1e550000;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  srtp_stream_ctx_t *str;
+  srtp_session_stats_t stats;
+  unsigned int free_count;
+  uint32_t i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create_ex(&srtp_recv, &policy, 4);
+  if (status)
+    return status;
+
+  /* the free list must hold the preallocated clones ... */
+  free_count = 0;
+  for (str = srtp_recv->stream_free_list; str != NULL; str = str->next)
+    free_count++;
+  if (free_count != 4)
+    return srtp_err_status_fail;
+
+  /* ... and the SSRC hash must be in place before any stream exists */
+  if (srtp_recv->stream_hash == NULL || srtp_recv->stream_hash->buckets < 4)
+    return srtp_err_status_fail;
+
+  /* a join burst: first packets from three previously-unseen SSRCs */
+  for (i = 0; i < 3; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc + i,
+                                           1, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(srtp_snd, msg, &len);
+    if (status) {
+      free(msg);
+      return status;
+    }
+    status = srtp_unprotect(srtp_recv, msg, &len);
+    free(msg);
+    if (status)
+      return status;
+  }
+
+  /* the joins must have been served from the free list */
+  free_count = 0;
+  for (str = srtp_recv->stream_free_list; str != NULL; str = str->next)
+    free_count++;
+  if (free_count != 1)
+    return srtp_err_status_fail;
+
+  status = srtp_get_session_stats(srtp_recv, &stats);
+  if (status)
+    return status;
+  if (stats.stream_count != 3)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+/*
+ * srtp_test_fused_pass() round-trips a payload large enough to take
+ * the fused encrypt+authenticate pipeline in srtp_protect().  The
+ * receiver verifies the tag with the classic two-pass code, so a
+ * successful unprotect proves the fused tag is bit-identical; a
+ * tampered packet must still fail authentication.
+ */
+
+srtp_err_status_t
+srtp_test_fused_pass() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0xfeed5eed;
+  int msg_len_octets = 1400;
+  srtp_hdr_t *msg;
+  int len, orig_len, i;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  msg = srtp_create_test_packet(msg_len_octets, ssrc, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  orig_len = len;
+
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+
+  status = srtp_unprotect(srtp_recv, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+
+  /* the payload must decrypt back to the original pattern */
+  if (len != orig_len) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
+  for (i = 0; i < msg_len_octets; i++) {
+    if (((uint8_t *)msg)[12 + i] != 0xab) {
+      free(msg);
+      return srtp_err_status_fail;
+    }
+  }
+  free(msg);
+
+  /* a corrupted packet must still fail authentication */
+  msg = srtp_create_test_packet(msg_len_octets, ssrc, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  msg->seq = htons(0x1235);
+
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  ((uint8_t *)msg)[12 + 700] ^= 0x55;
+  status = srtp_unprotect(srtp_recv, msg, &len);
+  free(msg);
+  if (status != srtp_err_status_auth_fail)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+/*
+ * srtp_test_unprotect_ex() checks the packet details reported by
+ * srtp_unprotect_ex(): packet index, ROC, payload location, and the
+ * stream-creation flag, for both the default policy and (when GCM is
+ * available) the AEAD path.
+ */
+
+srtp_err_status_t
+srtp_test_unprotect_ex() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0xdead5a1d;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  srtp_unprotect_info_t info;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  /* the first packet creates the stream from the wildcard template */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, 0x1234, 0,
+                                         &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+
+  memset(&info, 0xff, sizeof(info));
+  status = srtp_unprotect_ex(srtp_recv, msg, &len, 0, &info);
+  free(msg);
+  if (status)
+    return status;
+  if (info.rtp_packet_index != 0x1234 || info.roc != 0)
+    return srtp_err_status_fail;
+  if (info.payload_offset != 12 ||
+      info.payload_length != (unsigned int)msg_len_octets)
+    return srtp_err_status_fail;
+  if (info.mki_index != 0 || !info.stream_created)
+    return srtp_err_status_fail;
+
+  /* the second packet finds the stream already in place */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, 0x1235, 0,
+                                         &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  status = srtp_unprotect_ex(srtp_recv, msg, &len, 0, &info);
+  free(msg);
+  if (status)
+    return status;
+  if (info.rtp_packet_index != 0x1235 || info.stream_created)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  /* the AEAD unprotect path fills the same details */
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtp);
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtcp);
+  policy.window_size = 128;
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+  policy.ssrc.type = ssrc_any_inbound;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, 0x4321, 0,
+                                         &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  status = srtp_unprotect_ex(srtp_recv, msg, &len, 0, &info);
+  free(msg);
+  if (status)
+    return status;
+  if (info.rtp_packet_index != 0x4321 || info.roc != 0 ||
+      info.payload_offset != 12 ||
+      info.payload_length != (unsigned int)msg_len_octets ||
+      !info.stream_created)
+    return srtp_err_status_fail;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+#endif
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_snapshot() exercises srtp_session_serialize() and
+ * srtp_session_deserialize(): after a run of traffic, the receiver's
+ * replay window and packet index must survive a round trip through
+ * the snapshot format into a fresh session built from the same
+ * policy.  A previously-delivered packet must be rejected as a replay
+ * by the restored session, and a fresh packet must decrypt cleanly.
+ */
+
+srtp_err_status_t
+srtp_test_snapshot() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x66616f76; /* "faov" */
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  uint8_t saved_pkt[512];
+  int saved_len;
+  int len;
+  srtp_t srtp_snd, srtp_recv, srtp_standby;
+  srtp_policy_t policy;
+  uint8_t *snapshot;
+  unsigned int snapshot_len, needed;
+  int i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.key = test_key;
+
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  /* the receivers are wildcard sessions, so that restore can
+   * instantiate the snapshot's stream from the template */
+  policy.ssrc.type = ssrc_any_inbound;
+  policy.ssrc.value = 0;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&srtp_standby, &policy);
+  if (status)
+    return status;
+
+  /* run five packets through the active receiver, keeping a protected
+   * copy of the last one so we can replay it later (srtp_unprotect
+   * decrypts in place) */
+  saved_len = 0;
+  for (i = 1; i <= 5; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)i, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(srtp_snd, msg, &len);
+    if (status) {
+      free(msg);
+      return status;
+    }
+    if (i == 5) {
+      memcpy(saved_pkt, msg, len);
+      saved_len = len;
+    }
+    status = srtp_unprotect(srtp_recv, msg, &len);
+    free(msg);
+    if (status)
+      return status;
+  }
+
+  /* size query: a null buffer reports the space needed */
+  needed = 0;
+  status = srtp_session_serialize(srtp_recv, NULL, &needed);
+  if (status)
+    return status;
+  if (needed == 0)
+    return srtp_err_status_fail;
+
+  /* an undersized buffer must be refused, and the length updated */
+  snapshot = (uint8_t *)malloc(needed);
+  if (snapshot == NULL)
+    return srtp_err_status_alloc_fail;
+  snapshot_len = needed - 1;
+  if (srtp_session_serialize(srtp_recv, snapshot, &snapshot_len) !=
+      srtp_err_status_bad_param || snapshot_len != needed) {
+    free(snapshot);
+    return srtp_err_status_fail;
+  }
+
+  snapshot_len = needed;
+  status = srtp_session_serialize(srtp_recv, snapshot, &snapshot_len);
+  if (status) {
+    free(snapshot);
+    return status;
+  }
+
+  /* a corrupted snapshot must be rejected before any state changes */
+  snapshot[0] ^= 0xff;
+  if (srtp_session_deserialize(srtp_standby, snapshot, snapshot_len) !=
+      srtp_err_status_parse_err) {
+    free(snapshot);
+    return srtp_err_status_fail;
+  }
+  snapshot[0] ^= 0xff;
+
+  status = srtp_session_deserialize(srtp_standby, snapshot, snapshot_len);
+  free(snapshot);
+  if (status)
+    return status;
+
+  /* the restored replay window must reject the packet the failed
+   * receiver already delivered */
+  len = saved_len;
+  if (srtp_unprotect(srtp_standby, saved_pkt, &len) !=
+      srtp_err_status_replay_fail)
+    return srtp_err_status_fail;
+
+  /* ...and the next packet in the flow must decrypt cleanly */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, 6, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    return status;
+  }
+  status = srtp_unprotect(srtp_standby, msg, &len);
+  free(msg);
+  if (status)
+    return status;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_standby);
+}
+
+/*
+ * srtp_test_ekt() checks Encrypted Key Transport over SRTCP: a sender
+ * appends its cached encrypted master key to each protected RTCP
+ * packet, and a receiver that knows only the EKT key (and the shared
+ * master salt) must be able to provision the stream from the packet
+ * and decrypt it.
+ */
+
+srtp_err_status_t
+srtp_test_ekt() {
+
+  uint8_t ekt_key[16] = {
+    0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x30, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66
+  };
+  uint8_t rcvr_key[30];
+  srtp_ekt_policy_ctx_t ekt_policy;
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x656b7431;
+  int msg_len_octets = 28;
+  srtp_hdr_t *msg, *ref;
+  int len, ref_len, i;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+
+  memset(&ekt_policy, 0, sizeof(ekt_policy));
+  ekt_policy.spi = 0x1234;
+  ekt_policy.ekt_cipher_type = SRTP_EKT_CIPHER_AES_128_ECB;
+  ekt_policy.ekt_key = ekt_key;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = &ekt_policy;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.ssrc.value = 0;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  /*
+   * the receiver does not know the sender's master key - only the EKT
+   * key and the master salt from the EKT parameter set.  give it a
+   * deliberately different master key, with the same trailing salt
+   */
+  memcpy(rcvr_key, test_key, sizeof(rcvr_key));
+  for (i = 0; i < 16; i++)
+    rcvr_key[i] ^= 0xa5;
+  policy.ssrc.type = ssrc_any_inbound;
+  policy.ssrc.value = 0;
+  policy.key = rcvr_key;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  msg = srtp_create_test_packet(msg_len_octets, ssrc, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  ref = srtp_create_test_packet(msg_len_octets, ssrc, &ref_len);
+  if (ref == NULL) {
+    free(msg);
+    return srtp_err_status_alloc_fail;
+  }
+
+  status = srtp_protect_rtcp(srtp_snd, msg, &len);
+  if (status) {
+    free(msg);
+    free(ref);
+    return status;
+  }
+
+  /* the EKT fields (EMK, ROC, ISN, SPI) add 24 octets past the tag */
+  if (len != ref_len + (int)(4 + 10 + 24)) {
+    free(msg);
+    free(ref);
+    return srtp_err_status_fail;
+  }
+
+  status = srtp_unprotect_rtcp(srtp_recv, msg, &len);
+  if (status) {
+    free(msg);
+    free(ref);
+    return status;
+  }
+
+  /* the recovered plaintext must match the original packet */
+  if (len != ref_len || memcmp(msg, ref, len) != 0) {
+    free(msg);
+    free(ref);
+    return srtp_err_status_fail;
+  }
+
+  free(msg);
+  free(ref);
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+/*
+ * srtp_test_stream_footprint() reports the measured memory cost of one
+ * stream: the context and session-key struct sizes, where the hot
+ * (per-packet) section of the stream context ends, and the heap
+ * octets actually consumed by adding a stream to a session (which
+ * includes the cipher and auth state behind the session keys).
+ */
+
+srtp_err_status_t
+srtp_test_stream_footprint() {
+
+  srtp_err_status_t status;
+  srtp_policy_t policy;
+  srtp_t session;
+  size_t octets_before, octets_per_stream;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = 0x466f6f74;
+  policy.key = test_key;
+
+  status = srtp_create(&session, &policy);
+  if (status)
+    return status;
+
+  /* measure the incremental cost of the second stream */
+  octets_before = srtp_crypto_alloc_octets_outstanding();
+  policy.ssrc.value = 0x466f6f75;
+  status = srtp_add_stream(session, &policy);
+  if (status) {
+    srtp_dealloc(session);
+    return status;
+  }
+  octets_per_stream = srtp_crypto_alloc_octets_outstanding() - octets_before;
+
+  printf("  stream context: %u octets (hot per-packet section: %u)\n",
+         (unsigned)sizeof(srtp_stream_ctx_t),
+         (unsigned)offsetof(srtp_stream_ctx_t, num_master_keys));
+  printf("  session keys:   %u octets per master key\n",
+         (unsigned)sizeof(srtp_session_keys_t));
+  printf("  measured heap octets per stream: %u\n",
+         (unsigned)octets_per_stream);
+
+  return srtp_dealloc(session);
+}
+
+/*
+ * srtp_test_packet_filter() checks the pre-crypto receive filters:
+ * non-RTP garbage and unknown SSRCs are rejected before any crypto
+ * work, and the template stream-creation budget caps the number of
+ * streams an SSRC flood can create.
+ */
+
+srtp_err_status_t
+srtp_test_packet_filter() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x61616161;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg;
+  int len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  uint32_t i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  /* a packet with a bogus RTP version must be rejected outright */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc, 1, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  msg->version = 1;
+  if (srtp_unprotect(srtp_recv, msg, &len) != srtp_err_status_bad_param) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
+
+  /* an unknown SSRC in a template-less session must be filtered out */
+  msg->version = 2;
+  msg->ssrc = htonl(ssrc + 1);
+  if (srtp_unprotect(srtp_recv, msg, &len) != srtp_err_status_no_ctx) {
+    free(msg);
+    return srtp_err_status_fail;
+  }
+  free(msg);
+
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+
+  /*
+   * now check the template budget: with max_template_streams set to
+   * two, only the first two SSRCs may create streams
+   */
+  policy.ssrc.type = ssrc_any_outbound;
+  policy.max_template_streams = 2;
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+
+  for (i = 0; i < 3; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc + i,
+                                           1, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(srtp_snd, msg, &len);
+    free(msg);
+    if (i < 2) {
+      if (status)
+        return status;
+    } else {
+      if (status != srtp_err_status_no_ctx)
+        return srtp_err_status_fail;
+    }
+  }
+
+  /* removing a stream frees up budget for a new SSRC */
+  status = srtp_remove_stream(srtp_snd, htonl(ssrc));
+  if (status)
+    return status;
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc + 3,
+                                         1, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  free(msg);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_snd);
+}
+
+/*
+ * srtp_test_key_limit() drives a key-usage limit with the batched
+ * update and a reference limit with the per-packet update, and checks
+ * that both report the identical event on every packet, so that the
+ * amortized accounting cannot shift the soft- or hard-limit packet.
+ */
+
+srtp_err_status_t
+srtp_test_key_limit() {
+
+  srtp_key_limit_ctx_t batched, exact;
+  srtp_key_event_t event_batched, event_exact;
+  srtp_xtd_seq_num_t limit = 0x10000 + 3 * SRTP_KEY_LIMIT_BATCH;
+  srtp_xtd_seq_num_t i;
+
+  if (srtp_key_limit_set(&batched, limit) != srtp_err_status_ok)
+    return srtp_err_status_fail;
+  if (srtp_key_limit_set(&exact, limit) != srtp_err_status_ok)
+    return srtp_err_status_fail;
+
+  for (i = 0; i < limit; i++) {
+    event_batched = srtp_key_limit_update_batched(&batched);
+    event_exact = srtp_key_limit_update(&exact);
+    if (event_batched != event_exact)
+      return srtp_err_status_fail;
+    if (batched.num_left - batched.pending != exact.num_left)
+      return srtp_err_status_fail;
+  }
+
+  /* both limits must now be expired */
+  if (srtp_key_limit_check(&batched) != srtp_err_status_key_expired)
+    return srtp_err_status_fail;
+  if (srtp_key_limit_check(&exact) != srtp_err_status_key_expired)
+    return srtp_err_status_fail;
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_rekey() checks the double-buffered rekey: after
+ * srtp_rekey_stream() the sender protects under the new keys, while
+ * the receiver (told the switch point with srtp_rekey_stream_at())
+ * still accepts an in-flight packet protected under the old keys.
+ */
+
+srtp_err_status_t
+srtp_test_rekey() {
+
+  srtp_err_status_t status;
+  uint32_t ssrc = 0x57575757;
+  int msg_len_octets = 32;
+  srtp_hdr_t *msg, *held;
+  int len, held_len;
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  int i;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  /* exchange a run of packets under the initial keys */
+  for (i = 1; i <= 5; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)i, 0, &len);
+    if (msg == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(srtp_snd, msg, &len);
+    if (status == srtp_err_status_ok)
+      status = srtp_unprotect(srtp_recv, msg, &len);
+    free(msg);
+    if (status)
+      return status;
+  }
+
+  /* protect one more packet under the old keys and hold it back */
+  held = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                          (uint16_t)6, 0, &held_len);
+  if (held == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, held, &held_len);
+  if (status)
+    return status;
+
+  /* rekey: the sender switches at its next index, the receiver is
+   * told the switch point (ROC 0, sequence number 7) */
+  policy.key = test_key_2;
+  status = srtp_rekey_stream(srtp_snd, &policy);
+  if (status)
+    return status;
+  status = srtp_rekey_stream_at(srtp_recv, &policy, 0, 7);
+  if (status)
+    return status;
+
+  /* only one rekey may be in flight */
+  if (srtp_rekey_stream(srtp_recv, &policy) != srtp_err_status_bad_param)
+    return srtp_err_status_fail;
+
+  /* a packet sent after the switch uses the new keys */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                         (uint16_t)7, 0, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(srtp_snd, msg, &len);
+  if (status == srtp_err_status_ok)
+    status = srtp_unprotect(srtp_recv, msg, &len);
+  free(msg);
+  if (status)
+    return status;
+
+  /* the held packet arrives late and must still authenticate under
+   * the previous keys */
+  status = srtp_unprotect(srtp_recv, held, &held_len);
+  free(held);
+  if (status)
+    return status;
+
+  /* retire the old keys explicitly on both sides */
+  status = srtp_rekey_stream_complete(srtp_snd, ssrc);
+  if (status)
+    return status;
+  status = srtp_rekey_stream_complete(srtp_recv, ssrc);
+  if (status)
+    return status;
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
+}
+
+srtp_err_status_t
+srtp_test_protect_trailer_length() {
+
+  srtp_t srtp_send;
+  srtp_t srtp_send_mki;
+  srtp_t srtp_send_aes_gcm;
+  srtp_t srtp_send_aes_gcm_mki;
+  uint32_t length = 0;
+  srtp_err_status_t status;
+
+  srtp_test_setup_protect_trailer_streams(&srtp_send, &srtp_send_mki,
+					  &srtp_send_aes_gcm, &srtp_send_aes_gcm_mki);
+
+  status = srtp_get_protect_trailer_length(srtp_send, 0, 0, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 10 bytes */
+  if (length != 10)
+    return srtp_err_status_fail;
+
+  status = srtp_get_protect_trailer_length(srtp_send_mki, 1, 1, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 10 bytes + MKI length: 4 bytes*/
+  if (length != 14)
+    return srtp_err_status_fail;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  status = srtp_get_protect_trailer_length(srtp_send_aes_gcm, 0, 0, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 16 bytes */
+  if (length != 16)
+    return srtp_err_status_fail;
+
+
+  status = srtp_get_protect_trailer_length(srtp_send_aes_gcm_mki, 1, 1, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 16 bytes + MKI length: 4 bytes*/
+  if (length != 20)
+    return srtp_err_status_fail;
+
+#endif // GCM
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_test_protect_rtcp_trailer_length() {
+
+  srtp_t srtp_send;
+  srtp_t srtp_send_mki;
+  srtp_t srtp_send_aes_gcm;
+  srtp_t srtp_send_aes_gcm_mki;
+  uint32_t length = 0;
+  srtp_err_status_t status;
+
+  srtp_test_setup_protect_trailer_streams(&srtp_send, &srtp_send_mki,
+					  &srtp_send_aes_gcm, &srtp_send_aes_gcm_mki);
+
+  status = srtp_get_protect_rtcp_trailer_length(srtp_send, 0, 0, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 10 bytes + SRTCP Trailer 4 bytes*/
+  if (length != 14)
+    return srtp_err_status_fail;
+
+  status = srtp_get_protect_rtcp_trailer_length(srtp_send_mki, 1, 1, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 10 bytes + SRTCP Trailer 4 bytes + MKI 4 bytes*/
+  if (length != 18)
+    return srtp_err_status_fail;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  status = srtp_get_protect_rtcp_trailer_length(srtp_send_aes_gcm, 0, 0, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 16 bytes + SRTCP Trailer 4 bytes*/
+  if (length != 20)
+    return srtp_err_status_fail;
+
+
+  status = srtp_get_protect_rtcp_trailer_length(srtp_send_aes_gcm_mki, 1, 1, &length);
+  if (status)
+    return status;
+
+  /*  TAG Length: 16 bytes + SRTCP Trailer 4 bytes + MKI 4 bytes*/
+  if (length != 24)
+    return srtp_err_status_fail;
+
+#endif // GCM
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_test_get_roc() {
+  srtp_err_status_t status;
+  srtp_policy_t policy;
+  srtp_t session;
+  srtp_hdr_t *pkt;
+  uint32_t i;
+  uint32_t roc;
+  uint32_t ts;
+  uint16_t seq;
+
+  int msg_len_octets = 32;
+  int protected_msg_len_octets;
+
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ssrc.type  = ssrc_specific;
+  policy.ssrc.value = 0xcafebabe;
+  policy.key = test_key;
+  policy.window_size = 128;
+
+  /* Create a sender session */
+  status = srtp_create(&session, &policy);
+  if (status) {
+    return status;
+  }
+
+  /* Set start sequence so we roll over */
+  seq = 65535;
+  ts = 0;
+
+  for (i = 0; i < 2; i++) {
+    pkt = srtp_create_test_packet_extended(msg_len_octets, policy.ssrc.value, seq, ts, &protected_msg_len_octets);
+    status = srtp_protect(session, pkt, &protected_msg_len_octets);
+    free(pkt);
+    if (status) {
+      return status;
+    }
+
+    status = srtp_get_stream_roc(session, policy.ssrc.value, &roc);
+    if (status) {
+      return status;
+    }
+
+    if (roc != i) {
+      return srtp_err_status_fail;
+    }
+
+    seq++;
+    ts++;
+  }
+
+  /* Cleanup */
+  status = srtp_dealloc(session);
+  if (status) {
+    return status;
+  }
+
+  return srtp_err_status_ok;
+}
+
+static srtp_err_status_t
+test_set_receiver_roc(uint32_t packets, uint32_t roc_to_set)
+{
+  srtp_err_status_t status;
+
+  srtp_policy_t sender_policy;
+  srtp_t sender_session;
+
+  srtp_policy_t receiver_policy;
+  srtp_t receiver_session;
+
+  srtp_hdr_t *pkt_1;
+  unsigned char *recv_pkt_1;
+
+  srtp_hdr_t *pkt_2;
+  unsigned char *recv_pkt_2;
+
+  uint32_t i;
+  uint32_t ts;
+  uint16_t seq;
+
+  int msg_len_octets = 32;
+  int protected_msg_len_octets_1;
+  int protected_msg_len_octets_2;
+
+  /* Create sender */
+  memset(&sender_policy, 0, sizeof(sender_policy));
+  srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
+  sender_policy.ssrc.type  = ssrc_specific;
+  sender_policy.ssrc.value = 0xcafebabe;
+  sender_policy.key = test_key;
+  sender_policy.window_size = 128;
+
+  status = srtp_create(&sender_session, &sender_policy);
+  if (status) {
+    return status;
+  }
+
+  /* Create and protect packets */
+  seq = 0;
+  ts = 0;
+  for (i = 0; i < packets; i++) {
+    srtp_hdr_t *tmp_pkt;
+    int tmp_len;
+
+    tmp_pkt = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &tmp_len);
+    status = srtp_protect(sender_session, tmp_pkt, &tmp_len);
+    free(tmp_pkt);
+    if (status) {
+      return status;
+    }
+    seq++;
+    ts++;
+  }
+
+  /* Create the first packet to decrypt and test for ROC change */
+  pkt_1 = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &protected_msg_len_octets_1);
+  status = srtp_protect(sender_session, pkt_1, &protected_msg_len_octets_1);
+  if (status) {
+    return status;
+  }
+
+  /* Create the second packet to decrypt and test for ROC change */
+  seq++;
+  ts++;
+  pkt_2 = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &protected_msg_len_octets_2);
+  status = srtp_protect(sender_session, pkt_2, &protected_msg_len_octets_2);
+  if (status) {
+    return status;
+  }
+
+  /* Create the receiver */
+  memset(&receiver_policy, 0, sizeof(receiver_policy));
+  srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
+  receiver_policy.ssrc.type  = ssrc_specific;
+  receiver_policy.ssrc.value = sender_policy.ssrc.value;
+  receiver_policy.key = test_key;
+  receiver_policy.window_size = 128;
+
+  status = srtp_create(&receiver_session, &receiver_policy);
+  if (status) {
+    return status;
+  }
+
+  /* Make a copy of the first sent protected packet */
+  recv_pkt_1 = malloc(protected_msg_len_octets_1);
+  if (recv_pkt_1 == NULL) {
+    return srtp_err_status_fail;
+  }
+  memcpy(recv_pkt_1, pkt_1, protected_msg_len_octets_1);
+
+  /* Make a copy of the second sent protected packet */
+  recv_pkt_2 = malloc(protected_msg_len_octets_2);
+  if (recv_pkt_2 == NULL) {
+    return srtp_err_status_fail;
+  }
+  memcpy(recv_pkt_2, pkt_2, protected_msg_len_octets_2);
+
+  /* Set the ROC to the wanted value */
+  status = srtp_set_stream_roc(receiver_session, receiver_policy.ssrc.value, roc_to_set);
+  if (status) {
+    return status;
+  }
+
+  /* Unprotect the first packet */
+  status = srtp_unprotect(receiver_session, recv_pkt_1, &protected_msg_len_octets_1);
+  if (status) {
+    return status;
+  }
+
+  /* Unprotect the second packet */
+  status = srtp_unprotect(receiver_session, recv_pkt_2, &protected_msg_len_octets_2);
+  if (status) {
+    return status;
+  }
+
+  /* Cleanup */
+  status = srtp_dealloc(sender_session);
+  if (status) {
+    return status;
+  }
+
+  status = srtp_dealloc(receiver_session);
+  if (status) {
+    return status;
+  }
+
+  free(pkt_1);
+  free(recv_pkt_1);
+  free(pkt_2);
+  free(recv_pkt_2);
+
+  return srtp_err_status_ok;
+}
+
+static srtp_err_status_t
+test_set_sender_roc(uint16_t seq, uint32_t roc_to_set)
+{
+  srtp_err_status_t status;
+
+  srtp_policy_t sender_policy;
+  srtp_t sender_session;
+
+  srtp_policy_t receiver_policy;
+  srtp_t receiver_session;
+
+  srtp_hdr_t *pkt;
+  unsigned char *recv_pkt;
+
+  uint32_t ts;
+
+  int msg_len_octets = 32;
+  int protected_msg_len_octets;
+
+  /* Create sender */
+  memset(&sender_policy, 0, sizeof(sender_policy));
+  srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
+  sender_policy.ssrc.type  = ssrc_specific;
+  sender_policy.ssrc.value = 0xcafebabe;
+  sender_policy.key = test_key;
+  sender_policy.window_size = 128;
+
+  status = srtp_create(&sender_session, &sender_policy);
+  if (status) {
+    return status;
+  }
+
+  /* Set the ROC before encrypting the first packet */
+  status = srtp_set_stream_roc(sender_session, sender_policy.ssrc.value, roc_to_set);
+  if (status != srtp_err_status_ok) {
+    return status;
+  }
+
+  /* Create the packet to decrypt */
+  ts = 0;
+  pkt = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &protected_msg_len_octets);
+  status = srtp_protect(sender_session, pkt, &protected_msg_len_octets);
+  if (status) {
+    return status;
+  }
+
+  /* Create the receiver */
+  memset(&receiver_policy, 0, sizeof(receiver_policy));
+  srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
+  receiver_policy.ssrc.type  = ssrc_specific;
+  receiver_policy.ssrc.value = sender_policy.ssrc.value;
+  receiver_policy.key = test_key;
+  receiver_policy.window_size = 128;
+
+  status = srtp_create(&receiver_session, &receiver_policy);
+  if (status) {
+    return status;
+  }
+
+  /* Make a copy of the sent protected packet */
+  recv_pkt = malloc(protected_msg_len_octets);
+  if (recv_pkt == NULL) {
+    return srtp_err_status_fail;
+  }
+  memcpy(recv_pkt, pkt, protected_msg_len_octets);
+
+  /* Set the ROC to the wanted value */
+  status = srtp_set_stream_roc(receiver_session, receiver_policy.ssrc.value, roc_to_set);
+  if (status) {
+    return status;
+  }
+
+  status = srtp_unprotect(receiver_session, recv_pkt, &protected_msg_len_octets);
+  if (status) {
+    return status;
+  }
+
+  /* Cleanup */
+  status = srtp_dealloc(sender_session);
+  if (status) {
+    return status;
+  }
+
+  status = srtp_dealloc(receiver_session);
+  if (status) {
+    return status;
+  }
+
+  free(pkt);
+  free(recv_pkt);
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_test_set_receiver_roc() {
+  int packets;
+  uint32_t roc;
+  srtp_err_status_t status;
+
+  /* First test does not rollover */
+  packets = 1;
+  roc = 0;
+
+  status = test_set_receiver_roc(packets - 1, roc);
+  if (status) {
+    return status;
+  }
+
+  status = test_set_receiver_roc(packets, roc);
+  if (status) {
+    return status;
+  }
+
+  status = test_set_receiver_roc(packets + 1, roc);
+  if (status) {
+    return status;
+  }
+
+  status = test_set_receiver_roc(packets + 60000, roc);
+  if (status) {
+    return status;
+  }
+
+  /* Second test should rollover */
+  packets = 65535;
+  roc = 0;
+
+  status = test_set_receiver_roc(packets - 1, roc);
+  if (status) {
+    return status;
+  }
+
+  status = test_set_receiver_roc(packets, roc);
+  if (status) {
+    return status;
+  }
+
+  /* Now the rollover counter should be 1 */
+  roc = 1;
+  status = test_set_receiver_roc(packets + 1, roc);
+  if (status) {
+    return status;
+  }
+
+  status = test_set_receiver_roc(packets + 60000, roc);
+  if (status) {
+    return status;
+  }
+
+  return srtp_err_status_ok;
+}
+
+srtp_err_status_t
+srtp_test_set_sender_roc() {
+  uint32_t roc;
+  uint16_t seq;
+  srtp_err_status_t status;
+
+  seq = 43210;
+  roc = 0;
+  status = test_set_sender_roc(seq, roc);
+  if (status) {
+    return status;
+  }
+
+  roc = 65535;
+  status = test_set_sender_roc(seq, roc);
+  if (status) {
+    return status;
+  }
+
+  roc = 0xffff;
+  status = test_set_sender_roc(seq, roc);
+  if (status) {
+    return status;
+  }
+
+  roc = 0xffff00;
+  status = test_set_sender_roc(seq, roc);
+  if (status) {
+    return status;
+  }
+
+  roc = 0xfffffff0;
+  status = test_set_sender_roc(seq, roc);
+  if (status) {
+    return status;
+  }
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * test native ROC recovery: a late-joining receiver with a wildcard
+ * policy and no ROC signaling should recover the sender's rollover
+ * counter from the first packet when a recovery window is configured,
+ * and cache it for the packets that follow
+ */
+srtp_err_status_t
+srtp_test_roc_recovery() {
+  srtp_err_status_t status;
+
+  srtp_policy_t sender_policy;
+  srtp_t sender_session;
+
+  srtp_policy_t receiver_policy;
+  srtp_t receiver_session;
+
+  srtp_hdr_t *pkt;
+  unsigned char *recv_pkt;
+
+  uint32_t roc;
+  int msg_len_octets = 32;
+  int protected_msg_len_octets;
+  int len;
+
+  /* create a sender that is already three rollovers into the stream */
+  memset(&sender_policy, 0, sizeof(sender_policy));
   srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
   srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
   sender_policy.ssrc.type  = ssrc_specific;
-  sender_policy.ssrc.value = 0xcafebabe;
+  sender_policy.ssrc.value = 0xcafebabe;
+  sender_policy.key = test_key;
+  sender_policy.window_size = 128;
+
+  status = srtp_create(&sender_session, &sender_policy);
+  if (status) {
+    return status;
+  }
+
+  status = srtp_set_stream_roc(sender_session, sender_policy.ssrc.value, 3);
+  if (status) {
+    return status;
+  }
+
+  pkt = srtp_create_test_packet_extended(msg_len_octets,
+                                         sender_policy.ssrc.value,
+                                         1234, 0, &protected_msg_len_octets);
+  status = srtp_protect(sender_session, pkt, &protected_msg_len_octets);
+  if (status) {
+    return status;
+  }
+
+  /* create a late-joining receiver that has not been told the ROC */
+  memset(&receiver_policy, 0, sizeof(receiver_policy));
+  srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
+  receiver_policy.ssrc.type = ssrc_any_inbound;
+  receiver_policy.key = test_key;
+  receiver_policy.window_size = 128;
+
+  status = srtp_create(&receiver_session, &receiver_policy);
+  if (status) {
+    return status;
+  }
+
+  recv_pkt = malloc(protected_msg_len_octets);
+  if (recv_pkt == NULL) {
+    return srtp_err_status_fail;
+  }
+
+  /* without recovery, the first packet must fail authentication */
+  memcpy(recv_pkt, pkt, protected_msg_len_octets);
+  len = protected_msg_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
+  if (status != srtp_err_status_auth_fail) {
+    return srtp_err_status_fail;
+  }
+
+  /* a window that stops short of the sender's ROC must also fail */
+  status = srtp_set_roc_recovery_window(receiver_session, 2);
+  if (status) {
+    return status;
+  }
+  memcpy(recv_pkt, pkt, protected_msg_len_octets);
+  len = protected_msg_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
+  if (status != srtp_err_status_auth_fail) {
+    return srtp_err_status_fail;
+  }
+
+  /* with a sufficient window the packet authenticates */
+  status = srtp_set_roc_recovery_window(receiver_session, 8);
+  if (status) {
+    return status;
+  }
+  memcpy(recv_pkt, pkt, protected_msg_len_octets);
+  len = protected_msg_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
+  if (status) {
+    return status;
+  }
+
+  /* the discovered ROC is cached on the new stream */
+  status = srtp_get_stream_roc(receiver_session, sender_policy.ssrc.value,
+                               &roc);
+  if (status) {
+    return status;
+  }
+  if (roc != 3) {
+    return srtp_err_status_fail;
+  }
+
+  /* a follow-up packet rides on the cached ROC with no recovery work */
+  free(pkt);
+  pkt = srtp_create_test_packet_extended(msg_len_octets,
+                                         sender_policy.ssrc.value,
+                                         1235, 160, &protected_msg_len_octets);
+  status = srtp_protect(sender_session, pkt, &protected_msg_len_octets);
+  if (status) {
+    return status;
+  }
+  free(recv_pkt);
+  recv_pkt = malloc(protected_msg_len_octets);
+  if (recv_pkt == NULL) {
+    return srtp_err_status_fail;
+  }
+  memcpy(recv_pkt, pkt, protected_msg_len_octets);
+  len = protected_msg_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
+  if (status) {
+    return status;
+  }
+
+  /* cleanup */
+  status = srtp_dealloc(sender_session);
+  if (status) {
+    return status;
+  }
+
+  status = srtp_dealloc(receiver_session);
+  if (status) {
+    return status;
+  }
+
+  free(pkt);
+  free(recv_pkt);
+
+  return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_null_fast_path() checks the null-crypto recording path: a
+ * session with null cipher and null auth must pass packets through
+ * byte for byte while still enforcing the replay database on both the
+ * protect and unprotect sides
+ */
+srtp_err_status_t
+srtp_test_null_fast_path() {
+  srtp_err_status_t status;
+
+  srtp_policy_t sender_policy;
+  srtp_t sender_session;
+
+  srtp_policy_t receiver_policy;
+  srtp_t receiver_session;
+
+  srtp_hdr_t *pkt;
+  unsigned char *ref_pkt;
+  unsigned char *recv_pkt;
+
+  int msg_len_octets = 32;
+  int protected_msg_len_octets;
+  int ref_len_octets;
+  int len;
+
+  memset(&sender_policy, 0, sizeof(sender_policy));
+  srtp_crypto_policy_set_null_cipher_hmac_null(&sender_policy.rtp);
+  srtp_crypto_policy_set_null_cipher_hmac_null(&sender_policy.rtcp);
+  sender_policy.ssrc.type  = ssrc_specific;
+  sender_policy.ssrc.value = 0xdecafbad;
   sender_policy.key = test_key;
   sender_policy.window_size = 128;
 
@@ -3077,45 +6050,37 @@ test_set_receiver_roc(uint32_t packets, uint32_t roc_to_set)
     return status;
   }
 
-  /* Create and protect packets */
-  seq = 0;
-  ts = 0;
-  for (i = 0; i < packets; i++) {
-    srtp_hdr_t *tmp_pkt;
-    int tmp_len;
-
-    tmp_pkt = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &tmp_len);
-    status = srtp_protect(sender_session, tmp_pkt, &tmp_len);
-    free(tmp_pkt);
-    if (status) {
-      return status;
-    }
-    seq++;
-    ts++;
+  pkt = srtp_create_test_packet_extended(msg_len_octets,
+                                         sender_policy.ssrc.value,
+                                         1234, 0, &protected_msg_len_octets);
+  ref_len_octets = protected_msg_len_octets;
+  ref_pkt = malloc(ref_len_octets);
+  if (ref_pkt == NULL) {
+    return srtp_err_status_fail;
   }
+  memcpy(ref_pkt, pkt, ref_len_octets);
 
-  /* Create the first packet to decrypt and test for ROC change */
-  pkt_1 = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &protected_msg_len_octets_1);
-  status = srtp_protect(sender_session, pkt_1, &protected_msg_len_octets_1);
+  /* the packet must come through protect unchanged */
+  status = srtp_protect(sender_session, pkt, &protected_msg_len_octets);
   if (status) {
     return status;
   }
+  if (protected_msg_len_octets != ref_len_octets ||
+      memcmp(pkt, ref_pkt, ref_len_octets) != 0) {
+    return srtp_err_status_fail;
+  }
 
-  /* Create the second packet to decrypt and test for ROC change */
-  seq++;
-  ts++;
-  pkt_2 = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &protected_msg_len_octets_2);
-  status = srtp_protect(sender_session, pkt_2, &protected_msg_len_octets_2);
-  if (status) {
-    return status;
+  /* reusing the sequence number must still be caught */
+  len = ref_len_octets;
+  status = srtp_protect(sender_session, pkt, &len);
+  if (status != srtp_err_status_replay_fail) {
+    return srtp_err_status_fail;
   }
 
-  /* Create the receiver */
   memset(&receiver_policy, 0, sizeof(receiver_policy));
-  srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
-  srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
-  receiver_policy.ssrc.type  = ssrc_specific;
-  receiver_policy.ssrc.value = sender_policy.ssrc.value;
+  srtp_crypto_policy_set_null_cipher_hmac_null(&receiver_policy.rtp);
+  srtp_crypto_policy_set_null_cipher_hmac_null(&receiver_policy.rtcp);
+  receiver_policy.ssrc.type = ssrc_any_inbound;
   receiver_policy.key = test_key;
   receiver_policy.window_size = 128;
 
@@ -3124,39 +6089,259 @@ test_set_receiver_roc(uint32_t packets, uint32_t roc_to_set)
     return status;
   }
 
-  /* Make a copy of the first sent protected packet */
-  recv_pkt_1 = malloc(protected_msg_len_octets_1);
-  if (recv_pkt_1 == NULL) {
+  recv_pkt = malloc(ref_len_octets);
+  if (recv_pkt == NULL) {
     return srtp_err_status_fail;
   }
-  memcpy(recv_pkt_1, pkt_1, protected_msg_len_octets_1);
 
-  /* Make a copy of the second sent protected packet */
-  recv_pkt_2 = malloc(protected_msg_len_octets_2);
-  if (recv_pkt_2 == NULL) {
+  /* the packet must come through unprotect unchanged */
+  memcpy(recv_pkt, pkt, ref_len_octets);
+  len = ref_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
+  if (status) {
+    return status;
+  }
+  if (len != ref_len_octets ||
+      memcmp(recv_pkt, ref_pkt, ref_len_octets) != 0) {
     return srtp_err_status_fail;
   }
-  memcpy(recv_pkt_2, pkt_2, protected_msg_len_octets_2);
 
-  /* Set the ROC to the wanted value */
-  status = srtp_set_stream_roc(receiver_session, receiver_policy.ssrc.value, roc_to_set);
+  /* a replayed packet must still be rejected */
+  memcpy(recv_pkt, ref_pkt, ref_len_octets);
+  len = ref_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
+  if (status != srtp_err_status_replay_fail) {
+    return srtp_err_status_fail;
+  }
+
+  /* the replay state advances normally for the packet that follows */
+  free(pkt);
+  pkt = srtp_create_test_packet_extended(msg_len_octets,
+                                         sender_policy.ssrc.value,
+                                         1235, 160, &protected_msg_len_octets);
+  status = srtp_protect(sender_session, pkt, &protected_msg_len_octets);
+  if (status) {
+    return status;
+  }
+  memcpy(recv_pkt, pkt, protected_msg_len_octets);
+  len = protected_msg_len_octets;
+  status = srtp_unprotect(receiver_session, recv_pkt, &len);
   if (status) {
     return status;
   }
 
-  /* Unprotect the first packet */
-  status = srtp_unprotect(receiver_session, recv_pkt_1, &protected_msg_len_octets_1);
+  /* cleanup */
+  status = srtp_dealloc(sender_session);
   if (status) {
     return status;
   }
 
-  /* Unprotect the second packet */
-  status = srtp_unprotect(receiver_session, recv_pkt_2, &protected_msg_len_octets_2);
+  status = srtp_dealloc(receiver_session);
   if (status) {
     return status;
   }
 
-  /* Cleanup */
+  free(pkt);
+  free(ref_pkt);
+  free(recv_pkt);
+
+  return srtp_err_status_ok;
+}
+
+#define TRAFFIC_MODEL_EVENTS    400
+#define TRAFFIC_MODEL_MAX_INDEX 512   /* events plus in-flight packets */
+
+/*
+ * srtp_test_traffic_model() checks the seeded traffic generator in
+ * ut_sim: the same profile and seed must reproduce the exact same
+ * event sequence (so that benchmark runs on different builds see the
+ * same workload), the churn counters must advance on schedule, and a
+ * protect/unprotect pass over a generated corpus - with reorder, loss
+ * bursts and a packet-size mix - must round-trip every delivered
+ * packet
+ */
+srtp_err_status_t
+srtp_test_traffic_model() {
+  srtp_err_status_t status;
+
+  ut_traffic_profile profile;
+  ut_traffic utt;
+  ut_packet events[TRAFFIC_MODEL_EVENTS];
+  ut_packet check;
+
+  srtp_policy_t sender_policy;
+  srtp_t sender_session;
+
+  srtp_policy_t receiver_policy;
+  srtp_t receiver_session;
+
+  srtp_hdr_t *corpus[TRAFFIC_MODEL_MAX_INDEX];
+  int corpus_len[TRAFFIC_MODEL_MAX_INDEX];
+  int corpus_size[TRAFFIC_MODEL_MAX_INDEX];
+  srtp_hdr_t *ref_pkt;
+  unsigned char recv_pkt[512];
+
+  int i, idx, len, ref_len;
+  int max_seen = -1;
+  int num_lost = 0;
+  int num_reordered = 0;
+
+  memset(&profile, 0, sizeof(profile));
+  profile.reorder_depth = 32;
+  profile.loss_rate = 300;
+  profile.loss_burst = 3;
+  profile.ssrc_period = 64;
+  profile.key_period = 100;
+  profile.num_sizes = 4;
+  profile.sizes[0] = 32;
+  profile.sizes[1] = 64;
+  profile.sizes[2] = 128;
+  profile.sizes[3] = 172;
+
+  /*
+   * the event stream must be a pure function of the profile and the
+   * seed: regenerating with the same seed gives identical events
+   */
+  ut_traffic_init(&utt, &profile, 0x2a);
+  for (i = 0; i < TRAFFIC_MODEL_EVENTS; i++) {
+    ut_traffic_next(&utt, &events[i]);
+  }
+
+  ut_traffic_init(&utt, &profile, 0x2a);
+  for (i = 0; i < TRAFFIC_MODEL_EVENTS; i++) {
+    ut_traffic_next(&utt, &check);
+    if (check.index != events[i].index || check.ssrc != events[i].ssrc ||
+        check.key != events[i].key || check.size != events[i].size ||
+        check.lost != events[i].lost) {
+      return srtp_err_status_fail;
+    }
+  }
+
+  /* SSRC churn and key rotation advance on their configured periods */
+  if (events[TRAFFIC_MODEL_EVENTS - 1].key != TRAFFIC_MODEL_EVENTS / 100) {
+    return srtp_err_status_fail;
+  }
+  if (events[TRAFFIC_MODEL_EVENTS - 1].ssrc == events[0].ssrc) {
+    return srtp_err_status_fail;
+  }
+
+  /* a different seed must not replay the same sequence */
+  ut_traffic_init(&utt, &profile, 0x2b);
+  for (i = 0; i < TRAFFIC_MODEL_EVENTS; i++) {
+    ut_traffic_next(&utt, &check);
+    if (check.index != events[i].index || check.size != events[i].size ||
+        check.lost != events[i].lost) {
+      break;
+    }
+  }
+  if (i == TRAFFIC_MODEL_EVENTS) {
+    return srtp_err_status_fail;
+  }
+
+  /*
+   * protect/unprotect pass: a single-SSRC corpus with bounded reorder,
+   * loss bursts and mixed sizes; the sender protects in index order,
+   * the receiver sees the model's arrival order
+   */
+  profile.ssrc_period = 0;
+  profile.key_period = 0;
+  ut_traffic_init(&utt, &profile, 0xdecaf);
+  for (i = 0; i < TRAFFIC_MODEL_EVENTS; i++) {
+    ut_traffic_next(&utt, &events[i]);
+  }
+
+  memset(&sender_policy, 0, sizeof(sender_policy));
+  srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
+  sender_policy.ssrc.type = ssrc_any_outbound;
+  sender_policy.key = test_key;
+  sender_policy.window_size = 128;
+
+  status = srtp_create(&sender_session, &sender_policy);
+  if (status) {
+    return status;
+  }
+
+  memset(&receiver_policy, 0, sizeof(receiver_policy));
+  srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
+  receiver_policy.ssrc.type = ssrc_any_inbound;
+  receiver_policy.key = test_key;
+  receiver_policy.window_size = 128;
+
+  status = srtp_create(&receiver_session, &receiver_policy);
+  if (status) {
+    return status;
+  }
+
+  for (idx = 0; idx < TRAFFIC_MODEL_MAX_INDEX; idx++) {
+    corpus[idx] = NULL;
+    corpus_size[idx] = -1;
+  }
+  for (i = 0; i < TRAFFIC_MODEL_EVENTS; i++) {
+    if (events[i].index >= TRAFFIC_MODEL_MAX_INDEX) {
+      return srtp_err_status_fail;
+    }
+    corpus_size[events[i].index] = (int)events[i].size;
+  }
+
+  for (idx = 0; idx < TRAFFIC_MODEL_MAX_INDEX; idx++) {
+    if (corpus_size[idx] < 0) {
+      continue;   /* still in flight when the corpus ended */
+    }
+    corpus[idx] = srtp_create_test_packet_extended(corpus_size[idx],
+                                                   events[0].ssrc,
+                                                   (uint16_t)idx,
+                                                   (uint32_t)idx << 8, &len);
+    if (corpus[idx] == NULL) {
+      return srtp_err_status_fail;
+    }
+    status = srtp_protect(sender_session, corpus[idx], &len);
+    if (status) {
+      return status;
+    }
+    corpus_len[idx] = len;
+  }
+
+  for (i = 0; i < TRAFFIC_MODEL_EVENTS; i++) {
+    idx = (int)events[i].index;
+    if (events[i].lost) {
+      num_lost++;
+      continue;
+    }
+    if (idx < max_seen) {
+      num_reordered++;
+    } else {
+      max_seen = idx;
+    }
+
+    memcpy(recv_pkt, corpus[idx], corpus_len[idx]);
+    len = corpus_len[idx];
+    status = srtp_unprotect(receiver_session, recv_pkt, &len);
+    if (status) {
+      return status;
+    }
+
+    ref_pkt = srtp_create_test_packet_extended((int)events[i].size,
+                                               events[i].ssrc,
+                                               (uint16_t)idx,
+                                               (uint32_t)idx << 8, &ref_len);
+    if (ref_pkt == NULL) {
+      return srtp_err_status_fail;
+    }
+    if (len != ref_len || memcmp(recv_pkt, ref_pkt, ref_len) != 0) {
+      free(ref_pkt);
+      return srtp_err_status_fail;
+    }
+    free(ref_pkt);
+  }
+
+  /* the seeded profile must actually have exercised loss and reorder */
+  if (num_lost == 0 || num_reordered == 0) {
+    return srtp_err_status_fail;
+  }
+
+  /* cleanup */
   status = srtp_dealloc(sender_session);
   if (status) {
     return status;
@@ -3167,17 +6352,23 @@ test_set_receiver_roc(uint32_t packets, uint32_t roc_to_set)
     return status;
   }
 
-  free(pkt_1);
-  free(recv_pkt_1);
-  free(pkt_2);
-  free(recv_pkt_2);
+  for (idx = 0; idx < TRAFFIC_MODEL_MAX_INDEX; idx++) {
+    if (corpus[idx] != NULL) {
+      free(corpus[idx]);
+    }
+  }
 
   return srtp_err_status_ok;
 }
 
-static srtp_err_status_t
-test_set_sender_roc(uint16_t seq, uint32_t roc_to_set)
-{
+/*
+ * srtp_test_unprotect_copy() checks the out-of-place unprotect: the
+ * plaintext must land in the caller's buffer while the ciphertext
+ * stays byte-for-byte intact, including when authentication fails
+ * after the input has been staged
+ */
+srtp_err_status_t
+srtp_test_unprotect_copy() {
   srtp_err_status_t status;
 
   srtp_policy_t sender_policy;
@@ -3187,14 +6378,15 @@ test_set_sender_roc(uint16_t seq, uint32_t roc_to_set)
   srtp_t receiver_session;
 
   srtp_hdr_t *pkt;
-  unsigned char *recv_pkt;
-
-  uint32_t ts;
+  unsigned char *ref_pkt;
+  unsigned char *srtp_pkt;
+  unsigned char rtp_pkt[512];
 
   int msg_len_octets = 32;
-  int protected_msg_len_octets;
+  int ref_len_octets;
+  int srtp_len_octets;
+  int len;
 
-  /* Create sender */
   memset(&sender_policy, 0, sizeof(sender_policy));
   srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
   srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
@@ -3208,21 +6400,29 @@ test_set_sender_roc(uint16_t seq, uint32_t roc_to_set)
     return status;
   }
 
-  /* Set the ROC before encrypting the first packet */
-  status = srtp_set_stream_roc(sender_session, sender_policy.ssrc.value, roc_to_set);
-  if (status != srtp_err_status_ok) {
-    return status;
+  pkt = srtp_create_test_packet(msg_len_octets, sender_policy.ssrc.value,
+                                &len);
+  if (pkt == NULL) {
+    return srtp_err_status_fail;
+  }
+  ref_len_octets = len;
+  ref_pkt = malloc(ref_len_octets);
+  if (ref_pkt == NULL) {
+    return srtp_err_status_fail;
   }
+  memcpy(ref_pkt, pkt, ref_len_octets);
 
-  /* Create the packet to decrypt */
-  ts = 0;
-  pkt = srtp_create_test_packet_extended(msg_len_octets, sender_policy.ssrc.value, seq, ts, &protected_msg_len_octets);
-  status = srtp_protect(sender_session, pkt, &protected_msg_len_octets);
+  status = srtp_protect(sender_session, pkt, &len);
   if (status) {
     return status;
   }
+  srtp_len_octets = len;
+  srtp_pkt = malloc(srtp_len_octets);
+  if (srtp_pkt == NULL) {
+    return srtp_err_status_fail;
+  }
+  memcpy(srtp_pkt, pkt, srtp_len_octets);
 
-  /* Create the receiver */
   memset(&receiver_policy, 0, sizeof(receiver_policy));
   srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
   srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
@@ -3236,25 +6436,67 @@ test_set_sender_roc(uint16_t seq, uint32_t roc_to_set)
     return status;
   }
 
-  /* Make a copy of the sent protected packet */
-  recv_pkt = malloc(protected_msg_len_octets);
-  if (recv_pkt == NULL) {
+  /* an undersized output buffer is rejected up front */
+  len = srtp_len_octets - 1;
+  status = srtp_unprotect_copy(receiver_session, pkt, srtp_len_octets,
+                               rtp_pkt, &len);
+  if (status != srtp_err_status_bad_param) {
+    return srtp_err_status_fail;
+  }
+
+  /* the plaintext lands in the output; the input is untouched */
+  len = sizeof(rtp_pkt);
+  status = srtp_unprotect_copy(receiver_session, pkt, srtp_len_octets,
+                               rtp_pkt, &len);
+  if (status) {
+    return status;
+  }
+  if (len != ref_len_octets || memcmp(rtp_pkt, ref_pkt, ref_len_octets) != 0) {
+    return srtp_err_status_fail;
+  }
+  if (memcmp(pkt, srtp_pkt, srtp_len_octets) != 0) {
+    return srtp_err_status_fail;
+  }
+
+  /* a replayed packet is rejected without modifying the input */
+  len = sizeof(rtp_pkt);
+  status = srtp_unprotect_copy(receiver_session, pkt, srtp_len_octets,
+                               rtp_pkt, &len);
+  if (status != srtp_err_status_replay_fail) {
     return srtp_err_status_fail;
   }
-  memcpy(recv_pkt, pkt, protected_msg_len_octets);
-
-  /* Set the ROC to the wanted value */
-  status = srtp_set_stream_roc(receiver_session, receiver_policy.ssrc.value, roc_to_set);
-  if (status) {
-    return status;
+  if (memcmp(pkt, srtp_pkt, srtp_len_octets) != 0) {
+    return srtp_err_status_fail;
   }
 
-  status = srtp_unprotect(receiver_session, recv_pkt, &protected_msg_len_octets);
+  /* a tampered packet (with a fresh sequence number, so that the
+   * replay check does not fire first) fails authentication, and the
+   * caller's copy of the ciphertext is still intact afterwards */
+  free(pkt);
+  pkt = srtp_create_test_packet_extended(msg_len_octets,
+                                         sender_policy.ssrc.value,
+                                         0x1235, 0, &len);
+  if (pkt == NULL) {
+    return srtp_err_status_fail;
+  }
+  status = srtp_protect(sender_session, pkt, &len);
   if (status) {
     return status;
   }
+  srtp_len_octets = len;
+  ((unsigned char *)pkt)[srtp_len_octets - 1] ^= 0xff;
+  memcpy(srtp_pkt, pkt, srtp_len_octets);
+  len = sizeof(rtp_pkt);
+  status = srtp_unprotect_copy(receiver_session, pkt, srtp_len_octets,
+                               rtp_pkt, &len);
+  if (status != srtp_err_status_auth_fail) {
+    return srtp_err_status_fail;
+  }
+  if (memcmp(pkt, srtp_pkt, srtp_len_octets) != 0) {
+    return srtp_err_status_fail;
+  }
 
-  /* Cleanup */
+  /* cleanup */
   status = srtp_dealloc(sender_session);
   if (status) {
     return status;
@@ -3266,108 +6508,543 @@ test_set_sender_roc(uint16_t seq, uint32_t roc_to_set)
   }
 
   free(pkt);
-  free(recv_pkt);
+  free(ref_pkt);
+  free(srtp_pkt);
 
   return srtp_err_status_ok;
 }
 
-srtp_err_status_t
-srtp_test_set_receiver_roc() {
-  int packets;
-  uint32_t roc;
+/*
+ * mock offload provider for srtp_test_offload(): a software "device"
+ * that keys ordinary GCM cipher contexts, accepts a limited number of
+ * descriptors per submit() call (so the library's per-packet software
+ * fallback gets exercised) and completes them in reverse order when
+ * polled (so nothing may depend on completion order)
+ */
+
+#define MOCK_OFFLOAD_MAX_KEYS 4
+#define MOCK_OFFLOAD_QUEUE 64
+
+typedef struct {
+  srtp_cipher_t *key[MOCK_OFFLOAD_MAX_KEYS];
+  int num_keys;
+  srtp_offload_desc_t *queue[MOCK_OFFLOAD_QUEUE];
+  int queued;
+  int submit_limit; /* descriptors accepted per submit() call */
+  int opens;
+  int closes;
+} mock_offload_t;
+
+static uint32_t
+mock_offload_capabilities(void *data, uint32_t cipher_type_id,
+                          int cipher_key_len) {
+  (void)data;
+  if (cipher_type_id == SRTP_AES_GCM_128 &&
+      cipher_key_len == SRTP_AES_GCM_128_KEY_LEN_WSALT)
+    return SRTP_OFFLOAD_CAP_PROTECT | SRTP_OFFLOAD_CAP_UNPROTECT;
+  return 0;
+}
+
+static srtp_err_status_t
+mock_offload_session_open(void *data, uint32_t cipher_type_id,
+                          const uint8_t *key, int key_len,
+                          const uint8_t *salt, int salt_len,
+                          uint64_t *key_handle) {
+  mock_offload_t *mock = (mock_offload_t *)data;
   srtp_err_status_t status;
 
-  /* First test does not rollover */
-  packets = 1;
-  roc = 0;
+  (void)salt;
+  if (cipher_type_id != SRTP_AES_GCM_128 ||
+      key_len != SRTP_AES_128_KEY_LEN || salt_len != 12)
+    return srtp_err_status_bad_param;
+  if (mock->num_keys >= MOCK_OFFLOAD_MAX_KEYS)
+    return srtp_err_status_alloc_fail;
 
-  status = test_set_receiver_roc(packets - 1, roc);
+  status = srtp_crypto_kernel_alloc_cipher(SRTP_AES_GCM_128,
+                                           &mock->key[mock->num_keys],
+                                           SRTP_AES_GCM_128_KEY_LEN_WSALT, 16);
+  if (status)
+    return status;
+  status = srtp_cipher_init(mock->key[mock->num_keys], key);
   if (status) {
+    srtp_cipher_dealloc(mock->key[mock->num_keys]);
     return status;
   }
 
-  status = test_set_receiver_roc(packets, roc);
-  if (status) {
-    return status;
+  *key_handle = (uint64_t)mock->num_keys;
+  mock->num_keys++;
+  mock->opens++;
+  return srtp_err_status_ok;
+}
+
+static srtp_err_status_t
+mock_offload_session_close(void *data, uint64_t key_handle) {
+  mock_offload_t *mock = (mock_offload_t *)data;
+
+  if (key_handle >= (uint64_t)mock->num_keys ||
+      mock->key[key_handle] == NULL)
+    return srtp_err_status_bad_param;
+  srtp_cipher_dealloc(mock->key[key_handle]);
+  mock->key[key_handle] = NULL;
+  mock->closes++;
+  return srtp_err_status_ok;
+}
+
+static int
+mock_offload_submit(void *data, srtp_offload_desc_t **desc, int num_desc) {
+  mock_offload_t *mock = (mock_offload_t *)data;
+  int accepted = 0;
+
+  while (accepted < num_desc && mock->queued < MOCK_OFFLOAD_QUEUE &&
+         (mock->submit_limit == 0 || accepted < mock->submit_limit)) {
+    mock->queue[mock->queued++] = desc[accepted];
+    accepted++;
   }
+  return accepted;
+}
 
-  status = test_set_receiver_roc(packets + 1, roc);
-  if (status) {
+static int
+mock_offload_poll(void *data, srtp_offload_desc_t **done, int max_desc) {
+  mock_offload_t *mock = (mock_offload_t *)data;
+  int collected = 0;
+
+  /* complete in reverse submission order */
+  while (mock->queued > 0 && collected < max_desc) {
+    srtp_offload_desc_t *d = mock->queue[--mock->queued];
+    unsigned int octets = d->body_octets;
+
+    if (d->key_handle >= (uint64_t)mock->num_keys ||
+        mock->key[d->key_handle] == NULL) {
+      d->status = srtp_err_status_bad_param;
+    } else {
+      d->status = srtp_cipher_aead(mock->key[d->key_handle], d->iv,
+                                   d->encrypt ? srtp_direction_encrypt
+                                              : srtp_direction_decrypt,
+                                   (const uint8_t *)d->packet, d->aad_octets,
+                                   (uint8_t *)d->packet + d->aad_octets,
+                                   &octets);
+      d->body_octets = octets;
+    }
+    done[collected++] = d;
+  }
+  return collected;
+}
+
+static const srtp_offload_provider_t mock_offload_provider = {
+  "mock software offload device",
+  NULL, /* set per test via a local copy */
+  mock_offload_capabilities,
+  mock_offload_session_open,
+  mock_offload_session_close,
+  mock_offload_submit,
+  mock_offload_poll
+};
+
+/*
+ * srtp_test_offload() drives the offload provider interface with the
+ * mock device: offloaded protect must interoperate with plain
+ * srtp_unprotect() and vice versa, replayed and corrupted packets
+ * must be reported per-packet, non-AEAD streams must fall back to
+ * software, and detach (explicit or via srtp_dealloc()) must close
+ * every key handle the provider opened
+ */
+
+#define OFFLOAD_TEST_NUM_PKTS 24
+
+srtp_err_status_t
+srtp_test_offload() {
+  srtp_err_status_t status;
+  srtp_err_status_t pkt_status[OFFLOAD_TEST_NUM_PKTS];
+  uint32_t ssrc = 0x0f10adee;
+  int msg_len_octets = 64;
+  srtp_hdr_t *msg[OFFLOAD_TEST_NUM_PKTS];
+  void *pkts[OFFLOAD_TEST_NUM_PKTS];
+  int pkt_len[OFFLOAD_TEST_NUM_PKTS];
+  srtp_t srtp_snd, srtp_recv;
+  srtp_policy_t policy;
+  mock_offload_t mock;
+  srtp_offload_provider_t provider;
+  int orig_len;
+  int i;
+
+  memset(&mock, 0, sizeof(mock));
+  mock.submit_limit = 5; /* force per-packet software fallback, too */
+  provider = mock_offload_provider;
+  provider.data = &mock;
+
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtp);
+  srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
     return status;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  /* a provider missing a vtable entry must be refused */
+  {
+    srtp_offload_provider_t broken = provider;
+
+    broken.poll = NULL;
+    if (srtp_offload_attach(srtp_snd, &broken) != srtp_err_status_bad_param)
+      return srtp_err_status_fail;
   }
 
-  status = test_set_receiver_roc(packets + 60000, roc);
-  if (status) {
+  status = srtp_offload_attach(srtp_snd, &provider);
+  if (status)
     return status;
+  if (mock.opens != 1)
+    return srtp_err_status_fail;
+
+  /* a second provider must be refused until the first is detached */
+  if (srtp_offload_attach(srtp_snd, &provider) != srtp_err_status_bad_param)
+    return srtp_err_status_fail;
+
+  /* offloaded protect must interoperate with plain srtp_unprotect() */
+  for (i = 0; i < OFFLOAD_TEST_NUM_PKTS; i++) {
+    msg[i] = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                              (uint16_t)(i + 1), 0,
+                                              &pkt_len[i]);
+    if (msg[i] == NULL)
+      return srtp_err_status_alloc_fail;
+    pkts[i] = msg[i];
   }
+  orig_len = pkt_len[0];
 
-  /* Second test should rollover */
-  packets = 65535;
-  roc = 0;
+  status = srtp_offload_protect_batch(srtp_snd, pkts, pkt_len, pkt_status,
+                                      OFFLOAD_TEST_NUM_PKTS);
+  if (status)
+    return srtp_err_status_fail;
 
-  status = test_set_receiver_roc(packets - 1, roc);
-  if (status) {
-    return status;
+  for (i = 0; i < OFFLOAD_TEST_NUM_PKTS; i++) {
+    srtp_hdr_t *ref;
+    int ref_len;
+
+    if (pkt_status[i] != srtp_err_status_ok)
+      return srtp_err_status_fail;
+    status = srtp_unprotect(srtp_recv, pkts[i], &pkt_len[i]);
+    if (status)
+      return status;
+    if (pkt_len[i] != orig_len)
+      return srtp_err_status_fail;
+
+    ref = srtp_create_test_packet_extended(msg_len_octets, ssrc,
+                                           (uint16_t)(i + 1), 0, &ref_len);
+    if (ref == NULL)
+      return srtp_err_status_alloc_fail;
+    if (pkt_len[i] != ref_len || memcmp(pkts[i], ref, ref_len) != 0) {
+      free(ref);
+      return srtp_err_status_fail;
+    }
+    free(ref);
+    free(msg[i]);
   }
 
-  status = test_set_receiver_roc(packets, roc);
-  if (status) {
+  /* plain srtp_protect() must interoperate with offloaded unprotect,
+     with a replayed and a corrupted packet reported individually */
+  status = srtp_offload_attach(srtp_recv, &provider);
+  if (status)
     return status;
+  if (mock.opens != 2)
+    return srtp_err_status_fail;
+
+  for (i = 0; i < OFFLOAD_TEST_NUM_PKTS; i++) {
+    msg[i] = srtp_create_test_packet_extended(
+        msg_len_octets, ssrc, (uint16_t)(OFFLOAD_TEST_NUM_PKTS + i + 1), 0,
+        &pkt_len[i]);
+    if (msg[i] == NULL)
+      return srtp_err_status_alloc_fail;
+    pkts[i] = msg[i];
+    status = srtp_protect(srtp_snd, pkts[i], &pkt_len[i]);
+    if (status)
+      return status;
   }
 
-  /* Now the rollover counter should be 1 */
-  roc = 1;
-  status = test_set_receiver_roc(packets + 1, roc);
-  if (status) {
-    return status;
+  /* replay packet 3 as packet 5, corrupt the payload of packet 7 */
+  memcpy(pkts[5], pkts[3], pkt_len[3]);
+  pkt_len[5] = pkt_len[3];
+  ((uint8_t *)pkts[7])[msg_len_octets - 1] ^= 0xff;
+
+  status = srtp_offload_unprotect_batch(srtp_recv, pkts, pkt_len, pkt_status,
+                                        OFFLOAD_TEST_NUM_PKTS);
+  if (status != srtp_err_status_fail)
+    return srtp_err_status_fail;
+  for (i = 0; i < OFFLOAD_TEST_NUM_PKTS; i++) {
+    if (i == 5) {
+      if (pkt_status[i] != srtp_err_status_replay_fail)
+        return srtp_err_status_fail;
+    } else if (i == 7) {
+      if (pkt_status[i] != srtp_err_status_auth_fail)
+        return srtp_err_status_fail;
+    } else {
+      if (pkt_status[i] != srtp_err_status_ok)
+        return srtp_err_status_fail;
+      if (pkt_len[i] != orig_len)
+        return srtp_err_status_fail;
+    }
+    free(msg[i]);
   }
 
-  status = test_set_receiver_roc(packets + 60000, roc);
-  if (status) {
+  /* a detached sender keeps working, in software */
+  status = srtp_offload_detach(srtp_snd);
+  if (status)
     return status;
-  }
+  if (srtp_offload_detach(srtp_snd) != srtp_err_status_no_such_op)
+    return srtp_err_status_fail;
 
-  return srtp_err_status_ok;
+  msg[0] = srtp_create_test_packet_extended(
+      msg_len_octets, ssrc, (uint16_t)(2 * OFFLOAD_TEST_NUM_PKTS + 1), 0,
+      &pkt_len[0]);
+  if (msg[0] == NULL)
+    return srtp_err_status_alloc_fail;
+  pkts[0] = msg[0];
+  status = srtp_offload_protect_batch(srtp_snd, pkts, pkt_len, pkt_status, 1);
+  if (status || pkt_status[0] != srtp_err_status_ok)
+    return srtp_err_status_fail;
+  status = srtp_offload_unprotect_batch(srtp_recv, pkts, pkt_len, pkt_status,
+                                        1);
+  if (status || pkt_status[0] != srtp_err_status_ok ||
+      pkt_len[0] != orig_len)
+    return srtp_err_status_fail;
+  free(msg[0]);
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  /* srtp_dealloc() must detach (and close the handle) by itself */
+  status = srtp_dealloc(srtp_recv);
+  if (status)
+    return status;
+  if (mock.opens != 2 || mock.closes != 2 || mock.queued != 0)
+    return srtp_err_status_fail;
+#endif /* GCM */
+
+  /* a stream the provider cannot serve stays in software: under an
+     ICM policy no key handle is opened and the batch calls behave as
+     srtp_protect_batch()/srtp_unprotect_batch() */
+  memset(&policy, 0, sizeof(policy));
+  srtp_crypto_policy_set_rtp_default(&policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+  policy.ekt = NULL;
+  policy.window_size = 128;
+  policy.allow_repeat_tx = 0;
+  policy.next = NULL;
+  policy.ssrc.type = ssrc_specific;
+  policy.ssrc.value = ssrc;
+  policy.key = test_key;
+
+  status = srtp_create(&srtp_snd, &policy);
+  if (status)
+    return status;
+  status = srtp_create(&srtp_recv, &policy);
+  if (status)
+    return status;
+
+  i = mock.opens;
+  status = srtp_offload_attach(srtp_snd, &provider);
+  if (status)
+    return status;
+  status = srtp_offload_attach(srtp_recv, &provider);
+  if (status)
+    return status;
+  if (mock.opens != i)
+    return srtp_err_status_fail;
+
+  msg[0] = srtp_create_test_packet_extended(msg_len_octets, ssrc, 1, 0,
+                                            &pkt_len[0]);
+  if (msg[0] == NULL)
+    return srtp_err_status_alloc_fail;
+  pkts[0] = msg[0];
+  orig_len = pkt_len[0];
+  status = srtp_offload_protect_batch(srtp_snd, pkts, pkt_len, pkt_status, 1);
+  if (status || pkt_status[0] != srtp_err_status_ok)
+    return srtp_err_status_fail;
+  status = srtp_offload_unprotect_batch(srtp_recv, pkts, pkt_len, pkt_status,
+                                        1);
+  if (status || pkt_status[0] != srtp_err_status_ok ||
+      pkt_len[0] != orig_len)
+    return srtp_err_status_fail;
+  free(msg[0]);
+
+  status = srtp_dealloc(srtp_snd);
+  if (status)
+    return status;
+
+  return srtp_dealloc(srtp_recv);
 }
 
+/*
+ * srtp_test_session_group() shards one "conference" over several
+ * receiver sessions sharing a group template: each member unprotects
+ * its own SSRCs, the group reports aggregate counters and the memory
+ * saved by sharing, and a single srtp_group_update() rekeys every
+ * member while preserving packet-index continuity
+ */
+
+#define GROUP_TEST_NUM_MEMBERS 4
+
 srtp_err_status_t
-srtp_test_set_sender_roc() {
-  uint32_t roc;
-  uint16_t seq;
+srtp_test_session_group() {
   srtp_err_status_t status;
+  srtp_policy_t sender_policy;
+  srtp_policy_t group_policy;
+  srtp_t sender;
+  srtp_group_t group;
+  srtp_t member[GROUP_TEST_NUM_MEMBERS];
+  srtp_group_stats_t stats;
+  srtp_hdr_t *msg, *ref;
+  uint32_t ssrc_base = 0x47500000;
+  int msg_len_octets = 48;
+  int len, ref_len;
+  int i, j;
 
-  seq = 43210;
-  roc = 0;
-  status = test_set_sender_roc(seq, roc);
-  if (status) {
+  memset(&sender_policy, 0, sizeof(sender_policy));
+  srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
+  sender_policy.ssrc.type = ssrc_any_outbound;
+  sender_policy.key = test_key;
+  sender_policy.window_size = 128;
+
+  status = srtp_create(&sender, &sender_policy);
+  if (status)
     return status;
+
+  memset(&group_policy, 0, sizeof(group_policy));
+  srtp_crypto_policy_set_rtp_default(&group_policy.rtp);
+  srtp_crypto_policy_set_rtcp_default(&group_policy.rtcp);
+  group_policy.ssrc.type = ssrc_any_inbound;
+  group_policy.key = test_key;
+  group_policy.window_size = 128;
+
+  /* a group policy must be a single wildcard element */
+  {
+    srtp_policy_t bad = group_policy;
+
+    bad.ssrc.type = ssrc_specific;
+    bad.ssrc.value = 1;
+    if (srtp_group_create(&group, &bad) != srtp_err_status_bad_param)
+      return srtp_err_status_fail;
   }
 
-  roc = 65535;
-  status = test_set_sender_roc(seq, roc);
-  if (status) {
+  status = srtp_group_create(&group, &group_policy);
+  if (status)
     return status;
+  for (i = 0; i < GROUP_TEST_NUM_MEMBERS; i++) {
+    status = srtp_group_add_session(group, &member[i]);
+    if (status)
+      return status;
   }
 
-  roc = 0xffff;
-  status = test_set_sender_roc(seq, roc);
-  if (status) {
-    return status;
+  /* shard the conference: each member unprotects its own SSRC */
+  for (j = 0; j < 3; j++) {
+    for (i = 0; i < GROUP_TEST_NUM_MEMBERS; i++) {
+      msg = srtp_create_test_packet_extended(msg_len_octets, ssrc_base + i,
+                                             (uint16_t)(j + 1),
+                                             (uint32_t)(j << 8), &len);
+      ref = srtp_create_test_packet_extended(msg_len_octets, ssrc_base + i,
+                                             (uint16_t)(j + 1),
+                                             (uint32_t)(j << 8), &ref_len);
+      if (msg == NULL || ref == NULL)
+        return srtp_err_status_alloc_fail;
+      status = srtp_protect(sender, msg, &len);
+      if (status)
+        return status;
+      status = srtp_unprotect(member[i], msg, &len);
+      if (status)
+        return status;
+      if (len != ref_len || memcmp(msg, ref, ref_len) != 0)
+        return srtp_err_status_fail;
+      free(msg);
+      free(ref);
+    }
   }
 
-  roc = 0xffff00;
-  status = test_set_sender_roc(seq, roc);
-  if (status) {
+  /* aggregate counters, with the shared template counted once */
+  status = srtp_group_get_stats(group, &stats);
+  if (status)
     return status;
-  }
+  if (stats.num_sessions != GROUP_TEST_NUM_MEMBERS ||
+      stats.totals.stream_count != GROUP_TEST_NUM_MEMBERS ||
+      stats.totals.packets_unprotected != 3 * GROUP_TEST_NUM_MEMBERS ||
+      stats.template_octets == 0 ||
+      stats.octets_saved !=
+          (GROUP_TEST_NUM_MEMBERS - 1) * stats.template_octets)
+    return srtp_err_status_fail;
 
-  roc = 0xfffffff0;
-  status = test_set_sender_roc(seq, roc);
-  if (status) {
+  /* a packet protected under the old key, delivered after the rekey,
+     must fail authentication */
+  msg = srtp_create_test_packet_extended(msg_len_octets, ssrc_base, 100,
+                                         0x6400, &len);
+  if (msg == NULL)
+    return srtp_err_status_alloc_fail;
+  status = srtp_protect(sender, msg, &len);
+  if (status)
+    return status;
+
+  /* one rekey at the group covers every member */
+  group_policy.key = test_alt_key;
+  status = srtp_group_update(group, &group_policy);
+  if (status)
+    return status;
+  sender_policy.key = test_alt_key;
+  status = srtp_update(sender, &sender_policy);
+  if (status)
     return status;
+
+  if (srtp_unprotect(member[0], msg, &len) != srtp_err_status_auth_fail)
+    return srtp_err_status_fail;
+  free(msg);
+
+  /* packet-index continuity under the new keys */
+  for (i = 0; i < GROUP_TEST_NUM_MEMBERS; i++) {
+    msg = srtp_create_test_packet_extended(msg_len_octets, ssrc_base + i,
+                                           4, 0x400, &len);
+    ref = srtp_create_test_packet_extended(msg_len_octets, ssrc_base + i,
+                                           4, 0x400, &ref_len);
+    if (msg == NULL || ref == NULL)
+      return srtp_err_status_alloc_fail;
+    status = srtp_protect(sender, msg, &len);
+    if (status)
+      return status;
+    status = srtp_unprotect(member[i], msg, &len);
+    if (status)
+      return status;
+    if (len != ref_len || memcmp(msg, ref, ref_len) != 0)
+      return srtp_err_status_fail;
+    free(msg);
+    free(ref);
   }
 
-  return srtp_err_status_ok;
+  /* members leave one by one; srtp_dealloc() also unlinks by itself */
+  status = srtp_group_remove_session(group, member[3]);
+  if (status)
+    return status;
+  status = srtp_dealloc(member[2]);
+  if (status)
+    return status;
+  status = srtp_group_get_stats(group, &stats);
+  if (status)
+    return status;
+  if (stats.num_sessions != GROUP_TEST_NUM_MEMBERS - 2)
+    return srtp_err_status_fail;
+
+  /* group dealloc covers the remaining members and the template */
+  status = srtp_group_dealloc(group);
+  if (status)
+    return status;
+
+  return srtp_dealloc(sender);
 }
 
 /*
@@ -3426,6 +7103,9 @@ const srtp_policy_t default_policy = {
     0,         /* retransmission not allowed */
     NULL,      /* no encrypted extension headers */
     0,         /* list of encrypted extension headers is empty */
+    0,         /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,         /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3455,6 +7135,9 @@ const srtp_policy_t aes_only_policy = {
     0,         /* retransmission not allowed */
     NULL,      /* no encrypted extension headers */
     0,         /* list of encrypted extension headers is empty */
+    0,         /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,         /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3484,10 +7167,13 @@ const srtp_policy_t hmac_only_policy = {
     0,         /* retransmission not allowed */
     NULL,      /* no encrypted extension headers */
     0,         /* list of encrypted extension headers is empty */
+    0,         /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,         /* both RTP and RTCP enabled */
     NULL
 };
 
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
 const srtp_policy_t aes128_gcm_8_policy = {
     { ssrc_any_outbound, 0 },           /* SSRC                           */
     {                                   /* SRTP policy                    */
@@ -3514,6 +7200,9 @@ const srtp_policy_t aes128_gcm_8_policy = {
     0,           /* retransmission not allowed */
     NULL,        /* no encrypted extension headers */
     0,           /* list of encrypted extension headers is empty */
+    0,           /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,           /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3543,6 +7232,9 @@ const srtp_policy_t aes128_gcm_8_cauth_policy = {
     0,           /* retransmission not allowed */
     NULL,        /* no encrypted extension headers */
     0,           /* list of encrypted extension headers is empty */
+    0,           /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,           /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3572,6 +7264,9 @@ const srtp_policy_t aes256_gcm_8_policy = {
     0,           /* retransmission not allowed */
     NULL,        /* no encrypted extension headers */
     0,           /* list of encrypted extension headers is empty */
+    0,           /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,           /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3601,6 +7296,9 @@ const srtp_policy_t aes256_gcm_8_cauth_policy = {
     0,           /* retransmission not allowed */
     NULL,        /* no encrypted extension headers */
     0,           /* list of encrypted extension headers is empty */
+    0,           /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,           /* both RTP and RTCP enabled */
     NULL
 };
 #endif
@@ -3631,6 +7329,9 @@ const srtp_policy_t null_policy = {
     0,         /* retransmission not allowed */
     NULL,      /* no encrypted extension headers */
     0,         /* list of encrypted extension headers is empty */
+    0,         /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,         /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3696,6 +7397,9 @@ const srtp_policy_t aes_256_hmac_policy = {
     0,         /* retransmission not allowed */
     NULL,      /* no encrypted extension headers */
     0,         /* list of encrypted extension headers is empty */
+    0,         /* no limit on template-created streams */
+    srtp_stream_direction_any, /* direction learned from first use */
+    0,         /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3739,6 +7443,9 @@ const srtp_policy_t hmac_only_with_ekt_policy = {
     0,                     /* retransmission not allowed */
     NULL,                  /* no encrypted extension headers */
     0,                     /* list of encrypted extension headers is empty */
+    0,                     /* no limit on template-created streams */
+    srtp_stream_direction_any,      /* direction learned from first use */
+    0,                     /* both RTP and RTCP enabled */
     NULL
 };
 
@@ -3758,7 +7465,7 @@ policy_array[] = {
     &hmac_only_policy,
     &aes_only_policy,
     &default_policy,
-#ifdef OPENSSL
+#if defined(OPENSSL) || !defined(NO_64BIT_MATH)
     &aes128_gcm_8_policy,
     &aes128_gcm_8_cauth_policy,
     &aes256_gcm_8_policy,
@@ -3796,5 +7503,8 @@ const srtp_policy_t wildcard_policy = {
     0,                   /* retransmission not allowed */
     NULL,                /* no encrypted extension headers */
     0,                   /* list of encrypted extension headers is empty */
+    0,                   /* no limit on template-created streams */
+    srtp_stream_direction_any,    /* direction learned from first use */
+    0,                   /* both RTP and RTCP enabled */
     NULL
 };
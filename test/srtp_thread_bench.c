@@ -0,0 +1,474 @@
+/*
+ * srtp_thread_bench.c
+ *
+ * multi-threaded scaling benchmark and contention reporter
+ *
+ * runs N threads of protect/unprotect traffic over one shared session
+ * and over N independent sessions, reports per-thread throughput,
+ * scaling efficiency against the single-thread baseline and cache-miss
+ * counters from perf events, and exercises concurrent stream
+ * add/remove against active traffic; this is the acceptance harness
+ * for the lock-free concurrent data path
+ */
+/*
+ *
+ * Copyright (c) 2001-2017 Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
+
+#include "srtp.h"
+#include "srtp_priv.h"   /* for srtp_hdr_t */
+#include "getopt_s.h"
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_PAYLOAD_LEN 160     /* a typical audio payload */
+#define BENCH_SSRC_BASE   0xdec0de00
+#define BENCH_CHURN_SSRC  0x7e570000
+
+static int bench_pkts_per_thread = 20000;
+
+uint8_t bench_key[30] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+    0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+/*
+ * cache-miss and cache-reference counters via perf events, counted
+ * across all threads (inherit = 1); unavailable counters (no
+ * permission, no PMU) are reported as -1 in the JSON
+ */
+typedef struct bench_perf_t {
+    int miss_fd;
+    int ref_fd;
+} bench_perf_t;
+
+#ifdef __linux__
+static int bench_perf_open_one(uint64_t config) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void bench_perf_open(bench_perf_t *perf) {
+    perf->miss_fd = bench_perf_open_one(PERF_COUNT_HW_CACHE_MISSES);
+    perf->ref_fd = bench_perf_open_one(PERF_COUNT_HW_CACHE_REFERENCES);
+}
+
+static void bench_perf_start(bench_perf_t *perf) {
+    if (perf->miss_fd >= 0)
+        ioctl(perf->miss_fd, PERF_EVENT_IOC_ENABLE, 0);
+    if (perf->ref_fd >= 0)
+        ioctl(perf->ref_fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+static long long bench_perf_read_one(int fd) {
+    long long v = -1;
+
+    if (fd < 0)
+        return -1;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &v, sizeof(v)) != sizeof(v))
+        v = -1;
+    return v;
+}
+
+static void bench_perf_stop(bench_perf_t *perf, long long *misses,
+                            long long *refs) {
+    *misses = bench_perf_read_one(perf->miss_fd);
+    *refs = bench_perf_read_one(perf->ref_fd);
+    if (perf->miss_fd >= 0)
+        close(perf->miss_fd);
+    if (perf->ref_fd >= 0)
+        close(perf->ref_fd);
+}
+#else
+static void bench_perf_open(bench_perf_t *perf) {
+    perf->miss_fd = perf->ref_fd = -1;
+}
+static void bench_perf_start(bench_perf_t *perf) {
+    (void)perf;
+}
+static void bench_perf_stop(bench_perf_t *perf, long long *misses,
+                            long long *refs) {
+    (void)perf;
+    *misses = *refs = -1;
+}
+#endif /* __linux__ */
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* one worker: sender, receiver and the SSRC it owns */
+typedef struct bench_worker_t {
+    pthread_t tid;
+    srtp_t sender;
+    srtp_t receiver;
+    uint32_t ssrc;
+    int pkts;
+    srtp_err_status_t status;
+} bench_worker_t;
+
+static pthread_barrier_t bench_barrier;
+
+/*
+ * each worker protects and unprotects its own in-order stream; with a
+ * shared session this drives the lock-free lookup path from all
+ * threads at once, with independent sessions it gives the no-sharing
+ * upper bound for scaling comparisons
+ */
+static void *bench_worker(void *arg) {
+    bench_worker_t *w = arg;
+    uint8_t buf[sizeof(srtp_hdr_t) + BENCH_PAYLOAD_LEN + SRTP_MAX_TRAILER_LEN];
+    srtp_hdr_t *hdr = (srtp_hdr_t *)buf;
+    srtp_err_status_t status;
+    int i, len;
+
+    pthread_barrier_wait(&bench_barrier);
+    for (i = 0; i < w->pkts; i++) {
+        memset(buf, 0, sizeof(srtp_hdr_t));
+        hdr->version = 2;
+        hdr->pt = 0x60;
+        hdr->seq = htons((uint16_t)(i + 1));
+        hdr->ts = htonl(i);
+        hdr->ssrc = htonl(w->ssrc);
+        memset(buf + sizeof(srtp_hdr_t), 0xab, BENCH_PAYLOAD_LEN);
+        len = sizeof(srtp_hdr_t) + BENCH_PAYLOAD_LEN;
+
+        status = srtp_protect(w->sender, buf, &len);
+        if (status == srtp_err_status_ok)
+            status = srtp_unprotect(w->receiver, buf, &len);
+        if (status) {
+            w->status = status;
+            return NULL;
+        }
+    }
+    w->status = srtp_err_status_ok;
+    return NULL;
+}
+
+/*
+ * stream-addition churn run alongside the traffic threads; per the
+ * session concurrency contract one thread may add streams while the
+ * data path runs, but srtp_remove_stream() needs a quiesced session,
+ * so the added streams are torn down by the caller after the traffic
+ * threads have been joined
+ */
+#define BENCH_CHURN_MAX 4096
+
+typedef struct bench_churn_t {
+    pthread_t tid;
+    srtp_t session;
+    volatile int stop;
+    long ops;
+    srtp_err_status_t status;
+} bench_churn_t;
+
+static srtp_err_status_t bench_add_specific(srtp_t session, uint32_t ssrc);
+
+static void *bench_churn_worker(void *arg) {
+    bench_churn_t *c = arg;
+    srtp_err_status_t status;
+
+    pthread_barrier_wait(&bench_barrier);
+    while (!c->stop) {
+        if (c->ops >= BENCH_CHURN_MAX) {
+            usleep(1000);
+            continue;
+        }
+        status = bench_add_specific(c->session,
+                                    BENCH_CHURN_SSRC + (uint32_t)c->ops);
+        if (status) {
+            c->status = status;
+            return NULL;
+        }
+        c->ops++;
+    }
+    c->status = srtp_err_status_ok;
+    return NULL;
+}
+
+static srtp_err_status_t bench_make_pair(srtp_t *sender, srtp_t *receiver) {
+    srtp_policy_t policy;
+    srtp_err_status_t status;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = bench_key;
+    policy.window_size = 128;
+    policy.ssrc.type = ssrc_any_outbound;
+    status = srtp_create(sender, &policy);
+    if (status)
+        return status;
+    policy.ssrc.type = ssrc_any_inbound;
+    return srtp_create(receiver, &policy);
+}
+
+/*
+ * the shared-session modes give each worker an ssrc_specific stream,
+ * added before the threads start: streams cloned from a wildcard
+ * template share the template's cipher and auth contexts, so only
+ * specifically-keyed streams carry the per-stream cipher state the
+ * concurrency contract relies on (this also matches how large
+ * many-stream deployments key their sessions)
+ */
+static srtp_err_status_t bench_add_specific(srtp_t session, uint32_t ssrc) {
+    srtp_policy_t policy;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = bench_key;
+    policy.window_size = 128;
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = ssrc;
+    return srtp_add_stream(session, &policy);
+}
+
+/*
+ * run num_threads workers in the given mode ("shared": one
+ * sender/receiver pair for everyone, "independent": a pair per
+ * thread, "churn": shared plus a concurrent add/remove thread);
+ * returns the aggregate throughput so callers can compute efficiency
+ */
+static double bench_run(const char *mode, int num_threads, int with_churn,
+                        double baseline_mbps) {
+    bench_worker_t workers[BENCH_MAX_THREADS];
+    bench_churn_t churn;
+    bench_perf_t perf;
+    srtp_t shared_sender = NULL, shared_receiver = NULL;
+    srtp_err_status_t status;
+    long long misses, refs;
+    double t0, elapsed, mbps;
+    int shared = (strcmp(mode, "independent") != 0);
+    int i;
+
+    if (shared) {
+        status = srtp_create(&shared_sender, NULL);
+        if (status == srtp_err_status_ok)
+            status = srtp_create(&shared_receiver, NULL);
+        if (status) {
+            fprintf(stderr, "session setup failed (code %d)\n", status);
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_threads; i++) {
+        if (shared) {
+            workers[i].sender = shared_sender;
+            workers[i].receiver = shared_receiver;
+            status = bench_add_specific(shared_sender,
+                                        BENCH_SSRC_BASE + i);
+            if (status == srtp_err_status_ok)
+                status = bench_add_specific(shared_receiver,
+                                            BENCH_SSRC_BASE + i);
+        } else {
+            status = bench_make_pair(&workers[i].sender,
+                                     &workers[i].receiver);
+        }
+        if (status) {
+            fprintf(stderr, "session setup failed (code %d)\n", status);
+            exit(1);
+        }
+        workers[i].ssrc = BENCH_SSRC_BASE + i;
+        workers[i].pkts = bench_pkts_per_thread;
+        workers[i].status = srtp_err_status_fail;
+    }
+
+    pthread_barrier_init(&bench_barrier, NULL,
+                         num_threads + (with_churn ? 1 : 0));
+    bench_perf_open(&perf);
+    bench_perf_start(&perf);
+    t0 = bench_now();
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&workers[i].tid, NULL, bench_worker, &workers[i]);
+    if (with_churn) {
+        memset(&churn, 0, sizeof(churn));
+        churn.session = shared_sender;
+        pthread_create(&churn.tid, NULL, bench_churn_worker, &churn);
+    }
+    for (i = 0; i < num_threads; i++)
+        pthread_join(workers[i].tid, NULL);
+    if (with_churn) {
+        churn.stop = 1;
+        pthread_join(churn.tid, NULL);
+    }
+    elapsed = bench_now() - t0;
+    bench_perf_stop(&perf, &misses, &refs);
+    pthread_barrier_destroy(&bench_barrier);
+
+    for (i = 0; i < num_threads; i++) {
+        if (workers[i].status) {
+            fprintf(stderr, "worker %d failed (code %d)\n", i,
+                    workers[i].status);
+            exit(1);
+        }
+    }
+    if (with_churn) {
+        long j;
+
+        if (churn.status) {
+            fprintf(stderr, "stream churn failed (code %d)\n", churn.status);
+            exit(1);
+        }
+        /* the traffic threads are joined, so removal is safe now */
+        for (j = 0; j < churn.ops; j++) {
+            status = srtp_remove_stream(shared_sender,
+                                        htonl(BENCH_CHURN_SSRC + (uint32_t)j));
+            if (status) {
+                fprintf(stderr, "stream removal failed (code %d)\n", status);
+                exit(1);
+            }
+        }
+    }
+
+    /* each packet makes the protect and unprotect trip */
+    mbps = (double)num_threads * (double)bench_pkts_per_thread *
+           (sizeof(srtp_hdr_t) + BENCH_PAYLOAD_LEN) * 2 * 8 /
+           (elapsed * 1e6);
+
+    printf("{\"mode\": \"%s\", \"threads\": %d, "
+           "\"pkts_per_thread\": %d, \"seconds\": %.3f, "
+           "\"mbps\": %.1f, \"mbps_per_thread\": %.1f, "
+           "\"efficiency\": %.3f, "
+           "\"cache_misses\": %lld, \"cache_refs\": %lld",
+           mode, num_threads, bench_pkts_per_thread, elapsed, mbps,
+           mbps / num_threads,
+           baseline_mbps > 0.0 ? mbps / (baseline_mbps * num_threads) : 1.0,
+           misses, refs);
+    if (with_churn)
+        printf(", \"churn_ops\": %ld", churn.ops);
+    printf("}\n");
+
+    if (shared) {
+        srtp_dealloc(shared_sender);
+        srtp_dealloc(shared_receiver);
+    } else {
+        for (i = 0; i < num_threads; i++) {
+            srtp_dealloc(workers[i].sender);
+            srtp_dealloc(workers[i].receiver);
+        }
+    }
+    return mbps;
+}
+
+static void usage(char *prog_name) {
+    printf("usage: %s [ -p pkts_per_thread ] [ -t max_threads ]\n",
+           prog_name);
+    exit(255);
+}
+
+int main(int argc, char *argv[]) {
+    srtp_err_status_t status;
+    double shared_base = 0.0, indep_base = 0.0;
+    int max_threads, n, q;
+
+    max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads > BENCH_MAX_THREADS)
+        max_threads = BENCH_MAX_THREADS;
+
+    /* process input arguments */
+    while (1) {
+        q = getopt_s(argc, argv, "p:t:");
+        if (q == -1)
+            break;
+        switch (q) {
+        case 'p':
+            bench_pkts_per_thread = atoi(optarg_s);
+            if (bench_pkts_per_thread < 1)
+                usage(argv[0]);
+            break;
+        case 't':
+            max_threads = atoi(optarg_s);
+            if (max_threads < 1 || max_threads > BENCH_MAX_THREADS)
+                usage(argv[0]);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    status = srtp_init();
+    if (status) {
+        printf("error: srtp init failed with error code %d\n", status);
+        exit(1);
+    }
+
+    /* power-of-two thread counts up to the core count */
+    for (n = 1; n <= max_threads; n *= 2) {
+        double mbps = bench_run("shared", n, 0, shared_base);
+        if (n == 1)
+            shared_base = mbps;
+    }
+    for (n = 1; n <= max_threads; n *= 2) {
+        double mbps = bench_run("independent", n, 0, indep_base);
+        if (n == 1)
+            indep_base = mbps;
+    }
+
+    /* stream churn against full-width shared-session traffic */
+    bench_run("churn", max_threads, 1, shared_base);
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return 0;
+}